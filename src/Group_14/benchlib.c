@@ -0,0 +1,51 @@
+/*
+ * benchlib.c – Shared helpers of the UiAOS user-space benchmarks
+ *
+ * Compiled into every bench target; see benchlib.h.
+ */
+
+#include "benchlib.h"
+
+ char *put_udec(char *p, uint32_t v) {
+     char tmp[10];
+     int n = 0;
+     do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+     while (n) *p++ = tmp[--n];
+     return p;
+ }
+
+ char *put_str(char *p, const char *s) {
+     while (*s) *p++ = *s++;
+     return p;
+ }
+
+ void sort_u32(uint32_t *a, uint32_t n) {
+     for (uint32_t i = 1; i < n; i++) {
+         uint32_t v = a[i];
+         uint32_t j = i;
+         while (j > 0 && a[j - 1] > v) { a[j] = a[j - 1]; j--; }
+         a[j] = v;
+     }
+ }
+
+ void report(const char *workload, const char *op, uint32_t *s, uint32_t n) {
+     char line[128];
+     char *p = line;
+     uint64_t sum = 0;
+
+     if (n == 0) return;
+     for (uint32_t i = 0; i < n; i++) sum += s[i];
+     sort_u32(s, n);
+
+     p = put_str(p, "BENCH,proc,");
+     p = put_str(p, workload); *p++ = ',';
+     p = put_str(p, op);       *p++ = ',';
+     p = put_udec(p, n);                              *p++ = ',';
+     p = put_udec(p, (uint32_t)(sum / n));            *p++ = ',';
+     p = put_udec(p, s[n / 2]);                       *p++ = ',';
+     p = put_udec(p, s[(n * 99) / 100]);              *p++ = ',';
+     p = put_udec(p, s[n - 1]);
+     *p++ = '\n';
+     *p = '\0';
+     sys_puts(line);
+ }
@@ -0,0 +1,92 @@
+/*
+ * benchlib.h – Shared helpers of the UiAOS user-space benchmarks
+ *
+ * Purpose: Types, the INT 0x80 system call wrapper, TSC timing and the
+ * BENCH row printer used by forkbench, schedbench, smpbench and
+ * syscallbench. Each bench target compiles benchlib.c in (see
+ * CMakeLists.txt); there is no user-space libc to take these from.
+ *
+ * Rows are printed in the kernel benchmark format (see kbench.h) so
+ * scripts/run_bench.sh picks them up from COM1:
+ *
+ *   BENCH,proc,<workload>,<op>,count,avg,p50,p99,max     (TSC cycles)
+ */
+#ifndef BENCHLIB_H
+#define BENCHLIB_H
+
+/* ==== Core Type Definitions ============================================= */
+ typedef signed   int       int32_t;
+ typedef unsigned int       uint32_t;
+ typedef unsigned long long uint64_t;
+ typedef uint32_t           size_t;
+
+/* ==== Kernel ABI Constants ============================================== */
+ /* These values *must* align with syscall.h in the kernel. */
+ #define SYS_EXIT      1
+ #define SYS_FORK      2
+ #define SYS_PUTS      7
+ #define SYS_GETPID    20
+ #define SYS_WAITPID   114
+ #define SYS_NANOSLEEP 162
+
+/* ==== Syscall Wrapper (same convention as hello.c) ====================== */
+ static inline int32_t syscall(int32_t syscall_number,
+                               int32_t arg1_val,
+                               int32_t arg2_val,
+                               int32_t arg3_val) {
+     int32_t return_value;
+     __asm__ volatile (
+         "pushl %%ebx          \n\t"
+         "pushl %%ecx          \n\t"
+         "pushl %%edx          \n\t"
+         "movl %1, %%eax       \n\t"
+         "movl %2, %%ebx       \n\t"
+         "movl %3, %%ecx       \n\t"
+         "movl %4, %%edx       \n\t"
+         "int $0x80            \n\t"
+         "popl %%edx           \n\t"
+         "popl %%ecx           \n\t"
+         "popl %%ebx           \n\t"
+         : "=a" (return_value)
+         : "m" (syscall_number),
+           "m" (arg1_val),
+           "m" (arg2_val),
+           "m" (arg3_val)
+         : "cc", "memory"
+     );
+     return return_value;
+ }
+
+ #define sys_exit(code)            syscall(SYS_EXIT, (code), 0, 0)
+ #define sys_fork()                syscall(SYS_FORK, 0, 0, 0)
+ #define sys_puts(s)               syscall(SYS_PUTS, (int32_t)(s), 0, 0)
+ #define sys_waitpid(pid, st, opt) syscall(SYS_WAITPID, (pid), (int32_t)(st), (opt))
+ #define sys_nanosleep(req)        syscall(SYS_NANOSLEEP, (int32_t)(req), 0, 0)
+
+/* ==== Timing ============================================================ */
+ static inline uint64_t rdtsc(void) {
+     uint32_t lo, hi;
+     __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+     return ((uint64_t)hi << 32) | lo;
+ }
+
+ /* Cycles since t0, saturated to 32 bits. */
+ static inline uint32_t cycles_since(uint64_t t0) {
+     uint64_t d = rdtsc() - t0;
+     return (d > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (uint32_t)d;
+ }
+
+/* ==== Output (benchlib.c) =============================================== */
+ /* Appends the decimal form of v at p; returns the new end. */
+ char *put_udec(char *p, uint32_t v);
+
+ /* Appends s (without its NUL) at p; returns the new end. */
+ char *put_str(char *p, const char *s);
+
+ /* Insertion sort; the benches keep at most a few hundred samples. */
+ void sort_u32(uint32_t *a, uint32_t n);
+
+ /* Prints one BENCH row for n samples (sorts the array). */
+ void report(const char *workload, const char *op, uint32_t *s, uint32_t n);
+
+#endif /* BENCHLIB_H */
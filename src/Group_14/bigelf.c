@@ -0,0 +1,69 @@
+/*
+ * bigelf.c – UiAOS Padded Executable for the exec-latency benchmark
+ *
+ * Purpose: A program whose image is dominated by 1 MiB of initialised data,
+ * so its PT_LOAD segments are large on disk. The kernel benchmark
+ * (kbench_exec_suite) creates and destroys processes from it and from
+ * hello.elf; with demand-paged loading the two should cost about the same,
+ * because only pages that are touched are ever read.
+ *
+ * Run on its own, it touches one byte per 64 KiB of the padding, prints a
+ * line and exits.
+ */
+
+/* ==== Core Type Definitions ============================================= */
+ typedef signed   int       int32_t;
+ typedef unsigned int       uint32_t;
+ typedef uint32_t           size_t;
+
+/* ==== Kernel ABI Constants ============================================== */
+ /* These values *must* align with syscall.h in the kernel. */
+ #define SYS_EXIT     1
+ #define SYS_PUTS     7
+
+/* ==== Padding =========================================================== */
+ #define BE_PAD_SIZE   (1024 * 1024)
+ #define BE_PAD_STRIDE (64 * 1024)
+
+ /* Non-zero initialiser: keeps the array in .data (in the file), not .bss */
+ static volatile char g_pad[BE_PAD_SIZE] = { 1 };
+
+/* ==== Syscall Wrapper (same convention as hello.c) ====================== */
+ static inline int32_t syscall(int32_t syscall_number,
+                               int32_t arg1_val,
+                               int32_t arg2_val,
+                               int32_t arg3_val) {
+     int32_t return_value;
+     __asm__ volatile (
+         "pushl %%ebx          \n\t"
+         "pushl %%ecx          \n\t"
+         "pushl %%edx          \n\t"
+         "movl %1, %%eax       \n\t"
+         "movl %2, %%ebx       \n\t"
+         "movl %3, %%ecx       \n\t"
+         "movl %4, %%edx       \n\t"
+         "int $0x80            \n\t"
+         "popl %%edx           \n\t"
+         "popl %%ecx           \n\t"
+         "popl %%ebx           \n\t"
+         : "=a" (return_value)
+         : "m" (syscall_number),
+           "m" (arg1_val),
+           "m" (arg2_val),
+           "m" (arg3_val)
+         : "cc", "memory"
+     );
+     return return_value;
+ }
+
+ #define sys_exit(code)            syscall(SYS_EXIT, (code), 0, 0)
+ #define sys_puts(s)               syscall(SYS_PUTS, (int32_t)(s), 0, 0)
+
+/* ==== Main ============================================================== */
+ int main(void) {
+     uint32_t sum = 0;
+     for (size_t off = 0; off < BE_PAD_SIZE; off += BE_PAD_STRIDE) sum += (uint32_t)g_pad[off];
+
+     sys_puts(sum == 1 ? "[bigelf] ok\n" : "[bigelf] unexpected padding contents\n");
+     return 0;
+ }
@@ -0,0 +1,79 @@
+/*
+ * forkbench.c – UiAOS User-Space fork() Latency Benchmark
+ *
+ * Purpose: Measures the cost of SYS_FORK on a process with a populated
+ * address space. Before measuring, a 256 KiB buffer is written so every page
+ * of it is present; each fork then has to share those pages copy-on-write.
+ *
+ * Rows are printed in the kernel benchmark format (see kbench.h) so
+ * scripts/run_bench.sh picks them up from COM1:
+ *
+ *   BENCH,proc,<workload>,<op>,count,avg,p50,p99,max     (TSC cycles)
+ *
+ *   fork,return          parent: SYS_FORK entry to return
+ *   fork,exit_wait       parent: SYS_FORK entry to SYS_WAITPID return,
+ *                        child exits immediately
+ *   fork_touch,exit_wait same, but the child writes one byte to every page
+ *                        of the buffer first (one COW copy per page)
+ *
+ * The kernel launches this program only in KERNEL_BENCH builds.
+ */
+
+#include "benchlib.h"
+
+/* ==== Benchmark Parameters ============================================== */
+ #define FB_ITERATIONS  200          /* Samples per row */
+ #define FB_BUFFER_SIZE (256 * 1024) /* Populated address space carried into each fork */
+ #define FB_PAGE_SIZE   4096
+
+ static volatile char     g_buffer[FB_BUFFER_SIZE];
+ static uint32_t          g_samples[FB_ITERATIONS];
+ static uint32_t          g_wait_samples[FB_ITERATIONS];
+
+/* ==== Workloads ========================================================= */
+ /*
+  * Runs FB_ITERATIONS fork/exit/wait rounds. If touch is set the child dirties
+  * every page of g_buffer before exiting. Returns the number of completed rounds.
+  */
+ static uint32_t run_rounds(int touch, uint32_t *fork_cyc, uint32_t *wait_cyc) {
+     uint32_t done = 0;
+     for (uint32_t i = 0; i < FB_ITERATIONS; i++) {
+         uint64_t t0 = rdtsc();
+         int32_t pid = sys_fork();
+         if (pid == 0) {
+             if (touch) {
+                 for (size_t off = 0; off < FB_BUFFER_SIZE; off += FB_PAGE_SIZE) g_buffer[off] = (char)i;
+             }
+             sys_exit(0);
+         }
+         uint32_t fork_done = cycles_since(t0);
+         if (pid < 0) {
+             sys_puts("[forkbench] fork failed\n");
+             break;
+         }
+         if (sys_waitpid(pid, 0, 0) != pid) {
+             sys_puts("[forkbench] waitpid failed\n");
+             break;
+         }
+         if (fork_cyc) fork_cyc[done] = fork_done;
+         wait_cyc[done] = cycles_since(t0);
+         done++;
+     }
+     return done;
+ }
+
+/* ==== Main ============================================================== */
+ int main(void) {
+     /* Populate the address space the forks have to share */
+     for (size_t off = 0; off < FB_BUFFER_SIZE; off += FB_PAGE_SIZE) g_buffer[off] = 1;
+
+     uint32_t n = run_rounds(0, g_samples, g_wait_samples);
+     report("fork", "return", g_samples, n);
+     report("fork", "exit_wait", g_wait_samples, n);
+
+     n = run_rounds(1, 0, g_wait_samples);
+     report("fork_touch", "exit_wait", g_wait_samples, n);
+
+     sys_puts("BENCH-USER-END\n");
+     return 0;
+ }
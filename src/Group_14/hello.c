@@ -100,7 +100,41 @@
  
  /* ==== Syscall Wrapper Function ========================================== */
  /*
-  * Provides a C-callable interface for making system calls via `int $0x80`.
+  * SYSENTER fast path, used when CPUID reports SEP (probed on first use).
+  * Kernel convention: EAX = number, EBX/ESI/EDI = arguments 1-3,
+  * ECX = our ESP and EDX = the return address for SYSEXIT; ECX and EDX
+  * come back clobbered.
+  */
+ static int32_t g_use_sysenter = -1; /* -1 = not probed yet */
+
+ static int32_t use_sysenter(void) {
+     if (g_use_sysenter < 0) {
+         uint32_t a, b, c, d;
+         __asm__ volatile ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1));
+         /* The first Pentium Pro steppings report SEP without SYSENTER */
+         uint32_t family = (a >> 8) & 0xF, model = (a >> 4) & 0xF, stepping = a & 0xF;
+         g_use_sysenter = (d & (1u << 11)) && !(family == 6 && model < 3 && stepping < 3);
+     }
+     return g_use_sysenter;
+ }
+
+ static inline int32_t syscall_sysenter(int32_t num, int32_t a1, int32_t a2, int32_t a3) {
+     int32_t ret;
+     __asm__ volatile (
+         "movl %%esp, %%ecx    \n\t"
+         "movl $1f, %%edx      \n\t"
+         "sysenter             \n\t"
+         "1:                   \n\t"
+         : "=a" (ret)
+         : "0" (num), "b" (a1), "S" (a2), "D" (a3)
+         : "ecx", "edx", "cc", "memory"
+     );
+     return ret;
+ }
+
+ /*
+  * Provides a C-callable interface for making system calls via SYSENTER
+  * when available, else `int $0x80`.
   * Arguments: syscall_number, arg1, arg2, arg3.
   * Return: Value from kernel (typically status or data).
   * This wrapper handles register setup and restoration.
@@ -109,6 +143,7 @@
                                int32_t arg1_val,
                                int32_t arg2_val,
                                int32_t arg3_val) {
+     if (use_sysenter()) return syscall_sysenter(syscall_number, arg1_val, arg2_val, arg3_val);
      int32_t return_value;
      /*
       * This inline assembly block defines the low-level mechanism for transitioning
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef ACPI_H
+#define ACPI_H
+
+/**
+ * @file acpi.h
+ * @brief Discovery of the CPUs and interrupt controllers for SMP bring-up.
+ *
+ * Reads the ACPI MADT (found through the RSDP, then the RSDT or XSDT) and
+ * falls back to the Intel MultiProcessor table on firmware without one. Only
+ * what smp.c and apic.c need is kept: the local APIC address, the APIC IDs of
+ * the enabled CPUs, the first IOAPIC and the ISA IRQ overrides.
+ */
+
+#include "types.h"
+#include "get_cpu_id.h" // MAX_CPUS
+
+#define ACPI_ISA_IRQS 16
+
+// Polarity and trigger bits of an interrupt override (MPS INTI flags; the
+// MP table uses the same encoding)
+#define ACPI_INTI_POLARITY_MASK  0x3
+#define ACPI_INTI_POLARITY_LOW   0x3
+#define ACPI_INTI_TRIGGER_MASK   0xC
+#define ACPI_INTI_TRIGGER_LEVEL  0xC
+
+typedef struct {
+    uint32_t gsi;    // IOAPIC input the ISA IRQ is wired to
+    uint16_t flags;  // ACPI_INTI_* bits; 0 = ISA defaults (edge, active high)
+} acpi_irq_route_t;
+
+typedef struct {
+    const char *source;                     // "ACPI MADT" or "MP table"
+    uint32_t lapic_phys;                    // Local APIC register page
+    uint32_t cpu_count;                     // Entries used in cpu_apic_ids
+    uint32_t cpus_skipped;                  // Enabled CPUs beyond MAX_CPUS
+    uint8_t  cpu_apic_ids[MAX_CPUS];
+    bool     has_ioapic;
+    uint8_t  ioapic_id;
+    uint32_t ioapic_phys;
+    uint32_t ioapic_gsi_base;               // First GSI of the IOAPIC
+    acpi_irq_route_t isa_irq[ACPI_ISA_IRQS]; // Identity unless overridden
+} acpi_topology_t;
+
+/**
+ * @brief Fills @p out from the firmware tables.
+ * @param rsdp Copy of the RSDP handed over by the boot loader (Multiboot2
+ *             ACPI tag), or NULL to search the EBDA and the BIOS ROM area.
+ * @return true if a CPU list was found; false means uniprocessor, PIC only.
+ */
+bool acpi_discover_topology(const void *rsdp, acpi_topology_t *out);
+
+#endif // ACPI_H
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef APIC_H
+#define APIC_H
+
+/**
+ * @file apic.h
+ * @brief Local APIC and IOAPIC driver.
+ *
+ * Once apic_init has run, device IRQs come through the IOAPIC (routed to the
+ * BSP on the same vectors the 8259 PIC used, 32-47) and are acknowledged at
+ * the local APIC; the PICs are masked. Every CPU also gets a local APIC timer
+ * and can be sent reschedule IPIs. The PIT keeps driving the global tick and
+ * the timer wheel on the BSP; the APs use their local timer for time slices.
+ */
+
+#include "types.h"
+#include "acpi.h"
+
+#define APIC_TIMER_VECTOR     0xEF  // Local APIC timer (APs' scheduler tick)
+#define APIC_RESCHED_VECTOR   0xF0  // Reschedule IPI
+#define APIC_SPURIOUS_VECTOR  0xFF  // Low nibble must be all ones on P6-era CPUs
+
+#define APIC_TIMER_HZ         1000  // Same rate as the PIT tick
+
+typedef struct {
+    uint32_t timer_counts_per_ms;  // Calibrated against the PIT (divide by 16)
+    uint32_t timer_irqs;           // Local timer interrupts, all CPUs
+    uint32_t resched_irqs;         // Reschedule IPIs received, all CPUs
+} apic_stats_t;
+
+/**
+ * @brief Enables the BSP's local APIC, calibrates its timer and, if the
+ * topology has an IOAPIC, routes the ISA IRQs through it and masks the PICs.
+ * @return true if interrupts now go through the APICs; false leaves the
+ *         system on the 8259 PIC (no APIC, or no IOAPIC to route IRQs).
+ */
+bool apic_init(const acpi_topology_t *topology);
+
+/** @brief Enables the local APIC of an AP (after apic_init on the BSP). */
+void apic_init_ap(void);
+
+/** @brief True once apic_init has switched interrupt delivery to the APICs. */
+bool apic_is_enabled(void);
+
+/** @brief Local APIC ID of the executing CPU. */
+uint32_t lapic_id(void);
+
+/** @brief Acknowledges the interrupt being serviced. */
+void lapic_eoi(void);
+
+/** @brief True if @p vector is raised at this CPU's local APIC but not yet serviced. */
+bool lapic_vector_pending(uint8_t vector);
+
+/** @brief Sends a fixed interrupt with @p vector to the CPU with @p apic_id. */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/** @brief Sends an INIT IPI (assert, then de-assert) to @p apic_id. */
+void lapic_send_init(uint32_t apic_id);
+
+/** @brief Sends a STARTUP IPI; the AP starts in real mode at @p page * 4 KB. */
+void lapic_send_startup(uint32_t apic_id, uint8_t page);
+
+/** @brief Runs this CPU's local timer periodically at APIC_TIMER_HZ. Interrupts off. */
+void apic_timer_start(void);
+
+/** @brief Stops this CPU's local timer. Interrupts off. */
+void apic_timer_stop(void);
+
+void apic_get_stats(apic_stats_t *stats);
+
+#endif // APIC_H
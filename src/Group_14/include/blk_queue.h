@@ -0,0 +1,152 @@
+#pragma once
+#ifndef BLK_QUEUE_H
+#define BLK_QUEUE_H
+
+/**
+ * @file blk_queue.h
+ * @brief Block I/O request queue (one per ATA channel).
+ *
+ * Callers describe a transfer as a blk_request_t, submit it and later wait
+ * for it. The queue keeps pending requests sorted by LBA, merges adjacent
+ * requests of the same direction into a single ATA command of up to
+ * MAX_SECTORS_PER_IO sectors and picks the next command with a C-LOOK
+ * elevator, overridden when a request has waited past its deadline.
+ *
+ * Only one command runs per channel. It is started by whoever finds the
+ * channel idle (a submitter or the completion of the previous command), so
+ * no task owns the drive while it sleeps: waiters block in the scheduler and
+ * are woken by the completion IRQ, or poll the completion themselves when
+ * they cannot sleep (holding a spinlock, idle task, early boot). Commands
+ * the drive only does synchronously (PIO, flush) are run by a waiting task
+ * without the queue lock, never by the IRQ.
+ */
+
+#include "types.h"
+#include "spinlock.h"
+#include "block_device.h"
+#include "scheduler.h"
+#include "timer.h"
+
+// Largest single command built by merging (128 KiB with 512-byte sectors)
+#define MAX_SECTORS_PER_IO    256
+// A command's buffers may touch at most this many pages (one PRD entry each)
+#define BLK_MAX_CMD_PAGES     64
+
+// --- Request Flags ---
+#define BLK_REQ_WRITE    0x01 // Memory -> disk
+#define BLK_REQ_FLUSH    0x02 // No data; drains the drive's write cache
+#define BLK_REQ_BARRIER  0x04 // Starts after every earlier request completed; later ones wait for it
+
+// --- Elevator Deadlines (PIT ticks, 1 ms each) ---
+#define BLK_READ_DEADLINE_TICKS   50
+#define BLK_WRITE_DEADLINE_TICKS  500
+
+/** @brief One bio-like transfer of whole sectors to or from a kernel buffer. */
+typedef struct blk_request {
+    block_device_t *dev;
+    uint64_t lba;
+    uint32_t count;             // Sectors; 0 for BLK_REQ_FLUSH
+    void *buffer;
+    uint32_t flags;             // BLK_REQ_*
+
+    volatile bool done;
+    volatile int status;        // BLOCK_ERR_* once done
+    tcb_t * volatile waiter;    // Task sleeping in blk_wait, if any
+
+    // Queue bookkeeping
+    uint32_t seq;               // Submission order
+    uint32_t deadline;          // PIT tick after which the elevator must serve it
+    struct blk_request *prev;   // Pending list, sorted by (lba, seq)
+    struct blk_request *next;
+    struct blk_request *cmd_next; // Next request in the same command
+} blk_request_t;
+
+/** @brief The command the queue has handed to the driver. */
+typedef struct blk_cmd {
+    block_device_t *dev;
+    uint64_t lba;
+    uint32_t count;             // Total sectors over all requests
+    bool write;
+    bool flush;                 // FLUSH CACHE instead of a data transfer
+    blk_request_t *reqs;        // Consecutive LBA ranges, chained through cmd_next
+} blk_cmd_t;
+
+/** @brief Per-channel queue state. */
+typedef struct blk_queue {
+    spinlock_t lock;
+    blk_request_t *pending;     // Sorted by (lba, seq)
+    uint32_t pending_count;
+    bool active;                // cmd has been started and not completed
+    bool sync_ready;            // cmd needs a task to run it (BLOCK_CMD_SYNC) and none has yet
+    bool sync_running;          // A task is running cmd with the lock dropped
+    blk_cmd_t cmd;
+    uint64_t head_lba;          // Sector after the last dispatched command
+    uint32_t plugged;           // Dispatch held back while > 0
+    uint32_t next_seq;
+    ktimer_t timeout_timer;     // Deadline of sleeping waiters, see blk_wait
+    uint32_t timeout_cmd;       // Value of dispatched when the timer was armed
+
+    // Statistics
+    uint32_t submitted;
+    uint32_t dispatched;        // Commands sent to the drive
+    uint32_t merged;            // Requests that rode along in another's command
+    uint32_t expired;           // Dispatches forced by a deadline
+} blk_queue_t;
+
+/**
+ * @brief Returns the queue for ATA channel 0 (primary) or 1 (secondary),
+ * initialising it on first use.
+ */
+blk_queue_t *blk_queue_attach(uint32_t channel);
+
+/**
+ * @brief Fills in a request. Flushes pass buffer = NULL and count = 0.
+ */
+void blk_request_init(blk_request_t *req, block_device_t *dev, uint64_t lba,
+                      void *buffer, uint32_t count, uint32_t flags);
+
+/**
+ * @brief Queues a request without waiting for it.
+ * The request (and its buffer) must stay valid until blk_wait returns.
+ * @return BLOCK_ERR_OK, or a BLOCK_ERR_* if the request was rejected (it is
+ * then already marked done with that status).
+ */
+int blk_submit(blk_request_t *req);
+
+/**
+ * @brief Waits until a submitted request is done. A DMA command that does not
+ * complete in time is aborted, failing its requests with BLOCK_ERR_TIMEOUT.
+ * @return The request's BLOCK_ERR_* status.
+ */
+int blk_wait(blk_request_t *req);
+
+/**
+ * @brief Holds back dispatch on the device's queue so that a burst of
+ * submissions can be sorted and merged before the first command starts.
+ * Must be paired with blk_unplug; do not wait on a request in between.
+ */
+void blk_plug(block_device_t *dev);
+
+/** @brief Ends a blk_plug section and starts dispatching. */
+void blk_unplug(block_device_t *dev);
+
+/**
+ * @brief Synchronous transfer of any length, split into queue requests of at
+ * most MAX_SECTORS_PER_IO sectors.
+ */
+int blk_rw(block_device_t *dev, uint64_t lba, void *buffer, size_t count, bool write);
+
+/**
+ * @brief Waits for all earlier requests, then flushes the drive's write cache.
+ */
+int blk_flush(block_device_t *dev);
+
+/**
+ * @brief Called by the driver's IRQ handler. Under the queue lock, checks
+ * whether the running command has completed (block_device_poll_cmd); if so,
+ * wakes its waiters and starts the next command.
+ * @return true if a command completed, false if the interrupt was not ours.
+ */
+bool blk_queue_irq(blk_queue_t *q);
+
+#endif /* BLK_QUEUE_H */
@@ -19,6 +19,12 @@
 #define BLOCK_ERR_INTERNAL   -9 // Internal driver error
 #define BLOCK_ERR_IO         -10 // Generic I/O Error (e.g., DRQ not set when expected)
 
+#define BLOCK_CMD_PENDING     1 // block_device_start_cmd: command running, completion comes later
+#define BLOCK_CMD_SYNC        2 // block_device_start_cmd: drive untouched, run it with block_device_run_cmd
+
+struct blk_queue;
+struct blk_cmd;
+
 // --- Device Structure ---
 typedef struct {
     const char *device_name;   // e.g., "hda", "hdb"
@@ -32,7 +38,9 @@ typedef struct {
     // --- END REORDER ---
     bool initialized;
     bool lba48_supported;
+    bool dma_supported;        // Drive does DMA and its channel has a bus-master IDE controller
     spinlock_t *channel_lock;  // Pointer to the channel's lock (primary/secondary)
+    struct blk_queue *queue;   // The channel's request queue (blk_queue.h)
 } block_device_t;
 
 // --- Public API ---
@@ -43,14 +51,49 @@ void ata_channels_init(void);
 // Initializes a specific block device structure (hda, hdb, etc.)
 int block_device_init(const char *device, block_device_t *dev);
 
-// Reads sectors using best available method (MULTIPLE or single PIO)
+// Reads sectors through the channel's request queue (DMA, else READ MULTIPLE PIO)
 // LBA is now uint64_t
 int block_device_read(block_device_t *dev, uint64_t lba, void *buffer, size_t count);
 
-// Writes sectors using best available method (MULTIPLE or single PIO)
+// Writes sectors through the channel's request queue. The data may sit in the
+// drive's write cache until block_device_flush.
 // LBA is now uint64_t
 int block_device_write(block_device_t *dev, uint64_t lba, const void *buffer, size_t count);
 
+// Waits for all earlier requests, then issues FLUSH CACHE (EXT)
+int block_device_flush(block_device_t *dev);
+
 void ata_primary_irq_handler(isr_frame_t* frame); // <<< ADDED DECLARATION
 
+/**
+ * @brief Enables or disables bus-master DMA for all drives. While disabled,
+ * every transfer uses PIO (used for A/B benchmarking).
+ * @return Previous state.
+ */
+bool block_device_set_dma_enabled(bool enabled);
+
+// --- Request Queue Driver Hooks (called by blk_queue.c with the queue lock held, except run) ---
+
+/**
+ * @brief Starts a command built by the request queue.
+ * @return BLOCK_CMD_PENDING if a DMA command is now running (its completion
+ * is detected by block_device_poll_cmd, from blk_queue_irq or a polling waiter),
+ * BLOCK_CMD_SYNC if it needs PIO or is a flush, or a BLOCK_ERR_* if it failed.
+ */
+int block_device_start_cmd(struct blk_cmd *cmd);
+
+/**
+ * @brief Runs a command block_device_start_cmd answered BLOCK_CMD_SYNC for,
+ * polling the drive until it is done. Called by a task, without the queue
+ * lock (the queue keeps the channel reserved meanwhile).
+ * @return The command's final BLOCK_ERR_* status.
+ */
+int block_device_run_cmd(struct blk_cmd *cmd);
+
+/** @brief Non-blocking completion check: BLOCK_CMD_PENDING or the final status. */
+int block_device_poll_cmd(struct blk_cmd *cmd);
+
+/** @brief Stops a running command that timed out. */
+void block_device_abort_cmd(struct blk_cmd *cmd);
+
 #endif /* BLOCK_DEVICE_H */
\ No newline at end of file
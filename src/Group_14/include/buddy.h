@@ -95,6 +95,11 @@ void* buddy_alloc_raw(int order);
 
 void buddy_free_raw(void* block_addr_virt, int order);
 
+// Batched raw variants: one lock acquisition for the whole batch
+int buddy_alloc_raw_batch(int order, void **out, int count);
+
+void buddy_free_raw_batch(void **blocks, int count, int order);
+
 
 
 
@@ -15,33 +15,62 @@
  #define BUFFER_FLAG_ERROR   0x08  // Buffer has an I/O error
  #define MAX_BUFFER_BLOCK_SIZE      8192 
  
+ // Sharding: the hash table is split into independently locked shards,
+ // each with its own replacement lists and counters
+ #define BUFFER_CACHE_SHARD_BITS    4
+ #define BUFFER_CACHE_SHARDS        (1u << BUFFER_CACHE_SHARD_BITS)
+ #define BUFFER_CACHE_MAX_BUFFERS   1024    // Soft cap on cached blocks (512 KiB of 512-byte sectors)
+
+// Write-back defaults (see buffer_cache_set_writeback_params)
+#define BUFFER_DIRTY_EXPIRE_MS     3000    // Flusher writes buffers dirty for longer than this
+#define BUFFER_DIRTY_RATIO_PCT     20      // ... or every dirty buffer above this share of the cache
+
+ // Per-shard counters
+ typedef struct {
+     uint32_t hits;
+     uint32_t misses;
+     uint32_t evictions;
+     uint32_t ghost_hits;     // Misses on a block recently evicted from the probation queue
+     uint32_t cached_buffers;
+ } buffer_shard_stats_t;
+
  // Statistics structure
  typedef struct {
      uint32_t hits;           // Cache hits
      uint32_t misses;         // Cache misses
      uint32_t reads;          // Disk reads performed
      uint32_t writes;         // Disk writes performed
+     uint32_t prefetched;     // Blocks added by buffer_prefetch
      uint32_t evictions;      // Number of buffers evicted
      uint32_t alloc_failures; // Memory allocation failures
      uint32_t io_errors;      // I/O errors encountered
      uint32_t cached_buffers; // Current number of buffers in cache
      uint32_t dirty_buffers;  // Current number of dirty buffers
+     buffer_shard_stats_t shards[BUFFER_CACHE_SHARDS];
  } buffer_cache_stats_t;
  
+ // Which replacement queue a buffer is on (2Q)
+ #define BUFFER_QUEUE_NONE   0
+ #define BUFFER_QUEUE_A1IN   1  // Probation FIFO: blocks referenced once
+ #define BUFFER_QUEUE_AM     2  // Protected LRU: blocks referenced again after leaving A1in
+
  // Buffer structure
  typedef struct buffer buffer_t;
  
  struct buffer {
      disk_t *disk;            // Disk this buffer belongs to
+     uint32_t dev_id;         // Buffer cache device id of that disk (part of the key)
      uint32_t block_number;   // Block number on disk
      uint8_t *data;           // Pointer to the data
      uint32_t flags;          // Buffer flags
      uint32_t ref_count;      // Reference count
+     uint32_t queue;          // BUFFER_QUEUE_*
+     uint32_t dirty_since;    // PIT tick at which it last went from clean to dirty
      
      // Hash table chain
      buffer_t *hash_next;
      
-     // LRU list pointers
+     // Replacement queue pointers
      buffer_t *lru_prev;
      buffer_t *lru_next;
  };
@@ -49,11 +78,18 @@
  // Initialize the buffer cache system
  void buffer_cache_init(void);
  
- // Register a disk with the buffer cache
+ // Register a disk with the buffer cache; sets disk->cache_dev_id
  int buffer_register_disk(disk_t *disk);
+
+ // Device id of a registered disk by name (0 if not registered)
+ uint32_t buffer_device_id(const char *device_name);
  
  // Get a buffer from the cache or disk
- buffer_t *buffer_get(const char *device_name, uint32_t block_number);
+ buffer_t *buffer_get(uint32_t dev_id, uint32_t block_number);
+
+ // Read-ahead: read the uncached blocks of a range with as few disk requests as
+ // possible and cache them unreferenced. Returns blocks added or a negative error.
+ int buffer_prefetch(uint32_t dev_id, uint32_t first_block, uint32_t count);
  
  // Release a buffer
  void buffer_release(buffer_t *buf);
@@ -66,11 +102,30 @@
  
  // Sync all dirty buffers to disk
  void buffer_cache_sync(void);
+
+ // Sync one device's dirty buffers and flush its write cache; 0 or a negative error
+ int buffer_cache_sync_device(uint32_t dev_id);
+
+ // Called by the flusher before each pass, e.g. to copy an in-memory FAT into the cache
+ typedef void (*buffer_writeback_hook_t)(void *ctx);
+ int buffer_cache_register_writeback_hook(buffer_writeback_hook_t hook, void *ctx);
+ void buffer_cache_unregister_writeback_hook(buffer_writeback_hook_t hook, void *ctx);
+
+ // Tunes the flusher: expiry age of dirty buffers and the dirty ratio that
+ // makes it write everything
+ void buffer_cache_set_writeback_params(uint32_t expire_ms, uint32_t dirty_ratio_pct);
+
+ // Starts the background flusher thread (once the scheduler is initialized)
+ int buffer_cache_start_flusher(void);
  
  // Get buffer cache statistics
  void buffer_cache_get_stats(buffer_cache_stats_t *stats);
  
- // Invalidate all buffers for a specific device
- void buffer_invalidate_device(const char *device_name);
+ // Invalidate all unreferenced buffers of a device (dirty data is discarded)
+ void buffer_invalidate_device(uint32_t dev_id);
+
+ // Switches between 2Q (default) and plain LRU replacement; returns the previous
+ // setting. Used for A/B benchmarking.
+ bool buffer_cache_set_scan_resistant(bool enabled);
  
- #endif /* BUFFER_CACHE_H */
\ No newline at end of file
+ #endif /* BUFFER_CACHE_H */
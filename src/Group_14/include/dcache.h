@@ -0,0 +1,79 @@
+#pragma once
+#ifndef DCACHE_H
+#define DCACHE_H
+
+/**
+ * @file dcache.h
+ * @brief Directory-entry cache shared by the filesystem drivers.
+ *
+ * Maps (filesystem context, parent directory id, name) to a small blob of
+ * driver-defined lookup state, or records that the name does not exist
+ * (negative entry). Drivers consult it before scanning a directory and fill
+ * it after the scan. The parent id and the blob are opaque here; a driver
+ * that populates the cache must invalidate a name whenever it creates,
+ * removes or renames it. Names are compared byte for byte, so
+ * case-insensitive filesystems pass them in a canonical case.
+ *
+ * The cache has a fixed number of entries, recycled in LRU order.
+ */
+
+#include "types.h"
+
+#define DCACHE_ENTRIES      512
+#define DCACHE_BUCKETS      256   // Power of two
+#define DCACHE_NAME_MAX     63    // Longer names are never cached
+#define DCACHE_DATA_SIZE    16    // Bytes of driver state per positive entry
+
+// dcache_lookup results
+#define DCACHE_MISS         0     // Nothing cached; scan the directory
+#define DCACHE_HIT          1     // Name exists; data copied out
+#define DCACHE_NEGATIVE     2     // Name is known not to exist
+
+typedef struct {
+    uint32_t hits;
+    uint32_t negative_hits;
+    uint32_t misses;
+    uint32_t inserts;
+    uint32_t evictions;       // Entries recycled to make room
+    uint32_t invalidations;   // Entries dropped by dcache_invalidate*
+    uint32_t entries;         // Entries currently cached
+} dcache_stats_t;
+
+/** @brief Initialises the cache. Called once from vfs_init. */
+void dcache_init(void);
+
+/**
+ * @brief Looks up a name under a parent directory.
+ * @param data_out Receives up to data_len bytes of the entry's data on DCACHE_HIT.
+ * @return DCACHE_HIT, DCACHE_NEGATIVE or DCACHE_MISS.
+ */
+int dcache_lookup(const void *sb, uint32_t parent, const char *name, void *data_out, size_t data_len);
+
+/** @brief Caches a name that exists, with data_len (<= DCACHE_DATA_SIZE) bytes of driver data. */
+void dcache_insert(const void *sb, uint32_t parent, const char *name, const void *data, size_t data_len);
+
+/** @brief Caches a name that does not exist. */
+void dcache_insert_negative(const void *sb, uint32_t parent, const char *name);
+
+/** @brief Drops any entry, positive or negative, for one name. */
+void dcache_invalidate(const void *sb, uint32_t parent, const char *name);
+
+/**
+ * @brief Drops every entry under one parent directory. Drivers whose names
+ * have aliases (FAT long and short names, case variants) use this after a
+ * create or remove instead of invalidating each alias.
+ */
+void dcache_invalidate_parent(const void *sb, uint32_t parent);
+
+/** @brief Drops every entry of a filesystem (e.g. on unmount). */
+void dcache_invalidate_fs(const void *sb);
+
+/**
+ * @brief Turns the cache on or off (benchmarks). Turning it off empties it.
+ * @return The previous setting.
+ */
+bool dcache_set_enabled(bool enabled);
+
+void dcache_get_stats(dcache_stats_t *stats);
+
+#endif // DCACHE_H
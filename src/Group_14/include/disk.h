@@ -31,6 +31,7 @@ typedef struct disk {
     bool           initialized;     // Has this disk structure been initialized?
     bool           has_mbr;         // Was a valid MBR signature found?
     partition_t    partitions[MAX_PARTITIONS_PER_DISK]; // Parsed MBR partitions
+    uint32_t       cache_dev_id;    // Buffer cache device id (0 until buffer_register_disk)
     // Add other disk-wide info if needed (e.g., disk GUID for GPT)
 } disk_t;
 
@@ -65,6 +66,15 @@ int disk_read_raw_sectors(disk_t *disk, uint64_t lba, void *buffer, size_t count
  */
 int disk_write_raw_sectors(disk_t *disk, uint64_t lba, const void *buffer, size_t count);
 
+/**
+ * @brief Makes completed writes durable: waits for earlier requests on the
+ * disk's queue, then flushes the drive's write cache. Writes themselves no
+ * longer flush; call this on sync.
+ * @param disk Pointer to the initialized disk_t structure.
+ * @return FS_SUCCESS on success, negative error code on failure.
+ */
+int disk_flush(disk_t *disk);
+
 
 /**
  * @brief Reads sectors from a specific partition.
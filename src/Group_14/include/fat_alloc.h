@@ -10,6 +10,14 @@
 // Allocates a new cluster and optionally links it from a previous one.
 uint32_t fat_allocate_cluster(fat_fs_t *fs, uint32_t previous_cluster);
 
+// Allocates up to `count` physically contiguous clusters, chained in order and
+// ending in EOC, and links them from previous_cluster (if >= 2). Returns the
+// first cluster (0 on failure) and the run length in *allocated_out.
+uint32_t fat_allocate_run(fat_fs_t *fs, uint32_t previous_cluster, uint32_t count, uint32_t *allocated_out);
+
+// Builds fs->free_map and fs->free_clusters from the loaded FAT table.
+int fat_build_free_map(fat_fs_t *fs);
+
 // Frees an entire cluster chain starting from a given cluster.
 int fat_free_cluster_chain(fat_fs_t *fs, uint32_t start_cluster);
 
@@ -30,4 +38,18 @@ int fat_truncate_file(fat_fs_t *fs,
                       uint32_t entry_dir_cluster, // Cluster containing this entry
                       uint32_t entry_offset_in_dir); // Byte offset of this 8.3 entry
 
+// Finds the disk cluster holding file cluster `index`, extending the file's
+// extent map as far as needed. If the chain is shorter, returns FS_ERR_EOF with
+// the chain's last cluster in *cluster_out (0 if the file has none) and its
+// length in *chain_len_out. Assumes caller holds fs->lock.
+int fat_extent_lookup(fat_fs_t *fs, fat_file_context_t *fctx, uint32_t index,
+                      uint32_t *cluster_out, uint32_t *chain_len_out);
+
+// Records that file cluster `index` is on disk at `cluster` (called after
+// allocation). Only extends the map when `index` directly follows it.
+void fat_extent_append(fat_file_context_t *fctx, uint32_t index, uint32_t cluster);
+
+// Forgets the mapping of file clusters at or beyond `clusters` (0 drops the map).
+void fat_extent_truncate(fat_file_context_t *fctx, uint32_t clusters);
+
 #endif // FAT_ALLOC_H
\ No newline at end of file
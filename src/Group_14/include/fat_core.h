@@ -16,7 +16,7 @@
  #include "types.h"      // For kernel-specific types like size_t, off_t if not in stdint/def
  #include "vfs.h"        // For vfs_driver_t, vnode_t, file_t, struct dirent
  #include "disk.h"       // For disk_t definition
- #include "spinlock.h"   // For spinlock_t
+ #include "mutex.h"      // For mutex_t (fat_fs_t.lock)
  
  /* --- FAT Type Constants --- */
  #define FAT_TYPE_FAT12 1
@@ -107,7 +107,7 @@
  typedef struct {
      // Disk and Locking
      disk_t    *disk_ptr;            // Pointer to the underlying disk device structure
-     spinlock_t lock;                // Spinlock to protect concurrent access to this structure and FAT table
+     mutex_t    lock;                // Protects this structure and the FAT table; held across disk I/O
  
      // Filesystem Geometry & Type (parsed from Boot Sector)
      uint8_t    type;                // FAT type (FAT_TYPE_FAT12, FAT_TYPE_FAT16, FAT_TYPE_FAT32)
@@ -126,16 +126,28 @@
      uint32_t   eoc_marker;          // End-of-chain marker value for this FAT type (e.g., 0xFF8, 0xFFF8, 0x0FFFFFF8)
      // FSINFO related fields (optional, could be added later for performance)
      // uint32_t fs_info_sector;     // Sector number of FSINFO
-     // uint32_t free_cluster_count; // Cached count of free clusters
-     // uint32_t next_free_cluster;  // Hint for next free cluster search
+
+     // Free-Space Map (built from the FAT at mount; see fat_alloc.c)
+     uint32_t  *free_map;            // One bit per cluster number, set while the cluster is in use
+     uint32_t   free_clusters;       // Data clusters whose FAT entry is 0
+     uint32_t   next_free_hint;      // Cluster where the next-fit search starts
  
      // In-Memory FAT Table Cache
      void      *fat_table;           // Pointer to the cached FAT table in memory
      size_t     fat_table_size_bytes;// Size of the allocated fat_table buffer
      bool       fat_dirty;           // Flag indicating if the in-memory FAT needs flushing
+     uint8_t   *fat_dirty_sectors;   // One bit per FAT sector changed since the last flush
  
  } fat_fs_t;
  
+ /* --- Extent Map Entry --- */
+ // A run of physically contiguous clusters in a file's chain.
+ typedef struct {
+     uint32_t file_cluster;          // Index of the run's first cluster within the file
+     uint32_t disk_cluster;          // Cluster number of that cluster on disk
+     uint32_t length;                // Clusters in the run
+ } fat_extent_t;
+
  /* --- FAT File/Directory Context Structure --- */
  // Holds runtime state for an opened file or directory within a FAT filesystem.
  // This structure is typically stored in file->vnode->data.
@@ -155,6 +167,17 @@
      // Sequential I/O State (optimization, could be removed if lseek recalculates)
      // uint32_t current_cluster;    // Last cluster accessed for sequential read/write
      // uint32_t offset_in_cluster;  // Offset within the current_cluster
+
+     // Read-Ahead State (per open file; see fat_read_internal)
+     uint32_t ra_next_offset;        // Offset just past the previous read; a read starting here is sequential
+     uint32_t ra_end_offset;         // File data before this offset has already been read ahead
+     uint32_t ra_window;             // Bytes to read ahead of the reader (0 while access looks random)
+
+     // Extent Map (per open file; built lazily, see fat_extent_lookup)
+     fat_extent_t *extents;          // Sorted runs covering file clusters [0, extent_mapped)
+     uint32_t extent_count;          // Runs in use
+     uint32_t extent_capacity;       // Runs allocated
+     uint32_t extent_mapped;         // Leading file clusters the map covers
  
      // Readdir State (only relevant if is_directory is true)
      uint32_t readdir_current_cluster; // Cluster being scanned for readdir
@@ -162,6 +185,9 @@
      size_t   readdir_last_index;      // The logical index of the last entry returned by readdir
  
  } fat_file_context_t;
+
+ /** @brief Page cache identity (vfs_file_id_t.ino) of a file: where its directory entry lives. */
+ #define FAT_FILE_INO(dir_cluster, dir_offset) (((uint64_t)(dir_cluster) << 32) | (uint32_t)(dir_offset))
  
  
  /* --- Public Driver Functions --- */
@@ -41,5 +41,17 @@
   * @return Negative FS_ERR_* code on failure (e.g., invalid context, flush error).
   */
  int fat_unmount_internal(void *fs_context);
+
+ /**
+  * @brief Makes a FAT filesystem durable. Implements VFS sync.
+  *
+  * Copies the FAT sectors changed since the last flush into the buffer cache,
+  * writes back every dirty block of the device and flushes the drive's cache.
+  * (In the background, the buffer cache's flusher does the same lazily.)
+  *
+  * @param fs_context A pointer to the fat_fs_t structure.
+  * @return FS_SUCCESS (0), or a negative FS_ERR_* code.
+  */
+ int fat_sync_internal(void *fs_context);
  
  #endif /* FAT_FS_H */
\ No newline at end of file
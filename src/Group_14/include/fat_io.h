@@ -79,6 +79,29 @@
   * @return FS_SUCCESS (0) on success, or a negative FS_ERR_* code on failure.
   */
  int fat_close_internal(file_t *file);
+
+ /**
+  * @brief Makes an opened file durable. Implements VFS fsync.
+  *
+  * Writes the file's metadata back to its directory entry if it changed,
+  * then syncs the whole filesystem (see fat_sync_internal).
+  *
+  * @param file Pointer to the VFS file_t structure.
+  * @return FS_SUCCESS (0) on success, or a negative FS_ERR_* code on failure.
+  */
+ int fat_fsync_internal(file_t *file);
+
+ /**
+  * @brief Reports a file's identity for the page cache. Implements VFS identify.
+  *
+  * The identity is the location of the file's directory entry (FAT_FILE_INO),
+  * which stays the same across opens until the file is unlinked.
+  *
+  * @param file Pointer to the VFS file_t structure.
+  * @param id_out Receives the identity.
+  * @return FS_SUCCESS (0) on success, or a negative FS_ERR_* code on failure.
+  */
+ int fat_identify_internal(file_t *file, vfs_file_id_t *id_out);
  
  
  /* --- Cluster I/O Helpers (Potentially used by other FAT modules) --- */
@@ -43,6 +43,43 @@ int frame_init(struct multiboot_tag_mmap *mmap_tag,
  */
 uintptr_t frame_alloc(void);
 
+/**
+ * @brief Allocates a physically contiguous run of page frames.
+ * Each frame gets a reference count of 1 and the run length is recorded in
+ * the page-run descriptor array, so no in-band header is needed. Only the
+ * power-of-two remainder of the backing buddy block is returned to the buddy
+ * allocator, so the run itself wastes less than one page.
+ *
+ * @param npages Number of pages (1..65535).
+ * @return Physical address of the first frame, or 0 on failure.
+ */
+uintptr_t frame_alloc_run(size_t npages);
+
+/**
+ * @brief Frees a page run previously returned by frame_alloc_run().
+ *
+ * @param phys_addr Physical address of the first frame of the run.
+ */
+void frame_free_run(uintptr_t phys_addr);
+
+/**
+ * @brief Looks up the length of a page run in the page-run descriptor array.
+ *
+ * @param phys_addr Physical address of the first frame of the run.
+ * @return Number of pages in the run, or 0 if phys_addr does not head a run.
+ */
+size_t frame_run_pages(uintptr_t phys_addr);
+
+/**
+ * @brief Allocates a zero-filled, 4MB-aligned block of 1024 frames for a PSE
+ * user mapping. Unlike a page run, every frame is an independent frame with a
+ * reference count of 1, so the block can later be split and released page by
+ * page with put_frame().
+ *
+ * @return Physical address of the block, or 0 on failure.
+ */
+uintptr_t frame_alloc_large_page(void);
+
 /**
  * @brief Increments the reference count for a given physical frame.
  * Use this when a new PTE starts pointing to this frame (sharing).
@@ -61,6 +98,18 @@ void get_frame(uintptr_t phys_addr);
  */
 void put_frame(uintptr_t phys_addr);
 
+/**
+ * @brief Drops one reference from each of 'count' frames.
+ * The refcount array is updated under a single lock acquisition. Frames that
+ * reach zero top up this CPU's frame cache to its high watermark, and the rest
+ * go back to the buddy allocator in batches.
+ *
+ * @param frames Physical addresses (page-aligned). The array is reused as
+ *               scratch space and its contents are undefined on return.
+ * @param count  Number of entries.
+ */
+void put_frame_batch(uintptr_t *frames, uint32_t count);
+
 /**
  * @brief Gets the current reference count for a physical frame.
  *
@@ -82,7 +131,92 @@ static inline void frame_free(uintptr_t phys_addr) {
 }
 
 void frame_incref(uintptr_t phys_addr); // +++ ADD THIS LINE +++
+
+// --- Per-CPU Frame Cache ---
+
+/**
+ * @brief Per-CPU frame cache counters.
+ */
+typedef struct frame_pcp_stats {
+    uint32_t alloc_hits;   // frame_alloc served from the cache
+    uint32_t alloc_misses; // Cache empty even after a refill attempt
+    uint32_t frees;        // put_frame releases absorbed by the cache
+    uint32_t refills;      // Batched transfers buddy -> cache
+    uint32_t drains;       // Batched transfers cache -> buddy
+} frame_pcp_stats_t;
+
+/**
+ * @brief Enables or disables the per-CPU frame cache.
+ * Disabling returns every cached frame to the buddy allocator; frame_alloc and
+ * put_frame then go straight to the buddy (used for A/B benchmarking).
+ *
+ * @param enabled New state.
+ * @return Previous state.
+ */
+bool frame_pcp_set_enabled(bool enabled);
+
+/**
+ * @brief Tunes the cache: refill one batch when a CPU's cache holds 'low' frames
+ * or fewer, drain one batch when it holds more than 'high'.
+ *
+ * @return 0 on success, -1 if batch is 0, low + batch > high, or high exceeds capacity.
+ */
+int frame_pcp_set_watermarks(uint32_t low, uint32_t high, uint32_t batch);
+
+/**
+ * @brief Returns every cached frame on every CPU to the buddy allocator.
+ */
+void frame_pcp_drain_all(void);
+
+/**
+ * @brief Copies one CPU's cache counters.
+ *
+ * @param cpu CPU index.
+ * @param out Receives the counters.
+ * @param out_count Receives the number of frames currently cached (can be NULL).
+ */
+void frame_pcp_get_stats(int cpu, frame_pcp_stats_t *out, uint32_t *out_count);
 // <<< END ADDED >>>
 
 
+// --- Pre-zeroed Frame Pool ---
+
+/**
+ * @brief Zero pool statistics (see frame_zero_pool_get_stats).
+ * Hit rate = hits / (hits + misses).
+ */
+typedef struct frame_zero_pool_stats {
+    uint32_t pool_count;  // Frames currently pre-zeroed and waiting
+    uint32_t capacity;
+    uint32_t hits;        // frame_alloc_zeroed served from the pool
+    uint32_t misses;      // frame_alloc_zeroed cleared synchronously
+    uint32_t idle_zeroed; // Frames cleared in the background
+    uint32_t reclaimed;   // Pool frames handed to frame_alloc under memory pressure
+} frame_zero_pool_stats_t;
+
+/**
+ * @brief Allocates a zero-filled frame (refcount 1).
+ * Served from the idle task's pre-zeroed pool when possible, otherwise
+ * allocated and cleared synchronously.
+ *
+ * @return Physical address of the frame, or 0 if OOM.
+ */
+uintptr_t frame_alloc_zeroed(void);
+
+/**
+ * @brief Clears up to 'max_frames' free frames into the pre-zeroed pool.
+ * Intended for the idle task.
+ *
+ * @return Number of frames added; 0 once the pool is full (or memory is short).
+ */
+uint32_t frame_zero_pool_refill(uint32_t max_frames);
+
+/**
+ * @brief Retrieves current statistics about the pre-zeroed frame pool.
+ *
+ * @param stats Pointer to a frame_zero_pool_stats_t structure to fill.
+ */
+void frame_zero_pool_get_stats(frame_zero_pool_stats_t *stats);
+
+
 #endif // FRAME_H
\ No newline at end of file
@@ -20,6 +20,11 @@ extern "C" {
 
  #define GDT_USER_CODE_SELECTOR 0x18 | 0x03 // 3rd entry (index 3), RPL 3
  #define GDT_USER_DATA_SELECTOR 0x20 | 0x03 // 4th entry (index 4), RPL 3
+// Index 5: TSS (TSS_SELECTOR in tss.h)
+// Index 6: Per-CPU data segment; its base is this CPU's cpu_t (see smp.h)
+#define GDT_PERCPU_SELECTOR 0x30 // (6 * 8) | 0
+
+#define GDT_ENTRIES 7
 
 
 struct gdt_entry {
@@ -49,12 +54,20 @@ struct gdt_ptr {
  *   - User code segment (ring 3).
  *   - User data segment (ring 3).
  *   - TSS descriptor.
+ *   - Per-CPU data segment (loaded into GS).
  *
  * After setting up the GDT, the function flushes it to update the CPU's segment registers
- * and loads the TSS.
+ * and loads the TSS. Sets up the bootstrap processor (CPU 0).
  */
 void gdt_init(void);
 
+/**
+ * @brief Builds and loads the GDT and TSS of an application processor.
+ * Each CPU has its own table, so that its TSS descriptor (marked busy by ltr)
+ * and its per-CPU segment base are its own.
+ */
+void gdt_init_cpu(uint32_t cpu);
+
 #ifdef __cplusplus
 }
 #endif
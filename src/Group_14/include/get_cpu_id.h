@@ -7,13 +7,20 @@
 extern "C" {
 #endif
 
+// Upper bound on CPU ids that per-CPU data structures (percpu_alloc, slab
+// magazines, run queues) provide slots for. smp.c starts at most this many
+// CPUs; any further ones the firmware reports stay halted.
+#ifndef MAX_CPUS
+#define MAX_CPUS 4
+#endif
+
 /**
- * @brief Retrieves the current CPU's identifier using the CPUID instruction.
+ * @brief Retrieves the current CPU's index (0 = bootstrap processor).
  *
- * This function uses CPUID with EAX=1 to obtain the Local APIC ID from EBX (bits 24–31).
- * In an SMP environment, this value may be remapped if necessary.
+ * Indices are assigned at SMP bring-up (smp.c) and are always below MAX_CPUS.
+ * The value is only stable while interrupts are disabled.
  *
- * @return The CPU's identifier (0 if CPUID is not supported or in uniprocessor systems).
+ * @return The CPU's index.
  */
 int get_cpu_id(void);
 
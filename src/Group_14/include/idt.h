@@ -82,6 +82,11 @@ typedef struct interrupt_handler_info {
  */
 void idt_init(void);
 
+/**
+ * @brief Loads the IDT built by idt_init on the executing CPU (for the APs).
+ */
+void idt_load(void);
+
 /**
  * @brief Registers a C handler function for a specific interrupt number.
  *
@@ -0,0 +1,106 @@
+#ifndef KBENCH_H
+#define KBENCH_H
+
+#include "types.h"
+
+/**
+ * @file kbench.h
+ * @brief In-kernel microbenchmarks (built only with KERNEL_BENCH defined).
+ *
+ * Enable with the UIAOS_KERNEL_BENCH CMake option. Results are written to COM1
+ * as a machine-parseable table framed by BENCH-BEGIN / BENCH-END lines:
+ *
+ *   BENCH,<layer>,<workload>,<op>,<count>,<avg_cyc>,<p50_cyc>,<p99_cyc>,<max_cyc>
+ *
+ * scripts/run_bench.sh boots the kernel headless in QEMU, extracts the table
+ * and compares it against a stored baseline.
+ */
+
+// Upper bound on samples a single kbench_report call can rank
+#define KBENCH_MAX_SAMPLES 8192
+
+/**
+ * @brief Reads the CPU time-stamp counter.
+ * @return Current 64-bit TSC value.
+ */
+static inline uint64_t kbench_rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * @brief Converts a TSC delta into a 32-bit sample, minus the measured rdtsc overhead.
+ */
+uint32_t kbench_sample(uint64_t start, uint64_t end);
+
+/**
+ * @brief Emits one BENCH table row for a set of per-operation cycle samples.
+ * Sorts 'samples' in place to compute percentiles.
+ *
+ * @param layer    Subsystem under test (e.g. "buddy", "slab").
+ * @param workload Workload name (e.g. "churn").
+ * @param op       Operation measured (e.g. "alloc", "free").
+ * @param samples  Per-operation cycle counts.
+ * @param count    Number of samples (at most KBENCH_MAX_SAMPLES).
+ */
+void kbench_report(const char *layer, const char *workload, const char *op,
+                   uint32_t *samples, uint32_t count);
+
+/**
+ * @brief Runs the allocator workloads against buddy, slab, kmalloc and percpu,
+ * then prints the magazine hit/miss counts of the slab layer's caches.
+ */
+void kbench_alloc_suite(void);
+
+/**
+ * @brief Runs frame allocator churn and the page-fault storm, each with the
+ * per-CPU frame cache disabled and enabled. Also prints faults/second.
+ */
+void kbench_frame_suite(void);
+
+/**
+ * @brief Times destroy_mm on a populated address space with mmu_gather
+ * batching on and off, both with the address space loaded in CR3 and not.
+ */
+void kbench_teardown_suite(void);
+
+/**
+ * @brief Sequential 64 KiB reads from hda, once through PIO and once through
+ * bus-master DMA. Also prints KiB/second for each.
+ */
+void kbench_block_suite(void);
+
+/**
+ * @brief Interleaves metadata-block lookups with a sequential read 8x the
+ * size of the buffer cache, once with plain LRU and once with 2Q
+ * replacement. Also prints the metadata hit rate for each.
+ */
+void kbench_bcache_suite(void);
+
+/**
+ * @brief Opens an existing and a missing path repeatedly, with the dentry
+ * cache off and on. Also prints the cache's hit counts for each.
+ */
+void kbench_dcache_suite(void);
+
+/**
+ * @brief Times process creation (exec) and teardown for hello.elf and a
+ * large padded executable. Also prints the most memory a new process held
+ * before its first instruction.
+ */
+void kbench_exec_suite(void);
+
+/**
+ * @brief Runs all boot-time benchmarks. Called once from main() after memory init.
+ * Prints BENCH-BEGIN; the table is closed by kbench_run_late.
+ */
+void kbench_run_boot(void);
+
+/**
+ * @brief Runs the benchmarks that need devices (disk) and prints BENCH-END.
+ * Called once from main() after the filesystem layer is up.
+ */
+void kbench_run_late(void);
+
+#endif // KBENCH_H
@@ -31,9 +31,23 @@
 // --- ADDED VMA Type Flags (Example bits) ---
 #define VM_HEAP         0x00000100  // VMA represents the process heap (managed by brk/sbrk)
 #define VM_STACK        0x00000200  // VMA represents a stack region
+#define VM_HUGEPAGE     0x00000400  // Anonymous VMA: back whole 4MB-aligned blocks with PSE pages
 
 // Add more flags as needed (e.g., VM_LOCKED, VM_IO, VM_GUARD)
 
+// --- mmap() protection and flags (same values as Linux) ---
+#define PROT_NONE       0x0
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define PROT_EXEC       0x4
+#define MAP_SHARED      0x01  // Shared with every process mapping the file (read-only for files)
+#define MAP_PRIVATE     0x02  // Copy-on-write
+#define MAP_FIXED       0x10  // Map exactly at addr, replacing existing mappings
+#define MAP_ANONYMOUS   0x20  // Zero-filled memory, no file
+
+// mmap() places mappings without MAP_FIXED between here and the user stack
+#define USER_MMAP_BASE  0x40000000u
+
 
 /**
  * @brief Virtual Memory Area (VMA) structure.
@@ -48,6 +62,7 @@ typedef struct vma_struct {
     size_t vm_offset;           // Offset within the backing file (in bytes)
     struct rb_node rb_node;     // Node for Red-Black tree linkage
     struct mm_struct *vm_mm;    // Pointer back to the owning mm_struct
+    struct vma_struct *free_next; // Unlinked VMAs waiting to be freed once mm->lock is dropped
 } vma_struct_t;
 
 /**
@@ -109,6 +124,18 @@ vma_struct_t* insert_vma(mm_struct_t *mm, uintptr_t start, uintptr_t end,
                          uint32_t vm_flags, uint32_t page_prot,
                          file_t* file, size_t offset);
 
+/**
+ * @brief Duplicates an address space for fork().
+ * Clones every VMA of @p src into a new mm_struct and shares the mapped frames
+ * through @p dst_pgd_phys. Private writable pages become read-only in both
+ * directories, so whichever side writes first takes a COW fault.
+ *
+ * @param src The parent's memory structure.
+ * @param dst_pgd_phys Physical address of the child's (empty user half) page directory.
+ * @return The child's mm_struct, or NULL on failure (nothing is left mapped).
+ */
+mm_struct_t *copy_mm(mm_struct_t *src, uint32_t *dst_pgd_phys);
+
 /**
  * @brief Removes/modifies VMAs overlapping a given range.
  * Unmaps pages and frees corresponding physical frames (if not shared).
@@ -135,5 +162,32 @@ int remove_vma_range(mm_struct_t *mm, uintptr_t start, size_t length); // <-- Ad
  */
 int handle_vma_fault(mm_struct_t *mm, vma_struct_t *vma, uintptr_t address, uint32_t error_code);
 
+/**
+ * @brief Creates a mapping (mmap). Pages are faulted in on first touch:
+ * anonymous ones zero-filled, file-backed ones from the page cache.
+ *
+ * File mappings need a driver that implements identify. MAP_SHARED file
+ * mappings must be read-only, since mapped pages are never written back;
+ * MAP_PRIVATE ones may be writable and copy on write. The VMA takes its own
+ * reference to @p file.
+ *
+ * @param addr Required address with MAP_FIXED, otherwise a hint (0 for none).
+ * @param length Bytes to map (rounded up to whole pages).
+ * @param prot PROT_* bits.
+ * @param flags MAP_SHARED or MAP_PRIVATE, optionally MAP_FIXED / MAP_ANONYMOUS.
+ * @param file Open file to map (ignored with MAP_ANONYMOUS).
+ * @param offset Page-aligned offset within the file.
+ * @param addr_out Receives the start of the mapping.
+ * @return FS_SUCCESS or a negative FS_ERR_* code.
+ */
+int do_mmap(mm_struct_t *mm, uintptr_t addr, size_t length, uint32_t prot, uint32_t flags,
+            file_t *file, size_t offset, uintptr_t *addr_out);
+
+/**
+ * @brief Removes the mappings in [addr, addr + length) (munmap).
+ * @return FS_SUCCESS (also when nothing was mapped) or a negative FS_ERR_* code.
+ */
+int do_munmap(mm_struct_t *mm, uintptr_t addr, size_t length);
+
 
 #endif // MM_H
@@ -0,0 +1,103 @@
+#ifndef MMU_GATHER_H
+#define MMU_GATHER_H
+
+#include "types.h"
+#include "paging.h" // PAGE_SIZE
+
+/**
+ * @file mmu_gather.h
+ * @brief Batched TLB invalidation and frame release for unmapping.
+ *
+ * Unmap paths clear PTEs and hand the old frames to an mmu_gather instead of
+ * issuing invlpg and put_frame per page. The gather remembers the virtual
+ * range it has to invalidate. On flush it either reloads CR3 once or issues
+ * invlpg over the range, whichever is cheaper. Only then does it release the
+ * frames with put_frame_batch(), so no CPU can still reach a freed frame
+ * through a stale TLB entry.
+ *
+ * Typical use:
+ *
+ *   mmu_gather_t tlb;
+ *   mmu_gather_init(&tlb, mm->pgd_phys, false);
+ *   paging_unmap_range_gather(&tlb, start, length);
+ *   mmu_gather_finish(&tlb);
+ */
+
+// Frames held before the gather flushes on its own (bounds stack usage)
+#define MMU_GATHER_BATCH 128
+
+// Ranges larger than this many pages are flushed with a CR3 reload instead of invlpg
+#define MMU_GATHER_INVLPG_MAX_PAGES 32
+
+typedef struct mmu_gather {
+    uintptr_t pd_phys;    // Page directory whose entries are being removed
+    bool      tlb_live;   // pd_phys is loaded in CR3, so the TLB may hold its entries
+    bool      fullmm;     // Whole address space is going away: always reload CR3
+    uintptr_t start;      // Pending invalidation range [start, end); start == end means none
+    uintptr_t end;
+    uint32_t  nr_frames;
+    uintptr_t frames[MMU_GATHER_BATCH];
+} mmu_gather_t;
+
+/**
+ * @brief Cumulative counters (see mmu_gather_get_stats).
+ */
+typedef struct mmu_gather_stats {
+    uint32_t flushes;        // mmu_gather_flush calls that had work to do
+    uint32_t cr3_reloads;    // Flushes done with a full CR3 reload
+    uint32_t invlpg_pages;   // Pages invalidated one by one
+    uint32_t skipped;        // Flushes that needed no TLB work (directory not loaded)
+    uint32_t frames_freed;   // Frames handed to put_frame_batch
+} mmu_gather_stats_t;
+
+/**
+ * @brief Starts a gather for one page directory.
+ * @param tlb     Gather to initialize (usually on the caller's stack).
+ * @param pd_phys Physical address of the page directory being unmapped from.
+ * @param fullmm  True when the whole user address space is being torn down.
+ */
+void mmu_gather_init(mmu_gather_t *tlb, uint32_t *pd_phys, bool fullmm);
+
+/**
+ * @brief Records that [vaddr, vaddr + size) must be invalidated before the
+ * gathered frames are released.
+ */
+void mmu_gather_add_range(mmu_gather_t *tlb, uintptr_t vaddr, size_t size);
+
+/**
+ * @brief Queues one frame reference to drop after the next TLB flush.
+ * Flushes by itself when the batch is full.
+ */
+void mmu_gather_add_frame(mmu_gather_t *tlb, uintptr_t frame_phys);
+
+/**
+ * @brief Shorthand for a cleared 4KB PTE: records the page and its frame.
+ */
+static inline void mmu_gather_add_page(mmu_gather_t *tlb, uintptr_t vaddr, uintptr_t frame_phys) {
+    mmu_gather_add_range(tlb, vaddr, PAGE_SIZE);
+    mmu_gather_add_frame(tlb, frame_phys);
+}
+
+/**
+ * @brief Invalidates the pending range and releases the queued frames.
+ */
+void mmu_gather_flush(mmu_gather_t *tlb);
+
+/**
+ * @brief Final flush. The gather must not be used afterwards.
+ */
+void mmu_gather_finish(mmu_gather_t *tlb);
+
+/**
+ * @brief Enables or disables batching. While disabled every page is
+ * invalidated and its frame released immediately (used for A/B benchmarking).
+ * @return Previous state.
+ */
+bool mmu_gather_set_enabled(bool enabled);
+
+/**
+ * @brief Copies the cumulative counters.
+ */
+void mmu_gather_get_stats(mmu_gather_stats_t *out);
+
+#endif // MMU_GATHER_H
@@ -10,7 +10,10 @@
 // #define MSR_FS_BASE 0xC0000100
 // #define MSR_GS_BASE 0xC0000101
 // #define MSR_KERNEL_GS_BASE 0xC0000102 // For swapgs
-// #define MSR_IA32_APIC_BASE 0x1B
+#define MSR_IA32_APIC_BASE 0x1B // Local APIC base address and global enable (see apic.c)
+#define MSR_IA32_SYSENTER_CS  0x174 // Kernel CS for SYSENTER; SS, user CS and user SS follow in the GDT
+#define MSR_IA32_SYSENTER_ESP 0x175 // Kernel ESP loaded by SYSENTER (see syscall_init_cpu)
+#define MSR_IA32_SYSENTER_EIP 0x176 // Kernel entry point of SYSENTER
 // #define MSR_IA32_PAT 0x277
 
 /**
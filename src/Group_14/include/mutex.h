@@ -0,0 +1,36 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include "types.h"
+#include "spinlock.h"
+
+struct tcb;
+
+/**
+ * @brief Sleeping lock for code that may wait on I/O while holding it.
+ *
+ * A task that finds the mutex taken blocks in the scheduler (linked through
+ * its wait_prev/wait_next) and is handed the mutex directly by the unlock,
+ * so interrupts stay enabled and the holder may itself sleep. Callers that
+ * cannot block (see scheduler_can_block) spin on it instead, which makes it
+ * usable in early boot; it must still never be taken while holding a spinlock
+ * once other tasks run, since the holder may be preempted on this CPU.
+ */
+typedef struct {
+    spinlock_t   lock;      // Protects the fields below, held only briefly
+    bool         locked;
+    struct tcb  *owner;     // Holder, or NULL before the scheduler runs
+    struct tcb  *wait_head; // FIFO of blocked tasks
+    struct tcb  *wait_tail;
+} mutex_t;
+
+/** @brief Initializes a mutex to the unlocked state. */
+void mutex_init(mutex_t *mutex);
+
+/** @brief Acquires the mutex, blocking (or spinning, see above) while it is held. */
+void mutex_lock(mutex_t *mutex);
+
+/** @brief Releases the mutex, handing it to the longest-waiting task if any. */
+void mutex_unlock(mutex_t *mutex);
+
+#endif /* MUTEX_H */
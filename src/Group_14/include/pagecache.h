@@ -0,0 +1,60 @@
+#pragma once
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+/**
+ * @file pagecache.h
+ * @brief Page cache: whole file pages in physical frames.
+ *
+ * Pages are keyed by file identity (vfs_identify) and page index, so every
+ * open of a file, and every process mapping it, shares one frame per page.
+ * The cache owns one frame reference per page; pagecache_get_page hands the
+ * caller another, which it keeps for as long as a PTE points at the frame.
+ *
+ * Drivers that support identify must invalidate pages whenever file data
+ * changes (write, truncate, unlink). Frames that are still mapped survive
+ * invalidation: those mappings keep the data they faulted in.
+ *
+ * The cache holds at most PAGECACHE_PAGES frames, recycled in LRU order.
+ */
+
+#include "types.h"
+#include "vfs.h"
+
+#define PAGECACHE_PAGES     1024  // Frames the cache may hold (4MB)
+#define PAGECACHE_BUCKETS   512   // Power of two
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t fills;           // Pages read from the filesystem and cached
+    uint32_t evictions;       // Pages recycled to make room
+    uint32_t invalidations;   // Pages dropped by pagecache_invalidate*
+    uint32_t pages;           // Pages currently cached
+} pagecache_stats_t;
+
+/** @brief Initialises the cache. Called once from vfs_init. */
+void pagecache_init(void);
+
+/**
+ * @brief Gets the frame holding one page of a file, reading it on a miss.
+ * Bytes past end of file read as zero.
+ * @param offset Page-aligned file offset.
+ * @param phys_out Receives the frame; the caller owns one reference to it
+ *                 (put_frame when done).
+ * @return FS_SUCCESS or a negative FS_ERR_* code.
+ */
+int pagecache_get_page(file_t *file, off_t offset, uintptr_t *phys_out);
+
+/** @brief Drops the cached pages of a file that overlap [offset, offset + len). */
+void pagecache_invalidate_range(const void *sb, uint64_t ino, off_t offset, size_t len);
+
+/** @brief Drops every cached page of a file (truncate, unlink). */
+void pagecache_invalidate_file(const void *sb, uint64_t ino);
+
+/** @brief Drops every cached page of a filesystem (e.g. on unmount). */
+void pagecache_invalidate_fs(const void *sb);
+
+void pagecache_get_stats(pagecache_stats_t *stats);
+
+#endif // PAGECACHE_H
@@ -10,6 +10,8 @@
  extern "C" {
  #endif
 
+ struct mmu_gather; // mmu_gather.h
+
  // --- Page Size Definitions ---
  #ifndef PAGE_SIZE
  #define PAGE_SIZE 4096u
@@ -185,14 +187,50 @@
  void paging_activate(uint32_t *page_directory_phys); // Implemented in ASM
 
  // Mapping and Unmapping
+ /**
+  * @brief Maps a physically contiguous range.
+  * Every 4MB-aligned (virtual and physical) stretch whose PDE is still empty is
+  * mapped with a single PSE PDE. This is automatic for kernel ranges; user
+  * ranges opt in by passing PAGE_SIZE_4MB in flags.
+  */
  int paging_map_range(uint32_t *page_directory_phys, uintptr_t virt_start_addr, uintptr_t phys_start_addr, size_t memsz, uint32_t flags);
+ /**
+  * @brief Unmaps a user range and drops one reference per mapped frame.
+  * A 4MB page that is only partly covered is split into 4KB PTEs first.
+  */
  int paging_unmap_range(uint32_t *page_directory_phys, uintptr_t virt_start_addr, size_t memsz);
+ /**
+  * @brief paging_unmap_range() variant that queues invalidations and frames on
+  * a caller-owned mmu_gather (see mmu_gather.h) instead of flushing per page.
+  * The directory is tlb->pd_phys; the caller runs mmu_gather_finish().
+  */
+ int paging_unmap_range_gather(struct mmu_gather *tlb, uintptr_t virt_start_addr, size_t memsz);
  int paging_map_single_4k(uint32_t *page_directory_phys, uintptr_t vaddr, uintptr_t paddr, uint32_t flags);
 
+ /**
+  * @brief Replaces a user 4MB PDE with a PT of 1024 4KB PTEs mapping the same
+  * frames with the same permissions.
+  * @param pd_virt Virtual address of the page directory (current or temp-mapped).
+  * @param pd_idx  Index of the PDE to split (must be below KERNEL_PDE_INDEX).
+  * @return 0 on success, negative error code otherwise.
+  */
+ int paging_split_large_pde(uint32_t *pd_virt, uint32_t pd_idx);
+
  // Utilities and Process Management
  void page_fault_handler(registers_t *regs);
  void paging_free_user_space(uint32_t *page_directory_phys);
  uintptr_t paging_clone_directory(uint32_t* src_pd_phys);
+
+ /**
+  * @brief Copies the user mappings of [start, end) from one page directory to
+  * another, sharing the frames (each gains a reference) instead of their data.
+  * @param cow Write-protect writable pages in both directories so the first
+  *            write to either copy takes a copy-on-write fault.
+  * @return 0 on success, negative error code otherwise (mappings copied so far
+  *         stay in place for the caller's teardown).
+  */
+ int paging_copy_range_cow(uint32_t *dst_pd_phys, uint32_t *src_pd_phys,
+                           uintptr_t start, uintptr_t end, bool cow);
  int paging_get_physical_address(uint32_t *page_directory_phys, uintptr_t vaddr, uintptr_t *paddr);
  void copy_kernel_pde_entries(uint32_t *new_pd_virt);
 
@@ -225,6 +263,11 @@
   */
  void paging_temp_unmap(void* temp_vaddr);
 
+ /**
+  * @brief Translates vaddr and returns the flags of the entry that maps it.
+  * For an address inside a 4MB page the PDE flags are returned, so
+  * PAGE_SIZE_4MB is set in *flags_out.
+  */
  int paging_get_physical_address_and_flags(uint32_t *page_directory_phys,
     uintptr_t vaddr,
     uintptr_t *paddr_out,
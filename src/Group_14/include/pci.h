@@ -0,0 +1,57 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "types.h"
+
+/**
+ * @file pci.h
+ * @brief Minimal PCI configuration-space access (mechanism #1, ports 0xCF8/0xCFC).
+ */
+
+#define PCI_CONFIG_ADDRESS   0xCF8
+#define PCI_CONFIG_DATA      0xCFC
+
+// --- Configuration Space Offsets ---
+#define PCI_VENDOR_ID        0x00
+#define PCI_DEVICE_ID        0x02
+#define PCI_COMMAND          0x04
+#define PCI_PROG_IF          0x09
+#define PCI_SUBCLASS         0x0A
+#define PCI_CLASS            0x0B
+#define PCI_HEADER_TYPE      0x0E
+#define PCI_BAR0             0x10
+#define PCI_BAR4             0x20
+
+// --- Command Register Bits ---
+#define PCI_CMD_IO_SPACE     0x0001
+#define PCI_CMD_BUS_MASTER   0x0004
+
+#define PCI_BAR_IO           0x1        // BAR bit 0: I/O space
+#define PCI_BAR_IO_MASK      0xFFFFFFFCu
+
+// --- Class Codes ---
+#define PCI_CLASS_STORAGE    0x01
+#define PCI_SUBCLASS_IDE     0x01
+
+/** @brief Location of a PCI function. */
+typedef struct {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+} pci_addr_t;
+
+uint32_t pci_config_read32(pci_addr_t addr, uint8_t offset);
+uint16_t pci_config_read16(pci_addr_t addr, uint8_t offset);
+uint8_t  pci_config_read8(pci_addr_t addr, uint8_t offset);
+void     pci_config_write32(pci_addr_t addr, uint8_t offset, uint32_t value);
+void     pci_config_write16(pci_addr_t addr, uint8_t offset, uint16_t value);
+
+/**
+ * @brief Finds the first function with the given class and subclass.
+ * Scans every bus/device/function by brute force.
+ * @param out Receives the function's location.
+ * @return true if a matching function exists.
+ */
+bool pci_find_class(uint8_t class_code, uint8_t subclass, pci_addr_t *out);
+
+#endif // PCI_H
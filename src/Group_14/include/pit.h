@@ -42,6 +42,28 @@
 #define DIVIDER              (PIT_BASE_FREQUENCY / TARGET_FREQUENCY)
 #define TICKS_PER_MS         (TARGET_FREQUENCY / 1000)
 
+/**
+ * Dynamic tick (tickless) mode:
+ * PIT_TICKLESS           = 1 lets the scheduler stop the periodic tick while
+ *                          no task is waiting for the CPU. Channel 0 is then
+ *                          programmed one-shot to the next timer deadline, and
+ *                          the ticks that pass are credited from the PIT count.
+ * PIT_ONESHOT_MAX_TICKS  = longest one-shot period; the 16-bit counter holds
+ *                          about 54 ms at the PIT base frequency.
+ */
+#ifndef PIT_TICKLESS
+#define PIT_TICKLESS         1
+#endif
+#define PIT_ONESHOT_MAX_TICKS 50
+
+typedef struct {
+    uint32_t irqs;             // Channel 0 interrupts taken
+    uint32_t oneshots;         // One-shot periods programmed
+    uint32_t oneshot_expiries; // One-shot periods that ran to the end
+    uint32_t early_restarts;   // One-shot periods cut short by pit_tick_restart
+    uint32_t stopped_ticks;    // Ticks credited from the count while the tick was stopped
+} pit_stats_t;
+
 /**
  * init_pit
  *
@@ -80,6 +102,46 @@ void sleep_busy(uint32_t milliseconds);
  */
 void sleep_interrupt(uint32_t milliseconds);
 
+/**
+ * pit_tick_stop
+ *
+ * Stops the periodic tick: the next interrupt comes after 'ticks' ticks
+ * (clamped to 1..PIT_ONESHOT_MAX_TICKS). Calling it again while stopped
+ * credits the time that has passed and re-arms. No-op unless PIT_TICKLESS.
+ * Must be called with interrupts disabled, on the CPU that takes IRQ 0.
+ */
+void pit_tick_stop(uint32_t ticks);
+
+/**
+ * pit_tick_restart
+ *
+ * Credits the ticks that passed while stopped and returns to the periodic
+ * tick. No-op if the tick is running. Must be called with interrupts disabled.
+ */
+void pit_tick_restart(void);
+
+/**
+ * pit_tick_sync
+ *
+ * Credits the whole ticks that have passed while stopped, without changing
+ * the mode, so scheduler_get_ticks() is current. Must be called with
+ * interrupts disabled.
+ */
+void pit_tick_sync(void);
+
+/**
+ * pit_busy_wait_us
+ *
+ * Spins for 'us' microseconds timed by PIT channel 2. Works with interrupts
+ * disabled and before the scheduler runs.
+ */
+void pit_busy_wait_us(uint32_t us);
+
+/** True while the periodic tick is stopped. */
+bool pit_tick_stopped(void);
+
+void pit_get_stats(pit_stats_t *stats);
+
 /* Functions removed as the scheduler now controls its own readiness:
  * - pit_set_scheduler_ready()
  * - pit_is_scheduler_ready()
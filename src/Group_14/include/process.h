@@ -5,6 +5,7 @@
 
 #include "types.h"      // Include necessary base types
 #include "paging.h"      // Include for PAGE_SIZE, KERNEL_SPACE_VIRT_START, registers_t
+#include "isr_frame.h"   // isr_frame_t (process_fork)
 // #include "fs_limits.h"   // Define MAX_FD directly below instead
 
 // Forward declare mm_struct to avoid circular dependency with mm.h if needed
@@ -44,8 +45,10 @@ typedef enum {
 // === Process Control Block (PCB) Structure ===
 typedef struct pcb {
     uint32_t pid;                   // Process ID
+    uint32_t parent_pid;            // PID of the forking process (0 for processes started by the kernel)
     uint32_t *page_directory_phys;  // Physical address of the process's page directory
     uint32_t entry_point;           // Virtual address of the program's entry point
+    bool is_kernel_thread;          // Runs only in ring 0 on the kernel page directory (no user stack)
     void *user_stack_top;           // Virtual address for the initial user ESP setting
 
     // Per-process file descriptor table
@@ -90,6 +93,28 @@ typedef struct pcb {
  */
 pcb_t *create_user_process(const char *path);
 
+/**
+ * @brief Creates a copy-on-write child of a process (the fork() backend).
+ * The child gets a copy of the parent's page tables and VMAs (the frames are
+ * shared), references to all of its open files, and a kernel stack that
+ * returns to user mode from the same syscall with EAX = 0.
+ *
+ * @param parent The calling process.
+ * @param parent_regs The parent's INT 0x80 frame.
+ * @return The child's PCB (not yet scheduled), or NULL on failure.
+ */
+pcb_t *process_fork(pcb_t *parent, const isr_frame_t *parent_regs);
+
+/**
+ * @brief Creates a kernel thread: a PCB on the kernel page directory with its
+ * own kernel stack, whose first switch-in calls @p entry in ring 0 with
+ * interrupts enabled. @p entry must never return.
+ *
+ * @param entry The thread's main function.
+ * @return The thread's PCB (hand it to scheduler_add_task), or NULL on failure.
+ */
+pcb_t *create_kernel_thread(void (*entry)(void));
+
 /**
  * @brief Destroys a process and frees all associated resources.
  * Frees memory space (VMAs, page tables, frames), kernel stack, page directory, and PCB.
@@ -5,13 +5,14 @@
 #include "process.h" // Include process header for pcb_t definition
 #include <libc/stdint.h>
 #include <libc/stdbool.h> // Ensure bool is included
+#include "timer.h"
 
 // --- Enhanced Task States ---
 typedef enum {
     TASK_READY,     // Ready to run (in a run queue)
     TASK_RUNNING,   // Currently executing
     TASK_BLOCKED,   // Waiting for an event (in a wait queue, not run queue)
-    TASK_SLEEPING,  // Sleeping until a specific time (in the sleep queue)
+    TASK_SLEEPING,  // Sleeping until a specific time (sleep_timer armed)
     TASK_ZOMBIE,    // Terminated, resources awaiting cleanup
     TASK_EXITING    // Intermediate state during termination (optional)
 } task_state_e; // Changed name to avoid conflict if task_state_t is used elsewhere
@@ -24,19 +25,26 @@ typedef struct tcb {
     uint32_t       pid;          // Process ID
 
     // Execution Context
-    uint32_t      *esp;          // Saved kernel stack pointer
+    uint32_t      *esp;          // Saved kernel stack pointer; NULL while the task is on a CPU (see scheduler.c)
 
     // State & Scheduling Parameters
     task_state_e   state;        // Current state
     bool           in_run_queue; // <<< ADDED: True if task is currently in a run queue
     bool           has_run;      // True if task has executed at least once
-    uint8_t        priority;     // Task priority (0=highest)
+    uint8_t        priority;     // Task priority (0=highest); moved by the MLFQ rules in scheduler.c
+    uint8_t        cpu;          // CPU whose run queue the task is in, or last ran on
     uint32_t       time_slice_ticks; // Current time slice allocation in ticks
     uint32_t       ticks_remaining; // Ticks left in current time slice
 
     // Statistics & Sleep
     uint32_t       runtime_ticks;  // Total runtime in ticks
+    uint32_t       wait_ticks;     // Total ticks spent ready in a run queue, not running
+    uint32_t       max_wait_ticks; // Longest single stretch from ready to running
+    uint32_t       dispatch_count; // Times the task was picked to run
+    uint32_t       ready_since;    // Tick the task last entered a run queue
+    uint32_t       last_aged;      // Tick the task last moved up by aging
     uint32_t       wakeup_time;    // Absolute tick count when to wake up (if SLEEPING)
+    ktimer_t       sleep_timer;    // Armed by sleep_ms; wakes the task
     uint32_t       exit_code;      // Exit code when ZOMBIE
 
     // Wait Queue Links (used for BLOCKED state on mutexes, semaphores, etc.)
@@ -55,9 +63,28 @@ typedef struct tcb {
 
 // --- Public Function Prototypes ---
 
-/** @brief Initializes the scheduler subsystem. */
+typedef struct {
+    uint32_t dispatches;     // Tasks picked to run on this CPU
+    uint32_t steals;         // Tasks taken from another CPU's queue while idle
+    uint32_t pulls;          // Tasks moved here by the periodic load balance
+    uint32_t ipis;           // Reschedule IPIs sent to this CPU
+} sched_cpu_stats_t;
+
+/** @brief Initializes the scheduler subsystem (run queue and idle task of the BSP). */
 void scheduler_init(void);
 
+/**
+ * @brief Prepares the run queue and idle task of CPU @p cpu. Called by the
+ * BSP for each AP before starting it.
+ */
+void scheduler_init_cpu(uint32_t cpu);
+
+/**
+ * @brief Enters the executing AP's idle task; from there it takes work from
+ * its own run queue or steals from the others.
+ */
+void scheduler_start_cpu(void) __attribute__((noreturn));
+
 /**
  * @brief Creates a TCB for a given process and adds it to the scheduler.
  * @param pcb Pointer to the Process Control Block to schedule.
@@ -106,16 +133,46 @@ bool scheduler_is_ready(void);
 /** @brief Marks the scheduler as ready to perform context switching. */
 void scheduler_start(void);
 
+/**
+ * @brief True if the caller may block until another task or an IRQ wakes it.
+ * Early boot, the idle task and anyone holding a spinlock must poll instead.
+ */
+bool scheduler_can_block(void);
+
 /**
  * @brief Scheduler's timer tick routine.
- * @details Called by the timer interrupt handler. Updates ticks, checks
- * sleeping tasks, manages time slices, and triggers preemption.
+ * @details Called by the PIT interrupt handler on the BSP. Updates the global
+ * tick count, runs the timers due, then does the BSP's local tick.
  * @note Must be called with interrupts disabled.
  */
 void scheduler_tick(void);
 
 /**
- * @brief Returns the current system tick count.
+ * @brief Per-CPU part of the tick: aging and load balancing of this CPU's run
+ * queue, time slice accounting and preemption. The APs call it from their
+ * local APIC timer.
+ * @note Must be called with interrupts disabled.
+ */
+void scheduler_local_tick(void);
+
+/**
+ * @brief Chooses the tick mode of the executing CPU: the BSP's PIT stops
+ * while no task is waiting for any CPU, an AP's local timer while it idles.
+ * @note Must be called with interrupts disabled.
+ */
+void scheduler_update_tick(void);
+
+/**
+ * @brief Credits ticks that passed without a tick interrupt (tickless mode)
+ * to the tick count and, on the BSP, to its running task. Timers due in that
+ * time run on the next scheduler_tick().
+ * @note Must be called with interrupts disabled.
+ */
+void scheduler_account_ticks(uint32_t ticks);
+
+/**
+ * @brief Returns the current system tick count, caught up from the PIT if
+ * the periodic tick is stopped.
  * @return The volatile tick count.
  */
 uint32_t scheduler_get_ticks(void);
@@ -124,10 +181,8 @@ uint32_t scheduler_get_ticks(void);
 // --- External Declarations ---
 extern volatile bool g_scheduler_ready;
 
-extern volatile bool g_need_reschedule;
-
 // --- External Assembly Function Prototypes ---
-extern void jump_to_user_mode(uint32_t *kernel_stack_ptr, uint32_t *page_directory_phys);
+extern void jump_to_user_mode(uint32_t **old_esp_ptr, uint32_t *kernel_stack_ptr, uint32_t *page_directory_phys);
 extern void context_switch(uint32_t **old_esp_ptr, uint32_t *new_esp, uint32_t *new_page_directory);
 
 /**
@@ -137,5 +192,21 @@ extern void context_switch(uint32_t **old_esp_ptr, uint32_t *new_esp, uint32_t *
  */
  void scheduler_unblock_task(tcb_t *task);
 
+/**
+ * @brief Waits for a forked child to exit and releases it.
+ * @details Blocks the caller until the task with @p child_pid is a ZOMBIE
+ * (its exit wakes the caller), then unlinks it, destroys its process and
+ * frees its TCB. Zombies whose parent is still
+ * alive are left for this call instead of the idle task's reaper.
+ * @param parent_pid PID of the calling process; must be the child's parent.
+ * @param child_pid PID of the child to wait for.
+ * @param exit_code_out Receives the child's exit code (may be NULL).
+ * @return 0 on success, negative if @p child_pid is not a child of @p parent_pid.
+ */
+int scheduler_reap_child(uint32_t parent_pid, uint32_t child_pid, uint32_t *exit_code_out);
+
+/** @brief Retrieves the scheduler statistics of CPU @p cpu. */
+void scheduler_get_cpu_stats(uint32_t cpu, sched_cpu_stats_t *stats);
+
 
 #endif // SCHEDULER_H
\ No newline at end of file
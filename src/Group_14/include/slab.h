@@ -3,6 +3,7 @@
 
 #include "types.h" // Includes size_t, bool,stdint.h, etc.
 #include "spinlock.h" // Include spinlock header
+#include "get_cpu_id.h" // For MAX_CPUS
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +12,38 @@ extern "C" {
 // Forward declaration for slab_t used internally by slab.c
 typedef struct slab slab_t;
 
+// Number of object pointers ("rounds") a magazine holds.
+#ifndef SLAB_MAGAZINE_SIZE
+#define SLAB_MAGAZINE_SIZE 15
+#endif
+
+// Full magazines kept in a cache's depot before the surplus is flushed back to slabs.
+#ifndef SLAB_DEPOT_MAX_FULL
+#define SLAB_DEPOT_MAX_FULL 8
+#endif
+
+/**
+ * @brief A magazine: a small LIFO stack of free, constructed objects.
+ */
+typedef struct slab_magazine {
+    struct slab_magazine *next; // Link for depot lists
+    unsigned int rounds;        // Number of valid entries in objs[]
+    void *objs[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+/**
+ * @brief Per-CPU magazine pair for one cache (Bonwick "loaded" and "previous").
+ * Only ever touched by its own CPU with interrupts disabled, so no lock is needed.
+ */
+typedef struct slab_cpu_cache {
+    slab_magazine_t *loaded;    // Magazine allocations pop from / frees push to
+    slab_magazine_t *previous;  // Kept full or empty; swapped in before visiting the depot
+    unsigned long alloc_count;  // Objects handed out on this CPU
+    unsigned long free_count;   // Objects returned on this CPU
+    unsigned long mag_hits;     // Operations served without taking the cache lock
+    unsigned long mag_misses;   // Operations that had to visit the depot or the slabs
+} slab_cpu_cache_t;
+
 /**
  * @brief Structure representing a slab cache.
  */
@@ -30,12 +63,20 @@ typedef struct slab_cache {
     unsigned int color_next;    // Next color offset to use for a new slab.
     unsigned int color_range;   // Range of color offsets (e.g., cache line size).
 
-    // Statistics
-    unsigned long alloc_count;  // Total objects allocated.
-    unsigned long free_count;   // Total objects freed back.
+    // Statistics (slab layer: objects leaving/returning to slab pages; under lock)
+    unsigned long alloc_count;  // Total objects taken from slabs.
+    unsigned long free_count;   // Total objects returned to slabs.
+
+    // Magazine Layer
+    slab_cpu_cache_t cpu_caches[MAX_CPUS]; // Per-CPU loaded/previous magazines (lock-free)
+    slab_magazine_t *depot_full;  // Depot: full magazines (under lock)
+    slab_magazine_t *depot_empty; // Depot: empty magazines (under lock)
+    unsigned int depot_full_count;
+    unsigned long bypass_alloc_count; // Allocations from CPUs without a magazine slot (under lock)
+    unsigned long bypass_free_count;  // Frees from CPUs without a magazine slot (under lock)
 
     // Concurrency Control
-    spinlock_t lock;            // Spinlock to protect cache metadata and lists.
+    spinlock_t lock;            // Spinlock to protect cache metadata, slab lists and the depot.
 
     // Optional: Constructor/Destructor function pointers
     void (*constructor)(void *obj);
@@ -66,8 +107,11 @@ slab_cache_t *slab_create(const char *name, size_t obj_size, size_t align,
 /**
  * slab_alloc
  *
- * Allocates one object from the cache. Writes metadata (e.g., footer canary).
- * Calls constructor if provided. Thread-safe via internal locking.
+ * Allocates one object from the cache. The fast path pops from the current
+ * CPU's magazine with only interrupts disabled; the cache lock is taken only
+ * to exchange magazines with the depot or to refill from the slabs.
+ * Constructors run when an object leaves the slab layer, so objects cached in
+ * magazines stay constructed.
  *
  * @param cache Pointer to the slab cache.
  * @return Pointer to the allocated object (start of user area), or NULL on failure.
@@ -77,8 +121,9 @@ void *slab_alloc(slab_cache_t *cache);
 /**
  * slab_free
  *
- * Frees an object back into its slab cache. Checks metadata (e.g., footer canary).
- * Calls destructor if provided. Thread-safe via internal locking.
+ * Frees an object back into its slab cache. Checks metadata (e.g., footer canary)
+ * and then pushes the object onto the current CPU's magazine. Objects only go
+ * back to their slab (running the destructor) when magazines are flushed.
  *
  * @param cache Pointer to the slab cache (recommended, but can be NULL if metadata reliable).
  * @param obj   Pointer to the object (start of user area) previously allocated.
@@ -98,13 +143,17 @@ void slab_destroy(slab_cache_t *cache);
 /**
  * slab_cache_stats
  *
- * Retrieves allocation and free counts. Thread-safe via internal locking.
+ * Retrieves allocation/free counts and magazine hit/miss counts. Per-CPU
+ * counters are summed without stopping other CPUs, so the result is a snapshot.
  *
  * @param cache      Pointer to the slab cache.
  * @param out_alloc  Pointer to store the total allocation count (can be NULL).
  * @param out_free   Pointer to store the total free count (can be NULL).
+ * @param out_hits   Pointer to store operations served by a magazine (can be NULL).
+ * @param out_misses Pointer to store operations that took the cache lock (can be NULL).
  */
-void slab_cache_stats(slab_cache_t *cache, unsigned long *out_alloc, unsigned long *out_free);
+void slab_cache_stats(slab_cache_t *cache, unsigned long *out_alloc, unsigned long *out_free,
+                      unsigned long *out_hits, unsigned long *out_misses);
 
 
 #ifdef __cplusplus
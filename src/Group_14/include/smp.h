@@ -0,0 +1,103 @@
+#pragma once
+#ifndef SMP_H
+#define SMP_H
+
+/**
+ * @file smp.h
+ * @brief Per-CPU state and application processor (AP) bring-up.
+ *
+ * Every CPU has a cpu_t in g_cpus[]. Its GDT (gdt.c) holds a small data
+ * segment, GDT_PERCPU_SELECTOR, whose base is that cpu_t, and kernel code
+ * keeps GS loaded with it: the interrupt, exception and syscall stubs reload
+ * GS on entry, so %gs:0 always names the CPU the code is running on.
+ *
+ * A task can move to another CPU whenever it is preempted or blocks, so a
+ * cpu_t pointer is only stable while interrupts are disabled. Fields read
+ * from preemptible code go through a single GS-relative load
+ * (this_cpu_current).
+ */
+
+#include "types.h"
+#include "gdt.h"
+#include "get_cpu_id.h" // MAX_CPUS
+
+struct tcb;
+
+typedef struct cpu {
+    struct cpu   *self;            // Offset 0: this_cpu() reads it through GS
+    volatile bool need_resched;    // Offset 4: tested by syscall.asm as byte [gs:4]
+    uint32_t      index;           // Position in g_cpus; 0 is the bootstrap processor (BSP)
+    uint32_t      apic_id;         // Local APIC ID
+    volatile bool online;          // Set by the CPU itself at the end of bring-up
+    uint32_t      spinlocks_held;  // See spinlock_held_count()
+    struct tcb   *current;         // Task running on this CPU
+    struct tcb   *idle;            // This CPU's idle task
+} cpu_t;
+
+_Static_assert(__builtin_offsetof(cpu_t, self) == 0, "this_cpu() reads cpu_t.self at %gs:0");
+_Static_assert(__builtin_offsetof(cpu_t, need_resched) == 4, "syscall.asm tests cpu_t.need_resched at [gs:4]");
+
+typedef struct {
+    uint32_t cpus_found;      // Enabled CPUs the firmware reported
+    uint32_t cpus_online;     // CPUs running the scheduler (BSP included)
+    uint32_t cpus_failed;     // APs that did not answer INIT-SIPI-SIPI
+    uint32_t ipis_sent;       // Reschedule IPIs
+} smp_stats_t;
+
+extern cpu_t g_cpus[MAX_CPUS];
+
+/** @brief True once GS holds the per-CPU segment (after gdt_init on this CPU). */
+static inline bool percpu_gs_loaded(void) {
+    uint16_t gs;
+    asm volatile("mov %%gs, %0" : "=r"(gs));
+    return gs == GDT_PERCPU_SELECTOR;
+}
+
+/**
+ * @brief The cpu_t of the executing CPU. Before gdt_init has loaded GS this is
+ * the BSP's entry. Only meaningful while interrupts are disabled.
+ */
+static inline cpu_t *this_cpu(void) {
+    if (!percpu_gs_loaded()) return &g_cpus[0];
+    cpu_t *cpu;
+    asm volatile("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/**
+ * @brief The task running on the executing CPU, read in one instruction so
+ * the answer is right even if the caller is preempted and migrated.
+ */
+static inline struct tcb *this_cpu_current(void) {
+    if (!percpu_gs_loaded()) return g_cpus[0].current;
+    struct tcb *task;
+    asm volatile("movl %%gs:%c1, %0" : "=r"(task) : "i"(__builtin_offsetof(cpu_t, current)));
+    return task;
+}
+
+/** @brief Number of CPUs running the scheduler, the BSP included. */
+uint32_t smp_cpu_count(void);
+
+/**
+ * @brief Finds the CPUs (ACPI MADT, else the MP table), switches interrupt
+ * delivery to the local APIC and IOAPIC and starts every AP it can, each with
+ * its own GDT, TSS and idle task. Without an APIC the system stays on the BSP
+ * and the 8259 PIC. Called once from main after scheduler_start and before
+ * interrupts are enabled.
+ * @param rsdp Copy of the ACPI RSDP from the Multiboot2 information, or NULL
+ *             to search the BIOS areas for it.
+ */
+void smp_init(const void *rsdp);
+
+/** @brief C entry point of an AP, reached from ap_trampoline.asm. */
+void ap_main(uint32_t cpu_index) __attribute__((noreturn));
+
+/**
+ * @brief Sends a reschedule IPI to CPU @p cpu_index. The target calls
+ * schedule() if its need_resched is set, else rechecks its tick mode.
+ */
+void smp_send_resched(uint32_t cpu_index);
+
+void smp_get_stats(smp_stats_t *stats);
+
+#endif // SMP_H
@@ -40,6 +40,15 @@ uintptr_t spinlock_acquire_irqsave(spinlock_t *lock);
  */
 void spinlock_release_irqrestore(spinlock_t *lock, uintptr_t flags);
 
+/**
+ * @brief Number of spinlocks currently held on this CPU.
+ *
+ * Code that wants to block (schedule away until an event) must only do so
+ * when this is zero: a task spinning on a lock held by a sleeping task would
+ * spin with interrupts disabled forever.
+ */
+uint32_t spinlock_held_count(void);
+
 /**
  * @brief Helper function to disable local interrupts and return previous flags.
  * IMPLEMENTATION DEPENDENT (likely requires inline assembly).
@@ -71,4 +80,30 @@ static inline void local_irq_restore(uintptr_t flags) {
     );
 }
 
+/*
+ * Atomic read-modify-write on 32-bit words, for counters shared between CPUs.
+ * The kernel is built with -march=i386, for which GCC turns __atomic_fetch_add
+ * and compare-exchange into libatomic calls; XADD and CMPXCHG exist on every
+ * CPU that has a local APIC, so they are written out here.
+ */
+
+/** @brief Adds @p delta to @p *ptr atomically. @return The previous value. */
+static inline uint32_t atomic_fetch_add_u32(volatile uint32_t *ptr, uint32_t delta) {
+    asm volatile ("lock xaddl %0, %1" : "+r" (delta), "+m" (*ptr) : : "memory", "cc");
+    return delta;
+}
+
+/**
+ * @brief Stores @p desired in @p *ptr if it still holds @p expected.
+ * @return true if the store happened.
+ */
+static inline bool atomic_cmpxchg_u32(volatile uint32_t *ptr, uint32_t expected, uint32_t desired) {
+    uint32_t prev;
+    asm volatile ("lock cmpxchgl %2, %1"
+                  : "=a" (prev), "+m" (*ptr)
+                  : "r" (desired), "0" (expected)
+                  : "memory", "cc");
+    return prev == expected;
+}
+
 #endif // SPINLOCK_H
\ No newline at end of file
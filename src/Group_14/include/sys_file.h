@@ -38,6 +38,7 @@ extern "C" {
 typedef struct sys_file {
     file_t *vfs_file;
     int flags;
+    uint32_t refcount;  // fd table slots pointing here (fork shares one sys_file_t)
 } sys_file_t;
 
 
@@ -47,6 +48,21 @@ ssize_t sys_read(int fd, void *kbuf, size_t count);
 ssize_t sys_write(int fd, const void *kbuf, size_t count);
 int sys_close(int fd);
 off_t sys_lseek(int fd, off_t offset, int whence);
+int sys_fsync(int fd);
+int sys_sync(void);
+int32_t sys_mmap(uintptr_t addr, size_t length, uint32_t prot, uint32_t flags, int fd, size_t offset);
+int sys_munmap(uintptr_t addr, size_t length);
+
+/**
+ * @brief Takes another reference to an open file (e.g. for a forked child's fd table).
+ */
+void sys_file_get(sys_file_t *sf);
+
+/**
+ * @brief Drops a reference; the last one closes the VFS file and frees @p sf.
+ * @return 0, or the vfs_close result when this was the last reference.
+ */
+int sys_file_put(sys_file_t *sf);
 
 
 #ifdef __cplusplus
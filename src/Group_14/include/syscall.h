@@ -2,6 +2,7 @@
 #define SYSCALL_H
 
 #include <libc/stdint.h> // For int32_t, uint32_t
+#include <libc/stdbool.h>
 #include "isr_frame.h"   // For isr_frame_t
 
 // Define MAX_SYSCALLS if not already defined elsewhere (e.g., in a config file)
@@ -12,6 +13,7 @@
 
 // Syscall numbers (ensure these match your definitions in hello.c and elsewhere)
 #define SYS_EXIT    1
+#define SYS_FORK    2
 #define SYS_READ    3
 #define SYS_WRITE   4
 #define SYS_OPEN    5
@@ -19,7 +21,13 @@
 #define SYS_PUTS    7
 #define SYS_LSEEK   19
 #define SYS_GETPID  20
+#define SYS_SYNC    36  // Same number as Linux
+#define SYS_MMAP    90  // Linux's old_mmap: EBX points to the six arguments (see syscall.c)
+#define SYS_MUNMAP  91  // Same number as Linux
 #define SYS_READ_TERMINAL_LINE 21
+#define SYS_WAITPID 114 // Linux uses 7, which is SYS_PUTS here; 114 is Linux's wait4
+#define SYS_FSYNC   118 // Same number as Linux
+#define SYS_NANOSLEEP 162 // Same number as Linux; rounded up to whole milliseconds
 // Add other syscall numbers here as needed
 
 /**
@@ -37,9 +45,19 @@ typedef int32_t (*syscall_fn_t)(uint32_t arg1_ebx, uint32_t arg2_ecx, uint32_t a
  */
 void syscall_init(void);
 
+/**
+ * @brief Points the executing CPU's SYSENTER MSRs at sysenter_entry, if the
+ * CPU supports SYSENTER. syscall_init does this for the BSP; each AP calls it
+ * while coming online.
+ */
+void syscall_init_cpu(void);
+
+/** @brief True if the CPU implements SYSENTER/SYSEXIT (CPUID SEP). */
+bool syscall_sysenter_supported(void);
+
 /**
  * @brief The C-level system call dispatcher.
- * This function is called from the assembly interrupt handler (int 0x80).
+ * This function is called from the assembly entry stubs (int 0x80 and sysenter).
  * It identifies the syscall number and calls the appropriate handler.
  *
  * @param regs Pointer to the interrupt stack frame containing all saved registers.
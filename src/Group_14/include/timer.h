@@ -0,0 +1,83 @@
+#pragma once
+#ifndef TIMER_H
+#define TIMER_H
+
+/**
+ * @file timer.h
+ * @brief Kernel timers on a hierarchical timing wheel.
+ *
+ * A timer runs a callback once, at the first scheduler tick at or after its
+ * expiry tick. Callbacks run from the timer interrupt with interrupts
+ * disabled and no timer lock held, so they may add or cancel timers
+ * (including their own) but must not sleep.
+ *
+ * Adding, cancelling and expiring a timer are O(1). Timers due within 256
+ * ticks sit in the first wheel level; later ones sit in coarser levels and
+ * are cascaded down as the wheel turns, so each timer moves at most four
+ * times during its life.
+ *
+ * The caller owns the ktimer_t (usually embedded in a larger object) and must
+ * cancel it before freeing that object.
+ */
+
+#include "types.h"
+
+struct ktimer;
+typedef void (*ktimer_fn_t)(struct ktimer *timer, void *arg);
+
+typedef struct ktimer {
+    struct ktimer *next;      // Next timer in the same wheel slot
+    struct ktimer **pprev;    // Link pointing at this timer; NULL when not pending
+    uint32_t expires;         // Absolute scheduler tick
+    ktimer_fn_t fn;
+    void *arg;
+} ktimer_t;
+
+typedef struct {
+    uint32_t pending;         // Timers currently armed
+    uint32_t added;
+    uint32_t cancelled;       // timer_cancel calls that disarmed a pending timer
+    uint32_t expired;         // Callbacks run
+    uint32_t cascaded;        // Moves from a coarse wheel level to a finer one
+    uint32_t max_late_ticks;  // Largest gap between expiry tick and the tick the callback ran
+    uint64_t total_late_ticks;
+} timer_stats_t;
+
+/** @brief Initialises the wheel at the given tick. Called once from scheduler_init. */
+void timer_init(uint32_t now);
+
+/** @brief Prepares a timer for use. It is not pending afterwards. */
+void timer_setup(ktimer_t *timer, ktimer_fn_t fn, void *arg);
+
+/**
+ * @brief Arms a timer to fire at an absolute tick. A pending timer is moved
+ * to the new expiry. An expiry that has already passed fires on the next tick.
+ */
+void timer_add(ktimer_t *timer, uint32_t expires);
+
+/**
+ * @brief Disarms a timer.
+ * @return true if the timer was pending, false if it had already fired or
+ *         was never armed.
+ */
+bool timer_cancel(ktimer_t *timer);
+
+/** @brief True while the timer is armed and its callback has not started. */
+bool timer_pending(const ktimer_t *timer);
+
+/**
+ * @brief Runs the callbacks of every timer due at or before now. Called from
+ * scheduler_tick; ticks skipped since the last call are caught up in order.
+ */
+void timer_run(uint32_t now);
+
+/**
+ * @brief Ticks from now until the wheel next has work to do (a timer due or
+ * a cascade), capped at max_ticks; at least 1. Used to program a one-shot
+ * tick. Scans at most max_ticks first-level slots.
+ */
+uint32_t timer_ticks_until_due(uint32_t now, uint32_t max_ticks);
+
+void timer_get_stats(timer_stats_t *stats);
+
+#endif // TIMER_H
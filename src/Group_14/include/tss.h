@@ -34,12 +34,19 @@ typedef struct tss_entry {
     uint16_t iomap_base; // The I/O Map Base Address Field (in TSS's)
 } __attribute__((packed)) tss_entry_t;
 
-// Initialize the TSS
-void tss_init(void);
+// Initialize a CPU's TSS (one per CPU; see gdt.c)
+void tss_init(uint32_t cpu);
 
-// Set the kernel stack pointer stored in the TSS
+// The TSS of a CPU, for its GDT descriptor
+tss_entry_t *tss_for_cpu(uint32_t cpu);
+
+// Set the kernel stack pointer stored in the executing CPU's TSS (and its
+// SYSENTER stack). Call with interrupts disabled.
 void tss_set_kernel_stack(uint32_t stack);
 
+// Value for a CPU's IA32_SYSENTER_ESP: a word that always holds its esp0
+uint32_t tss_sysenter_stack(uint32_t cpu);
+
 // Verify that the TSS esp0 value is reasonable
 bool tss_debug_check_esp0(void);
 
@@ -8,6 +8,7 @@
 #include <libc/stdbool.h>   // For bool
 #include "types.h"
 #include "spinlock.h"       // <<< ADDED: Include for spinlock_t
+#include "mutex.h"          // mutex_t (file_t.io_lock)
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,10 +35,18 @@ typedef struct vnode vnode_t;
 typedef struct file {
     vnode_t    *vnode;    // Underlying vnode pointer
     uint32_t    flags;    // Open flags
-    off_t       offset;   // Current file offset (protected by lock)
-    spinlock_t  lock;     // <<< ADDED: Lock to protect file offset and concurrent driver access
+    off_t       offset;   // Current file offset (protected by io_lock)
+    spinlock_t  lock;     // Protects refcount
+    mutex_t     io_lock;  // Held across driver read/write/lseek, which may sleep on the disk
+    uint32_t    refcount; // vfs_open sets 1, vfs_file_dup adds one, vfs_close drops one
 } file_t;
 
+/* Identity shared by every open of the same file (page cache key) */
+typedef struct vfs_file_id {
+    const void *sb;       // Filesystem context the file lives on
+    uint64_t    ino;      // Driver-defined, unique within sb
+} vfs_file_id_t;
+
 /* VFS driver interface */
 typedef struct vfs_driver {
     const char *fs_name;  // Filesystem name (e.g., "FAT32")
@@ -57,6 +66,12 @@ typedef struct vfs_driver {
     off_t (*lseek)(file_t *file, off_t offset, int whence);
     int (*readdir)(file_t *dir_file, struct dirent *d_entry_out, size_t entry_index); // Add this
     int (*unlink)(void *fs_context, const char *path); // Add this
+    /* Fsync: makes the file's data and metadata durable. Optional. */
+    int (*fsync)(file_t *file);
+    /* Sync: makes everything written to the filesystem durable. Optional. */
+    int (*sync)(void *fs_context);
+    /* Identify: fills in the file's identity. Optional; needed for mmap. */
+    int (*identify)(file_t *file, vfs_file_id_t *id_out);
     struct vfs_driver *next;
 } vfs_driver_t;;
 
@@ -79,6 +94,11 @@ int vfs_close(file_t *file);
 int vfs_read(file_t *file, void *buf, size_t len);
 int vfs_write(file_t *file, const void *buf, size_t len);
 off_t vfs_lseek(file_t *file, off_t offset, int whence);
+int vfs_pread(file_t *file, void *buf, size_t len, off_t offset);
+file_t *vfs_file_dup(file_t *file);
+int vfs_identify(file_t *file, vfs_file_id_t *id_out);
+int vfs_fsync(file_t *file);
+int vfs_sync(void);
 
 
 #ifdef __cplusplus
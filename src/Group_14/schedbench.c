@@ -0,0 +1,97 @@
+/*
+ * schedbench.c – UiAOS User-Space Scheduling-Latency Benchmark
+ *
+ * Purpose: Measures how quickly an interactive task gets the CPU back while
+ * CPU-bound tasks are running. The interactive side is a loop of 1 ms
+ * SYS_NANOSLEEP calls; each sample is the full round trip, so anything above
+ * the sleep itself is time spent waiting behind other tasks. The loop runs
+ * once on an otherwise quiet system and once next to SB_HOGS forked children
+ * that spin without ever blocking. A quiet loop of 10 ms sleeps checks wakeup
+ * accuracy when the kernel stops the periodic tick while idle (PIT_TICKLESS):
+ * its median should stay close to ten times the 1 ms median.
+ *
+ * Rows are printed in the kernel benchmark format (see kbench.h) so
+ * scripts/run_bench.sh picks them up from COM1:
+ *
+ *   BENCH,proc,<workload>,<op>,count,avg,p50,p99,max     (TSC cycles)
+ *
+ *   sleep_1ms,quiet   nanosleep(1 ms) round trip, no other load
+ *   sleep_1ms,hog     the same with the hogs running
+ *   sleep_10ms,quiet  nanosleep(10 ms) round trip, no other load
+ *
+ * The kernel also logs each task's runtime and wait ticks when it exits.
+ * The kernel launches this program only in KERNEL_BENCH builds.
+ */
+
+#include "benchlib.h"
+
+/* ==== Benchmark Parameters ============================================== */
+ #define SB_ITERATIONS  200  /* Sleeps per row */
+ #define SB_LONG_ITERATIONS 50 /* 10 ms sleeps in the sleep_10ms row */
+ #define SB_HOGS        2    /* CPU-bound children */
+ #define SB_HOG_SLACK_MS 1000 /* Hogs outlive the measured loop by about this much */
+
+ struct timespec {
+     int32_t tv_sec;
+     int32_t tv_nsec;
+ };
+
+ static uint32_t g_samples[SB_ITERATIONS];
+
+/* ==== Helpers =========================================================== */
+ static void sleep_ms(int32_t ms) {
+     struct timespec req;
+     req.tv_sec = ms / 1000;
+     req.tv_nsec = (ms % 1000) * 1000000;
+     sys_nanosleep(&req);
+ }
+
+/* ==== Workloads ========================================================= */
+ /* Times n sleeps of ms milliseconds each into g_samples. */
+ static void run_sleeps(int32_t ms, uint32_t n) {
+     for (uint32_t i = 0; i < n; i++) {
+         uint64_t t0 = rdtsc();
+         sleep_ms(ms);
+         g_samples[i] = cycles_since(t0);
+     }
+ }
+
+ /* Child body: spins, never blocking, for the given number of cycles. */
+ static void hog(uint64_t budget_cycles) {
+     uint64_t t0 = rdtsc();
+     volatile uint32_t sink = 0;
+     while (rdtsc() - t0 < budget_cycles) sink++;
+     sys_exit(0);
+ }
+
+/* ==== Main ============================================================== */
+ int main(void) {
+     run_sleeps(1, SB_ITERATIONS);
+     report("sleep_1ms", "quiet", g_samples, SB_ITERATIONS);
+
+     /* Calibrate: the quiet median is roughly one 1 ms sleep */
+     uint64_t cycles_per_ms = g_samples[SB_ITERATIONS / 2];
+     uint64_t budget = cycles_per_ms * (SB_ITERATIONS * 2 + SB_HOG_SLACK_MS);
+
+     run_sleeps(10, SB_LONG_ITERATIONS);
+     report("sleep_10ms", "quiet", g_samples, SB_LONG_ITERATIONS);
+
+     int32_t pids[SB_HOGS];
+     int32_t started = 0;
+     for (int32_t i = 0; i < SB_HOGS; i++) {
+         int32_t pid = sys_fork();
+         if (pid == 0) hog(budget);
+         if (pid < 0) {
+             sys_puts("[schedbench] fork failed\n");
+             break;
+         }
+         pids[started++] = pid;
+     }
+
+     run_sleeps(1, SB_ITERATIONS);
+     report("sleep_1ms", "hog", g_samples, SB_ITERATIONS);
+
+     for (int32_t i = 0; i < started; i++) sys_waitpid(pids[i], 0, 0);
+     sys_puts("BENCH-USER-END\n");
+     return 0;
+ }
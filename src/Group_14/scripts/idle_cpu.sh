@@ -0,0 +1,98 @@
+#!/bin/bash
+# Boots a build headless in QEMU, lets it settle at the idle loop and reports
+# how much host CPU the guest burns while doing nothing, together with the
+# kernel's tick and timer statistics (printed by the idle task on COM1).
+# Build once with -DUIAOS_TICKLESS=ON (the default) and once with OFF to
+# compare the periodic and dynamic tick.
+#
+# Usage: idle_cpu.sh [options] <build-dir>
+#   --settle <sec>    Wait this long after the idle task starts (default: 5)
+#   --window <sec>    Measure over this many seconds (default: 10)
+#   --timeout <sec>   Give up if the idle task has not started (default: 60)
+#
+# Exit status: 0 = measured, 1 = usage/boot error.
+
+SETTLE=5
+WINDOW=10
+TIMEOUT=60
+BUILD_DIR=""
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --settle)  SETTLE="$2"; shift ;;
+        --window)  WINDOW="$2"; shift ;;
+        --timeout) TIMEOUT="$2"; shift ;;
+        -*)        echo "Unknown option: $1"; exit 1 ;;
+        *)         BUILD_DIR="$1" ;;
+    esac
+    shift
+done
+
+if [ -z "$BUILD_DIR" ]; then
+    echo "Usage: $0 [--settle <sec>] [--window <sec>] [--timeout <sec>] <build-dir>"
+    exit 1
+fi
+
+ISO="$BUILD_DIR/kernel.iso"
+DISK="$BUILD_DIR/disk.img"
+for f in "$ISO" "$DISK"; do
+    if [ ! -f "$f" ]; then
+        echo "Error: $f not found (build the kernel first)"
+        exit 1
+    fi
+done
+
+LOG=$(mktemp /tmp/uiaos-idle-log.XXXXXX)
+# QEMU writes to the disk image; keep the build output pristine
+DISK_COPY=$(mktemp /tmp/uiaos-idle-disk.XXXXXX)
+cp "$DISK" "$DISK_COPY"
+
+qemu-system-i386 -boot d \
+                 -cdrom "$ISO" \
+                 -hdb "$DISK_COPY" \
+                 -m 1024 \
+                 -display none \
+                 -monitor none \
+                 -serial file:"$LOG" &
+QEMU_PID=$!
+
+cleanup() {
+    kill "$QEMU_PID" 2>/dev/null
+    wait "$QEMU_PID" 2>/dev/null
+    rm -f "$LOG" "$DISK_COPY"
+}
+trap cleanup EXIT
+
+echo "[idle] QEMU started (PID $QEMU_PID), waiting for the idle task..."
+elapsed=0
+while ! grep -q 'Idle task started' "$LOG" 2>/dev/null; do
+    if ! kill -0 "$QEMU_PID" 2>/dev/null; then
+        echo "[idle] Error: QEMU exited before the idle task started. Serial log:"
+        cat "$LOG"
+        exit 1
+    fi
+    if [ "$elapsed" -ge "$TIMEOUT" ]; then
+        echo "[idle] Error: timed out after ${TIMEOUT}s."
+        exit 1
+    fi
+    sleep 1
+    elapsed=$((elapsed + 1))
+done
+sleep "$SETTLE"
+
+# utime + stime of the QEMU process, in clock ticks (fields 14 and 15;
+# the command name in field 2 has no spaces for qemu-system-i386)
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$QEMU_PID/stat"
+}
+
+HZ=$(getconf CLK_TCK)
+start=$(cpu_ticks)
+sleep "$WINDOW"
+end=$(cpu_ticks)
+
+awk -v d=$((end - start)) -v hz="$HZ" -v w="$WINDOW" \
+    'BEGIN { printf "[idle] Host CPU while idle: %.1f%% of one core over %ss\n", 100.0 * d / hz / w, w }'
+
+echo "[idle] Last kernel tick/timer statistics:"
+tr -d '\r' < "$LOG" | grep '^\[Idle Diagnostics\] \(Tick\|Timers\):' | tail -n 2
@@ -0,0 +1,167 @@
+#!/bin/bash
+# Boots a KERNEL_BENCH build headless in QEMU, extracts the BENCH table printed
+# on COM1 and compares it against a stored baseline.
+#
+# No baseline is committed: cycle counts depend on the host CPU and QEMU
+# version, so record one on the machine that will run the comparisons first:
+#   run_bench.sh --save-baseline <build-dir>
+#
+# Usage: run_bench.sh [options] <build-dir>
+#   --configure          Re-run cmake on <build-dir> with UIAOS_KERNEL_BENCH=ON and build it
+#   --baseline <file>    Baseline CSV (default: scripts/bench_baseline.csv)
+#   --save-baseline      Write the results of this run as the new baseline
+#   --threshold <pct>    p50 regression (in percent) that fails the run (default: 10)
+#   --timeout <sec>      Give up if BENCH-END has not appeared (default: 120)
+#   --smp <n>            Number of CPUs QEMU emulates (default: 4; smpbench scales with it)
+#
+# Exit status: 0 = no regressions (or baseline saved), 1 = usage/boot error or
+# no baseline recorded yet, 2 = regression found.
+
+SCRIPT_DIR=$(dirname "$(readlink -f "$0")")
+SOURCE_DIR=$(dirname "$SCRIPT_DIR")
+
+BASELINE="$SCRIPT_DIR/bench_baseline.csv"
+SAVE_BASELINE=0
+CONFIGURE=0
+THRESHOLD=10
+TIMEOUT=120
+SMP_CPUS=4
+BUILD_DIR=""
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --configure)     CONFIGURE=1 ;;
+        --baseline)      BASELINE="$2"; shift ;;
+        --save-baseline) SAVE_BASELINE=1 ;;
+        --threshold)     THRESHOLD="$2"; shift ;;
+        --timeout)       TIMEOUT="$2"; shift ;;
+        --smp)           SMP_CPUS="$2"; shift ;;
+        -*)              echo "Unknown option: $1"; exit 1 ;;
+        *)               BUILD_DIR="$1" ;;
+    esac
+    shift
+done
+
+if [ -z "$BUILD_DIR" ]; then
+    echo "Usage: $0 [--configure] [--baseline <file>] [--save-baseline] [--threshold <pct>] [--timeout <sec>] [--smp <n>] <build-dir>"
+    exit 1
+fi
+
+if [ "$SAVE_BASELINE" -eq 0 ] && [ ! -f "$BASELINE" ]; then
+    echo "[bench] Error: no baseline at $BASELINE."
+    echo "[bench] None ships with the tree (results are host-specific). Record one on this machine first:"
+    echo "[bench]   $0 --save-baseline $BUILD_DIR"
+    exit 1
+fi
+
+if [ "$CONFIGURE" -eq 1 ]; then
+    cmake -S "$SOURCE_DIR" -B "$BUILD_DIR" -DUIAOS_KERNEL_BENCH=ON || exit 1
+    cmake --build "$BUILD_DIR" -j"$(nproc)" || exit 1
+fi
+
+ISO="$BUILD_DIR/kernel.iso"
+DISK="$BUILD_DIR/disk.img"
+for f in "$ISO" "$DISK"; do
+    if [ ! -f "$f" ]; then
+        echo "Error: $f not found (build with -DUIAOS_KERNEL_BENCH=ON first, or pass --configure)"
+        exit 1
+    fi
+done
+
+LOG=$(mktemp /tmp/uiaos-bench-log.XXXXXX)
+RESULTS=$(mktemp /tmp/uiaos-bench-csv.XXXXXX)
+# QEMU writes to the disk image; keep the build output pristine
+DISK_COPY=$(mktemp /tmp/uiaos-bench-disk.XXXXXX)
+cp "$DISK" "$DISK_COPY"
+
+qemu-system-i386 -boot d \
+                 -cdrom "$ISO" \
+                 -hdb "$DISK_COPY" \
+                 -m 1024 \
+                 -smp "$SMP_CPUS" \
+                 -display none \
+                 -monitor none \
+                 -serial file:"$LOG" &
+QEMU_PID=$!
+
+cleanup() {
+    kill "$QEMU_PID" 2>/dev/null
+    wait "$QEMU_PID" 2>/dev/null
+    rm -f "$LOG" "$RESULTS" "$DISK_COPY"
+}
+trap cleanup EXIT
+
+echo "[bench] QEMU started (PID $QEMU_PID), waiting for results..."
+elapsed=0
+while ! grep -q '^BENCH-END' "$LOG" 2>/dev/null; do
+    if ! kill -0 "$QEMU_PID" 2>/dev/null; then
+        echo "[bench] Error: QEMU exited before BENCH-END. Serial log:"
+        cat "$LOG"
+        exit 1
+    fi
+    if [ "$elapsed" -ge "$TIMEOUT" ]; then
+        echo "[bench] Error: timed out after ${TIMEOUT}s. Serial log:"
+        cat "$LOG"
+        exit 1
+    fi
+    sleep 1
+    elapsed=$((elapsed + 1))
+done
+
+# User-space benchmarks (forkbench.elf, schedbench.elf, smpbench.elf,
+# syscallbench.elf) report after the kernel suites; each ends with its own
+# BENCH-USER-END line
+USER_BENCHES=4
+while [ "$(grep -c '^BENCH-USER-END' "$LOG" 2>/dev/null)" -lt "$USER_BENCHES" ]; do
+    if ! kill -0 "$QEMU_PID" 2>/dev/null || [ "$elapsed" -ge "$TIMEOUT" ]; then
+        echo "[bench] Warning: BENCH-USER-END not seen; user-space rows may be missing."
+        break
+    fi
+    sleep 1
+    elapsed=$((elapsed + 1))
+done
+
+# Keep only table rows, dropping the BENCH, prefix and any stray CRs
+tr -d '\r' < "$LOG" | sed -n 's/^BENCH,//p' > "$RESULTS"
+ROWS=$(wc -l < "$RESULTS")
+echo "[bench] Collected $ROWS result rows."
+
+if [ "$SAVE_BASELINE" -eq 1 ]; then
+    {
+        echo "layer,workload,op,count,avg_cyc,p50_cyc,p99_cyc,max_cyc"
+        cat "$RESULTS"
+    } > "$BASELINE"
+    echo "[bench] Baseline written to $BASELINE"
+    exit 0
+fi
+
+# Join on layer/workload/op and report the relative change of avg, p50 and p99.
+awk -F, -v threshold="$THRESHOLD" '
+    function pct(new, old) { return (old > 0) ? (100.0 * (new - old) / old) : 0 }
+    NR == FNR {
+        if (FNR == 1 && $1 == "layer") next
+        key = $1 "," $2 "," $3
+        base_avg[key] = $5; base_p50[key] = $6; base_p99[key] = $7
+        next
+    }
+    {
+        key = $1 "," $2 "," $3
+        if (!(key in base_p50)) {
+            printf "%-34s %10s %10s %10s   (new)\n", key, $5, $6, $7
+            next
+        }
+        d50 = pct($6, base_p50[key])
+        flag = ""
+        if (d50 > threshold) { flag = "  REGRESSION"; regressions++ }
+        else if (d50 < -threshold) { flag = "  improved" }
+        printf "%-34s avg %6d (%+6.1f%%)  p50 %6d (%+6.1f%%)  p99 %7d (%+6.1f%%)%s\n",
+               key, $5, pct($5, base_avg[key]), $6, d50, $7, pct($7, base_p99[key]), flag
+    }
+    END {
+        if (regressions > 0) {
+            printf "[bench] %d p50 regression(s) above %s%%\n", regressions, threshold
+            exit 2
+        }
+        print "[bench] No p50 regressions above " threshold "%"
+    }
+' "$BASELINE" "$RESULTS"
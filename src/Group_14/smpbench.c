@@ -0,0 +1,89 @@
+/*
+ * smpbench.c – UiAOS User-Space SMP Scaling Benchmark
+ *
+ * Purpose: Measures how well CPU-bound processes spread over the CPUs. Each
+ * round forks N children that each do the same fixed amount of arithmetic
+ * without ever blocking, and times from the first fork until the last child
+ * has been collected. With N CPUs and working load balancing the wall time
+ * stays close to that of a single child; on one CPU it grows N-fold. The
+ * scaling is printed as the procs_1 median divided by the procs_N median,
+ * times N (100 = linear).
+ *
+ * Rows are printed in the kernel benchmark format (see kbench.h) so
+ * scripts/run_bench.sh picks them up from COM1:
+ *
+ *   BENCH,proc,cpu_bound,<op>,count,avg,p50,p99,max     (TSC cycles)
+ *
+ *   procs_1   one child: the single-CPU reference
+ *   procs_2   two children at once
+ *   procs_4   four children at once
+ *
+ * The kernel also logs each CPU's dispatches, steals and pulls from the idle
+ * task. The kernel launches this program only in KERNEL_BENCH builds; run it
+ * with `qemu -smp 4` (run_bench.sh does) to see it scale.
+ */
+
+#include "benchlib.h"
+
+/* ==== Benchmark Parameters ============================================== */
+ #define SMB_ROUNDS     5          /* Timed rounds per row */
+ #define SMB_MAX_PROCS  4          /* Largest N */
+ #define SMB_WORK       20000000u  /* Loop iterations per child (a few tens of ms) */
+
+ static uint32_t g_samples[SMB_ROUNDS];
+
+/* ==== Workloads ========================================================= */
+ /* Child body: a fixed amount of arithmetic that never blocks. */
+ static void worker(void) {
+     volatile uint32_t x = 1;
+     for (uint32_t i = 0; i < SMB_WORK; i++) x = x * 1664525u + 1013904223u;
+     sys_exit((int32_t)(x & 1));
+ }
+
+ /* Times one round of n concurrent workers; 0 if a fork failed. */
+ static uint32_t run_round(int32_t n) {
+     int32_t pids[SMB_MAX_PROCS];
+     int32_t started = 0;
+     uint64_t t0 = rdtsc();
+     for (int32_t i = 0; i < n; i++) {
+         int32_t pid = sys_fork();
+         if (pid == 0) worker();
+         if (pid < 0) {
+             sys_puts("[smpbench] fork failed\n");
+             break;
+         }
+         pids[started++] = pid;
+     }
+     for (int32_t i = 0; i < started; i++) sys_waitpid(pids[i], 0, 0);
+     return (started == n) ? cycles_since(t0) : 0;
+ }
+
+ /* Runs SMB_ROUNDS rounds of n workers, prints the row and returns the median. */
+ static uint32_t run_row(int32_t n, const char *op) {
+     uint32_t ok = 0;
+     for (uint32_t r = 0; r < SMB_ROUNDS; r++) {
+         uint32_t c = run_round(n);
+         if (c) g_samples[ok++] = c;
+     }
+     report("cpu_bound", op, g_samples, ok);
+     return ok ? g_samples[ok / 2] : 0;
+ }
+
+/* ==== Main ============================================================== */
+ int main(void) {
+     uint32_t base = run_row(1, "procs_1");
+     uint32_t p2 = run_row(2, "procs_2");
+     uint32_t p4 = run_row(4, "procs_4");
+
+     char line[96];
+     char *p = put_str(line, "[smpbench] Scaling (100 = linear): 2 procs ");
+     p = put_udec(p, p2 ? (uint32_t)((200ull * base) / p2) : 0);
+     p = put_str(p, ", 4 procs ");
+     p = put_udec(p, p4 ? (uint32_t)((400ull * base) / p4) : 0);
+     p = put_str(p, "\n");
+     *p = '\0';
+     sys_puts(line);
+
+     sys_puts("BENCH-USER-END\n");
+     return 0;
+ }
@@ -0,0 +1,338 @@
+/**
+ * @file acpi.c
+ * @brief CPU and interrupt controller discovery (see acpi.h).
+ *
+ * Firmware tables can sit anywhere in physical memory (QEMU puts the ACPI
+ * tables near the top of RAM), so they are copied out through temporary
+ * mappings one page at a time. The BIOS areas searched for the RSDP and the
+ * MP floating pointer are below 1 MB, inside the identity-mapped first 4 MB.
+ */
+
+#include "acpi.h"
+#include "paging.h"
+#include "terminal.h"
+#include "string.h"
+
+#define ACPI_IDENTITY_LIMIT 0x400000u   // Physical memory mapped 1:1 in every page directory
+#define ACPI_TABLE_MAX      8192u       // Largest MADT / MP configuration table we copy
+
+#define BDA_EBDA_SEGMENT    0x40Eu      // Real-mode segment of the EBDA, in the BIOS data area
+#define BIOS_ROM_START      0xE0000u
+#define BIOS_ROM_END        0x100000u
+
+// MADT entry types
+#define MADT_LOCAL_APIC          0
+#define MADT_IO_APIC             1
+#define MADT_INT_SRC_OVERRIDE    2
+#define MADT_LAPIC_ADDR_OVERRIDE 5
+#define MADT_LAPIC_ENABLED       0x1
+
+// MP configuration table entry types and sizes
+#define MP_ENTRY_PROCESSOR  0
+#define MP_ENTRY_BUS        1
+#define MP_ENTRY_IOAPIC     2
+#define MP_ENTRY_IO_INT     3
+#define MP_ENTRY_LOCAL_INT  4
+#define MP_PROC_ENABLED     0x1
+#define MP_IOAPIC_ENABLED   0x1
+
+typedef struct {
+    char     signature[8];   // "RSD PTR "
+    uint8_t  checksum;
+    char     oem_id[6];
+    uint8_t  revision;       // 0 = ACPI 1.0, 2+ = has the XSDT fields
+    uint32_t rsdt_phys;
+    uint32_t length;
+    uint64_t xsdt_phys;
+    uint8_t  ext_checksum;
+    uint8_t  reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char     signature[4];
+    uint32_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_phys;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct {
+    char     signature[4];   // "_MP_"
+    uint32_t config_phys;
+    uint8_t  length;         // In 16-byte units
+    uint8_t  spec_rev;
+    uint8_t  checksum;
+    uint8_t  features[5];
+} __attribute__((packed)) mp_floating_t;
+
+typedef struct {
+    char     signature[4];   // "PCMP"
+    uint16_t base_length;
+    uint8_t  spec_rev;
+    uint8_t  checksum;
+    char     oem_id[8];
+    char     product_id[12];
+    uint32_t oem_table_phys;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_phys;
+    uint16_t ext_length;
+    uint8_t  ext_checksum;
+    uint8_t  reserved;
+} __attribute__((packed)) mp_config_t;
+
+static uint8_t s_table[ACPI_TABLE_MAX];
+
+/** @brief Copies physical memory into a kernel buffer. */
+static bool phys_copy(void *dst, uint32_t phys, uint32_t len) {
+    uint8_t *out = (uint8_t *)dst;
+    if (phys + len <= ACPI_IDENTITY_LIMIT && phys + len >= phys) {
+        memcpy(out, (const void *)(uintptr_t)phys, len);
+        return true;
+    }
+    while (len) {
+        uint32_t page = phys & ~(PAGE_SIZE - 1);
+        uint32_t offset = phys - page;
+        uint32_t chunk = PAGE_SIZE - offset;
+        if (chunk > len) chunk = len;
+        uint8_t *map = paging_temp_map(page, PTE_KERNEL_READONLY_FLAGS);
+        if (!map) return false;
+        memcpy(out, map + offset, chunk);
+        paging_temp_unmap(map);
+        out += chunk;
+        phys += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+static bool checksum_ok(const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += p[i];
+    return sum == 0;
+}
+
+/** @brief Scans [start, end) on 16-byte boundaries for a checksummed structure. */
+static uint32_t scan_low_memory(uint32_t start, uint32_t end, const char *sig, uint32_t sig_len, uint32_t len) {
+    for (uint32_t addr = start; addr + len <= end; addr += 16) {
+        const uint8_t *p = (const uint8_t *)(uintptr_t)addr;
+        if (memcmp(p, sig, sig_len) == 0 && checksum_ok(p, len)) return addr;
+    }
+    return 0;
+}
+
+/** @brief Searches the first KB of the EBDA, then the BIOS ROM area. */
+static uint32_t find_in_bios_areas(const char *sig, uint32_t sig_len, uint32_t len) {
+    uint32_t ebda = (uint32_t)(*(volatile uint16_t *)(uintptr_t)BDA_EBDA_SEGMENT) << 4;
+    uint32_t found = 0;
+    if (ebda >= 0x80000 && ebda < 0xA0000) found = scan_low_memory(ebda, ebda + 1024, sig, sig_len, len);
+    if (!found) found = scan_low_memory(BIOS_ROM_START, BIOS_ROM_END, sig, sig_len, len);
+    return found;
+}
+
+static void add_cpu(acpi_topology_t *out, uint8_t apic_id) {
+    for (uint32_t i = 0; i < out->cpu_count; i++) {
+        if (out->cpu_apic_ids[i] == apic_id) return;
+    }
+    if (out->cpu_count < MAX_CPUS) out->cpu_apic_ids[out->cpu_count++] = apic_id;
+    else out->cpus_skipped++;
+}
+
+static void reset_topology(acpi_topology_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) out->isa_irq[irq].gsi = irq;
+}
+
+/** @brief Copies an SDT into s_table after checking its length and checksum. */
+static acpi_sdt_header_t *load_sdt(uint32_t phys) {
+    acpi_sdt_header_t header;
+    if (!phys_copy(&header, phys, sizeof(header))) return NULL;
+    if (header.length < sizeof(header) || header.length > ACPI_TABLE_MAX) return NULL;
+    if (!phys_copy(s_table, phys, header.length)) return NULL;
+    if (!checksum_ok(s_table, header.length)) return NULL;
+    return (acpi_sdt_header_t *)s_table;
+}
+
+/** @brief Finds the MADT through the RSDT or XSDT. */
+static uint32_t find_madt(const acpi_rsdp_t *rsdp) {
+    bool use_xsdt = rsdp->revision >= 2 && rsdp->xsdt_phys && rsdp->xsdt_phys < 0x100000000ull;
+    uint32_t root_phys = use_xsdt ? (uint32_t)rsdp->xsdt_phys : rsdp->rsdt_phys;
+    uint32_t entry_size = use_xsdt ? 8 : 4;
+
+    acpi_sdt_header_t *root = load_sdt(root_phys);
+    if (!root) return 0;
+    uint32_t count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+
+    // load_sdt reuses s_table, so keep the entry list on the stack
+    uint32_t entries[64];
+    if (count > 64) count = 64;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *e = s_table + sizeof(acpi_sdt_header_t) + i * entry_size;
+        uint32_t hi = use_xsdt ? *(const uint32_t *)(e + 4) : 0;
+        entries[i] = hi ? 0 : *(const uint32_t *)e;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        acpi_sdt_header_t header;
+        if (!entries[i] || !phys_copy(&header, entries[i], sizeof(header))) continue;
+        if (memcmp(header.signature, "APIC", 4) == 0) return entries[i];
+    }
+    return 0;
+}
+
+static bool parse_madt(uint32_t madt_phys, acpi_topology_t *out) {
+    acpi_madt_t *madt = (acpi_madt_t *)load_sdt(madt_phys);
+    if (!madt) return false;
+
+    reset_topology(out);
+    out->source = "ACPI MADT";
+    out->lapic_phys = madt->lapic_phys;
+
+    const uint8_t *p = s_table + sizeof(acpi_madt_t);
+    const uint8_t *end = s_table + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        switch (p[0]) {
+        case MADT_LOCAL_APIC:
+            if (*(const uint32_t *)(p + 4) & MADT_LAPIC_ENABLED) add_cpu(out, p[3]);
+            break;
+        case MADT_IO_APIC:
+            if (!out->has_ioapic) {
+                out->has_ioapic = true;
+                out->ioapic_id = p[2];
+                out->ioapic_phys = *(const uint32_t *)(p + 4);
+                out->ioapic_gsi_base = *(const uint32_t *)(p + 8);
+            }
+            break;
+        case MADT_INT_SRC_OVERRIDE:
+            // bus 0 (ISA), source IRQ, GSI, INTI flags
+            if (p[2] == 0 && p[3] < ACPI_ISA_IRQS) {
+                out->isa_irq[p[3]].gsi = *(const uint32_t *)(p + 4);
+                out->isa_irq[p[3]].flags = *(const uint16_t *)(p + 8);
+            }
+            break;
+        case MADT_LAPIC_ADDR_OVERRIDE:
+            if (*(const uint32_t *)(p + 8) == 0) out->lapic_phys = *(const uint32_t *)(p + 4);
+            break;
+        default:
+            break;
+        }
+        p += p[1];
+    }
+    return out->cpu_count > 0;
+}
+
+static bool parse_mp_table(acpi_topology_t *out) {
+    uint32_t fp_phys = find_in_bios_areas("_MP_", 4, sizeof(mp_floating_t));
+    if (!fp_phys) return false;
+    const mp_floating_t *fp = (const mp_floating_t *)(uintptr_t)fp_phys;
+    if (fp->config_phys == 0) {
+        // Default configurations (features[0] != 0) describe two CPUs we
+        // cannot name without a table; stay on the BSP
+        terminal_printf("[ACPI] MP default configuration %u not supported.\n", fp->features[0]);
+        return false;
+    }
+
+    mp_config_t config;
+    if (!phys_copy(&config, fp->config_phys, sizeof(config))) return false;
+    if (memcmp(config.signature, "PCMP", 4) != 0 || config.base_length > ACPI_TABLE_MAX ||
+        config.base_length < sizeof(config)) return false;
+    if (!phys_copy(s_table, fp->config_phys, config.base_length) || !checksum_ok(s_table, config.base_length)) {
+        return false;
+    }
+
+    reset_topology(out);
+    out->source = "MP table";
+    out->lapic_phys = config.lapic_phys;
+
+    int isa_bus = -1;
+    const uint8_t *p = s_table + sizeof(mp_config_t);
+    const uint8_t *end = s_table + config.base_length;
+    for (uint32_t i = 0; i < config.entry_count && p < end; i++) {
+        switch (p[0]) {
+        case MP_ENTRY_PROCESSOR:
+            if (p[3] & MP_PROC_ENABLED) add_cpu(out, p[1]);
+            p += 20;
+            break;
+        case MP_ENTRY_BUS:
+            if (memcmp(p + 2, "ISA", 3) == 0) isa_bus = p[1];
+            p += 8;
+            break;
+        case MP_ENTRY_IOAPIC:
+            if (!out->has_ioapic && (p[3] & MP_IOAPIC_ENABLED)) {
+                out->has_ioapic = true;
+                out->ioapic_id = p[1];
+                out->ioapic_phys = *(const uint32_t *)(p + 4);
+                out->ioapic_gsi_base = 0;
+            }
+            p += 8;
+            break;
+        case MP_ENTRY_IO_INT:
+            // type, flags, source bus, source IRQ, destination IOAPIC, INTIN
+            if (p[1] == 0 && (int)p[4] == isa_bus && p[5] < ACPI_ISA_IRQS &&
+                (p[6] == out->ioapic_id || p[6] == 0xFF)) {
+                out->isa_irq[p[5]].gsi = p[7];
+                out->isa_irq[p[5]].flags = *(const uint16_t *)(p + 2);
+            }
+            p += 8;
+            break;
+        case MP_ENTRY_LOCAL_INT:
+            p += 8;
+            break;
+        default:
+            p = end; // Unknown entry: its size is unknown too
+            break;
+        }
+    }
+    return out->cpu_count > 0;
+}
+
+bool acpi_discover_topology(const void *rsdp_hint, acpi_topology_t *out) {
+    acpi_rsdp_t rsdp;
+    bool have_rsdp = false;
+
+    if (rsdp_hint) {
+        memcpy(&rsdp, rsdp_hint, sizeof(rsdp));
+        have_rsdp = memcmp(rsdp.signature, "RSD PTR ", 8) == 0 && checksum_ok(&rsdp, 20);
+    }
+    if (!have_rsdp) {
+        uint32_t phys = find_in_bios_areas("RSD PTR ", 8, 20);
+        if (phys) {
+            memcpy(&rsdp, (const void *)(uintptr_t)phys, sizeof(rsdp));
+            have_rsdp = true;
+        }
+    }
+
+    if (have_rsdp) {
+        uint32_t madt = find_madt(&rsdp);
+        if (madt && parse_madt(madt, out)) goto found;
+        terminal_write("[ACPI] No usable MADT; trying the MP table.\n");
+    }
+    if (parse_mp_table(out)) goto found;
+
+    terminal_write("[ACPI] No CPU tables found; staying uniprocessor.\n");
+    return false;
+
+found:
+    terminal_printf("[ACPI] %s: %lu CPU(s)%s, LAPIC at %#lx, IOAPIC %s%#lx (GSI base %lu)\n",
+                    out->source, (unsigned long)out->cpu_count,
+                    out->cpus_skipped ? " (more than MAX_CPUS)" : "",
+                    (unsigned long)out->lapic_phys, out->has_ioapic ? "at " : "missing ",
+                    (unsigned long)out->ioapic_phys, (unsigned long)out->ioapic_gsi_base);
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        if (out->isa_irq[irq].gsi != irq || out->isa_irq[irq].flags) {
+            terminal_printf("[ACPI]   ISA IRQ %lu -> GSI %lu (flags %#x)\n", (unsigned long)irq,
+                            (unsigned long)out->isa_irq[irq].gsi, out->isa_irq[irq].flags);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+; src/ap_trampoline.asm
+; Real-mode entry of the application processors (APs).
+;
+; A STARTUP IPI starts an AP in real mode at CS:IP = (page << 8):0000, so
+; smp.c copies the bytes between ap_trampoline_start and ap_trampoline_end to
+; a free page below 1 MB and fills in the parameter block before sending it.
+; The code does not know where it runs until it reads CS: every address is
+; taken relative to the copy's base (EBP), and the two pointers that need a
+; linear address (GDTR base and the far jump) are patched on the fly.
+;
+; The AP then loads a flat GDT, enters protected mode, switches on paging with
+; the BSP's CR4/CR3/CR0 (the low 4 MB are identity-mapped in every page
+; directory, so execution continues here), takes its boot stack and jumps to
+; ap_main(cpu_index). ap_main loads the CPU's own GDT, TSS and IDT.
+
+section .text
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_params
+
+%define TRAMP(x) ((x) - ap_trampoline_start)
+
+; Parameter block offsets (filled in by smp.c, see ap_trampoline_params_t)
+PARAM_CR4    equ 0
+PARAM_CR3    equ 4
+PARAM_CR0    equ 8
+PARAM_STACK  equ 12
+PARAM_CPU    equ 16
+PARAM_ENTRY  equ 20
+
+TRAMP_CODE_SEG equ 0x08
+TRAMP_DATA_SEG equ 0x10
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+    mov ax, cs
+    mov ds, ax
+    xor ebp, ebp
+    mov bp, ax
+    shl ebp, 4                          ; EBP = linear base of this copy
+
+    ; Point the GDTR and the far jump at this copy
+    lea eax, [ebp + TRAMP(ap_tramp_gdt)]
+    mov [TRAMP(ap_tramp_gdtr) + 2], eax
+    lea eax, [ebp + TRAMP(ap_tramp_pm)]
+    mov [TRAMP(ap_tramp_pm_ptr)], eax
+
+    o32 lgdt [TRAMP(ap_tramp_gdtr)]
+    mov eax, cr0
+    or eax, 1                           ; PE
+    mov cr0, eax
+    o32 jmp far [TRAMP(ap_tramp_pm_ptr)]
+
+bits 32
+ap_tramp_pm:
+    mov ax, TRAMP_DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    lea esi, [ebp + TRAMP(ap_trampoline_params)]
+    mov eax, [esi + PARAM_CR4]          ; PSE before paging: the kernel uses 4 MB pages
+    mov cr4, eax
+    mov eax, [esi + PARAM_CR3]
+    mov cr3, eax
+    mov eax, [esi + PARAM_CR0]          ; PG, WP, ... as on the BSP
+    mov cr0, eax
+
+    mov esp, [esi + PARAM_STACK]
+    push dword [esi + PARAM_CPU]        ; ap_main(cpu_index)
+    push dword 0                        ; No return address: ap_main never returns
+    mov eax, [esi + PARAM_ENTRY]
+    jmp eax
+
+align 8
+ap_tramp_gdt:
+    dq 0                                ; Null
+    dq 0x00CF9A000000FFFF               ; 0x08: flat 32-bit code
+    dq 0x00CF92000000FFFF               ; 0x10: flat data
+ap_tramp_gdtr:
+    dw 3 * 8 - 1
+    dd 0                                ; Base: patched above
+ap_tramp_pm_ptr:
+    dd 0                                ; Offset: patched above
+    dw TRAMP_CODE_SEG
+
+align 4
+ap_trampoline_params:
+    times 6 dd 0
+ap_trampoline_end:
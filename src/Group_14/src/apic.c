@@ -0,0 +1,280 @@
+/**
+ * @file apic.c
+ * @brief Local APIC and IOAPIC driver (see apic.h).
+ *
+ * Both register blocks are uncached MMIO pages, mapped once through the
+ * temporary-mapping window (paging_temp_map) and kept; the kernel half of the
+ * address space is shared, so every CPU reaches them at the same address.
+ * All CPUs' local APICs sit at the same physical address, and each one sees
+ * its own.
+ */
+
+#include "apic.h"
+#include "idt.h"
+#include "msr.h"
+#include "cpuid.h"
+#include "paging.h"
+#include "pit.h"
+#include "port_io.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "terminal.h"
+#include "assert.h"
+
+// Local APIC registers (byte offsets)
+#define LAPIC_ID        0x020
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0B0
+#define LAPIC_SVR       0x0F0
+#define LAPIC_IRR       0x200
+#define LAPIC_ESR       0x280
+#define LAPIC_ICR_LO    0x300
+#define LAPIC_ICR_HI    0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_ICR 0x380
+#define LAPIC_TIMER_CCR 0x390
+#define LAPIC_TIMER_DCR 0x3E0
+
+#define LAPIC_SVR_ENABLE       0x100
+#define LAPIC_LVT_MASKED       0x10000
+#define LAPIC_TIMER_PERIODIC   0x20000
+#define LAPIC_TIMER_DIV_16     0x3
+#define LAPIC_ICR_PENDING      0x1000    // Delivery status
+#define LAPIC_ICR_INIT         0x500
+#define LAPIC_ICR_STARTUP      0x600
+#define LAPIC_ICR_LEVEL_ASSERT 0x4000
+#define LAPIC_ICR_LEVEL_TRIG   0x8000
+#define LAPIC_LVT_NMI          0x400
+
+#define APIC_BASE_MSR_ENABLE   0x800
+#define APIC_BASE_ADDR_MASK    0xFFFFF000u
+#define CPUID_FEAT_EDX_APIC    (1u << 9)
+
+// IOAPIC registers
+#define IOAPIC_REGSEL   0x00
+#define IOAPIC_WIN      0x10
+#define IOAPIC_REG_VER  0x01
+#define IOAPIC_REDTBL(n) (0x10 + 2 * (n))
+#define IOAPIC_RED_LOW_ACTIVE 0x2000
+#define IOAPIC_RED_LEVEL      0x8000
+#define IOAPIC_RED_MASKED     0x10000
+
+#define APIC_CALIBRATE_US 10000 // Calibration window against the PIT (10 ms)
+
+// ISA IRQs the kernel has drivers for: PIT, keyboard, primary ATA (the cascade
+// line the PIC needed has no meaning on the IOAPIC)
+#define APIC_ISA_IRQS_USED ((1u << 0) | (1u << 1) | (1u << 14))
+
+static volatile uint32_t *s_lapic;
+static volatile uint32_t *s_ioapic;
+static bool s_enabled;
+static apic_stats_t s_stats;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return s_lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    s_lapic[reg / 4] = value;
+    (void)s_lapic[LAPIC_ID / 4]; // Read back so the write is posted before we go on
+}
+
+static uint32_t ioapic_read(uint32_t reg) {
+    s_ioapic[IOAPIC_REGSEL / 4] = reg;
+    return s_ioapic[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    s_ioapic[IOAPIC_REGSEL / 4] = reg;
+    s_ioapic[IOAPIC_WIN / 4] = value;
+}
+
+static volatile uint32_t *map_mmio(uint32_t phys) {
+    return (volatile uint32_t *)paging_temp_map(phys & APIC_BASE_ADDR_MASK,
+                                                PTE_KERNEL_DATA_FLAGS | PAGE_PCD | PAGE_PWT);
+}
+
+/** @brief Software-enables this CPU's local APIC with everything masked but errors. */
+static void lapic_enable_local(void) {
+    uint64_t base = rdmsr(MSR_IA32_APIC_BASE);
+    if (!(base & APIC_BASE_MSR_ENABLE)) wrmsr(MSR_IA32_APIC_BASE, base | APIC_BASE_MSR_ENABLE);
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    // LINT1 carries NMI on PC hardware (BSP only, but harmless on the APs)
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0); // Back-to-back writes clear the error status
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/** @brief Counts the local timer ticks in APIC_CALIBRATE_US of PIT time. */
+static uint32_t lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_ICR, 0xFFFFFFFFu);
+    pit_busy_wait_us(APIC_CALIBRATE_US);
+    uint32_t elapsed = 0xFFFFFFFFu - lapic_read(LAPIC_TIMER_CCR);
+    lapic_write(LAPIC_TIMER_ICR, 0);
+    return elapsed / (APIC_CALIBRATE_US / 1000);
+}
+
+/**
+ * @brief Points ISA IRQ @p irq at the BSP on vector 32 + irq, honouring the
+ * firmware's overrides. Only IRQs with a driver are routed: an override can
+ * move an IRQ onto another's identity pin (IRQ0 onto GSI 2 on most boards).
+ */
+static void ioapic_route_isa_irq(const acpi_topology_t *topology, uint32_t irq, uint32_t max_entry) {
+    const acpi_irq_route_t *route = &topology->isa_irq[irq];
+    if (route->gsi < topology->ioapic_gsi_base) return;
+    uint32_t pin = route->gsi - topology->ioapic_gsi_base;
+    if (pin > max_entry) return;
+
+    uint32_t low = IRQ0_VECTOR + irq; // Fixed delivery, physical destination
+    if ((route->flags & ACPI_INTI_POLARITY_MASK) == ACPI_INTI_POLARITY_LOW) low |= IOAPIC_RED_LOW_ACTIVE;
+    if ((route->flags & ACPI_INTI_TRIGGER_MASK) == ACPI_INTI_TRIGGER_LEVEL) low |= IOAPIC_RED_LEVEL;
+
+    ioapic_write(IOAPIC_REDTBL(pin) + 1, lapic_id() << 24); // Runs on the BSP
+    ioapic_write(IOAPIC_REDTBL(pin), low);
+}
+
+static void apic_timer_irq_handler(isr_frame_t *frame) {
+    (void)frame;
+    atomic_fetch_add_u32(&s_stats.timer_irqs, 1);
+    scheduler_local_tick();
+}
+
+/**
+ * @brief Another CPU queued a task for us or wants the tick mode rechecked.
+ * The EOI has been sent already (isr_common_handler), so switching away here
+ * does not hold up further IPIs.
+ */
+static void apic_resched_irq_handler(isr_frame_t *frame) {
+    (void)frame;
+    atomic_fetch_add_u32(&s_stats.resched_irqs, 1);
+    cpu_t *cpu = this_cpu();
+    if (cpu->need_resched) {
+        cpu->need_resched = false;
+        schedule();
+    } else {
+        scheduler_update_tick();
+    }
+}
+
+bool apic_init(const acpi_topology_t *topology) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_APIC)) {
+        terminal_write("[APIC] CPU has no local APIC; staying on the 8259 PIC.\n");
+        return false;
+    }
+    if (!topology->has_ioapic) {
+        terminal_write("[APIC] No IOAPIC; staying on the 8259 PIC.\n");
+        return false;
+    }
+
+    uint32_t lapic_phys = topology->lapic_phys;
+    if (!lapic_phys) lapic_phys = (uint32_t)rdmsr(MSR_IA32_APIC_BASE) & APIC_BASE_ADDR_MASK;
+    s_lapic = map_mmio(lapic_phys);
+    s_ioapic = map_mmio(topology->ioapic_phys);
+    if (!s_lapic || !s_ioapic) {
+        terminal_write("[APIC] Could not map the APIC registers; staying on the 8259 PIC.\n");
+        return false;
+    }
+
+    lapic_enable_local();
+    s_stats.timer_counts_per_ms = lapic_timer_calibrate();
+    register_int_handler(APIC_TIMER_VECTOR, apic_timer_irq_handler, NULL);
+    register_int_handler(APIC_RESCHED_VECTOR, apic_resched_irq_handler, NULL);
+
+    // Mask every IOAPIC input, then route the ISA IRQs
+    uint32_t max_entry = (ioapic_read(IOAPIC_REG_VER) >> 16) & 0xFF;
+    for (uint32_t pin = 0; pin <= max_entry; pin++) {
+        ioapic_write(IOAPIC_REDTBL(pin), IOAPIC_RED_MASKED);
+    }
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        if (APIC_ISA_IRQS_USED & (1u << irq)) ioapic_route_isa_irq(topology, irq, max_entry);
+    }
+
+    // The PICs stay programmed (vectors 32-47) but masked
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+    s_enabled = true;
+
+    terminal_printf("[APIC] LAPIC ID %lu at %#lx, IOAPIC %u at %#lx (%lu inputs), timer %lu counts/ms\n",
+                    (unsigned long)lapic_id(), (unsigned long)lapic_phys, topology->ioapic_id,
+                    (unsigned long)topology->ioapic_phys, (unsigned long)(max_entry + 1),
+                    (unsigned long)s_stats.timer_counts_per_ms);
+    return true;
+}
+
+void apic_init_ap(void) {
+    KERNEL_ASSERT(s_enabled, "apic_init_ap before apic_init");
+    lapic_enable_local();
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV_16);
+}
+
+bool apic_is_enabled(void) {
+    return s_enabled;
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    s_lapic[LAPIC_EOI / 4] = 0;
+}
+
+bool lapic_vector_pending(uint8_t vector) {
+    return (lapic_read(LAPIC_IRR + 0x10 * (vector / 32)) & (1u << (vector % 32))) != 0;
+}
+
+static void lapic_send_icr(uint32_t apic_id, uint32_t low) {
+    uintptr_t flags = local_irq_save();
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) {
+        asm volatile("pause");
+    }
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, low);
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) {
+        asm volatile("pause");
+    }
+    local_irq_restore(flags);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    lapic_send_icr(apic_id, vector);
+}
+
+void lapic_send_init(uint32_t apic_id) {
+    lapic_send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL_TRIG | LAPIC_ICR_LEVEL_ASSERT);
+    lapic_send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL_TRIG);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint8_t page) {
+    lapic_send_icr(apic_id, LAPIC_ICR_STARTUP | page);
+}
+
+void apic_timer_start(void) {
+    if (!(lapic_read(LAPIC_LVT_TIMER) & LAPIC_LVT_MASKED)) return;
+    uint32_t counts = s_stats.timer_counts_per_ms * (1000 / APIC_TIMER_HZ);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_ICR, counts ? counts : 1);
+}
+
+void apic_timer_stop(void) {
+    if (lapic_read(LAPIC_LVT_TIMER) & LAPIC_LVT_MASKED) return;
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_ICR, 0);
+}
+
+void apic_get_stats(apic_stats_t *stats) {
+    if (stats) *stats = s_stats;
+}
@@ -0,0 +1,501 @@
+/**
+ * @file blk_queue.c
+ * @brief Block I/O request queue: elevator, merging and completion (see blk_queue.h).
+ *
+ * All queue state is protected by the queue's spinlock, taken with interrupts
+ * disabled; the driver's start/poll hooks are called with it held, and the
+ * completion IRQ takes it too. PIO transfers and flushes are run by a waiting
+ * task with the lock dropped. The pending list is short (a handful of
+ * requests per waiting task), so the elevator simply scans it.
+ */
+
+#include "blk_queue.h"
+#include "block_device.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "terminal.h"
+#include "string.h"
+#include "paging.h"       // PAGE_SIZE
+#include "pit.h"          // get_pit_ticks
+#include <assert.h>
+
+#define BLK_QUEUE_CHANNELS      2
+#define BLK_RW_BATCH            4          // Requests blk_rw keeps in flight
+#define BLK_POLL_TIMEOUT_LOOPS  30000000u  // Polling waiter gives up on a stuck command
+#define BLK_SLEEP_TIMEOUT_TICKS 5000u      // Same for sleeping waiters, in scheduler ticks (5 s)
+
+static blk_queue_t g_blk_queues[BLK_QUEUE_CHANNELS];
+static bool g_blk_queue_ready[BLK_QUEUE_CHANNELS];
+
+static void blk_timeout_expired(ktimer_t *timer, void *arg);
+
+/** @brief Sequence-number order that survives wrap-around. */
+static inline bool blk_seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static inline bool blk_overlaps(const blk_request_t *a, const blk_request_t *b) {
+    return a->dev == b->dev && a->lba < b->lba + b->count && b->lba < a->lba + a->count;
+}
+
+/** @brief Pages a buffer touches, i.e. the most PRD entries it can need. */
+static inline uint32_t blk_pages_spanned(const void *buffer, uint32_t bytes) {
+    uintptr_t va = (uintptr_t)buffer;
+    return (uint32_t)((va + bytes - 1) / PAGE_SIZE - va / PAGE_SIZE + 1);
+}
+
+/** @brief Largest request the device accepts in one piece. */
+static uint32_t blk_max_request_sectors(block_device_t *dev) {
+    // One page of slack for a buffer that does not start on a page boundary
+    uint32_t by_pages = ((BLK_MAX_CMD_PAGES - 1) * PAGE_SIZE) / dev->sector_size;
+    return by_pages < MAX_SECTORS_PER_IO ? by_pages : MAX_SECTORS_PER_IO;
+}
+
+blk_queue_t *blk_queue_attach(uint32_t channel) {
+    KERNEL_ASSERT(channel < BLK_QUEUE_CHANNELS, "Invalid ATA channel for block queue");
+    if (!g_blk_queue_ready[channel]) {
+        spinlock_init(&g_blk_queues[channel].lock);
+        timer_setup(&g_blk_queues[channel].timeout_timer, blk_timeout_expired, &g_blk_queues[channel]);
+        g_blk_queue_ready[channel] = true;
+    }
+    return &g_blk_queues[channel];
+}
+
+void blk_request_init(blk_request_t *req, block_device_t *dev, uint64_t lba,
+                      void *buffer, uint32_t count, uint32_t flags) {
+    memset(req, 0, sizeof(*req));
+    req->dev = dev;
+    req->lba = lba;
+    req->buffer = buffer;
+    req->count = count;
+    req->flags = flags;
+    req->status = BLOCK_ERR_OK;
+}
+
+// --- Pending List ---
+
+/** @brief Inserts by (lba, seq); equal LBAs keep submission order. */
+static void blk_insert_locked(blk_queue_t *q, blk_request_t *req) {
+    blk_request_t *prev = NULL;
+    blk_request_t *cur = q->pending;
+    while (cur && cur->lba <= req->lba) {
+        prev = cur;
+        cur = cur->next;
+    }
+    req->prev = prev;
+    req->next = cur;
+    if (cur) cur->prev = req;
+    if (prev) prev->next = req; else q->pending = req;
+    q->pending_count++;
+}
+
+static void blk_unlink_locked(blk_queue_t *q, blk_request_t *req) {
+    if (req->prev) req->prev->next = req->next; else q->pending = req->next;
+    if (req->next) req->next->prev = req->prev;
+    req->prev = req->next = NULL;
+    q->pending_count--;
+}
+
+// --- Elevator ---
+
+/**
+ * @brief Whether req may be started now (the queue is idle when this is
+ * asked, so 'dispatched' and 'completed' coincide for earlier requests).
+ * A barrier waits until it is the oldest request; nothing younger than a
+ * pending barrier goes before it; and a request never overtakes an older
+ * one touching the same sectors.
+ */
+static bool blk_dispatchable_locked(blk_queue_t *q, blk_request_t *req) {
+    for (blk_request_t *p = q->pending; p; p = p->next) {
+        if (p == req || !blk_seq_before(p->seq, req->seq)) continue;
+        if ((req->flags & BLK_REQ_BARRIER) || (p->flags & BLK_REQ_BARRIER) || blk_overlaps(p, req)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Chooses the request the next command is built around.
+ * The oldest request whose deadline has passed wins; otherwise C-LOOK: the
+ * lowest LBA at or after the head, wrapping to the lowest LBA overall.
+ * The oldest pending request is always dispatchable, so this never fails.
+ */
+static blk_request_t *blk_pick_locked(blk_queue_t *q) {
+    uint32_t now = get_pit_ticks();
+    blk_request_t *oldest = NULL;
+    blk_request_t *expired = NULL;
+    for (blk_request_t *p = q->pending; p; p = p->next) {
+        if (!oldest || blk_seq_before(p->seq, oldest->seq)) oldest = p;
+        if ((int32_t)(now - p->deadline) >= 0 && (!expired || blk_seq_before(p->seq, expired->seq))) {
+            expired = p;
+        }
+    }
+    if (expired) {
+        q->expired++;
+        return blk_dispatchable_locked(q, expired) ? expired : oldest;
+    }
+
+    for (blk_request_t *p = q->pending; p; p = p->next) {
+        if (p->lba >= q->head_lba && blk_dispatchable_locked(q, p)) return p;
+    }
+    for (blk_request_t *p = q->pending; p; p = p->next) {
+        if (blk_dispatchable_locked(q, p)) return p;
+    }
+    return oldest;
+}
+
+/** @brief Whether cand can join a command of count sectors over pages pages. */
+static bool blk_can_merge_locked(blk_queue_t *q, const blk_request_t *base, blk_request_t *cand,
+                                 uint32_t count, uint32_t pages) {
+    const uint32_t no_merge = BLK_REQ_FLUSH | BLK_REQ_BARRIER;
+    if (cand->dev != base->dev || ((cand->flags ^ base->flags) & BLK_REQ_WRITE)) return false;
+    if ((cand->flags | base->flags) & no_merge) return false;
+    if (count + cand->count > MAX_SECTORS_PER_IO) return false;
+    if (pages + blk_pages_spanned(cand->buffer, cand->count * cand->dev->sector_size) > BLK_MAX_CMD_PAGES) return false;
+    return blk_dispatchable_locked(q, cand);
+}
+
+/**
+ * @brief Removes req and the LBA-adjacent requests around it from the
+ * pending list and describes them as q->cmd.
+ */
+static void blk_build_cmd_locked(blk_queue_t *q, blk_request_t *req) {
+    blk_cmd_t *cmd = &q->cmd;
+    blk_request_t *first = req;
+    blk_request_t *last = req;
+    uint32_t count = req->count;
+    uint32_t pages = (req->flags & BLK_REQ_FLUSH) ? 0 : blk_pages_spanned(req->buffer, req->count * req->dev->sector_size);
+
+    while (first->prev && first->prev->lba + first->prev->count == first->lba &&
+           blk_can_merge_locked(q, req, first->prev, count, pages)) {
+        first = first->prev;
+        count += first->count;
+        pages += blk_pages_spanned(first->buffer, first->count * first->dev->sector_size);
+    }
+    while (last->next && last->next->lba == last->lba + last->count &&
+           blk_can_merge_locked(q, req, last->next, count, pages)) {
+        last = last->next;
+        count += last->count;
+        pages += blk_pages_spanned(last->buffer, last->count * last->dev->sector_size);
+    }
+
+    cmd->dev = req->dev;
+    cmd->lba = first->lba;
+    cmd->count = count;
+    cmd->write = (req->flags & BLK_REQ_WRITE) != 0;
+    cmd->flush = (req->flags & BLK_REQ_FLUSH) != 0;
+    cmd->reqs = first;
+
+    blk_request_t *r = first;
+    for (;;) {
+        blk_request_t *next = r->next;
+        bool end = (r == last);
+        blk_unlink_locked(q, r);
+        r->cmd_next = end ? NULL : next;
+        if (r != req) q->merged++;
+        if (end) break;
+        r = next;
+    }
+    if (!cmd->flush) q->head_lba = cmd->lba + count;
+}
+
+// --- Dispatch & Completion ---
+
+/** @brief Whether q->cmd is a DMA command in flight, i.e. one the IRQ or a poll may complete. */
+static inline bool blk_dma_running_locked(const blk_queue_t *q) {
+    return q->active && !q->sync_ready && !q->sync_running;
+}
+
+/**
+ * @brief Wakes one task sleeping on a request of q to run the command left
+ * for a task. If none sleeps, the next task to wait runs it before blocking.
+ */
+static void blk_wake_sync_runner_locked(blk_queue_t *q) {
+    blk_request_t *req = q->cmd.reqs;
+    while (req && !req->waiter) req = req->cmd_next;
+    if (!req) {
+        req = q->pending;
+        while (req && !req->waiter) req = req->next;
+    }
+    if (!req) return;
+    tcb_t *waiter = req->waiter;
+    req->waiter = NULL;
+    scheduler_unblock_task(waiter);
+}
+
+/** @brief Marks every request of the running command done and wakes its waiters. */
+static void blk_finish_cmd_locked(blk_queue_t *q, int status) {
+    blk_request_t *req = q->cmd.reqs;
+    q->cmd.reqs = NULL;
+    q->active = false;
+    while (req) {
+        // The waiter may reuse the request as soon as done is set
+        blk_request_t *next = req->cmd_next;
+        tcb_t *waiter = req->waiter;
+        req->waiter = NULL;
+        req->status = status;
+        req->done = true;
+        if (waiter) scheduler_unblock_task(waiter);
+        req = next;
+    }
+}
+
+/**
+ * @brief Starts commands until one is running or nothing is left. A command
+ * the driver can only run synchronously (PIO, flush) is left for a task to
+ * run with blk_run_sync_locked, never here under the lock or in the IRQ.
+ * @param force Dispatch even while the queue is plugged.
+ */
+static void blk_run_queue_locked(blk_queue_t *q, bool force) {
+    while (!q->active && q->pending && (q->plugged == 0 || force)) {
+        blk_build_cmd_locked(q, blk_pick_locked(q));
+        q->active = true;
+        q->dispatched++;
+        int status = block_device_start_cmd(&q->cmd);
+        if (status == BLOCK_CMD_SYNC) {
+            q->sync_ready = true;
+            blk_wake_sync_runner_locked(q);
+        } else if (status != BLOCK_CMD_PENDING) {
+            blk_finish_cmd_locked(q, status);
+        }
+    }
+}
+
+/**
+ * @brief Runs the commands left for a task, dropping the queue lock (and
+ * restoring the caller's interrupt state) for each transfer; the channel
+ * stays reserved because q->active is kept set. Entered and left with the
+ * lock held, *irq_flags being the value spinlock_acquire_irqsave returned.
+ * @return true if a command completed.
+ */
+static bool blk_run_sync_locked(blk_queue_t *q, uintptr_t *irq_flags) {
+    bool ran = false;
+    while (q->sync_ready) {
+        q->sync_ready = false;
+        q->sync_running = true;
+        spinlock_release_irqrestore(&q->lock, *irq_flags);
+        int status = block_device_run_cmd(&q->cmd);
+        *irq_flags = spinlock_acquire_irqsave(&q->lock);
+        q->sync_running = false;
+        blk_finish_cmd_locked(q, status);
+        blk_run_queue_locked(q, false);
+        ran = true;
+    }
+    return ran;
+}
+
+/** @brief Gives up on the running DMA command: aborts it and fails its requests. */
+static void blk_timeout_cmd_locked(blk_queue_t *q) {
+    terminal_printf("[BlkQ %s] Timeout: command at LBA %llu (%u sectors) did not complete.\n",
+                    q->cmd.dev->device_name, q->cmd.lba, (unsigned)q->cmd.count);
+    block_device_abort_cmd(&q->cmd);
+    blk_finish_cmd_locked(q, BLOCK_ERR_TIMEOUT);
+}
+
+/** @brief (Re)starts the sleeping waiters' deadline for the command running now. */
+static void blk_arm_timeout_locked(blk_queue_t *q) {
+    q->timeout_cmd = q->dispatched;
+    timer_add(&q->timeout_timer, scheduler_get_ticks() + BLK_SLEEP_TIMEOUT_TICKS);
+}
+
+/**
+ * @brief Deadline of the tasks sleeping in blk_wait. Aborts a DMA command
+ * that has been running since the timer was armed; otherwise the queue made
+ * progress and, if it still has work, the deadline restarts.
+ */
+static void blk_timeout_expired(ktimer_t *timer, void *arg) {
+    (void)timer;
+    blk_queue_t *q = (blk_queue_t *)arg;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+    if (blk_dma_running_locked(q) && q->dispatched == q->timeout_cmd) {
+        blk_timeout_cmd_locked(q);
+        blk_run_queue_locked(q, false);
+    }
+    if (q->active || q->pending) blk_arm_timeout_locked(q);
+    spinlock_release_irqrestore(&q->lock, irq_flags);
+}
+
+bool blk_queue_irq(blk_queue_t *q) {
+    bool completed = false;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+    // A polling waiter on another CPU may have finished the command (and
+    // started the next one) already: only the driver's view under the lock counts.
+    // Interrupts raised during a task's PIO transfer are only acknowledged by the caller
+    if (blk_dma_running_locked(q)) {
+        int status = block_device_poll_cmd(&q->cmd);
+        if (status != BLOCK_CMD_PENDING) {
+            blk_finish_cmd_locked(q, status);
+            blk_run_queue_locked(q, false);
+            completed = true;
+        }
+    }
+    spinlock_release_irqrestore(&q->lock, irq_flags);
+    return completed;
+}
+
+/** @brief Rejects a request before it reaches the queue. */
+static int blk_reject(blk_request_t *req, int status) {
+    req->status = status;
+    req->done = true;
+    return status;
+}
+
+int blk_submit(blk_request_t *req) {
+    KERNEL_ASSERT(req != NULL && req->dev != NULL, "NULL request or device in blk_submit");
+    block_device_t *dev = req->dev;
+    blk_queue_t *q = dev->queue;
+
+    req->done = false;
+    req->status = BLOCK_ERR_OK;
+    req->waiter = NULL;
+    req->cmd_next = NULL;
+    if (!dev->initialized || !q) return blk_reject(req, BLOCK_ERR_NO_DEV);
+    if (req->flags & BLK_REQ_FLUSH) {
+        req->flags |= BLK_REQ_BARRIER;
+        req->lba = 0;
+        req->count = 0;
+    } else {
+        if (!req->buffer || req->count == 0 || req->count > blk_max_request_sectors(dev)) {
+            return blk_reject(req, BLOCK_ERR_PARAMS);
+        }
+        if (req->lba >= dev->total_sectors || req->count > dev->total_sectors - req->lba) {
+            return blk_reject(req, BLOCK_ERR_BOUNDS);
+        }
+    }
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+    req->seq = q->next_seq++;
+    req->deadline = get_pit_ticks() +
+                    ((req->flags & BLK_REQ_WRITE) ? BLK_WRITE_DEADLINE_TICKS : BLK_READ_DEADLINE_TICKS);
+    blk_insert_locked(q, req);
+    q->submitted++;
+    blk_run_queue_locked(q, false);
+    spinlock_release_irqrestore(&q->lock, irq_flags);
+    return BLOCK_ERR_OK;
+}
+
+/**
+ * @brief Drives the queue from a waiter that cannot sleep: checks the running
+ * DMA command for completion and starts the next one, ignoring plugs (the
+ * plugger may not get to run while we spin).
+ * @return true if a command completed.
+ */
+static bool blk_poll_locked(blk_queue_t *q) {
+    bool progress = false;
+    if (blk_dma_running_locked(q)) {
+        int status = block_device_poll_cmd(&q->cmd);
+        if (status != BLOCK_CMD_PENDING) {
+            blk_finish_cmd_locked(q, status);
+            progress = true;
+        }
+    }
+    blk_run_queue_locked(q, true);
+    return progress;
+}
+
+int blk_wait(blk_request_t *req) {
+    blk_queue_t *q = req->dev->queue;
+    if (req->done) return req->status;
+
+    if (scheduler_can_block()) {
+        uint32_t eflags;
+        asm volatile("pushf; pop %0" : "=r"(eflags));
+        for (;;) {
+            // PIO and flushes are run by the waiting tasks, not the IRQ
+            uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+            blk_run_sync_locked(q, &irq_flags);
+            spinlock_release_irqrestore(&q->lock, irq_flags);
+
+            asm volatile("cli");
+            // The completion IRQ may run on another CPU: decide under q->lock,
+            // so either it sees the waiter or we see done
+            irq_flags = spinlock_acquire_irqsave(&q->lock);
+            bool done = req->done;
+            bool block = !done && !q->sync_ready;
+            if (block) {
+                tcb_t *self = get_current_task();
+                req->waiter = self;
+                self->state = TASK_BLOCKED;
+                // A hung command would leave us asleep for good
+                if (!timer_pending(&q->timeout_timer)) blk_arm_timeout_locked(q);
+            }
+            spinlock_release_irqrestore(&q->lock, irq_flags); // Interrupts stay off
+            if (block) schedule(); // Woken by blk_finish_cmd_locked (also on timeout) or blk_wake_sync_runner_locked
+            if (eflags & 0x200) asm volatile("sti");
+            if (done) break;
+        }
+        return req->status;
+    }
+
+    uint32_t loops = BLK_POLL_TIMEOUT_LOOPS;
+    while (!req->done) {
+        uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+        if (!req->done) {
+            if (blk_poll_locked(q) || blk_run_sync_locked(q, &irq_flags)) {
+                loops = BLK_POLL_TIMEOUT_LOOPS;
+            } else if (--loops == 0 && blk_dma_running_locked(q)) {
+                blk_timeout_cmd_locked(q);
+                blk_run_queue_locked(q, true);
+                loops = BLK_POLL_TIMEOUT_LOOPS;
+            }
+        }
+        spinlock_release_irqrestore(&q->lock, irq_flags);
+        if (!req->done) asm volatile ("pause");
+    }
+    return req->status;
+}
+
+void blk_plug(block_device_t *dev) {
+    blk_queue_t *q = dev->queue;
+    if (!q) return;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+    q->plugged++;
+    spinlock_release_irqrestore(&q->lock, irq_flags);
+}
+
+void blk_unplug(block_device_t *dev) {
+    blk_queue_t *q = dev->queue;
+    if (!q) return;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&q->lock);
+    KERNEL_ASSERT(q->plugged > 0, "blk_unplug without blk_plug");
+    if (--q->plugged == 0) blk_run_queue_locked(q, false);
+    spinlock_release_irqrestore(&q->lock, irq_flags);
+}
+
+int blk_rw(block_device_t *dev, uint64_t lba, void *buffer, size_t count, bool write) {
+    if (!dev || !buffer || count == 0) return BLOCK_ERR_PARAMS;
+    if (!dev->initialized || !dev->queue) return BLOCK_ERR_NO_DEV;
+
+    blk_request_t reqs[BLK_RW_BATCH];
+    uint32_t max_sectors = blk_max_request_sectors(dev);
+    uint8_t *current_buffer = (uint8_t *)buffer;
+    int ret = BLOCK_ERR_OK;
+
+    // Keep a few pieces queued so the next one starts from the completion IRQ
+    while (count > 0 && ret == BLOCK_ERR_OK) {
+        int n = 0;
+        while (count > 0 && n < BLK_RW_BATCH) {
+            uint32_t sectors = count < max_sectors ? (uint32_t)count : max_sectors;
+            blk_request_init(&reqs[n], dev, lba, current_buffer, sectors, write ? BLK_REQ_WRITE : 0);
+            blk_submit(&reqs[n]);
+            n++;
+            lba += sectors;
+            count -= sectors;
+            current_buffer += sectors * dev->sector_size;
+        }
+        for (int i = 0; i < n; i++) {
+            int status = blk_wait(&reqs[i]);
+            if (status != BLOCK_ERR_OK && ret == BLOCK_ERR_OK) ret = status;
+        }
+    }
+    return ret;
+}
+
+int blk_flush(block_device_t *dev) {
+    if (!dev) return BLOCK_ERR_PARAMS;
+    blk_request_t req;
+    blk_request_init(&req, dev, 0, NULL, 0, BLK_REQ_FLUSH);
+    blk_submit(&req);
+    return blk_wait(&req);
+}
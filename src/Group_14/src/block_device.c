@@ -1,9 +1,10 @@
 /**
  * @file block_device.c
- * @brief ATA PIO Block Device Driver (IRQ for R/W with Polling Assist, Polling for IDENTIFY)
+ * @brief ATA Block Device Driver (bus-master DMA with PIO fallback, Polling for IDENTIFY)
  *
  * Author: Group 14 (UiA) & Gemini
- * Version: 5.4 - Fixed build errors from debug prints and unused variables.
+ * Version: 5.6 - Transfers go through the per-channel request queue (blk_queue.c);
+ *                DMA completes asynchronously, no cache flush after every write.
  */
 
  #include "block_device.h"
@@ -18,6 +19,9 @@
  #include <isr_frame.h>    // Include the frame definition
  #include <assert.h>       // KERNEL_ASSERT (Optional, but recommended)
  #include "keyboard_hw.h" // <<< ADDED for KBC_STATUS_PORT constant for debug prints
+ #include "pci.h"          // Bus-master IDE controller lookup
+ #include "paging.h"       // PAGE_SIZE, paging_get_physical_address_and_flags
+ #include "blk_queue.h"    // Request queue; commands arrive as blk_cmd_t
  // --- ATA Register Definitions ---
  #define ATA_REG_DATA        0
  #define ATA_REG_ERROR        1
@@ -56,6 +60,21 @@
  #define ATA_CMD_WRITE_MULTIPLE_EXT 0x3A
  #define ATA_CMD_FLUSH_CACHE       0xE7
  #define ATA_CMD_FLUSH_CACHE_EXT   0xEA
+ #define ATA_CMD_READ_DMA          0xC8
+ #define ATA_CMD_READ_DMA_EXT      0x25
+ #define ATA_CMD_WRITE_DMA         0xCA
+ #define ATA_CMD_WRITE_DMA_EXT     0x35
+
+ // --- Bus-Master IDE Registers (offsets from BAR4; secondary channel at +8) ---
+ #define BMIDE_REG_COMMAND     0x0
+ #define BMIDE_REG_STATUS      0x2
+ #define BMIDE_REG_PRDT        0x4
+ #define BMIDE_SECONDARY_OFFSET 0x8
+ #define BMIDE_CMD_START       0x01
+ #define BMIDE_CMD_READ        0x08 // Direction: device -> memory
+ #define BMIDE_SR_ACTIVE       0x01
+ #define BMIDE_SR_ERR          0x02
+ #define BMIDE_SR_IRQ          0x04 // Write 1 to clear
 
  // --- Device Selection Bits ---
  #define ATA_DEV_MASTER        0xA0
@@ -76,10 +95,39 @@
  static spinlock_t g_ata_primary_lock;
  static spinlock_t g_ata_secondary_lock;
 
- // IRQ Handling Flags (Specific to Primary Channel for now)
- static volatile bool g_ata_primary_irq_fired = false;
- static volatile uint8_t g_ata_primary_last_status = 0;
- static volatile uint8_t g_ata_primary_last_error = 0;
+ // --- Bus-Master DMA State ---
+ #define ATA_PRD_EOT          0x8000  // Last entry of a PRD table
+ #define ATA_PRD_BOUNDARY     0x10000 // A PRD region must not cross a 64 KiB boundary
+ #define ATA_PRDT_ENTRIES     64
+ #define ATA_DMA_MAX_BYTES    (128 * 1024) // Per command; at most 33 page-sized regions
+
+ /** @brief Physical Region Descriptor: one contiguous piece of a DMA buffer. */
+ typedef struct {
+     uint32_t phys_addr;
+     uint16_t byte_count; // 0 means 64 KiB
+     uint16_t flags;      // ATA_PRD_EOT on the last entry
+ } __attribute__((packed)) ata_prd_t;
+
+ /**
+  * @brief Per-channel DMA state. The channel's request queue starts at most
+  * one command at a time, so a single PRD table per channel suffices.
+  */
+ typedef struct {
+     uint16_t bmide_base;       // 0 = no bus-master controller for this channel
+     uint16_t io_base;
+     volatile bool dma_active;  // Command started, completion not yet seen
+     blk_cmd_t *cmd;            // The running command
+     ata_prd_t *prdt;
+ } ata_dma_channel_t;
+
+ // 512-byte tables aligned to their size, so none crosses a 64 KiB boundary
+ static ata_prd_t g_ata_prdt[2][ATA_PRDT_ENTRIES] __attribute__((aligned(512)));
+ static ata_dma_channel_t g_ata_dma[2] = {
+     { .io_base = ATA_PRIMARY_IO,   .prdt = g_ata_prdt[0] },
+     { .io_base = ATA_SECONDARY_IO, .prdt = g_ata_prdt[1] },
+ };
+ static bool g_ata_dma_probed = false;
+ static volatile bool g_ata_dma_enabled = true;
 
  // --- Internal Helper Prototypes ---
  static int ata_poll_status(uint16_t io_base, uint8_t wait_mask, uint8_t wait_value, uint32_t timeout, const char* context);
@@ -88,8 +136,10 @@
  static int ata_identify(block_device_t *dev); // Uses polling
  static int ata_set_multiple_mode(block_device_t *dev); // Uses polling
  static void ata_setup_lba(block_device_t *dev, uint64_t lba, size_t count);
- static int ata_pio_transfer_block(block_device_t *dev, void *buffer, size_t sectors_in_block, bool write);
- static int block_device_transfer(block_device_t *dev, uint64_t lba, void *buffer, size_t count, bool write); // Uses IRQ wait
+ static int ata_pio_run(blk_cmd_t *cmd);
+ static int ata_flush_cache(block_device_t *dev);
+ static void ata_dma_probe_controller(void);
+ static int ata_dma_start(blk_cmd_t *cmd);
 
  // --- Wait Functions ---
 
@@ -267,6 +317,9 @@ static int ata_identify(block_device_t *dev) {
     // LBA48 Support (Word 83, bit 10)
     dev->lba48_supported = (identify_data[83] & (1 << 10)) != 0;
 
+    // DMA Support (Word 49, bit 8); block_device_init also requires a bus-master controller
+    dev->dma_supported = (identify_data[49] & (1 << 8)) != 0;
+
     // Total Sectors (Words 100-103 for LBA48, Words 60-61 for LBA28)
     // Note: Using direct cast relies on compiler handling potential unaligned access on some archs.
     // Safer approach might be memcpy into a local uint64_t/uint32_t.
@@ -350,12 +403,27 @@ static int ata_identify(block_device_t *dev) {
  }
 
  // --- PIO Transfer ---
- 
+
+ /** @brief Walks the sectors of a command across its requests' buffers. */
+ typedef struct {
+     blk_request_t *req;
+     uint32_t sector;    // Next sector within req
+ } ata_sector_cursor_t;
+
+ static uint16_t *ata_cursor_next(ata_sector_cursor_t *cur, uint32_t sector_size) {
+     while (cur->req && cur->sector == cur->req->count) {
+         cur->req = cur->req->cmd_next;
+         cur->sector = 0;
+     }
+     KERNEL_ASSERT(cur->req != NULL, "PIO transfer ran past the end of its command");
+     return (uint16_t *)((uint8_t *)cur->req->buffer + (cur->sector++) * sector_size);
+ }
+
  /**
-  * @brief Performs the PIO data transfer for a block of sectors (after IRQ/DRQ is ready).
+  * @brief Transfers one DRQ data block (after BSY has cleared).
   */
- static int ata_pio_transfer_block(block_device_t *dev, void *buffer, size_t sectors_in_block, bool write) {
-      KERNEL_ASSERT(dev != NULL && buffer != NULL && sectors_in_block > 0 && dev->sector_size > 0, "Invalid params in ata_pio_transfer_block");
+ static int ata_pio_transfer_block(block_device_t *dev, ata_sector_cursor_t *cur, size_t sectors_in_block, bool write) {
+      KERNEL_ASSERT(dev != NULL && cur != NULL && sectors_in_block > 0 && dev->sector_size > 0, "Invalid params in ata_pio_transfer_block");
       size_t words_per_sector = dev->sector_size / 2;
       uint16_t data_port = dev->io_base + ATA_REG_DATA;
       for (size_t sector = 0; sector < sectors_in_block; sector++) {
@@ -378,19 +446,261 @@ static int ata_identify(block_device_t *dev) {
           }
           // <<<--- End Moved Check --->>>
 
-          uint16_t *buf_words = (uint16_t *)((uint8_t *)buffer + sector * dev->sector_size);
+          uint16_t *buf_words = ata_cursor_next(cur, dev->sector_size);
           if (write) {
               for (size_t i = 0; i < words_per_sector; i++) outw(data_port, buf_words[i]);
           } else {
               for (size_t i = 0; i < words_per_sector; i++) buf_words[i] = inw(data_port);
           }
-          // After transferring a sector (especially for MULTIPLE mode), a delay or status check might be needed
-          // before the next IRQ/DRQ signal for the *next* sector in the block. The current hybrid wait handles the
-          // wait *before* the block transfer starts. Let's assume controller handles subsequent sectors okay for now.
       }
       return BLOCK_ERR_OK;
  }
 
+ /**
+  * @brief Runs a whole queue command as a single PIO command, polling.
+  * With MULTIPLE mode the drive raises DRQ once per multiple_sector_count
+  * sectors instead of once per sector; either way only one command (and one
+  * seek) is issued for the merged range.
+  */
+ static int ata_pio_run(blk_cmd_t *cmd) {
+     block_device_t *dev = cmd->dev;
+     bool write = cmd->write;
+     bool use_lba48 = dev->lba48_supported && (cmd->lba + cmd->count - 1 >= 0x10000000ULL);
+     if (!use_lba48 && (cmd->lba + cmd->count > 0x10000000ULL)) return BLOCK_ERR_BOUNDS;
+     bool use_multiple = dev->multiple_sector_count > 1;
+     size_t block_sectors = use_multiple ? dev->multiple_sector_count : 1;
+
+     uint8_t command;
+     if (write) command = use_multiple ? (use_lba48 ? ATA_CMD_WRITE_MULTIPLE_EXT:ATA_CMD_WRITE_MULTIPLE) : (use_lba48 ? ATA_CMD_WRITE_PIO_EXT:ATA_CMD_WRITE_PIO);
+     else       command = use_multiple ? (use_lba48 ? ATA_CMD_READ_MULTIPLE_EXT :ATA_CMD_READ_MULTIPLE)  : (use_lba48 ? ATA_CMD_READ_PIO_EXT  :ATA_CMD_READ_PIO);
+
+     int ret = ata_select_drive(dev);
+     if (ret != BLOCK_ERR_OK) return ret;
+     ata_setup_lba(dev, cmd->lba, cmd->count);
+     outb(dev->io_base + ATA_REG_COMMAND, command);
+     ata_delay_400ns(dev->control_base);
+
+     ata_sector_cursor_t cur = { cmd->reqs, 0 };
+     size_t sectors_remaining = cmd->count;
+     while (sectors_remaining > 0) {
+         size_t sectors_this_block = sectors_remaining < block_sectors ? sectors_remaining : block_sectors;
+         int poll_result = ata_poll_status(dev->io_base, ATA_SR_BSY, 0x00, ATA_TIMEOUT_PIO * ATA_IRQ_WAIT_MULTIPLIER, "PIOBlock");
+         if (poll_result < 0) {
+             terminal_printf("[ATA %s RW %s] Timeout waiting for data (Cmd %#x, LBA %llu)\n",
+                             dev->device_name, write ? "Write" : "Read", command, cmd->lba);
+             return BLOCK_ERR_TIMEOUT;
+         }
+         uint8_t status = (uint8_t)poll_result;
+         if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+             uint8_t error = (status & ATA_SR_ERR) ? inb(dev->io_base + ATA_REG_ERROR) : 0;
+             terminal_printf("[ATA %s RW %s] Error/Fault detected (Cmd %#x, LBA %llu, Status=%#x, Error=%#x)\n",
+                             dev->device_name, write ? "Write" : "Read", command, cmd->lba, status, error);
+             return (status & ATA_SR_ERR) ? BLOCK_ERR_DEV_ERR : BLOCK_ERR_DEV_FAULT;
+         }
+         ret = ata_pio_transfer_block(dev, &cur, sectors_this_block, write);
+         if (ret != BLOCK_ERR_OK) return ret;
+         sectors_remaining -= sectors_this_block;
+     }
+
+     // Writes complete (and report errors) only after the last block was taken
+     ata_delay_400ns(dev->control_base);
+     int poll_result = ata_poll_status(dev->io_base, ATA_SR_BSY, 0x00, ATA_TIMEOUT_PIO * ATA_IRQ_WAIT_MULTIPLIER, "PIODone");
+     if (poll_result < 0) return BLOCK_ERR_TIMEOUT;
+     uint8_t status = (uint8_t)poll_result;
+     if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+         terminal_printf("[ATA %s RW %s] Error/Fault at completion (Cmd %#x, LBA %llu, Status=%#x)\n",
+                         dev->device_name, write ? "Write" : "Read", command, cmd->lba, status);
+         return (status & ATA_SR_ERR) ? BLOCK_ERR_DEV_ERR : BLOCK_ERR_DEV_FAULT;
+     }
+     return BLOCK_ERR_OK;
+ }
+
+ /**
+  * @brief Issues FLUSH CACHE (EXT) and polls until the drive has written its
+  * cache out. Only sent for explicit flush requests.
+  */
+ static int ata_flush_cache(block_device_t *dev) {
+     int ret = ata_select_drive(dev);
+     if (ret != BLOCK_ERR_OK) {
+         terminal_printf("[ATA %s] Select drive failed before FlushCache (Err %d).\n", dev->device_name, ret);
+         return ret;
+     }
+     outb(dev->io_base + ATA_REG_COMMAND, dev->lba48_supported ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+     ata_delay_400ns(dev->control_base);
+
+     int poll_result = ata_poll_status(dev->io_base, ATA_SR_BSY, 0x00, ATA_TIMEOUT_PIO * ATA_IRQ_WAIT_MULTIPLIER, "FlushCache");
+     if (poll_result < 0) {
+         terminal_printf("[ATA %s] FlushCache timeout.\n", dev->device_name);
+         return BLOCK_ERR_TIMEOUT;
+     }
+     uint8_t status = (uint8_t)poll_result;
+     if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+         uint8_t error = (status & ATA_SR_ERR) ? inb(dev->io_base + ATA_REG_ERROR) : 0;
+         terminal_printf("[ATA %s] FlushCache error/fault (Status=%#x, Error=%#x).\n", dev->device_name, status, error);
+         return (status & ATA_SR_ERR) ? BLOCK_ERR_DEV_ERR : BLOCK_ERR_DEV_FAULT;
+     }
+     return BLOCK_ERR_OK;
+ }
+
+
+ // --- Bus-Master DMA ---
+
+ /** @brief DMA state of the channel a device sits on. */
+ static inline ata_dma_channel_t *ata_dma_channel(block_device_t *dev) {
+     return &g_ata_dma[dev->io_base == ATA_PRIMARY_IO ? 0 : 1];
+ }
+
+ /**
+  * @brief Finds the PCI IDE controller and enables bus mastering on it.
+  * Runs once; channels stay PIO-only if there is no usable BAR4.
+  */
+ static void ata_dma_probe_controller(void) {
+     if (g_ata_dma_probed) return;
+     g_ata_dma_probed = true;
+
+     pci_addr_t ide;
+     if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide)) {
+         terminal_write("[ATA DMA] No PCI IDE controller found, using PIO only.\n");
+         return;
+     }
+     uint8_t prog_if = pci_config_read8(ide, PCI_PROG_IF);
+     uint32_t bar4 = pci_config_read32(ide, PCI_BAR4);
+     if (!(prog_if & 0x80) || !(bar4 & PCI_BAR_IO) || (bar4 & PCI_BAR_IO_MASK) == 0) {
+         terminal_printf("[ATA DMA] IDE controller %u:%u.%u has no bus-master interface (ProgIF=%#x, BAR4=%#lx), using PIO only.\n",
+                         ide.bus, ide.device, ide.function, prog_if, (unsigned long)bar4);
+         return;
+     }
+
+     uint16_t cmd = pci_config_read16(ide, PCI_COMMAND);
+     pci_config_write16(ide, PCI_COMMAND, cmd | PCI_CMD_IO_SPACE | PCI_CMD_BUS_MASTER);
+
+     uint16_t bmide = (uint16_t)(bar4 & PCI_BAR_IO_MASK);
+     g_ata_dma[0].bmide_base = bmide;
+     g_ata_dma[1].bmide_base = bmide + BMIDE_SECONDARY_OFFSET;
+     for (int i = 0; i < 2; i++) {
+         outb(g_ata_dma[i].bmide_base + BMIDE_REG_COMMAND, 0);
+         outb(g_ata_dma[i].bmide_base + BMIDE_REG_STATUS, BMIDE_SR_IRQ | BMIDE_SR_ERR);
+     }
+     terminal_printf("[ATA DMA] Bus-master IDE at %u:%u.%u, I/O base %#x.\n",
+                     ide.bus, ide.device, ide.function, bmide);
+ }
+
+ /**
+  * @brief Appends [buffer, buffer + bytes) to a PRD table that already holds
+  * n entries. Pages that are physically adjacent (also across buffers) are
+  * merged into one region as long as it stays inside a 64 KiB window.
+  * @return New number of entries, or a negative BLOCK_ERR_* if the buffer
+  * cannot be used for DMA (caller falls back to PIO).
+  */
+ static int ata_dma_build_prdt(ata_prd_t *prdt, int n, void *buffer, size_t bytes) {
+     uintptr_t va = (uintptr_t)buffer;
+     if (va < KERNEL_SPACE_VIRT_START || (va & 1) || (bytes & 1)) return BLOCK_ERR_UNSUPPORTED;
+
+     while (bytes > 0) {
+         size_t chunk = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+         if (chunk > bytes) chunk = bytes;
+
+         uintptr_t pa = 0;
+         uint32_t flags = 0;
+         if (paging_get_physical_address_and_flags((uint32_t*)(uintptr_t)g_kernel_page_directory_phys,
+                                                   va, &pa, &flags) != 0) {
+             return BLOCK_ERR_UNSUPPORTED;
+         }
+
+         ata_prd_t *prev = (n > 0) ? &prdt[n - 1] : NULL;
+         uint32_t prev_len = prev ? (prev->byte_count ? prev->byte_count : ATA_PRD_BOUNDARY) : 0;
+         if (prev && prev->phys_addr + prev_len == pa &&
+             (prev->phys_addr & ~(ATA_PRD_BOUNDARY - 1)) == ((pa + chunk - 1) & ~(ATA_PRD_BOUNDARY - 1))) {
+             prev->byte_count = (uint16_t)(prev_len + chunk); // Wraps to 0 for exactly 64 KiB
+         } else {
+             if (n == ATA_PRDT_ENTRIES) return BLOCK_ERR_UNSUPPORTED;
+             prdt[n].phys_addr = (uint32_t)pa;
+             prdt[n].byte_count = (uint16_t)chunk;
+             prdt[n].flags = 0;
+             n++;
+         }
+         va += chunk;
+         bytes -= chunk;
+     }
+     return n;
+ }
+
+ /**
+  * @brief Stops the bus-master engine and turns the end of the running
+  * command into a BLOCK_ERR_* status. Reading the ATA status register also
+  * acknowledges the drive's interrupt.
+  * Called from the IRQ handler or, when polling, with interrupts disabled.
+  */
+ static int ata_dma_finish(ata_dma_channel_t *ch) {
+     uint8_t bm_status = inb(ch->bmide_base + BMIDE_REG_STATUS);
+     outb(ch->bmide_base + BMIDE_REG_COMMAND, 0);
+     outb(ch->bmide_base + BMIDE_REG_STATUS, BMIDE_SR_IRQ | BMIDE_SR_ERR);
+     uint8_t ata_status = inb(ch->io_base + ATA_REG_STATUS);
+     blk_cmd_t *cmd = ch->cmd;
+     ch->dma_active = false;
+     ch->cmd = NULL;
+
+     if (bm_status & BMIDE_SR_ERR) {
+         terminal_printf("[ATA %s DMA] Bus-master error (LBA %llu, BM Status=%#x)\n",
+                         cmd->dev->device_name, cmd->lba, bm_status);
+         return BLOCK_ERR_IO;
+     }
+     if (ata_status & (ATA_SR_ERR | ATA_SR_DF)) {
+         uint8_t error = (ata_status & ATA_SR_ERR) ? inb(ch->io_base + ATA_REG_ERROR) : 0;
+         terminal_printf("[ATA %s DMA] Error/Fault detected (%s, LBA %llu, Status=%#x, Error=%#x)\n",
+                         cmd->dev->device_name, cmd->write ? "Write" : "Read", cmd->lba, ata_status, error);
+         return (ata_status & ATA_SR_ERR) ? BLOCK_ERR_DEV_ERR : BLOCK_ERR_DEV_FAULT;
+     }
+     return BLOCK_ERR_OK;
+ }
+
+ /**
+  * @brief Programs and starts one READ/WRITE DMA (EXT) command covering
+  * every request of cmd (one PRD table over all their buffers).
+  * @return BLOCK_CMD_PENDING once started, or BLOCK_ERR_UNSUPPORTED (before
+  * touching the drive) if a buffer cannot be described by the PRD table, so
+  * the caller can use PIO instead.
+  */
+ static int ata_dma_start(blk_cmd_t *cmd) {
+     block_device_t *dev = cmd->dev;
+     ata_dma_channel_t *ch = ata_dma_channel(dev);
+     if (cmd->count * dev->sector_size > ATA_DMA_MAX_BYTES) return BLOCK_ERR_UNSUPPORTED;
+
+     int prd_count = 0;
+     for (blk_request_t *req = cmd->reqs; req; req = req->cmd_next) {
+         prd_count = ata_dma_build_prdt(ch->prdt, prd_count, req->buffer, req->count * dev->sector_size);
+         if (prd_count < 0) return prd_count;
+     }
+     ch->prdt[prd_count - 1].flags = ATA_PRD_EOT;
+
+     bool use_lba48 = dev->lba48_supported && (cmd->lba + cmd->count - 1 >= 0x10000000ULL);
+     if (!use_lba48 && (cmd->lba + cmd->count > 0x10000000ULL)) return BLOCK_ERR_BOUNDS;
+     uint8_t command = cmd->write ? (use_lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA)
+                                  : (use_lba48 ? ATA_CMD_READ_DMA_EXT  : ATA_CMD_READ_DMA);
+
+     int ret = ata_select_drive(dev);
+     if (ret != BLOCK_ERR_OK) return ret;
+
+     uintptr_t prdt_phys = 0;
+     uint32_t prdt_flags = 0;
+     paging_get_physical_address_and_flags((uint32_t*)(uintptr_t)g_kernel_page_directory_phys,
+                                           (uintptr_t)ch->prdt, &prdt_phys, &prdt_flags);
+     outl(ch->bmide_base + BMIDE_REG_PRDT, (uint32_t)prdt_phys);
+     outb(ch->bmide_base + BMIDE_REG_COMMAND, cmd->write ? 0 : BMIDE_CMD_READ);
+     outb(ch->bmide_base + BMIDE_REG_STATUS, BMIDE_SR_IRQ | BMIDE_SR_ERR);
+
+     ch->cmd = cmd;
+     ch->dma_active = true;
+     ata_setup_lba(dev, cmd->lba, cmd->count);
+     outb(dev->io_base + ATA_REG_COMMAND, command);
+     outb(ch->bmide_base + BMIDE_REG_COMMAND, (cmd->write ? 0 : BMIDE_CMD_READ) | BMIDE_CMD_START);
+     return BLOCK_CMD_PENDING;
+ }
+ bool block_device_set_dma_enabled(bool enabled) {
+     bool was_enabled = g_ata_dma_enabled;
+     g_ata_dma_enabled = enabled;
+     return was_enabled;
+ }
 
  // --- Public API ---
 
@@ -421,8 +731,11 @@ static int ata_identify(block_device_t *dev) {
      dev->control_base = primary_channel ? ATA_PRIMARY_CTRL : ATA_SECONDARY_CTRL;
      dev->is_slave = is_slave;
      dev->channel_lock = primary_channel ? &g_ata_primary_lock : &g_ata_secondary_lock;
+     dev->queue = blk_queue_attach(primary_channel ? 0 : 1);
      terminal_printf("[BlockDev Init] Probing '%s' (IO:%#x, Ctrl:%#x, Slave:%d)...\n", device, dev->io_base, dev->control_base, dev->is_slave);
 
+     // Probing happens at boot with the channel's queue idle; the channel lock
+     // only keeps two concurrent probes apart
      uintptr_t irq_flags = spinlock_acquire_irqsave(dev->channel_lock);
 
      // --- Debug Print BEFORE ata_identify ---
@@ -449,205 +762,106 @@ static int ata_identify(block_device_t *dev) {
      }
      dev->initialized = (ret == BLOCK_ERR_OK);
      spinlock_release_irqrestore(dev->channel_lock, irq_flags);
+
+     // DMA also needs the controller's bus-master interface, and completion
+     // IRQs are only handled on the primary channel
+     if (dev->initialized && dev->dma_supported) {
+         ata_dma_probe_controller();
+         dev->dma_supported = primary_channel && ata_dma_channel(dev)->bmide_base != 0;
+     }
      if (!dev->initialized) { terminal_printf("[BlockDev Init] Failed for '%s' during IDENTIFY (err %d).\n", device, ret); return ret; }
      // <<< FIX: Use %llu for uint64_t, %u for uint16_t, %lu for uint32_t >>>
      terminal_printf("[BlockDev Init] OK: '%s' LBA48:%d Sectors:%llu\n",
         device, dev->lba48_supported, dev->total_sectors);
-terminal_printf("    -> Mult:%u SectorSize:%lu\n", // Use %u for uint16_t, %lu for uint32_t
-        dev->multiple_sector_count, (unsigned long)dev->sector_size);
+terminal_printf("    -> Mult:%u SectorSize:%lu DMA:%d\n", // Use %u for uint16_t, %lu for uint32_t
+        dev->multiple_sector_count, (unsigned long)dev->sector_size, dev->dma_supported);
      return BLOCK_ERR_OK;
  }
 
 
+ // --- Request Queue Driver Hooks ---
+
  /**
-  * @brief Reads or writes sectors to/from a block device using PIO with hybrid IRQ/Polling wait.
+  * @brief Starts a command built by the request queue.
+  * Data transfers use bus-master DMA when the drive supports it and the
+  * buffers are suitable. PIO transfers and flushes poll the drive, so they
+  * are left to block_device_run_cmd in the context of a waiting task rather
+  * than run here, under the queue lock and possibly in the completion IRQ.
   */
-  static int block_device_transfer(block_device_t *dev, uint64_t lba, void *buffer, size_t count, bool write) {
-     KERNEL_ASSERT(dev && dev->initialized && buffer && count > 0, "Invalid parameters to block_device_transfer");
+ int block_device_start_cmd(blk_cmd_t *cmd) {
+     KERNEL_ASSERT(cmd && cmd->dev && cmd->dev->initialized, "Invalid command in block_device_start_cmd");
+     block_device_t *dev = cmd->dev;
      KERNEL_ASSERT(dev->sector_size > 0 && (dev->sector_size % 2 == 0), "Invalid sector size");
-     KERNEL_ASSERT(lba < dev->total_sectors && count <= dev->total_sectors - lba, "Transfer out of bounds");
-
-     volatile bool* irq_fired_flag;
-     volatile uint8_t* last_status_flag;
-     volatile uint8_t* last_error_flag;
-     bool primary_channel = (dev->io_base == ATA_PRIMARY_IO);
-     if (primary_channel) {
-         irq_fired_flag = &g_ata_primary_irq_fired;
-         last_status_flag = &g_ata_primary_last_status;
-         last_error_flag = &g_ata_primary_last_error;
-     } else {
+
+     if (dev->io_base != ATA_PRIMARY_IO) {
          terminal_printf("[ATA %s RW] Error: Secondary channel IRQ handling not implemented.\n", dev->device_name);
          return BLOCK_ERR_UNSUPPORTED;
      }
+     if (cmd->flush) return BLOCK_CMD_SYNC;
 
-     uintptr_t irq_flags = spinlock_acquire_irqsave(dev->channel_lock);
-     int final_ret = BLOCK_ERR_OK;
-     size_t sectors_remaining = count;
-     uint64_t current_lba = lba;
-     uint8_t *current_buffer = (uint8_t *)buffer;
-
-     while (sectors_remaining > 0) {
-         int current_ret = BLOCK_ERR_OK;
-         bool use_lba48 = dev->lba48_supported && (current_lba + sectors_remaining -1 >= 0x10000000ULL);
-         size_t max_sectors_per_ata_cmd = use_lba48 ? 65536 : 256;
-         bool use_multiple_this_cmd = (dev->multiple_sector_count > 0) && (sectors_remaining >= dev->multiple_sector_count);
-         size_t sectors_this_cmd = use_multiple_this_cmd ? dev->multiple_sector_count : 1;
-         if (sectors_this_cmd > sectors_remaining) sectors_this_cmd = sectors_remaining;
-         if (sectors_this_cmd > max_sectors_per_ata_cmd) sectors_this_cmd = max_sectors_per_ata_cmd;
-         use_multiple_this_cmd = use_multiple_this_cmd && (sectors_this_cmd >= dev->multiple_sector_count);
-
-         uint8_t command;
-         if (write) command = use_multiple_this_cmd ? (use_lba48 ? ATA_CMD_WRITE_MULTIPLE_EXT:ATA_CMD_WRITE_MULTIPLE) : (use_lba48 ? ATA_CMD_WRITE_PIO_EXT:ATA_CMD_WRITE_PIO);
-         else       command = use_multiple_this_cmd ? (use_lba48 ? ATA_CMD_READ_MULTIPLE_EXT :ATA_CMD_READ_MULTIPLE)  : (use_lba48 ? ATA_CMD_READ_PIO_EXT  :ATA_CMD_READ_PIO);
-         if (!use_lba48 && (current_lba + sectors_this_cmd > 0x10000000ULL)) { final_ret = BLOCK_ERR_BOUNDS; break; }
-
-         current_ret = ata_select_drive(dev);
-         if (current_ret != BLOCK_ERR_OK) { final_ret = current_ret; break; }
-
-         ata_setup_lba(dev, current_lba, sectors_this_cmd);
-         *irq_fired_flag = false;
-         *last_status_flag = 0;
-         *last_error_flag = 0;
-
-         outb(dev->io_base + ATA_REG_COMMAND, command);
-         ata_delay_400ns(dev->control_base);
-
-         // --- Hybrid Wait for IRQ or BSY Clear ---
-         uint32_t wait_loops = ATA_TIMEOUT_PIO * ATA_IRQ_WAIT_MULTIPLIER;
-         bool timed_out = true;
-         // <<< FIX: Remove unused variable >>>
-         // bool command_done_polling = false;
-         uint8_t polled_status = 0;
-
-         while(wait_loops--) {
-             if (*irq_fired_flag) { // Check IRQ flag first
-                 timed_out = false;
-                 break;
-             }
-             // If no IRQ, poll status register (non-blocking read)
-             polled_status = inb(dev->io_base + ATA_REG_STATUS);
-             if (!(polled_status & ATA_SR_BSY)) { // Check if BSY is clear
-                 // BSY clear means command finished or errored
-                 // <<< FIX: Remove assignment to unused variable >>>
-                 // command_done_polling = true;
-                 timed_out = false; // Consider it not a timeout if BSY cleared
-                 break;
-             }
-             asm volatile ("pause"); // Yield CPU slice slightly
-         }
-         // Final check for IRQ flag after loop
-         if (!timed_out) { /* Already done */ }
-         else if (*irq_fired_flag) {
-             terminal_printf("[ATA %s RW %s] IRQ detected *after* wait loop finished (Cmd %#x, LBA %llu).\n",
-                             dev->device_name, write ? "Write" : "Read", command, current_lba);
-             timed_out = false; // Treat as success
-         }
-
-         if (timed_out) {
-             terminal_printf("[ATA %s RW %s] Timeout waiting for IRQ/BSY Clear (Cmd %#x, LBA %llu)\n",
-                             dev->device_name, write ? "Write" : "Read", command, current_lba);
-             final_ret = BLOCK_ERR_TIMEOUT;
-             *last_status_flag = inb(dev->io_base + ATA_REG_STATUS); // Read status on timeout
-              terminal_printf(" -> Last Status before timeout: %#x\n", *last_status_flag);
-             break; // Exit outer transfer loop
-         }
-
-         // --- Command Completed (via IRQ or BSY Poll) - Check Final Status ---
-         uint8_t final_status = *irq_fired_flag ? *last_status_flag : polled_status;
-         uint8_t final_error = *irq_fired_flag ? *last_error_flag : ((final_status & ATA_SR_ERR) ? inb(dev->io_base + ATA_REG_ERROR) : 0);
+     KERNEL_ASSERT(cmd->count > 0 && cmd->lba < dev->total_sectors && cmd->count <= dev->total_sectors - cmd->lba,
+                   "Transfer out of bounds");
+     if (dev->dma_supported && g_ata_dma_enabled) {
+         int ret = ata_dma_start(cmd);
+         if (ret != BLOCK_ERR_UNSUPPORTED) return ret;
+     }
+     return BLOCK_CMD_SYNC;
+ }
 
-         if (final_status & (ATA_SR_ERR | ATA_SR_DF)) {
-             terminal_printf("[ATA %s RW %s] Error/Fault detected (Cmd %#x, LBA %llu, Status=%#x, Error=%#x)\n",
-                             dev->device_name, write ? "Write" : "Read", command, current_lba, final_status, final_error);
-             final_ret = (final_status & ATA_SR_ERR) ? BLOCK_ERR_DEV_ERR : BLOCK_ERR_DEV_FAULT;
-             break; // Exit outer loop
-         }
+ int block_device_run_cmd(blk_cmd_t *cmd) {
+     return cmd->flush ? ata_flush_cache(cmd->dev) : ata_pio_run(cmd);
+ }
 
-         // --- Transfer Data ---
-         if (command != ATA_CMD_FLUSH_CACHE && command != ATA_CMD_FLUSH_CACHE_EXT) {
-             // Check DRQ bit - MUST be set for successful R/W completion
-             if (!(final_status & ATA_SR_DRQ)) {
-                 terminal_printf("[ATA %s RW %s] Command done but DRQ not set! (Cmd %#x, LBA %llu, Status=%#x)\n",
-                                 dev->device_name, write ? "Write" : "Read", command, current_lba, final_status);
-                 final_ret = BLOCK_ERR_IO; break;
-             }
-             current_ret = ata_pio_transfer_block(dev, current_buffer, sectors_this_cmd, write);
-             if (current_ret != BLOCK_ERR_OK) { final_ret = current_ret; break; }
-         }
+ int block_device_poll_cmd(blk_cmd_t *cmd) {
+     ata_dma_channel_t *ch = ata_dma_channel(cmd->dev);
+     if (!ch->dma_active || ch->cmd != cmd) return BLOCK_ERR_INTERNAL;
+     if (!(inb(ch->bmide_base + BMIDE_REG_STATUS) & BMIDE_SR_IRQ)) return BLOCK_CMD_PENDING;
+     return ata_dma_finish(ch);
+ }
 
-         // Advance state
-         sectors_remaining -= sectors_this_cmd;
-         current_lba += sectors_this_cmd;
-         current_buffer += sectors_this_cmd * dev->sector_size;
-     } // End while(sectors_remaining > 0)
-
-     // --- Final Cache Flush --- (Logic remains similar, uses hybrid wait)
-     if (write && final_ret == BLOCK_ERR_OK) {
-         *irq_fired_flag = false; *last_status_flag = 0; *last_error_flag = 0;
-         int sel_ret = ata_select_drive(dev);
-         if (sel_ret == BLOCK_ERR_OK) {
-             uint8_t flush_cmd = dev->lba48_supported ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE;
-             outb(dev->io_base + ATA_REG_COMMAND, flush_cmd);
-             ata_delay_400ns(dev->control_base);
-
-             uint32_t wait_loops = ATA_TIMEOUT_PIO * ATA_IRQ_WAIT_MULTIPLIER;
-             bool timed_out = true;
-             // <<< FIX: Remove unused variable >>>
-             // bool cmd_done_poll = false;
-             uint8_t poll_stat = 0;
-             while(wait_loops--) {
-                 if (*irq_fired_flag) { timed_out = false; break; }
-                 poll_stat = inb(dev->io_base + ATA_REG_STATUS);
-                 if (!(poll_stat & ATA_SR_BSY)) { /*cmd_done_poll = true;*/ timed_out = false; break; } // Removed assignment
-                 asm volatile("pause");
-             }
-             if (!timed_out || *irq_fired_flag) { timed_out = false; } // Final IRQ check
-
-             if (timed_out) {
-                 terminal_printf("[ATA %s RW Write] FlushCache timeout.\n", dev->device_name);
-                 final_ret = BLOCK_ERR_TIMEOUT;
-             } else {
-                 uint8_t final_stat = *irq_fired_flag ? *last_status_flag : poll_stat;
-                 uint8_t final_err = *irq_fired_flag ? *last_error_flag : ((final_stat & ATA_SR_ERR) ? inb(dev->io_base + ATA_REG_ERROR) : 0);
-                 if ((final_stat & ATA_SR_BSY) || (final_stat & (ATA_SR_ERR | ATA_SR_DF))) {
-                     terminal_printf("[ATA %s RW Write] FlushCache error/fault/busy (Status=%#x, Error=%#x).\n", dev->device_name, final_stat, final_err);
-                     final_ret = (final_stat & ATA_SR_ERR) ? BLOCK_ERR_DEV_ERR : BLOCK_ERR_DEV_FAULT;
-                 }
-             }
-         } else {
-             terminal_printf("[ATA %s RW Write] Select drive failed before FlushCache (Err %d).\n", dev->device_name, sel_ret);
-             if (final_ret == BLOCK_ERR_OK) final_ret = sel_ret;
-         }
+ void block_device_abort_cmd(blk_cmd_t *cmd) {
+     ata_dma_channel_t *ch = ata_dma_channel(cmd->dev);
+     if (ch->dma_active && ch->cmd == cmd) {
+         outb(ch->bmide_base + BMIDE_REG_COMMAND, 0);
+         outb(ch->bmide_base + BMIDE_REG_STATUS, BMIDE_SR_IRQ | BMIDE_SR_ERR);
+         ch->dma_active = false;
+         ch->cmd = NULL;
      }
-
-     // Release Lock and Return
-     spinlock_release_irqrestore(dev->channel_lock, irq_flags);
-     return final_ret;
  }
 
  /**
   * @brief Reads sectors from the block device. Public wrapper.
   */
  int block_device_read(block_device_t *dev, uint64_t lba, void *buffer, size_t count) {
-     return block_device_transfer(dev, lba, buffer, count, false);
+     return blk_rw(dev, lba, buffer, count, false);
  }
 
  /**
   * @brief Writes sectors to the block device. Public wrapper.
   */
  int block_device_write(block_device_t *dev, uint64_t lba, const void *buffer, size_t count) {
-     return block_device_transfer(dev, lba, (void *)buffer, count, true);
+     return blk_rw(dev, lba, (void *)buffer, count, true);
+ }
+
+ /**
+  * @brief Flushes the drive's write cache once earlier requests are done.
+  */
+ int block_device_flush(block_device_t *dev) {
+     if (!dev || !dev->initialized) return BLOCK_ERR_NO_DEV;
+     return blk_flush(dev);
  }
 
  /**
   * @brief Primary ATA IRQ Handler (IRQ 14 -> Vector 46).
+  * Only DMA completions matter; PIO and flush commands are polled, so their
+  * interrupts are just acknowledged.
   */
   void ata_primary_irq_handler(isr_frame_t* frame) {
       (void)frame; // Frame not used currently
-      uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
-      uint8_t error = (status & ATA_SR_ERR) ? inb(ATA_PRIMARY_IO + ATA_REG_ERROR) : 0;
-      g_ata_primary_last_status = status;
-      g_ata_primary_last_error = error;
-      g_ata_primary_irq_fired = true;
-      // serial_write('!'); // Minimal debug signal
-  }
\ No newline at end of file
+
+      // Checked and finished under the queue lock, which a polling waiter
+      // on another CPU holds while it does the same
+      if (blk_queue_irq(blk_queue_attach(0))) return; // Woke the waiters, started the next command
+
+      (void)inb(ATA_PRIMARY_IO + ATA_REG_STATUS); // Reading status deasserts INTRQ
+  }
@@ -1,11 +1,22 @@
 /**
  * @file buddy.c
- * @brief Power-of-Two Buddy Allocator Implementation (Revised v4.1 - Build Fixes)
+ * @brief Power-of-Two Buddy Allocator Implementation (Revised v4.3 - Hashed Debug Tracker)
  *
  * Manages a virtually contiguous region mapped to physical memory, returning
  * VIRTUAL addresses to callers. Includes robust checks, SMP safety via spinlocks,
  * and optional debugging features (canaries, leak tracking).
  *
+ * Key Improvements (v4.3):
+ * - Debug allocation tracker keeps live allocations in an open-addressed hash
+ *   table keyed by user address, so tracked frees are O(1). Leak dumps are
+ *   aggregated per allocation site.
+ *
+ * Key Improvements (v4.2):
+ * - Free lists are doubly linked and free blocks carry an order tag, so a
+ *   buddy's free state is checked and it is unlinked in O(1) while coalescing.
+ * - A per-order non-empty bitmap lets allocation find the smallest usable
+ *   order with a single bit scan.
+ *
  * Key Improvements (v4.1):
  * - Fixed printf format specifiers for size_t/uintptr_t.
  * - Removed duplicate function definition.
@@ -80,14 +91,26 @@ typedef struct buddy_header {
 // --- Free List Structure ---
 /**
  * @brief Structure used to link free blocks in the free lists.
- * Placed at the beginning of each free block.
+ * Placed at the beginning of each free block. The lists are doubly linked so
+ * that a buddy can be unlinked in O(1) during coalescing, and the tag records
+ * that the block is free and at which order.
  */
 typedef struct buddy_block {
     struct buddy_block *next;
+    struct buddy_block *prev;
+    uint32_t tag;              // BUDDY_FREE_TAG | order while on a free list, 0 otherwise
 } buddy_block_t;
 
+#define BUDDY_FREE_TAG       0xB0DD1E00u
+#define BUDDY_FREE_TAG_MASK  0xFFFFFF00u
+#define BUDDY_MAKE_TAG(order) (BUDDY_FREE_TAG | (uint32_t)(order))
+
+_Static_assert(sizeof(buddy_block_t) <= MIN_BLOCK_SIZE_INTERNAL, "buddy_block_t must fit in the smallest block");
+_Static_assert(MAX_ORDER < 32, "Free-order bitmap is a single 32-bit word");
+
 // === Global State ===
 static buddy_block_t *free_lists[MAX_ORDER + 1] = {0}; // Array of free lists per order
+static uint32_t g_free_order_bitmap = 0;               // Bit N set <=> free_lists[N] is non-empty
 static uintptr_t g_heap_start_virt_addr = 0;           // Aligned VIRTUAL start address of managed heap
 static uintptr_t g_heap_end_virt_addr = 0;             // VIRTUAL end address (exclusive) of managed heap
 static uintptr_t g_buddy_heap_phys_start_addr = 0;     // Aligned PHYSICAL start address of managed heap
@@ -105,6 +128,11 @@ static uint64_t g_failed_alloc_count = 0;
 #define DEBUG_CANARY_START 0xDEADBEEF
 #define DEBUG_CANARY_END   0xCAFEBABE
 #define MAX_TRACKER_NODES 1024 // Adjust as needed
+#define TRACKER_HASH_BITS 11   // 2048 slots: load factor stays <= 0.5
+#define TRACKER_HASH_SIZE (1u << TRACKER_HASH_BITS)
+#define MAX_LEAK_SITES    128  // Distinct file:line sites aggregated by buddy_dump_leaks
+
+_Static_assert(TRACKER_HASH_SIZE >= 2 * MAX_TRACKER_NODES, "Tracker hash table must be at least twice the node pool");
 
 /**
  * @brief Structure to track allocations in debug builds.
@@ -116,23 +144,34 @@ typedef struct allocation_tracker {
     int    order;                    // Order of the buddy block
     const char* source_file;         // File where allocation occurred
     int source_line;                 // Line where allocation occurred
-    struct allocation_tracker* next; // Link for active/free lists
+    struct allocation_tracker* next; // Link for the free node pool
 } allocation_tracker_t;
 
 static allocation_tracker_t g_tracker_nodes[MAX_TRACKER_NODES]; // Static pool
 static allocation_tracker_t *g_free_tracker_nodes = NULL;      // List of free tracker nodes
-static allocation_tracker_t *g_active_allocations = NULL;      // List of active allocations
-static spinlock_t g_alloc_tracker_lock;                        // Lock for tracker lists
+// Open-addressed (linear probing) table of active allocations keyed by user_addr
+static allocation_tracker_t *g_active_table[TRACKER_HASH_SIZE];
+static size_t g_active_count = 0;
+static spinlock_t g_alloc_tracker_lock;                        // Lock for tracker pool and table
+
+/** @brief Hashes a user address to its home slot (Fibonacci hashing). */
+static inline uint32_t tracker_hash(const void* user_addr) {
+    uint32_t key = (uint32_t)((uintptr_t)user_addr >> MIN_ORDER); // Low bits are always zero
+    return (key * 2654435761u) >> (32 - TRACKER_HASH_BITS);
+}
 
-/** @brief Initializes the debug tracker node pool. */
+/** @brief Initializes the debug tracker node pool and the active-allocation table. */
 static void init_tracker_pool() {
     spinlock_init(&g_alloc_tracker_lock);
     g_free_tracker_nodes = NULL;
-    g_active_allocations = NULL;
     for (int i = 0; i < MAX_TRACKER_NODES; ++i) {
         g_tracker_nodes[i].next = g_free_tracker_nodes;
         g_free_tracker_nodes = &g_tracker_nodes[i];
     }
+    for (uint32_t i = 0; i < TRACKER_HASH_SIZE; ++i) {
+        g_active_table[i] = NULL;
+    }
+    g_active_count = 0;
 }
 
 /** @brief Allocates a tracker node from the free pool. Returns NULL if pool is empty. */
@@ -160,29 +199,55 @@ static void free_tracker_node(allocation_tracker_t* node) {
     spinlock_release_irqrestore(&g_alloc_tracker_lock, tracker_irq_flags);
 }
 
-/** @brief Adds a tracker node to the active allocations list. */
+/**
+ * @brief Inserts a tracker node into the active-allocation table.
+ * Every node comes from the pool, so the table can never fill up.
+ */
 static void add_active_allocation(allocation_tracker_t* tracker) {
     if (!tracker) return;
     uintptr_t tracker_irq_flags = spinlock_acquire_irqsave(&g_alloc_tracker_lock);
-    tracker->next = g_active_allocations;
-    g_active_allocations = tracker;
+    uint32_t slot = tracker_hash(tracker->user_addr);
+    while (g_active_table[slot] != NULL) {
+        slot = (slot + 1) & (TRACKER_HASH_SIZE - 1);
+    }
+    g_active_table[slot] = tracker;
+    g_active_count++;
     spinlock_release_irqrestore(&g_alloc_tracker_lock, tracker_irq_flags);
 }
 
-/** @brief Removes and returns the tracker node corresponding to user_addr. Returns NULL if not found. */
+/**
+ * @brief Removes and returns the tracker node corresponding to user_addr. Returns NULL if not found.
+ * Uses backward-shift deletion so probe chains stay intact without tombstones.
+ */
 static allocation_tracker_t* remove_active_allocation(void* user_addr) {
     allocation_tracker_t* found_tracker = NULL;
-    allocation_tracker_t** prev_next_ptr = &g_active_allocations;
     uintptr_t tracker_irq_flags = spinlock_acquire_irqsave(&g_alloc_tracker_lock);
-    allocation_tracker_t* current = g_active_allocations;
-    while (current) {
-        if (current->user_addr == user_addr) {
-            found_tracker = current;
-            *prev_next_ptr = current->next; // Unlink
+    uint32_t slot = tracker_hash(user_addr);
+    while (g_active_table[slot] != NULL) {
+        if (g_active_table[slot]->user_addr == user_addr) {
+            found_tracker = g_active_table[slot];
             break;
         }
-        prev_next_ptr = &current->next;
-        current = current->next;
+        slot = (slot + 1) & (TRACKER_HASH_SIZE - 1);
+    }
+
+    if (found_tracker) {
+        // Pull later entries of the same cluster back into the hole if their
+        // home slot does not lie cyclically within (hole, current].
+        uint32_t hole = slot;
+        uint32_t next = (hole + 1) & (TRACKER_HASH_SIZE - 1);
+        while (g_active_table[next] != NULL) {
+            uint32_t home = tracker_hash(g_active_table[next]->user_addr);
+            bool stays = (hole <= next) ? (home > hole && home <= next)
+                                        : (home > hole || home <= next);
+            if (!stays) {
+                g_active_table[hole] = g_active_table[next];
+                hole = next;
+            }
+            next = (next + 1) & (TRACKER_HASH_SIZE - 1);
+        }
+        g_active_table[hole] = NULL;
+        g_active_count--;
     }
     spinlock_release_irqrestore(&g_alloc_tracker_lock, tracker_irq_flags);
     return found_tracker;
@@ -253,33 +318,81 @@ static void add_block_to_free_list(void *block_ptr, int order) {
     BUDDY_ASSERT(block_ptr != NULL, "Adding NULL block to free list");
 
     buddy_block_t *block = (buddy_block_t*)block_ptr;
+    block->prev = NULL;
     block->next = free_lists[order];
+    block->tag = BUDDY_MAKE_TAG(order);
+    if (block->next) {
+        block->next->prev = block;
+    }
     free_lists[order] = block;
+    g_free_order_bitmap |= (1u << order);
+}
+
+/**
+ * @brief Unlinks a block that is known to be on free_lists[order].
+ * Clears the free tag so stale data can never be mistaken for a free block.
+ * @note Assumes the buddy lock is held by the caller.
+ */
+static inline void unlink_free_block(buddy_block_t *block, int order) {
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        free_lists[order] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+    if (!free_lists[order]) {
+        g_free_order_bitmap &= ~(1u << order);
+    }
+    block->next = NULL;
+    block->prev = NULL;
+    block->tag = 0;
+}
+
+/**
+ * @brief Checks in O(1) whether a block is currently free at exactly 'order'.
+ * The tag alone could be forged by user data in an allocated block, so the
+ * back-link must also agree with the free list before it is trusted; being
+ * forgeable too, it is only followed once it names a block of this order
+ * inside the heap.
+ * @note Assumes the buddy lock is held by the caller.
+ */
+static inline bool is_free_block_of_order(const buddy_block_t *block, int order) {
+    if (block->tag != BUDDY_MAKE_TAG(order)) {
+        return false;
+    }
+    const buddy_block_t *prev = block->prev;
+    if (!prev) {
+        return free_lists[order] == block;
+    }
+    uintptr_t prev_addr = (uintptr_t)prev;
+    size_t block_size = (size_t)1 << order;
+    if (prev == block || prev_addr < g_heap_start_virt_addr || prev_addr >= g_heap_end_virt_addr ||
+        g_heap_end_virt_addr - prev_addr < block_size ||
+        (prev_addr - g_heap_start_virt_addr) % block_size != 0) {
+        return false;
+    }
+    return prev->tag == BUDDY_MAKE_TAG(order) && prev->next == block;
 }
 
 /**
  * @brief Removes a specific block (given by its virtual address) from its free list.
  * @param block_ptr Virtual address of the block to remove.
  * @param order The order of the block to remove.
- * @return true if found and removed, false otherwise.
+ * @return true if the block was free at this order and has been removed, false otherwise.
  * @note Assumes the buddy lock is held by the caller.
  */
 static bool remove_block_from_free_list(void *block_ptr, int order) {
     BUDDY_ASSERT(order >= MIN_INTERNAL_ORDER && order <= MAX_ORDER, "Invalid order in remove_block_from_free_list");
     BUDDY_ASSERT(block_ptr != NULL, "Removing NULL block from free list");
 
-    buddy_block_t **prev_next_ptr = &free_lists[order];
-    buddy_block_t *current = free_lists[order];
-
-    while (current) {
-        if (current == (buddy_block_t*)block_ptr) {
-            *prev_next_ptr = current->next; // Unlink
-            return true;
-        }
-        prev_next_ptr = &current->next;
-        current = current->next;
+    buddy_block_t *block = (buddy_block_t*)block_ptr;
+    if (!is_free_block_of_order(block, order)) {
+        return false; // Not free, or free at a different order (split/merged)
     }
-    return false; // Not found
+    unlink_free_block(block, order);
+    return true;
 }
 
 /**
@@ -344,6 +457,7 @@ void buddy_init(void *heap_region_phys_start_ptr, size_t region_size) {
 
     // 2. Initialize Locks and Free Lists
     for (int i = 0; i <= MAX_ORDER; i++) free_lists[i] = NULL;
+    g_free_order_bitmap = 0;
     spinlock_init(&g_buddy_lock);
     #ifdef DEBUG_BUDDY
     init_tracker_pool();
@@ -451,14 +565,9 @@ void buddy_init(void *heap_region_phys_start_ptr, size_t region_size) {
 static void* buddy_alloc_impl(int requested_order, const char* file, int line) {
     //terminal_printf("[Buddy Alloc Impl] Enter: Request order %d. File: %s Line: %d\n", requested_order, file, line); // LOG ENTRY
 
-    // Find the smallest available block order >= requested_order
-    int order = requested_order;
-    while (order <= MAX_ORDER) {
-        if (free_lists[order] != NULL) {
-            break; // Found a suitable free list
-        }
-        order++;
-    }
+    // Find the smallest available block order >= requested_order with one bit scan
+    uint32_t usable_orders = g_free_order_bitmap & ~((1u << requested_order) - 1u);
+    int order = usable_orders ? __builtin_ctz(usable_orders) : MAX_ORDER + 1;
 
     if (order > MAX_ORDER) { // Out of memory
         g_failed_alloc_count++;
@@ -473,7 +582,7 @@ static void* buddy_alloc_impl(int requested_order, const char* file, int line) {
 
     // Remove block from the found free list
     buddy_block_t *block = free_lists[order];
-    free_lists[order] = block->next; // Dequeue
+    unlink_free_block(block, order); // Dequeue
 
     // Split the block down to the requested order if necessary
     while (order > requested_order) {
@@ -719,28 +828,63 @@ void buddy_free_internal(void *ptr, const char* file, int line) {
 }
 
 /* buddy_dump_leaks (Debug Version) */
+typedef struct leak_site {
+    const char* source_file;
+    int source_line;
+    int block_count;
+    size_t bytes;
+} leak_site_t;
+
+static leak_site_t g_leak_sites[MAX_LEAK_SITES]; // Scratch space, only used under the tracker lock
+
 void buddy_dump_leaks(void) {
     terminal_write("\n--- Buddy Allocator Leak Check ---\n");
     uintptr_t tracker_irq_flags = spinlock_acquire_irqsave(&g_alloc_tracker_lock);
-    allocation_tracker_t* current = g_active_allocations;
     int leak_count = 0;
     size_t leak_bytes = 0;
-    if (!current) {
+    int site_count = 0;
+    int unaggregated = 0;
+    if (g_active_count == 0) {
         terminal_write("No active allocations tracked. No leaks detected.\n");
     } else {
-        terminal_write("Detected potential memory leaks (unfreed blocks):\n");
-        while(current) {
-            // Use %lu for size_t
-            terminal_printf("  - User Addr: 0x%p, Block Addr: 0x%p, Block Size: %lu bytes (Order %d), Allocated at: %s:%d\n",
-                            current->user_addr, current->block_addr, current->block_size, current->order,
-                            current->source_file ? current->source_file : "<unknown>",
-                            current->source_line);
+        // Aggregate live allocations by their allocation site
+        for (uint32_t i = 0; i < TRACKER_HASH_SIZE; ++i) {
+            allocation_tracker_t* current = g_active_table[i];
+            if (!current) continue;
             leak_count++;
             leak_bytes += current->block_size;
-            current = current->next;
+
+            int s = 0;
+            while (s < site_count &&
+                   !(g_leak_sites[s].source_line == current->source_line &&
+                     g_leak_sites[s].source_file == current->source_file)) {
+                s++;
+            }
+            if (s == site_count) {
+                if (site_count == MAX_LEAK_SITES) { unaggregated++; continue; }
+                g_leak_sites[s].source_file = current->source_file;
+                g_leak_sites[s].source_line = current->source_line;
+                g_leak_sites[s].block_count = 0;
+                g_leak_sites[s].bytes = 0;
+                site_count++;
+            }
+            g_leak_sites[s].block_count++;
+            g_leak_sites[s].bytes += current->block_size;
+        }
+
+        terminal_write("Detected potential memory leaks (unfreed blocks) by allocation site:\n");
+        for (int s = 0; s < site_count; ++s) {
+            // Use %lu for size_t
+            terminal_printf("  - %s:%d: %d blocks, %lu bytes\n",
+                            g_leak_sites[s].source_file ? g_leak_sites[s].source_file : "<unknown>",
+                            g_leak_sites[s].source_line,
+                            g_leak_sites[s].block_count, g_leak_sites[s].bytes);
+        }
+        if (unaggregated > 0) {
+            terminal_printf("  - (%d blocks from further sites not listed)\n", unaggregated);
         }
         // Use %lu for size_t
-        terminal_printf("Total Leaks: %d blocks, %lu bytes (buddy block size)\n", leak_count, leak_bytes);
+        terminal_printf("Total Leaks: %d blocks, %lu bytes (buddy block size) from %d sites\n", leak_count, leak_bytes, site_count);
     }
     terminal_write("----------------------------------\n");
     spinlock_release_irqrestore(&g_alloc_tracker_lock, tracker_irq_flags);
@@ -881,6 +1025,63 @@ void buddy_free_raw(void* block_addr_virt, int order) {
      // Note: buddy_free_impl already increments g_free_count
 }
 
+/**
+ * @brief Allocates up to 'count' raw blocks of one order under a single lock hold.
+ * Used by the per-CPU frame cache to refill in batches.
+ * @param order The exact buddy order to allocate.
+ * @param out Array receiving the block addresses.
+ * @param count Number of blocks wanted.
+ * @return Number of blocks actually allocated (may be short on OOM).
+ */
+int buddy_alloc_raw_batch(int order, void **out, int count) {
+    if (!out || count <= 0) return 0;
+    if (order < MIN_INTERNAL_ORDER || order > MAX_ORDER) {
+        terminal_printf("[Buddy Raw Batch] Error: Invalid order %d requested.\n", order);
+        return 0;
+    }
+    int got = 0;
+    uintptr_t buddy_irq_flags = spinlock_acquire_irqsave(&g_buddy_lock);
+    while (got < count) {
+        void *block = buddy_alloc_impl(order, __FILE__, __LINE__);
+        if (!block) break;
+        out[got++] = block;
+    }
+    spinlock_release_irqrestore(&g_buddy_lock, buddy_irq_flags);
+    return got;
+}
+
+/**
+ * @brief Frees 'count' raw blocks of one order under a single lock hold.
+ * Blocks are validated like buddy_free_raw() before the lock is taken.
+ * @param blocks Array of block addresses.
+ * @param count Number of blocks.
+ * @param order The exact buddy order of every block.
+ */
+void buddy_free_raw_batch(void **blocks, int count, int order) {
+    if (!blocks || count <= 0) return;
+    if (order < MIN_INTERNAL_ORDER || order > MAX_ORDER) {
+        terminal_printf("[Buddy Raw Batch] Error: Invalid order %d for free.\n", order);
+        BUDDY_PANIC("Invalid order in buddy_free_raw_batch");
+        return;
+    }
+    size_t block_size = (size_t)1 << order;
+    for (int i = 0; i < count; i++) {
+        uintptr_t addr = (uintptr_t)blocks[i];
+        if (addr < g_heap_start_virt_addr || addr >= g_heap_end_virt_addr ||
+            (addr - g_heap_start_virt_addr) % block_size != 0) {
+            terminal_printf("[Buddy Raw Batch] Error: Bad block 0x%p for order %d.\n", blocks[i], order);
+            BUDDY_PANIC("Invalid block in buddy_free_raw_batch");
+            return;
+        }
+    }
+
+    uintptr_t buddy_irq_flags = spinlock_acquire_irqsave(&g_buddy_lock);
+    for (int i = 0; i < count; i++) {
+        buddy_free_impl(blocks[i], order, __FILE__, __LINE__);
+    }
+    spinlock_release_irqrestore(&g_buddy_lock, buddy_irq_flags);
+}
+
 #endif // DEBUG_BUDDY
 
 
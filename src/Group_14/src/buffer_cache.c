@@ -4,6 +4,16 @@
  * This implementation provides a robust buffer caching system for block devices
  * with comprehensive error handling, proper synchronization primitives, and
  * optimal memory management to prevent buffer overflows and memory corruption.
+ *
+ * Buffers are keyed by (device id, block number). The hash table is split
+ * into BUFFER_CACHE_SHARDS shards, each with its own lock, replacement
+ * queues and counters, so lookups of unrelated blocks do not contend.
+ *
+ * Replacement is 2Q: a block read for the first time goes on the shard's
+ * A1in FIFO. When it falls off A1in its key is remembered on the A1out ghost
+ * list; a miss on a remembered key means the block is re-used, and it is
+ * admitted to the Am LRU. A large sequential read therefore only cycles
+ * through A1in and never pushes hot FAT and directory blocks out of Am.
  */
 
  #include "buffer_cache.h"
@@ -12,73 +22,101 @@
  #include "disk.h"
  #include "fs_errno.h"
  #include "spinlock.h"
+ #include "mutex.h"
+ #include "blk_queue.h"
+ #include "pit.h"
+ #include "process.h"
+ #include "scheduler.h"
  #include <string.h>
  #include "types.h"
- 
+
  // Configuration
- #define BUFFER_CACHE_HASH_SIZE     256     // Power of 2 recommended for hash distribution
+ #define BUFFER_CACHE_BUCKET_BITS   4       // Hash buckets per shard = 16
+ #define BUFFER_CACHE_BUCKETS       (1u << BUFFER_CACHE_BUCKET_BITS)
+ #define BUFFER_SHARD_CAPACITY      (BUFFER_CACHE_MAX_BUFFERS / BUFFER_CACHE_SHARDS)
+ #define BUFFER_2Q_KIN              (BUFFER_SHARD_CAPACITY / 4) // A1in target size
+ #define BUFFER_2Q_KOUT             BUFFER_SHARD_CAPACITY       // A1out ghost entries (8 bytes each)
  #define DEFAULT_BUFFER_BLOCK_SIZE  512     // Standard sector size
  #define MAX_BUFFER_BLOCK_SIZE      8192    // Maximum allowed buffer size
  #define MIN_BUFFER_BLOCK_SIZE      128     // Minimum allowed buffer size
  #define BUFFER_PADDING             16      // Safety padding for buffers
- #define MAX_SECTORS_PER_IO         128     // Maximum sectors in a single I/O operation
- 
- // Cache statistics (optional)
+ #define BUFFER_PREFETCH_MAX_BLOCKS MAX_SECTORS_PER_IO // Blocks per read-ahead request
+ #define BUFFER_FLUSH_INTERVAL_MS   500     // Flusher wake-up period
+ #define BUFFER_MAX_WRITEBACK_HOOKS 8
+
+ // Cache statistics that are not per shard (optional)
  static struct {
-     uint32_t hits;          // Cache hits
-     uint32_t misses;        // Cache misses
      uint32_t reads;         // Disk reads performed
      uint32_t writes;        // Disk writes performed
-     uint32_t evictions;     // Number of buffers evicted
+     uint32_t prefetched;    // Blocks added by read-ahead
      uint32_t alloc_failures;// Memory allocation failures
      uint32_t io_errors;     // I/O errors encountered
  } cache_stats;
- 
- // Lock for the entire buffer cache
- static spinlock_t cache_lock;
- 
- // Hash table of buffer pointers
- static buffer_t *buffer_hash_table[BUFFER_CACHE_HASH_SIZE];
- 
- // LRU list for buffer replacement
- static buffer_t *lru_head = NULL;  // Most recently used
- static buffer_t *lru_tail = NULL;  // Least recently used
- 
- // Device registry - simple implementation
+
+ // A replacement queue (doubly linked through lru_prev/lru_next)
+ typedef struct {
+     buffer_t *head;          // Most recently inserted/used
+     buffer_t *tail;
+     uint32_t count;
+ } buffer_queue_t;
+
+ // Key of a block evicted from A1in
+ typedef struct {
+     uint32_t dev_id;         // 0 = unused slot
+     uint32_t block_number;
+ } buffer_ghost_t;
+
+ typedef struct {
+     spinlock_t lock;
+     buffer_t *hash[BUFFER_CACHE_BUCKETS];
+     buffer_queue_t a1in;
+     buffer_queue_t am;
+     buffer_ghost_t a1out[BUFFER_2Q_KOUT]; // Ring, oldest overwritten first
+     uint32_t a1out_next;
+     uint32_t count;
+     buffer_shard_stats_t stats;
+ } buffer_shard_t;
+
+ static buffer_shard_t buffer_shards[BUFFER_CACHE_SHARDS];
+ static volatile bool g_buffer_scan_resistant = true;
+
+ // Background write-back: filesystem hooks run before each flusher pass
+ typedef struct {
+     buffer_writeback_hook_t hook;
+     void *ctx;
+ } buffer_hook_entry_t;
+
+ static buffer_hook_entry_t writeback_hooks[BUFFER_MAX_WRITEBACK_HOOKS];
+ static mutex_t writeback_hooks_lock; // Hooks take filesystem mutexes
+ static volatile uint32_t g_dirty_expire_ms = BUFFER_DIRTY_EXPIRE_MS;
+ static volatile uint32_t g_dirty_ratio_pct = BUFFER_DIRTY_RATIO_PCT;
+ static volatile bool g_flusher_started;
+
+ // Device registry - simple implementation; device id = index + 1
  #define MAX_REGISTERED_DISKS 8
  static struct {
      disk_t *disks[MAX_REGISTERED_DISKS];
      int count;
      spinlock_t lock;
  } disk_registry;
- 
+
  /**
-  * Compute a high-quality hash for buffer lookup
+  * Multiplicative hash of the (device id, block) key. The top bits pick the
+  * shard and the next bits the bucket, so consecutive blocks spread out.
   */
- static uint32_t buffer_hash(const char *device_name, uint32_t block_number) {
-     if (!device_name) return block_number % BUFFER_CACHE_HASH_SIZE;
- 
-     // FNV-1a hash algorithm
-     uint32_t hash = 2166136261u; // FNV offset basis
- 
-     // Hash the device name
-     for (const char *p = device_name; *p; p++) {
-         hash ^= (uint8_t)(*p);
-         hash *= 16777619u; // FNV prime
-     }
- 
-     // Mix in the block number
-     hash ^= (block_number & 0xFF);
-     hash *= 16777619u;
-     hash ^= ((block_number >> 8) & 0xFF);
-     hash *= 16777619u;
-     hash ^= ((block_number >> 16) & 0xFF);
-     hash *= 16777619u;
-     hash ^= ((block_number >> 24) & 0xFF);
- 
-     return hash % BUFFER_CACHE_HASH_SIZE;
- }
- 
+ static inline uint32_t buffer_hash(uint32_t dev_id, uint32_t block_number) {
+     return (block_number ^ (dev_id << 24)) * 2654435761u;
+ }
+
+ static inline buffer_shard_t *buffer_shard_of(uint32_t dev_id, uint32_t block_number) {
+     return &buffer_shards[buffer_hash(dev_id, block_number) >> (32 - BUFFER_CACHE_SHARD_BITS)];
+ }
+
+ static inline uint32_t buffer_bucket_of(uint32_t dev_id, uint32_t block_number) {
+     return (buffer_hash(dev_id, block_number) >> (32 - BUFFER_CACHE_SHARD_BITS - BUFFER_CACHE_BUCKET_BITS)) &
+            (BUFFER_CACHE_BUCKETS - 1);
+ }
+
  /**
   * Register a disk with the buffer cache system
   */
@@ -86,17 +124,17 @@
      if (!disk || !disk->initialized || !disk->blk_dev.device_name) {
          return -FS_ERR_INVALID_PARAM;
      }
- 
+
      // Validate sector size
      if (disk->blk_dev.sector_size < MIN_BUFFER_BLOCK_SIZE ||
          disk->blk_dev.sector_size > MAX_BUFFER_BLOCK_SIZE) {
-         terminal_printf("[BufferCache] Invalid sector size %u for device '%s'.\n",
-                        disk->blk_dev.sector_size, disk->blk_dev.device_name);
+         terminal_printf("[BufferCache] Invalid sector size %lu for device '%s'.\n",
+                        (unsigned long)disk->blk_dev.sector_size, disk->blk_dev.device_name);
          return -FS_ERR_INVALID_PARAM;
      }
- 
+
      uintptr_t irq_state = spinlock_acquire_irqsave(&disk_registry.lock);
- 
+
      // Check if disk is already registered
      for (int i = 0; i < disk_registry.count; i++) {
          if (disk_registry.disks[i] == disk) {
@@ -104,7 +142,7 @@
              return 0; // Already registered
          }
      }
- 
+
      // Check if registry is full
      if (disk_registry.count >= MAX_REGISTERED_DISKS) {
          terminal_printf("[BufferCache] Cannot register disk '%s': registry full.\n",
@@ -112,143 +150,98 @@
          spinlock_release_irqrestore(&disk_registry.lock, irq_state);
          return -FS_ERR_NO_RESOURCES;
      }
- 
+
      // Add to registry
      disk_registry.disks[disk_registry.count++] = disk;
- 
+     disk->cache_dev_id = (uint32_t)disk_registry.count;
+
      spinlock_release_irqrestore(&disk_registry.lock, irq_state);
-     terminal_printf("[BufferCache] Registered disk '%s'.\n", disk->blk_dev.device_name);
+     terminal_printf("[BufferCache] Registered disk '%s' as device %lu.\n",
+                     disk->blk_dev.device_name, (unsigned long)disk->cache_dev_id);
      return 0;
  }
- 
+
+ /**
+  * Lookup a disk by device id. Entries are never removed, so no lock is needed.
+  */
+ static disk_t *get_disk_by_id(uint32_t dev_id) {
+     if (dev_id == 0 || dev_id > (uint32_t)disk_registry.count) return NULL;
+     return disk_registry.disks[dev_id - 1];
+ }
+
  /**
-  * Lookup a disk by device name
+  * Lookup a device id by device name
   */
- static disk_t *get_disk_by_name(const char *device_name) {
-     if (!device_name) return NULL;
- 
+ uint32_t buffer_device_id(const char *device_name) {
+     if (!device_name) return 0;
+
      uintptr_t irq_state = spinlock_acquire_irqsave(&disk_registry.lock);
- 
-     disk_t *found_disk = NULL;
+
+     uint32_t dev_id = 0;
      for (int i = 0; i < disk_registry.count; i++) {
          if (strcmp(disk_registry.disks[i]->blk_dev.device_name, device_name) == 0) {
-             found_disk = disk_registry.disks[i];
+             dev_id = (uint32_t)i + 1;
              break;
          }
      }
- 
+
      spinlock_release_irqrestore(&disk_registry.lock, irq_state);
-     return found_disk;
+     return dev_id;
  }
- 
+
  /**
   * Initialize the buffer cache system
   */
  void buffer_cache_init(void) {
-     // Initialize locks
-     spinlock_init(&cache_lock);
+     // Initialize locks and shards
+     memset(buffer_shards, 0, sizeof(buffer_shards));
+     for (uint32_t i = 0; i < BUFFER_CACHE_SHARDS; i++) {
+         spinlock_init(&buffer_shards[i].lock);
+     }
      spinlock_init(&disk_registry.lock);
- 
-     // Initialize hash table
-     memset(buffer_hash_table, 0, sizeof(buffer_hash_table));
- 
+     mutex_init(&writeback_hooks_lock);
+
      // Initialize disk registry
      disk_registry.count = 0;
- 
+
      // Clear statistics
      memset(&cache_stats, 0, sizeof(cache_stats));
- 
-     terminal_write("[BufferCache] Initialized buffer cache system.\n");
+
+     terminal_printf("[BufferCache] Initialized buffer cache system (%u shards, %u buffers).\n",
+                     (unsigned)BUFFER_CACHE_SHARDS, (unsigned)BUFFER_CACHE_MAX_BUFFERS);
  }
- 
+
  /**
   * Lookup a buffer in the cache (internal helper)
-  * Assumes cache_lock is already held
+  * Assumes the shard lock is already held
   */
- static buffer_t *buffer_lookup_internal(const char *device_name, uint32_t block_number) {
-     if (!device_name) return NULL;
- 
-     uint32_t index = buffer_hash(device_name, block_number);
-     buffer_t *buf = buffer_hash_table[index];
- 
+ static buffer_t *buffer_lookup_internal(buffer_shard_t *shard, uint32_t dev_id, uint32_t block_number) {
+     buffer_t *buf = shard->hash[buffer_bucket_of(dev_id, block_number)];
      while (buf) {
-         if (buf->block_number == block_number &&
-             buf->disk &&
-             strcmp(buf->disk->blk_dev.device_name, device_name) == 0) {
+         if (buf->block_number == block_number && buf->dev_id == dev_id) {
              return buf;
          }
          buf = buf->hash_next;
      }
- 
      return NULL;
  }
- 
- /**
-  * LRU list management: move buffer to front of LRU list
-  * Assumes cache_lock is already held
-  */
- static void lru_make_most_recent(buffer_t *buf) {
-     if (!buf || buf == lru_head) return;
- 
-     // Remove from current position
-     if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next;
-     if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev;
-     if (buf == lru_tail) lru_tail = buf->lru_prev;
- 
-     // Add to head
-     buf->lru_prev = NULL;
-     buf->lru_next = lru_head;
-     if (lru_head) lru_head->lru_prev = buf;
-     lru_head = buf;
- 
-     // If list was empty, set tail
-     if (!lru_tail) lru_tail = buf;
- }
- 
+
  /**
-  * Remove a buffer from the LRU list
-  * Assumes cache_lock is already held
+  * Insert buffer into its shard's hash table
+  * Assumes the shard lock is already held
   */
- static void lru_remove(buffer_t *buf) {
-     if (!buf) return;
- 
-     if (buf->lru_prev) {
-         buf->lru_prev->lru_next = buf->lru_next;
-     } else {
-         lru_head = buf->lru_next;
-     }
- 
-     if (buf->lru_next) {
-         buf->lru_next->lru_prev = buf->lru_prev;
-     } else {
-         lru_tail = buf->lru_prev;
-     }
- 
-     buf->lru_prev = buf->lru_next = NULL;
+ static void buffer_insert_internal(buffer_shard_t *shard, buffer_t *buf) {
+     uint32_t index = buffer_bucket_of(buf->dev_id, buf->block_number);
+     buf->hash_next = shard->hash[index];
+     shard->hash[index] = buf;
  }
- 
- /**
-  * Insert buffer into hash table
-  * Assumes cache_lock is already held
-  */
- static void buffer_insert_internal(buffer_t *buf) {
-     if (!buf || !buf->disk || !buf->disk->blk_dev.device_name) return;
- 
-     uint32_t index = buffer_hash(buf->disk->blk_dev.device_name, buf->block_number);
-     buf->hash_next = buffer_hash_table[index];
-     buffer_hash_table[index] = buf;
- }
- 
+
  /**
-  * Remove buffer from hash table
-  * Assumes cache_lock is already held
+  * Remove buffer from its shard's hash table
+  * Assumes the shard lock is already held
   */
- static void buffer_remove_internal(buffer_t *buf) {
-     if (!buf || !buf->disk || !buf->disk->blk_dev.device_name) return;
- 
-     uint32_t index = buffer_hash(buf->disk->blk_dev.device_name, buf->block_number);
-     buffer_t **pp = &buffer_hash_table[index];
- 
+ static void buffer_remove_internal(buffer_shard_t *shard, buffer_t *buf) {
+     buffer_t **pp = &shard->hash[buffer_bucket_of(buf->dev_id, buf->block_number)];
      while (*pp) {
          if (*pp == buf) {
              *pp = buf->hash_next;
@@ -258,313 +251,425 @@
          pp = &((*pp)->hash_next);
      }
  }
- 
+
+ // --- Replacement Queues (shard lock held) ---
+
+ static buffer_queue_t *queue_of(buffer_shard_t *shard, buffer_t *buf) {
+     return buf->queue == BUFFER_QUEUE_AM ? &shard->am : &shard->a1in;
+ }
+
+ static void queue_push_head(buffer_shard_t *shard, buffer_t *buf, uint32_t which) {
+     buf->queue = which;
+     buffer_queue_t *q = queue_of(shard, buf);
+     buf->lru_prev = NULL;
+     buf->lru_next = q->head;
+     if (q->head) q->head->lru_prev = buf;
+     q->head = buf;
+     if (!q->tail) q->tail = buf;
+     q->count++;
+ }
+
+ static void queue_remove(buffer_shard_t *shard, buffer_t *buf) {
+     if (buf->queue == BUFFER_QUEUE_NONE) return;
+     buffer_queue_t *q = queue_of(shard, buf);
+     if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next; else q->head = buf->lru_next;
+     if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev; else q->tail = buf->lru_prev;
+     buf->lru_prev = buf->lru_next = NULL;
+     buf->queue = BUFFER_QUEUE_NONE;
+     q->count--;
+ }
+
+ /**
+  * A cache hit. Blocks on Am move to its head; hits on A1in are treated as
+  * correlated references (2Q) and leave the block where it is.
+  */
+ static void buffer_touch(buffer_shard_t *shard, buffer_t *buf) {
+     if (buf->queue == BUFFER_QUEUE_AM && shard->am.head != buf) {
+         queue_remove(shard, buf);
+         queue_push_head(shard, buf, BUFFER_QUEUE_AM);
+     }
+ }
+
+ static void ghost_remember(buffer_shard_t *shard, uint32_t dev_id, uint32_t block_number) {
+     buffer_ghost_t *g = &shard->a1out[shard->a1out_next];
+     g->dev_id = dev_id;
+     g->block_number = block_number;
+     shard->a1out_next = (shard->a1out_next + 1) % BUFFER_2Q_KOUT;
+ }
+
+ /** Removes the key from A1out; true if it was there. */
+ static bool ghost_take(buffer_shard_t *shard, uint32_t dev_id, uint32_t block_number) {
+     for (uint32_t i = 0; i < BUFFER_2Q_KOUT; i++) {
+         buffer_ghost_t *g = &shard->a1out[i];
+         if (g->dev_id == dev_id && g->block_number == block_number) {
+             g->dev_id = 0;
+             return true;
+         }
+     }
+     return false;
+ }
+
  /**
-  * Evict the LRU buffer (if possible), flush if dirty, remove from cache, and free it.
+  * Places a newly read block: straight onto Am if it was seen recently (or
+  * if scan resistance is off, which makes Am a plain LRU), else on A1in.
+  */
+ static void buffer_admit(buffer_shard_t *shard, buffer_t *buf) {
+     bool reused = ghost_take(shard, buf->dev_id, buf->block_number);
+     if (reused) shard->stats.ghost_hits++;
+     queue_push_head(shard, buf, (reused || !g_buffer_scan_resistant) ? BUFFER_QUEUE_AM : BUFFER_QUEUE_A1IN);
+ }
+
+ /** Oldest unreferenced buffer on a queue, or NULL. */
+ static buffer_t *queue_oldest_unpinned(buffer_queue_t *q) {
+     for (buffer_t *buf = q->tail; buf; buf = buf->lru_prev) {
+         if (buf->ref_count == 0) return buf;
+     }
+     return NULL;
+ }
+
+ /**
+  * 2Q victim choice: trim A1in while it holds more than its share, otherwise
+  * take the LRU end of Am. Referenced buffers are skipped.
+  */
+ static buffer_t *buffer_pick_victim(buffer_shard_t *shard) {
+     buffer_t *victim = NULL;
+     if (shard->a1in.count > BUFFER_2Q_KIN || shard->am.count == 0) {
+         victim = queue_oldest_unpinned(&shard->a1in);
+     }
+     if (!victim) victim = queue_oldest_unpinned(&shard->am);
+     if (!victim) victim = queue_oldest_unpinned(&shard->a1in);
+     return victim;
+ }
+
+ /**
+  * Evict one buffer from the shard, writing it back first if it is dirty,
+  * and free it.
   * Returns 0 on success (eviction performed), negative error code if no suitable victim.
   * Handles its own locking internally (acquire, release).
   */
- static int evict_lru_buffer_and_free(void) {
-     uintptr_t irq_flags_cache = spinlock_acquire_irqsave(&cache_lock);
- 
-     buffer_t *victim = lru_tail;
- 
-     while (victim) {
-         if (victim->ref_count == 0) {
-             // Found a candidate
-             bool needs_flush = (victim->flags & BUFFER_FLAG_DIRTY);
-             disk_t* disk_to_write = victim->disk;
-             uint32_t block_to_write = victim->block_number;
-             size_t sector_size = 0;
-             void* data_to_write = NULL; // Temporary buffer
- 
-             if (needs_flush) {
-                 // Validate the disk
-                 if (!disk_to_write || !disk_to_write->initialized) {
-                     terminal_printf("[Evict] Error: Victim disk invalid for block %u.\n",
-                                     block_to_write);
-                     // Try previous victim
-                     victim = victim->lru_prev;
-                     continue;
-                 }
- 
-                 sector_size = disk_to_write->blk_dev.sector_size;
-                 if (sector_size == 0) {
-                     sector_size = DEFAULT_BUFFER_BLOCK_SIZE;
-                 }
- 
-                 // Allocate a temporary buffer to hold dirty data
-                 data_to_write = kmalloc(sector_size);
-                 if (!data_to_write) {
-                     terminal_printf("[Evict] Error: kmalloc failed for flush buffer.\n");
-                     // Cannot flush this one; try previous
-                     victim = victim->lru_prev;
-                     continue;
-                 }
- 
-                 memcpy(data_to_write, victim->data, sector_size);
-                 // Mark clean in cache metadata (under lock)
-                 victim->flags &= ~BUFFER_FLAG_DIRTY;
-             }
- 
-             // Remove from LRU and hash while holding lock
-             lru_remove(victim);
-             buffer_remove_internal(victim);
-             cache_stats.evictions++;
- 
-             // Keep pointer to free outside lock
-             buffer_t *victim_to_free = victim;
- 
-             // Release lock before doing I/O
-             spinlock_release_irqrestore(&cache_lock, irq_flags_cache);
- 
-             // Perform Disk I/O if needed
-             if (needs_flush && data_to_write && disk_to_write) {
-                int write_result = disk_write_raw_sectors(disk_to_write, block_to_write,
-                    data_to_write, 1);
-
-                 if (write_result != 0) {
-                     terminal_printf("[Evict] Flush FAILED (Error %d) for block %u.\n",
-                                     write_result, block_to_write);
-                     cache_stats.io_errors++;
-                 } else {
-                     cache_stats.writes++;
-                 }
-             }
- 
-             if (data_to_write) {
-                 kfree(data_to_write);
-             }
- 
-             // Free the victim memory outside the lock
-             kfree(victim_to_free->data);
-             kfree(victim_to_free);
- 
-             return 0; // Success
+ static int buffer_evict_and_free(buffer_shard_t *shard) {
+     uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+
+     buffer_t *victim = buffer_pick_victim(shard);
+     if (!victim) {
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+         return -FS_ERR_NO_RESOURCES;
+     }
+
+     if (victim->queue == BUFFER_QUEUE_A1IN) {
+         ghost_remember(shard, victim->dev_id, victim->block_number);
+     }
+     queue_remove(shard, victim);
+     buffer_remove_internal(shard, victim);
+     shard->count--;
+     shard->stats.evictions++;
+
+     // Queue the write-back before the block can be missed and re-read: the
+     // request queue never lets the later read overtake it
+     blk_request_t req;
+     bool needs_flush = (victim->flags & BUFFER_FLAG_DIRTY) && (victim->flags & BUFFER_FLAG_VALID) && victim->disk;
+     if (needs_flush) {
+         blk_request_init(&req, &victim->disk->blk_dev, victim->block_number, victim->data, 1, BLK_REQ_WRITE);
+         blk_submit(&req);
+     }
+
+     spinlock_release_irqrestore(&shard->lock, irq_state);
+
+     if (needs_flush) {
+         int write_result = blk_wait(&req);
+         if (write_result != BLOCK_ERR_OK) {
+             terminal_printf("[Evict] Flush FAILED (Error %d) for block %lu.\n",
+                             write_result, (unsigned long)victim->block_number);
+             cache_stats.io_errors++;
+         } else {
+             cache_stats.writes++;
          }
- 
-         // Move to previous LRU entry
-         victim = victim->lru_prev;
      }
- 
-     // No suitable buffer found
-     spinlock_release_irqrestore(&cache_lock, irq_flags_cache);
-     return -FS_ERR_NO_RESOURCES;
+
+     kfree(victim->data);
+     kfree(victim);
+     return 0;
  }
- 
+
  /**
   * Perform safe read of disk sectors with retries
   */
  static int safe_disk_read(disk_t *disk, uint32_t start_sector, void *buffer, size_t sector_size) {
      if (!disk || !buffer) return -FS_ERR_INVALID_PARAM;
- 
+
      // Retry parameters
      const int max_retries = 3;
      int retries = 0;
      int result = -1;
- 
+
      while (retries < max_retries) {
         result = disk_read_raw_sectors(disk, start_sector, buffer, 1);
          if (result == 0) {
              break; // Success
          }
- 
+
          // Failed, retry
          retries++;
-         terminal_printf("[BufferCache] Retry %d: Reading sector %u from '%s'...\n",
-                         retries, start_sector, disk->blk_dev.device_name);
+         terminal_printf("[BufferCache] Retry %d: Reading sector %lu from '%s'...\n",
+                         retries, (unsigned long)start_sector, disk->blk_dev.device_name);
      }
- 
+
      if (result != 0) {
-         terminal_printf("[BufferCache] Error: Failed to read sector %u from '%s' after %d retries.\n",
-                         start_sector, disk->blk_dev.device_name, max_retries);
+         terminal_printf("[BufferCache] Error: Failed to read sector %lu from '%s' after %d retries.\n",
+                         (unsigned long)start_sector, disk->blk_dev.device_name, max_retries);
          cache_stats.io_errors++;
      } else {
          cache_stats.reads++;
      }
- 
+
      return result;
  }
- 
+
  /**
-  * Get a buffer (allocate new or return cached)
+  * Allocate an empty buffer, evicting from the shard once if memory is short
   */
- buffer_t *buffer_get(const char *device_name, uint32_t block_number) {
-     if (!device_name) {
-         terminal_write("[BufferCache] Error: NULL device name in buffer_get().\n");
-         return NULL;
+ static buffer_t *buffer_alloc(buffer_shard_t *shard, size_t sector_size) {
+     for (int attempt = 0; attempt < 2; attempt++) {
+         buffer_t *buf = (buffer_t *)kmalloc(sizeof(buffer_t));
+         uint8_t *data = buf ? kmalloc(sector_size + BUFFER_PADDING) : NULL;
+         if (buf && data) {
+             memset(buf, 0, sizeof(buffer_t));
+             memset(data, 0, sector_size + BUFFER_PADDING);
+             buf->data = data;
+             return buf;
+         }
+         if (buf) kfree(buf);
+         if (attempt == 0) {
+             terminal_write("[BufferCache] kmalloc failed for buffer, attempting eviction...\n");
+             if (buffer_evict_and_free(shard) != 0) break;
+         }
      }
- 
-     disk_t *disk = get_disk_by_name(device_name);
+     cache_stats.alloc_failures++;
+     terminal_write("[BufferCache] kmalloc failed for buffer even after eviction.\n");
+     return NULL;
+ }
+
+ /**
+  * Get a buffer (allocate new or return cached)
+  */
+ buffer_t *buffer_get(uint32_t dev_id, uint32_t block_number) {
+     disk_t *disk = get_disk_by_id(dev_id);
      if (!disk || !disk->initialized) {
-         terminal_printf("[BufferCache] Error: Device '%s' not found or not initialized.\n", device_name);
+         terminal_printf("[BufferCache] Error: Device %lu not registered or not initialized.\n", (unsigned long)dev_id);
          return NULL;
      }
- 
+
      // Check sector size
      if (disk->blk_dev.sector_size < MIN_BUFFER_BLOCK_SIZE ||
          disk->blk_dev.sector_size > MAX_BUFFER_BLOCK_SIZE) {
-         terminal_printf("[BufferCache] Error: Invalid sector size %u for device '%s'.\n",
-                         disk->blk_dev.sector_size, device_name);
+         terminal_printf("[BufferCache] Error: Invalid sector size %lu for device '%s'.\n",
+                         (unsigned long)disk->blk_dev.sector_size, disk->blk_dev.device_name);
          return NULL;
      }
- 
-     // Acquire cache lock
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
+
+     buffer_shard_t *shard = buffer_shard_of(dev_id, block_number);
+     uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+
      // Check if buffer is already in cache
-     buffer_t *buf = buffer_lookup_internal(device_name, block_number);
+     buffer_t *buf = buffer_lookup_internal(shard, dev_id, block_number);
      if (buf) {
-         // Found in cache
          buf->ref_count++;
-         lru_make_most_recent(buf);
-         spinlock_release_irqrestore(&cache_lock, irq_state);
-         cache_stats.hits++;
+         buffer_touch(shard, buf);
+         shard->stats.hits++;
+         spinlock_release_irqrestore(&shard->lock, irq_state);
          return buf;
      }
- 
+
      // Not found in cache
-     cache_stats.misses++;
- 
-     // Try to allocate the buffer_t
-     buf = (buffer_t *)kmalloc(sizeof(buffer_t));
+     shard->stats.misses++;
+     bool full = shard->count >= BUFFER_SHARD_CAPACITY;
+     spinlock_release_irqrestore(&shard->lock, irq_state);
+
+     if (full) {
+         buffer_evict_and_free(shard);
+     }
+
+     buf = buffer_alloc(shard, disk->blk_dev.sector_size);
      if (!buf) {
-         terminal_write("[BufferCache] kmalloc failed for buffer_t, attempting eviction...\n");
-         // Release lock before eviction
-         spinlock_release_irqrestore(&cache_lock, irq_state);
- 
-         // Attempt eviction
-         if (evict_lru_buffer_and_free() == 0) {
-             // Eviction succeeded, re-acquire lock & retry allocation
-             irq_state = spinlock_acquire_irqsave(&cache_lock);
-             buf = (buffer_t *)kmalloc(sizeof(buffer_t));
-         } else {
-             // Eviction failed or no buffers to evict
-             irq_state = spinlock_acquire_irqsave(&cache_lock);
-         }
- 
-         if (!buf) {
-             terminal_write("[BufferCache] kmalloc failed for buffer_t even after eviction.\n");
-             spinlock_release_irqrestore(&cache_lock, irq_state);
-             return NULL;
-         }
+         return NULL;
      }
- 
-     memset(buf, 0, sizeof(buffer_t));
      buf->disk = disk;
+     buf->dev_id = dev_id;
      buf->block_number = block_number;
      buf->ref_count = 1;
-     buf->flags = 0;
- 
-     // Allocate buffer->data
-     size_t sector_size = disk->blk_dev.sector_size;
-     buf->data = kmalloc(sector_size + BUFFER_PADDING);
-     if (!buf->data) {
-         terminal_write("[BufferCache] kmalloc failed for buffer data, attempting eviction...\n");
-         // Free the buf struct itself before we try eviction
-         kfree(buf);
-         spinlock_release_irqrestore(&cache_lock, irq_state);
- 
-         if (evict_lru_buffer_and_free() == 0) {
-             // Retake lock and retry
-             irq_state = spinlock_acquire_irqsave(&cache_lock);
-             buf = (buffer_t *)kmalloc(sizeof(buffer_t));
-             if (buf) {
-                 memset(buf, 0, sizeof(buffer_t));
-                 buf->disk = disk;
-                 buf->block_number = block_number;
-                 buf->ref_count = 1;
-                 buf->flags = 0;
-                 buf->data = kmalloc(sector_size + BUFFER_PADDING);
-             }
-         } else {
-             // Could not evict
-             irq_state = spinlock_acquire_irqsave(&cache_lock);
-         }
- 
-         if (!buf || !buf->data) {
-             terminal_write("[BufferCache] kmalloc failed for buffer data even after eviction.\n");
-             if (buf) {
-                 // if buf->data is NULL, free buf
-                 kfree(buf);
-             }
-             spinlock_release_irqrestore(&cache_lock, irq_state);
-             return NULL;
-         }
-     }
- 
-     // Zero data area (including padding)
-     memset(buf->data, 0, sector_size + BUFFER_PADDING);
- 
-     // Release lock for disk I/O
-     spinlock_release_irqrestore(&cache_lock, irq_state);
- 
-     // Read data from disk
+
+     // Read data from disk without holding the lock
      int read_result = safe_disk_read(disk, block_number, buf->data, disk->blk_dev.sector_size);
- 
-     // Re-acquire lock
-     irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
      if (read_result != 0) {
-         // Read failed, free buffer
          kfree(buf->data);
          kfree(buf);
-         spinlock_release_irqrestore(&cache_lock, irq_state);
-         terminal_printf("[BufferCache] Error: Failed to read block %u from device '%s'.\n",
-                         block_number, device_name);
+         terminal_printf("[BufferCache] Error: Failed to read block %lu from device '%s'.\n",
+                         (unsigned long)block_number, disk->blk_dev.device_name);
          return NULL;
      }
- 
-     // Mark buffer as valid
      buf->flags |= BUFFER_FLAG_VALID;
- 
-     // Insert into hash table and LRU list
-     buffer_insert_internal(buf);
-     lru_make_most_recent(buf);
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
+
+     irq_state = spinlock_acquire_irqsave(&shard->lock);
+
+     // Another task may have read the same block meanwhile; keep the first copy
+     buffer_t *existing = buffer_lookup_internal(shard, dev_id, block_number);
+     if (existing) {
+         existing->ref_count++;
+         buffer_touch(shard, existing);
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+         kfree(buf->data);
+         kfree(buf);
+         return existing;
+     }
+
+     buffer_insert_internal(shard, buf);
+     buffer_admit(shard, buf);
+     shard->count++;
+
+     spinlock_release_irqrestore(&shard->lock, irq_state);
      return buf;
  }
- 
+
+ static bool buffer_is_cached(uint32_t dev_id, uint32_t block_number) {
+     buffer_shard_t *shard = buffer_shard_of(dev_id, block_number);
+     uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+     bool cached = buffer_lookup_internal(shard, dev_id, block_number) != NULL;
+     spinlock_release_irqrestore(&shard->lock, irq_state);
+     return cached;
+ }
+
+ /**
+  * Read one chunk of at most BUFFER_PREFETCH_MAX_BLOCKS for buffer_prefetch.
+  * Cached blocks at either end are skipped; cached blocks in the middle are
+  * read along with the rest (one request beats several) but keep their copy.
+  */
+ static int buffer_prefetch_chunk(disk_t *disk, uint32_t dev_id, uint32_t first_block, uint32_t count) {
+     while (count > 0 && buffer_is_cached(dev_id, first_block)) { first_block++; count--; }
+     while (count > 0 && buffer_is_cached(dev_id, first_block + count - 1)) count--;
+     if (count == 0) return 0;
+
+     size_t sector_size = disk->blk_dev.sector_size;
+     uint8_t *staging = kmalloc((size_t)count * sector_size);
+     if (!staging) {
+         cache_stats.alloc_failures++;
+         return FS_ERR_OUT_OF_MEMORY;
+     }
+     if (disk_read_raw_sectors(disk, first_block, staging, count) != 0) {
+         cache_stats.io_errors++;
+         kfree(staging);
+         return FS_ERR_IO;
+     }
+     cache_stats.reads++;
+
+     int added = 0;
+     for (uint32_t i = 0; i < count; i++) {
+         uint32_t block_number = first_block + i;
+         buffer_shard_t *shard = buffer_shard_of(dev_id, block_number);
+
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         bool cached = buffer_lookup_internal(shard, dev_id, block_number) != NULL;
+         bool full = shard->count >= BUFFER_SHARD_CAPACITY;
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+         if (cached) continue;
+
+         if (full) {
+             buffer_evict_and_free(shard);
+         }
+         buffer_t *buf = buffer_alloc(shard, sector_size);
+         if (!buf) break;
+         memcpy(buf->data, staging + (size_t)i * sector_size, sector_size);
+         buf->disk = disk;
+         buf->dev_id = dev_id;
+         buf->block_number = block_number;
+         buf->flags |= BUFFER_FLAG_VALID;
+
+         irq_state = spinlock_acquire_irqsave(&shard->lock);
+         if (buffer_lookup_internal(shard, dev_id, block_number)) {
+             spinlock_release_irqrestore(&shard->lock, irq_state);
+             kfree(buf->data);
+             kfree(buf);
+             continue;
+         }
+         buffer_insert_internal(shard, buf);
+         buffer_admit(shard, buf);
+         shard->count++;
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+         added++;
+     }
+
+     kfree(staging);
+     cache_stats.prefetched += (uint32_t)added;
+     return added;
+ }
+
+ /**
+  * Read-ahead into the cache. Blocks enter unreferenced and, like any first
+  * reference, on A1in, so a streamed file does not displace hot metadata.
+  */
+ int buffer_prefetch(uint32_t dev_id, uint32_t first_block, uint32_t count) {
+     disk_t *disk = get_disk_by_id(dev_id);
+     if (!disk || !disk->initialized) {
+         return FS_ERR_INVALID_PARAM;
+     }
+     if (disk->blk_dev.sector_size < MIN_BUFFER_BLOCK_SIZE ||
+         disk->blk_dev.sector_size > MAX_BUFFER_BLOCK_SIZE) {
+         return FS_ERR_INVALID_PARAM;
+     }
+
+     int added = 0;
+     while (count > 0) {
+         uint32_t n = count < BUFFER_PREFETCH_MAX_BLOCKS ? count : BUFFER_PREFETCH_MAX_BLOCKS;
+         int result = buffer_prefetch_chunk(disk, dev_id, first_block, n);
+         if (result < 0) return added > 0 ? added : result;
+         added += result;
+         first_block += n;
+         count -= n;
+     }
+     return added;
+ }
+
  /**
   * Release a buffer
   */
  void buffer_release(buffer_t *buf) {
      if (!buf) return;
- 
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
+
+     buffer_shard_t *shard = buffer_shard_of(buf->dev_id, buf->block_number);
+     uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+
      if (buf->ref_count > 0) {
          buf->ref_count--;
      } else {
-         terminal_printf("[BufferCache] Warning: Releasing buffer with ref_count=0 (block %u on '%s').\n",
-                         buf->block_number,
+         terminal_printf("[BufferCache] Warning: Releasing buffer with ref_count=0 (block %lu on '%s').\n",
+                         (unsigned long)buf->block_number,
                          buf->disk ? buf->disk->blk_dev.device_name : "unknown");
      }
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
+
+     spinlock_release_irqrestore(&shard->lock, irq_state);
  }
- 
+
  /**
   * Mark a buffer as dirty
   */
  void buffer_mark_dirty(buffer_t *buf) {
      if (!buf) return;
- 
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
+
+     buffer_shard_t *shard = buffer_shard_of(buf->dev_id, buf->block_number);
+     uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+
      // Only mark valid buffers as dirty
      if (buf->flags & BUFFER_FLAG_VALID) {
+         if (!(buf->flags & BUFFER_FLAG_DIRTY)) buf->dirty_since = get_pit_ticks();
          buf->flags |= BUFFER_FLAG_DIRTY;
      } else {
-         terminal_printf("[BufferCache] Warning: Attempted to mark invalid buffer as dirty (%u on '%s').\n",
-                         buf->block_number,
+         terminal_printf("[BufferCache] Warning: Attempted to mark invalid buffer as dirty (%lu on '%s').\n",
+                         (unsigned long)buf->block_number,
                          buf->disk ? buf->disk->blk_dev.device_name : "unknown");
      }
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
+
+     spinlock_release_irqrestore(&shard->lock, irq_state);
  }
- 
+
  /**
   * Flush a single buffer to disk
   */
@@ -572,203 +677,417 @@
      if (!buf || !buf->disk) {
          return -FS_ERR_INVALID_PARAM;
      }
- 
+
      // Check if buffer needs flushing
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
+     buffer_shard_t *shard = buffer_shard_of(buf->dev_id, buf->block_number);
+     uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+
      if (!(buf->flags & BUFFER_FLAG_DIRTY) || !(buf->flags & BUFFER_FLAG_VALID)) {
          // Nothing to flush
-         spinlock_release_irqrestore(&cache_lock, irq_state);
+         spinlock_release_irqrestore(&shard->lock, irq_state);
          return 0;
      }
- 
+
      disk_t *disk = buf->disk;
      uint32_t block = buf->block_number;
      size_t buffer_size = disk->blk_dev.sector_size;
- 
-     // Copy data to temporary buffer for writing outside the lock
+
+     // Copy data to temporary buffer so the cached copy stays usable meanwhile
      void *temp_data = kmalloc(buffer_size);
      if (!temp_data) {
-         spinlock_release_irqrestore(&cache_lock, irq_state);
+         spinlock_release_irqrestore(&shard->lock, irq_state);
          return -FS_ERR_OUT_OF_MEMORY;
      }
- 
+
      memcpy(temp_data, buf->data, buffer_size);
      buf->flags &= ~BUFFER_FLAG_DIRTY; // Mark clean now under lock
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
- 
-     // Write to disk without holding the lock
-     int write_result = disk_write_raw_sectors(disk, block, temp_data, 1);
+
+     // Submitted under the lock so concurrent flushes of the block reach the
+     // disk in the order their snapshots were taken
+     blk_request_t req;
+     blk_request_init(&req, &disk->blk_dev, block, temp_data, 1, BLK_REQ_WRITE);
+     blk_submit(&req);
+
+     spinlock_release_irqrestore(&shard->lock, irq_state);
+
+     int write_result = blk_wait(&req);
      kfree(temp_data);
- 
-     if (write_result != 0) {
+
+     if (write_result != BLOCK_ERR_OK) {
          cache_stats.io_errors++;
-         terminal_printf("[BufferCache] Error: Failed to write block %u to disk '%s'.\n",
-                         block, disk->blk_dev.device_name);
+         terminal_printf("[BufferCache] Error: Failed to write block %lu to disk '%s'.\n",
+                         (unsigned long)block, disk->blk_dev.device_name);
+         irq_state = spinlock_acquire_irqsave(&shard->lock);
+         buf->flags |= BUFFER_FLAG_DIRTY; // Try again on the next flush
+         spinlock_release_irqrestore(&shard->lock, irq_state);
          return -FS_ERR_IO;
      }
- 
+
      cache_stats.writes++;
- 
+
      return 0;
  }
- 
+
+ /** @brief One dirty buffer being written back by buffer_writeback. */
+ typedef struct {
+     buffer_t *buf;
+     void *data;          // Snapshot taken when the buffer was marked clean
+     blk_request_t req;
+     bool submitted;
+ } buffer_writeback_t;
+
+ static inline bool buffer_needs_writeback(const buffer_t *buf, uint32_t dev_id, uint32_t now, uint32_t min_age) {
+     return (buf->flags & BUFFER_FLAG_DIRTY) && (buf->flags & BUFFER_FLAG_VALID) && buf->disk &&
+            (dev_id == 0 || buf->dev_id == dev_id) && (now - buf->dirty_since) >= min_age;
+ }
+
+ static inline bool buffer_key_before(const buffer_t *a, const buffer_t *b) {
+     return a->dev_id < b->dev_id || (a->dev_id == b->dev_id && a->block_number < b->block_number);
+ }
+
+ /** Shell sort (Ciura gaps) of the write-back list by (device, block). */
+ static void buffer_writeback_sort(buffer_writeback_t *wb, uint32_t n) {
+     static const uint32_t gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+     for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+         uint32_t gap = gaps[g];
+         for (uint32_t i = gap; i < n; i++) {
+             buffer_t *v = wb[i].buf;
+             uint32_t j = i;
+             while (j >= gap && buffer_key_before(v, wb[j - gap].buf)) {
+                 wb[j].buf = wb[j - gap].buf;
+                 j -= gap;
+             }
+             wb[j].buf = v;
+         }
+     }
+ }
+
  /**
-  * Sync all dirty buffers
+  * Write back the dirty buffers of one device (0 = every device) that have
+  * been dirty for at least min_age ticks, in (device, block) order.
+  *
+  * Candidates are pinned first and sorted; each one is then snapshotted,
+  * marked clean and submitted under its shard lock (see buffer_flush), all
+  * while the disks' queues are plugged, so neighbouring sectors go out as
+  * a few merged commands. With flush_disks, each written disk's write cache
+  * is flushed afterwards. Returns the number of blocks written, or a
+  * negative error.
   */
- void buffer_cache_sync(void) {
-     terminal_write("[BufferCache] Starting full cache sync...\n");
- 
-     int total_flushed = 0;
+ static int buffer_writeback(uint32_t dev_id, uint32_t min_age, bool flush_disks, int *errors_out) {
+     uint32_t now = get_pit_ticks();
+     int written = 0;
      int errors = 0;
- 
-     // Get all dirty buffers
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
-     // Create a copy of all dirty buffers to avoid long lock hold
-     buffer_t **dirty_buffers = kmalloc(sizeof(buffer_t*) * BUFFER_CACHE_HASH_SIZE);
-     if (!dirty_buffers) {
-         spinlock_release_irqrestore(&cache_lock, irq_state);
-         terminal_write("[BufferCache] Error: Failed to allocate memory for sync.\n");
-         return;
-     }
- 
-     int dirty_count = 0;
- 
-     // Scan all hash buckets
-     for (uint32_t i = 0; i < BUFFER_CACHE_HASH_SIZE; i++) {
-         buffer_t *buf = buffer_hash_table[i];
-         while (buf) {
-             if ((buf->flags & BUFFER_FLAG_DIRTY) && (buf->flags & BUFFER_FLAG_VALID)) {
-                 // Increment ref count to prevent eviction during sync
+
+     // Count candidates; buffers dirtied after this wait for the next pass
+     uint32_t dirty_count = 0;
+     for (uint32_t s = 0; s < BUFFER_CACHE_SHARDS; s++) {
+         buffer_shard_t *shard = &buffer_shards[s];
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         for (uint32_t i = 0; i < BUFFER_CACHE_BUCKETS; i++) {
+             for (buffer_t *buf = shard->hash[i]; buf; buf = buf->hash_next) {
+                 if (buffer_needs_writeback(buf, dev_id, now, min_age)) dirty_count++;
+             }
+         }
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+     }
+     if (errors_out) *errors_out = 0;
+     if (dirty_count == 0) return 0;
+
+     buffer_writeback_t *wb = kmalloc(sizeof(buffer_writeback_t) * dirty_count);
+     if (!wb) {
+         terminal_write("[BufferCache] Error: Failed to allocate memory for write-back.\n");
+         return FS_ERR_OUT_OF_MEMORY;
+     }
+
+     // Pin the candidates so they cannot be evicted while we sort
+     uint32_t n = 0;
+     for (uint32_t s = 0; s < BUFFER_CACHE_SHARDS && n < dirty_count; s++) {
+         buffer_shard_t *shard = &buffer_shards[s];
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         for (uint32_t i = 0; i < BUFFER_CACHE_BUCKETS && n < dirty_count; i++) {
+             for (buffer_t *buf = shard->hash[i]; buf && n < dirty_count; buf = buf->hash_next) {
+                 if (!buffer_needs_writeback(buf, dev_id, now, min_age)) continue;
                  buf->ref_count++;
-                 dirty_buffers[dirty_count++] = buf;
- 
-                 // Resize array if needed (unlikely, but just in case)
-                 if (dirty_count >= (int)BUFFER_CACHE_HASH_SIZE && i < BUFFER_CACHE_HASH_SIZE - 1) {
-                     buffer_t **new_array = kmalloc(sizeof(buffer_t*) * BUFFER_CACHE_HASH_SIZE * 2);
-                     if (!new_array) {
-                         // Decrement ref counts for buffers we've already found
-                         for (int j = 0; j < dirty_count; j++) {
-                             dirty_buffers[j]->ref_count--;
-                         }
-                         spinlock_release_irqrestore(&cache_lock, irq_state);
-                         kfree(dirty_buffers);
-                         terminal_write("[BufferCache] Error: Failed to resize dirty buffer array.\n");
-                         return;
-                     }
-                     // Copy to new array
-                     memcpy(new_array, dirty_buffers, sizeof(buffer_t*) * dirty_count);
-                     kfree(dirty_buffers);
-                     dirty_buffers = new_array;
-                 }
+                 wb[n].buf = buf;
+                 wb[n].data = NULL;
+                 wb[n].submitted = false;
+                 n++;
              }
-             buf = buf->hash_next;
          }
+         spinlock_release_irqrestore(&shard->lock, irq_state);
      }
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
- 
-     // Flush each dirty buffer
-     for (int i = 0; i < dirty_count; i++) {
-         buffer_t *buf = dirty_buffers[i];
- 
-         int flush_result = buffer_flush(buf);
-         if (flush_result != 0) {
+     buffer_writeback_sort(wb, n);
+
+     int registered = disk_registry.count;
+     for (int d = 0; d < registered; d++) blk_plug(&disk_registry.disks[d]->blk_dev);
+
+     for (uint32_t i = 0; i < n; i++) {
+         buffer_t *buf = wb[i].buf;
+         buffer_shard_t *shard = buffer_shard_of(buf->dev_id, buf->block_number);
+         void *data = kmalloc(buf->disk->blk_dev.sector_size);
+         if (!data) {
              errors++;
-         } else {
-             total_flushed++;
+             continue;
+         }
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         if (buf->flags & BUFFER_FLAG_DIRTY) { // buffer_flush may have beaten us to it
+             memcpy(data, buf->data, buf->disk->blk_dev.sector_size);
+             buf->flags &= ~BUFFER_FLAG_DIRTY;
+             wb[i].data = data;
+             wb[i].submitted = true;
+             blk_request_init(&wb[i].req, &buf->disk->blk_dev, buf->block_number, data, 1, BLK_REQ_WRITE);
+             blk_submit(&wb[i].req);
+         }
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+         if (!wb[i].submitted) kfree(data);
+     }
+
+     // Let the elevator merge everything
+     for (int d = 0; d < registered; d++) blk_unplug(&disk_registry.disks[d]->blk_dev);
+
+     for (uint32_t i = 0; i < n; i++) {
+         buffer_t *buf = wb[i].buf;
+         buffer_shard_t *shard = buffer_shard_of(buf->dev_id, buf->block_number);
+         bool ok = true;
+         if (wb[i].submitted) {
+             ok = (blk_wait(&wb[i].req) == BLOCK_ERR_OK);
+             if (!ok) {
+                 errors++;
+                 cache_stats.io_errors++;
+                 terminal_printf("[BufferCache] Error: Failed to write block %lu to disk '%s'.\n",
+                                 (unsigned long)buf->block_number, buf->disk->blk_dev.device_name);
+             } else {
+                 written++;
+                 cache_stats.writes++;
+             }
+             kfree(wb[i].data);
+         }
+
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         if (!ok) buf->flags |= BUFFER_FLAG_DIRTY; // Try again on the next pass
+         if (buf->ref_count > 0) buf->ref_count--;
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+     }
+
+     // One cache flush per disk that was written
+     if (flush_disks) {
+         for (int d = 0; d < registered; d++) {
+             disk_t *disk = disk_registry.disks[d];
+             for (uint32_t i = 0; i < n; i++) {
+                 if (wb[i].submitted && wb[i].buf->disk == disk) {
+                     if (disk_flush(disk) != 0) errors++;
+                     break;
+                 }
+             }
+         }
+     }
+
+     kfree(wb);
+     if (errors_out) *errors_out = errors;
+     return written;
+ }
+
+ /**
+  * Sync all dirty buffers to stable storage
+  */
+ void buffer_cache_sync(void) {
+     terminal_write("[BufferCache] Starting full cache sync...\n");
+     int errors = 0;
+     int written = buffer_writeback(0, 0, true, &errors);
+     if (written < 0) return;
+     terminal_printf("[BufferCache] Sync complete: %d flushed, %d errors.\n", written, errors);
+ }
+
+ /**
+  * Sync one device's dirty buffers to stable storage (fsync)
+  */
+ int buffer_cache_sync_device(uint32_t dev_id) {
+     if (!get_disk_by_id(dev_id)) return FS_ERR_INVALID_PARAM;
+     int errors = 0;
+     int written = buffer_writeback(dev_id, 0, true, &errors);
+     if (written < 0) return written;
+     if (errors > 0) return FS_ERR_IO;
+
+     // Nothing was dirty, but earlier write-backs may still sit in the drive's cache
+     if (written == 0 && disk_flush(get_disk_by_id(dev_id)) != 0) return FS_ERR_IO;
+     return FS_SUCCESS;
+ }
+
+ // --- Background Write-Back ---
+
+ int buffer_cache_register_writeback_hook(buffer_writeback_hook_t hook, void *ctx) {
+     if (!hook) return FS_ERR_INVALID_PARAM;
+     int result = FS_ERR_NO_RESOURCES;
+     mutex_lock(&writeback_hooks_lock);
+     for (uint32_t i = 0; i < BUFFER_MAX_WRITEBACK_HOOKS; i++) {
+         if (!writeback_hooks[i].hook) {
+             writeback_hooks[i].hook = hook;
+             writeback_hooks[i].ctx = ctx;
+             result = FS_SUCCESS;
+             break;
+         }
+     }
+     mutex_unlock(&writeback_hooks_lock);
+     return result;
+ }
+
+ void buffer_cache_unregister_writeback_hook(buffer_writeback_hook_t hook, void *ctx) {
+     mutex_lock(&writeback_hooks_lock);
+     for (uint32_t i = 0; i < BUFFER_MAX_WRITEBACK_HOOKS; i++) {
+         if (writeback_hooks[i].hook == hook && writeback_hooks[i].ctx == ctx) {
+             writeback_hooks[i].hook = NULL;
+             writeback_hooks[i].ctx = NULL;
+         }
+     }
+     mutex_unlock(&writeback_hooks_lock);
+ }
+
+ void buffer_cache_set_writeback_params(uint32_t expire_ms, uint32_t dirty_ratio_pct) {
+     g_dirty_expire_ms = expire_ms;
+     g_dirty_ratio_pct = dirty_ratio_pct > 100 ? 100 : dirty_ratio_pct;
+ }
+
+ /**
+  * Lets filesystems copy their in-memory metadata into the cache. Runs under
+  * the hook lock so unregistering waits for a running hook to finish.
+  */
+ static void buffer_run_writeback_hooks(void) {
+     mutex_lock(&writeback_hooks_lock);
+     for (uint32_t i = 0; i < BUFFER_MAX_WRITEBACK_HOOKS; i++) {
+         if (writeback_hooks[i].hook) writeback_hooks[i].hook(writeback_hooks[i].ctx);
+     }
+     mutex_unlock(&writeback_hooks_lock);
+ }
+
+ static uint32_t buffer_count_dirty(void) {
+     uint32_t dirty = 0;
+     for (uint32_t s = 0; s < BUFFER_CACHE_SHARDS; s++) {
+         buffer_shard_t *shard = &buffer_shards[s];
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         for (uint32_t i = 0; i < BUFFER_CACHE_BUCKETS; i++) {
+             for (buffer_t *buf = shard->hash[i]; buf; buf = buf->hash_next) {
+                 if (buf->flags & BUFFER_FLAG_DIRTY) dirty++;
+             }
          }
- 
-         // Release the extra reference we added
-         irq_state = spinlock_acquire_irqsave(&cache_lock);
-         if (buf->ref_count > 0) {
-             buf->ref_count--;
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+     }
+     return dirty;
+ }
+
+ /**
+  * Flusher thread: every BUFFER_FLUSH_INTERVAL_MS, write back buffers that
+  * have been dirty longer than the expiry age, or every dirty buffer once
+  * they make up more than the dirty ratio of the cache.
+  */
+ static void buffer_flusher_main(void) {
+     for (;;) {
+         sleep_ms(BUFFER_FLUSH_INTERVAL_MS);
+
+         buffer_run_writeback_hooks();
+         uint32_t dirty = buffer_count_dirty();
+         if (dirty == 0) continue;
+
+         bool over_ratio = dirty * 100u > BUFFER_CACHE_MAX_BUFFERS * g_dirty_ratio_pct;
+         uint32_t min_age = over_ratio ? 0 : g_dirty_expire_ms * TICKS_PER_MS;
+         int errors = 0;
+         buffer_writeback(0, min_age, false, &errors);
+         if (errors > 0) {
+             terminal_printf("[BufferCache] Flusher: %d write-back errors.\n", errors);
          }
-         spinlock_release_irqrestore(&cache_lock, irq_state);
      }
- 
-     kfree(dirty_buffers);
- 
-     terminal_printf("[BufferCache] Sync complete: %d flushed, %d errors.\n", total_flushed, errors);
  }
- 
+
+ int buffer_cache_start_flusher(void) {
+     if (g_flusher_started) return FS_SUCCESS;
+     pcb_t *thread = create_kernel_thread(buffer_flusher_main);
+     if (!thread) return FS_ERR_OUT_OF_MEMORY;
+     if (scheduler_add_task(thread) != 0) {
+         destroy_process(thread);
+         return FS_ERR_OUT_OF_MEMORY;
+     }
+     g_flusher_started = true;
+     terminal_printf("[BufferCache] Flusher thread started (PID %lu, expire %lu ms, ratio %lu%%).\n",
+                     (unsigned long)thread->pid, (unsigned long)g_dirty_expire_ms,
+                     (unsigned long)g_dirty_ratio_pct);
+     return FS_SUCCESS;
+ }
+
  /**
   * Get buffer cache statistics
   */
  void buffer_cache_get_stats(buffer_cache_stats_t *stats) {
      if (!stats) return;
- 
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
-     stats->hits = cache_stats.hits;
-     stats->misses = cache_stats.misses;
+
+     memset(stats, 0, sizeof(*stats));
      stats->reads = cache_stats.reads;
      stats->writes = cache_stats.writes;
-     stats->evictions = cache_stats.evictions;
+     stats->prefetched = cache_stats.prefetched;
      stats->alloc_failures = cache_stats.alloc_failures;
      stats->io_errors = cache_stats.io_errors;
- 
-     // Count current buffers
-     stats->cached_buffers = 0;
-     stats->dirty_buffers = 0;
- 
-     buffer_t *buf = lru_head;
-     while (buf) {
-         stats->cached_buffers++;
-         if (buf->flags & BUFFER_FLAG_DIRTY) {
-             stats->dirty_buffers++;
+
+     for (uint32_t s = 0; s < BUFFER_CACHE_SHARDS; s++) {
+         buffer_shard_t *shard = &buffer_shards[s];
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+         buffer_shard_stats_t *out = &stats->shards[s];
+         *out = shard->stats;
+         out->cached_buffers = shard->count;
+         for (uint32_t i = 0; i < BUFFER_CACHE_BUCKETS; i++) {
+             for (buffer_t *buf = shard->hash[i]; buf; buf = buf->hash_next) {
+                 if (buf->flags & BUFFER_FLAG_DIRTY) stats->dirty_buffers++;
+             }
          }
-         buf = buf->lru_next;
+         spinlock_release_irqrestore(&shard->lock, irq_state);
+
+         stats->hits += out->hits;
+         stats->misses += out->misses;
+         stats->evictions += out->evictions;
+         stats->cached_buffers += out->cached_buffers;
      }
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
  }
- 
+
  /**
   * Invalidate all buffers for a specific device
   */
- void buffer_invalidate_device(const char *device_name) {
-     if (!device_name) return;
- 
-     uintptr_t irq_state = spinlock_acquire_irqsave(&cache_lock);
- 
+ void buffer_invalidate_device(uint32_t dev_id) {
      int invalidated = 0;
- 
-     // Check all hash buckets
-     for (uint32_t i = 0; i < BUFFER_CACHE_HASH_SIZE; i++) {
-         buffer_t **pp = &buffer_hash_table[i];
-         while (*pp) {
-             buffer_t *buf = *pp;
- 
-             if (buf->disk && strcmp(buf->disk->blk_dev.device_name, device_name) == 0) {
-                 // Check if buffer can be invalidated
-                 if (buf->ref_count > 0) {
-                     // Skip buffers still in use
+
+     for (uint32_t s = 0; s < BUFFER_CACHE_SHARDS; s++) {
+         buffer_shard_t *shard = &buffer_shards[s];
+         uintptr_t irq_state = spinlock_acquire_irqsave(&shard->lock);
+
+         // Check all hash buckets
+         for (uint32_t i = 0; i < BUFFER_CACHE_BUCKETS; i++) {
+             buffer_t **pp = &shard->hash[i];
+             while (*pp) {
+                 buffer_t *buf = *pp;
+                 if (buf->dev_id != dev_id || buf->ref_count > 0) {
+                     // Other device, or still in use
                      pp = &buf->hash_next;
-                 } else {
-                     // Remove from hash table
-                     *pp = buf->hash_next;
- 
-                     // Remove from LRU list
-                     lru_remove(buf);
- 
-                     // Free the buffer
-                     kfree(buf->data);
-                     kfree(buf);
- 
-                     invalidated++;
+                     continue;
                  }
-             } else {
-                 pp = &buf->hash_next;
+                 *pp = buf->hash_next;
+                 queue_remove(shard, buf);
+                 shard->count--;
+                 kfree(buf->data);
+                 kfree(buf);
+                 invalidated++;
              }
          }
+
+         // Forget ghosts too, so re-reads start on probation again
+         for (uint32_t i = 0; i < BUFFER_2Q_KOUT; i++) {
+             if (shard->a1out[i].dev_id == dev_id) shard->a1out[i].dev_id = 0;
+         }
+
+         spinlock_release_irqrestore(&shard->lock, irq_state);
      }
- 
-     spinlock_release_irqrestore(&cache_lock, irq_state);
- 
-     terminal_printf("[BufferCache] Invalidated %d buffers for device '%s'.\n",
-                     invalidated, device_name);
+
+     terminal_printf("[BufferCache] Invalidated %d buffers for device %lu.\n",
+                     invalidated, (unsigned long)dev_id);
+ }
+
+ bool buffer_cache_set_scan_resistant(bool enabled) {
+     bool was_enabled = g_buffer_scan_resistant;
+     g_buffer_scan_resistant = enabled;
+     return was_enabled;
  }
- 
\ No newline at end of file
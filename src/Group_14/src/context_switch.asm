@@ -32,35 +32,40 @@ context_switch:
     pushfd                ; EFLAGS
     pushad                ; General Purpose Registers (EDI, ESI, EBP_orig, ESP_orig, EBX, EDX, ECX, EAX)
 
-    ; --- Save Old Task's Stack Pointer ---
+    ; --- Load the arguments while the old stack is still ours ---
+    ; Once the old ESP is published another CPU may resume the old task on
+    ; this stack, so saving it must be the last access to the stack.
     mov eax, [ebp + 8]    ; EAX = old_esp_ptr
-    test eax, eax
-    jz .skip_esp_save
-    cmp eax, 0xC0000000   ; Basic check if pointer is in kernel space
-    jb .skip_esp_save
-    mov [eax], esp        ; Save current ESP (pointing to saved context)
+    mov edx, [ebp + 12]   ; EDX = new_esp
+    mov ecx, [ebp + 16]   ; ECX = new_page_directory
 
-.skip_esp_save:
     ; --- Verify new_esp validity ---
-    mov eax, [ebp + 12]   ; EAX = new_esp
-    test eax, eax
+    test edx, edx
     jz .fatal_error
-    cmp eax, 0xC0000000   ; Basic check if pointer is in kernel space
+    cmp edx, 0xC0000000   ; Basic check if pointer is in kernel space
     jb .fatal_error
 
     ; --- Switch Page Directory (CR3) if needed ---
-    mov eax, [ebp + 16]   ; EAX = new_page_directory
-    test eax, eax
+    test ecx, ecx
     jz .skip_cr3_load
-    mov ecx, cr3
-    cmp eax, ecx
+    mov ebx, cr3
+    cmp ecx, ebx
     je .skip_cr3_load     ; Skip if same PD
-    ; Optional: invlpg [esp] could go here if TLB issues suspected, but unlikely cause of #DE
-    mov cr3, eax          ; Load new page directory (flushes TLB)
+    mov cr3, ecx          ; Load new page directory (flushes TLB)
 
 .skip_cr3_load:
+    ; --- Save Old Task's Stack Pointer ---
+    ; The idle tasks' TCBs are static, below 0xC0000000: their ESP is never
+    ; saved and they restart from their initial frame each time.
+    test eax, eax
+    jz .skip_esp_save
+    cmp eax, 0xC0000000   ; Basic check if pointer is in kernel space
+    jb .skip_esp_save
+    mov [eax], esp        ; Save current ESP (pointing to saved context)
+
+.skip_esp_save:
     ; --- Switch Kernel Stack Pointer ---
-    mov esp, [ebp + 12]   ; ESP = new_esp (Should point to stack frame prepared for idle task)
+    mov esp, edx          ; ESP = new_esp
 
     ; --- Restore Full Kernel Context of New Task ---
     ; Order must be the reverse of the save sequence.
@@ -0,0 +1,258 @@
+/**
+ * @file dcache.c
+ * @brief Directory-entry cache (see dcache.h).
+ *
+ * Entries live in a static pool, hashed into singly linked bucket chains and
+ * threaded on one LRU list. A lookup hit moves the entry to the LRU head; an
+ * insert that finds no free entry recycles the LRU tail. One spinlock covers
+ * everything: each operation is a short hash-chain walk.
+ */
+
+#include "dcache.h"
+#include "spinlock.h"
+#include "terminal.h"
+#include "string.h"
+#include "assert.h"
+
+typedef struct dcache_entry {
+    const void *sb;
+    uint32_t parent;
+    uint32_t hash;
+    bool in_use;
+    bool negative;
+    uint8_t data[DCACHE_DATA_SIZE];
+    char name[DCACHE_NAME_MAX + 1];
+    struct dcache_entry *hash_next;
+    struct dcache_entry *lru_prev;    // Towards the most recently used entry
+    struct dcache_entry *lru_next;
+} dcache_entry_t;
+
+_Static_assert((DCACHE_BUCKETS & (DCACHE_BUCKETS - 1)) == 0, "DCACHE_BUCKETS must be a power of two");
+
+static dcache_entry_t s_entries[DCACHE_ENTRIES];
+static dcache_entry_t *s_buckets[DCACHE_BUCKETS];
+static dcache_entry_t *s_lru_head;   // Most recently used
+static dcache_entry_t *s_lru_tail;
+static dcache_entry_t *s_free_list;  // Unused entries, chained through hash_next
+static spinlock_t s_dcache_lock;
+static bool s_enabled = true;
+static dcache_stats_t s_stats;
+
+/** @brief FNV-1a over the name, mixed with the parent and filesystem. */
+static uint32_t dcache_hash(const void *sb, uint32_t parent, const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = name; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    h ^= parent * 0x9E3779B1u;
+    h ^= (uint32_t)(uintptr_t)sb >> 4;
+    return h;
+}
+
+static void lru_unlink(dcache_entry_t *e)
+{
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else s_lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else s_lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_head(dcache_entry_t *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = s_lru_head;
+    if (s_lru_head) s_lru_head->lru_prev = e;
+    s_lru_head = e;
+    if (!s_lru_tail) s_lru_tail = e;
+}
+
+/** @brief Finds an entry. Caller holds s_dcache_lock. */
+static dcache_entry_t *dcache_find_locked(const void *sb, uint32_t parent, const char *name, uint32_t hash)
+{
+    for (dcache_entry_t *e = s_buckets[hash & (DCACHE_BUCKETS - 1)]; e; e = e->hash_next) {
+        if (e->hash == hash && e->sb == sb && e->parent == parent && strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/** @brief Unhashes an entry and returns it to the free list. Caller holds s_dcache_lock. */
+static void dcache_remove_locked(dcache_entry_t *e)
+{
+    dcache_entry_t **link = &s_buckets[e->hash & (DCACHE_BUCKETS - 1)];
+    while (*link && *link != e) link = &(*link)->hash_next;
+    KERNEL_ASSERT(*link == e, "dcache entry missing from its bucket");
+    *link = e->hash_next;
+
+    lru_unlink(e);
+    e->in_use = false;
+    e->hash_next = s_free_list;
+    s_free_list = e;
+    s_stats.entries--;
+}
+
+void dcache_init(void)
+{
+    spinlock_init(&s_dcache_lock);
+    memset(s_entries, 0, sizeof(s_entries));
+    memset(s_buckets, 0, sizeof(s_buckets));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_lru_head = s_lru_tail = NULL;
+    s_free_list = NULL;
+    for (int i = DCACHE_ENTRIES - 1; i >= 0; i--) {
+        s_entries[i].hash_next = s_free_list;
+        s_free_list = &s_entries[i];
+    }
+    terminal_printf("[DCache] Initialized (%u entries, %u buckets).\n",
+                    (unsigned)DCACHE_ENTRIES, (unsigned)DCACHE_BUCKETS);
+}
+
+int dcache_lookup(const void *sb, uint32_t parent, const char *name, void *data_out, size_t data_len)
+{
+    KERNEL_ASSERT(name != NULL, "dcache_lookup: NULL name");
+    if (strlen(name) > DCACHE_NAME_MAX) return DCACHE_MISS;
+    uint32_t hash = dcache_hash(sb, parent, name);
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    int result = DCACHE_MISS;
+    dcache_entry_t *e = s_enabled ? dcache_find_locked(sb, parent, name, hash) : NULL;
+    if (e) {
+        lru_unlink(e);
+        lru_push_head(e);
+        if (e->negative) {
+            s_stats.negative_hits++;
+            result = DCACHE_NEGATIVE;
+        } else {
+            if (data_out) memcpy(data_out, e->data, data_len < DCACHE_DATA_SIZE ? data_len : DCACHE_DATA_SIZE);
+            s_stats.hits++;
+            result = DCACHE_HIT;
+        }
+    } else {
+        s_stats.misses++;
+    }
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+    return result;
+}
+
+/** @brief Inserts or replaces an entry. */
+static void dcache_store(const void *sb, uint32_t parent, const char *name,
+                         bool negative, const void *data, size_t data_len)
+{
+    KERNEL_ASSERT(name != NULL, "dcache_store: NULL name");
+    KERNEL_ASSERT(data_len <= DCACHE_DATA_SIZE, "dcache_store: data too large");
+    size_t name_len = strlen(name);
+    if (name_len > DCACHE_NAME_MAX) return;
+    uint32_t hash = dcache_hash(sb, parent, name);
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    if (!s_enabled) {
+        spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+        return;
+    }
+
+    dcache_entry_t *e = dcache_find_locked(sb, parent, name, hash);
+    if (e) {
+        lru_unlink(e);
+    } else {
+        if (!s_free_list) {
+            KERNEL_ASSERT(s_lru_tail != NULL, "dcache: no free entry and empty LRU");
+            dcache_remove_locked(s_lru_tail);
+            s_stats.evictions++;
+        }
+        e = s_free_list;
+        s_free_list = e->hash_next;
+
+        e->sb = sb;
+        e->parent = parent;
+        e->hash = hash;
+        memcpy(e->name, name, name_len + 1);
+        e->in_use = true;
+        e->hash_next = s_buckets[hash & (DCACHE_BUCKETS - 1)];
+        s_buckets[hash & (DCACHE_BUCKETS - 1)] = e;
+        s_stats.entries++;
+    }
+
+    e->negative = negative;
+    memset(e->data, 0, sizeof(e->data));
+    if (!negative && data) memcpy(e->data, data, data_len);
+    lru_push_head(e);
+    s_stats.inserts++;
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+}
+
+void dcache_insert(const void *sb, uint32_t parent, const char *name, const void *data, size_t data_len)
+{
+    dcache_store(sb, parent, name, false, data, data_len);
+}
+
+void dcache_insert_negative(const void *sb, uint32_t parent, const char *name)
+{
+    dcache_store(sb, parent, name, true, NULL, 0);
+}
+
+void dcache_invalidate(const void *sb, uint32_t parent, const char *name)
+{
+    KERNEL_ASSERT(name != NULL, "dcache_invalidate: NULL name");
+    if (strlen(name) > DCACHE_NAME_MAX) return;
+    uint32_t hash = dcache_hash(sb, parent, name);
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    dcache_entry_t *e = dcache_find_locked(sb, parent, name, hash);
+    if (e) {
+        dcache_remove_locked(e);
+        s_stats.invalidations++;
+    }
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+}
+
+void dcache_invalidate_parent(const void *sb, uint32_t parent)
+{
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        dcache_entry_t *e = &s_entries[i];
+        if (e->in_use && e->sb == sb && e->parent == parent) {
+            dcache_remove_locked(e);
+            s_stats.invalidations++;
+        }
+    }
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+}
+
+void dcache_invalidate_fs(const void *sb)
+{
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        dcache_entry_t *e = &s_entries[i];
+        if (e->in_use && e->sb == sb) {
+            dcache_remove_locked(e);
+            s_stats.invalidations++;
+        }
+    }
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+}
+
+bool dcache_set_enabled(bool enabled)
+{
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    bool was_enabled = s_enabled;
+    s_enabled = enabled;
+    if (!enabled) {
+        for (int i = 0; i < DCACHE_ENTRIES; i++) {
+            if (s_entries[i].in_use) dcache_remove_locked(&s_entries[i]);
+        }
+    }
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+    return was_enabled;
+}
+
+void dcache_get_stats(dcache_stats_t *stats)
+{
+    if (!stats) return;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_dcache_lock);
+    *stats = s_stats;
+    spinlock_release_irqrestore(&s_dcache_lock, irq_flags);
+}
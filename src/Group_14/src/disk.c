@@ -171,6 +171,22 @@
      }
      return ret;
  }
+
+ /**
+  * @brief Flushes the drive's write cache after all earlier requests.
+  * @param disk Pointer to the initialized disk_t structure.
+  * @return FS_SUCCESS on success, negative error code on failure.
+  */
+ int disk_flush(disk_t *disk) {
+     if (!disk || !disk->initialized) {
+         return FS_ERR_INVALID_PARAM;
+     }
+     int ret = block_device_flush(&disk->blk_dev);
+     if (ret != FS_SUCCESS) {
+         terminal_printf("[Disk] flush: Cache flush failed on '%s' (code %d).\n", disk->blk_dev.device_name, ret);
+     }
+     return ret;
+ }
  
  
  /**
@@ -7,7 +7,8 @@
  #include "elf.h"          // ELF structures (Elf32_Ehdr, etc.)
  #include "terminal.h"     // Logging
  #include "kmalloc.h"      // kmalloc, kfree
- #include "read_file.h"    // read_file
+ #include "vfs.h"          // vfs_open, vfs_pread, vfs_close
+ #include "sys_file.h"     // O_RDONLY, SEEK_END
  #include "frame.h"        // frame_alloc, frame_free
  #include "paging.h"       // Paging functions and constants
  #include "fs_errno.h"     // Filesystem error codes (used implicitly by read_file)
@@ -49,9 +50,11 @@
  /**
   * @brief Loads an ELF binary file into the specified page directory.
   *
-  * Reads the ELF file, validates headers, allocates physical frames for LOAD segments,
+  * Reads the ELF headers, validates them, allocates physical frames for LOAD segments,
   * maps these frames into the provided page directory at the specified virtual addresses,
-  * and copies/zeroes the segment data.
+  * and reads/zeroes the segment data straight into each frame. There are no VMAs
+  * here to fault against, so segments are loaded eagerly; process.c's loader
+  * maps them on demand instead.
   *
   * NOTE: This function duplicates logic found in process.c/load_elf_and_init_memory.
   * Its use might be limited or obsolete. Error handling for partial mapping
@@ -63,7 +66,9 @@
   * @return 0 on success, a negative error code (e.g., -FS_ERR_*, -1) on failure.
   */
  int load_elf_binary(const char *path, uint32_t *page_directory_phys, uint32_t *entry_point) {
-     size_t file_size = 0;
+     off_t file_size = 0;
+     Elf32_Ehdr ehdr_buf;
+     Elf32_Phdr *phdrs = NULL;
      allocated_page_info_t *phys_frames = NULL; // Array to track allocated frames
      uint32_t total_pages_needed = 0;
      uint32_t allocated_frame_count = 0;
@@ -71,16 +76,21 @@
  
      terminal_printf("[elf_loader] Loading ELF binary: '%s'\n", path);
  
-     // 1. Read the entire ELF file into memory
-     void *file_data = read_file(path, &file_size);
-     if (!file_data) {
-         terminal_printf("[elf_loader] Error: Failed to read file '%s'.\n", path);
-         return -1; // Or specific error from read_file if available
+     // 1. Open the ELF file and read its header (segments are read page by page below)
+     file_t *file = vfs_open(path, O_RDONLY);
+     if (!file) {
+         terminal_printf("[elf_loader] Error: Failed to open file '%s'.\n", path);
+         return -1;
+     }
+     file_size = vfs_lseek(file, 0, SEEK_END);
+     if (file_size < (off_t)sizeof(Elf32_Ehdr) ||
+         vfs_pread(file, &ehdr_buf, sizeof(ehdr_buf), 0) != (int)sizeof(ehdr_buf)) {
+         terminal_printf("[elf_loader] Error: Failed to read ELF header of '%s'.\n", path);
+         goto cleanup_file;
      }
-     terminal_printf("[elf_loader] Read %u bytes from '%s'.\n", (unsigned int)file_size, path);
  
      // 2. Validate ELF Header
-     Elf32_Ehdr *ehdr = (Elf32_Ehdr *)file_data;
+     Elf32_Ehdr *ehdr = &ehdr_buf;
      // Corrected: Check individual magic bytes
      if (ehdr->e_ident[EI_MAG0] != ELFMAG0 ||
          ehdr->e_ident[EI_MAG1] != ELFMAG1 ||
@@ -98,7 +108,8 @@
          terminal_printf("[elf_loader] Error: Not an executable for i386 (Type=%d, Machine=%d).\n", ehdr->e_type, ehdr->e_machine);
          goto cleanup_file;
      }
-     if (ehdr->e_phentsize != sizeof(Elf32_Phdr) || ehdr->e_phoff == 0 || ehdr->e_phnum == 0) {
+     if (ehdr->e_phentsize != sizeof(Elf32_Phdr) || ehdr->e_phoff == 0 || ehdr->e_phnum == 0 ||
+         ehdr->e_phoff + (uint64_t)ehdr->e_phnum * sizeof(Elf32_Phdr) > (uint64_t)file_size) {
           terminal_printf("[elf_loader] Error: Invalid program header table.\n");
           goto cleanup_file;
      }
@@ -106,7 +117,12 @@
      *entry_point = ehdr->e_entry;
      terminal_printf("[elf_loader] ELF Entry Point: 0x%x\n", *entry_point);
  
-     Elf32_Phdr *phdrs = (Elf32_Phdr *)((uint8_t *)file_data + ehdr->e_phoff);
+     size_t phdrs_size = (size_t)ehdr->e_phnum * sizeof(Elf32_Phdr);
+     phdrs = kmalloc(phdrs_size);
+     if (!phdrs || vfs_pread(file, phdrs, phdrs_size, (off_t)ehdr->e_phoff) != (int)phdrs_size) {
+         terminal_printf("[elf_loader] Error: Failed to read program headers.\n");
+         goto cleanup_file;
+     }
  
      // 3. First Pass: Calculate total pages needed for all PT_LOAD segments
      terminal_printf("[elf_loader] Calculating total pages needed...\n");
@@ -223,13 +239,12 @@
          uint32_t seg_memsz = phdr->p_memsz;
  
          // Validate file offsets against file size again (belt-and-suspenders)
-         if (seg_offset > file_size || (seg_offset + seg_filesz) > file_size) {
+         if (seg_offset > (uint32_t)file_size || (seg_offset + seg_filesz) > (uint32_t)file_size) {
               terminal_printf("[elf_loader] Error: Invalid segment file offset/size (Seg %d).\n", i);
               ret = -1;
               goto cleanup_mappings; // Unmap pages, free frames
          }
  
-         uint8_t *file_src_base = (uint8_t *)file_data + seg_offset;
          uintptr_t current_vaddr = seg_vaddr;
          uint32_t bytes_processed = 0; // Track bytes copied/zeroed within the segment
  
@@ -272,9 +287,13 @@
              }
              bytes_to_zero = bytes_to_process_this_page - bytes_to_copy;
  
-             // Perform copy
-             if (bytes_to_copy > 0) {
-                 memcpy(page_target_ptr, file_src_base + bytes_processed, bytes_to_copy);
+             // Read file data straight into the frame
+             if (bytes_to_copy > 0 &&
+                 vfs_pread(file, page_target_ptr, bytes_to_copy, (off_t)(seg_offset + bytes_processed)) != (int)bytes_to_copy) {
+                 terminal_printf("[elf_loader] Error: Short read of segment %d.\n", i);
+                 paging_temp_unmap(temp_mapped_page);
+                 ret = -1;
+                 goto cleanup_mappings;
              }
              // Perform zeroing
              if (bytes_to_zero > 0) {
@@ -294,7 +313,7 @@
  
      // 7. Success
      ret = 0;
-     goto cleanup_frames_array; // Skip other cleanups, just free tracking array and file data
+     goto cleanup_frames_array; // Skip other cleanups, just free tracking array and headers
  
  cleanup_mappings:
      terminal_printf("[elf_loader] Cleaning up mappings due to error...\n");
@@ -321,9 +340,10 @@
      }
  
  cleanup_file:
-     if (file_data) {
-         kfree(file_data);
+     if (phdrs) {
+         kfree(phdrs);
      }
+     vfs_close(file);
  
      if (ret == 0) {
          terminal_printf("[elf_loader] load_elf_binary succeeded.\n");
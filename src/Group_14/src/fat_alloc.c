@@ -19,6 +19,8 @@
 #include "kmalloc.h"        // kmalloc/kfree
 #include "assert.h"         // KERNEL_ASSERT
 #include "string.h"         // strlen, strcpy, memset, memcpy, strcmp
+#include "dcache.h"         // dcache_invalidate_parent
+#include "pagecache.h"      // pagecache_invalidate_file
 
 // --- Standard Type Includes ---
 #include "libc/stdbool.h"
@@ -37,8 +39,96 @@
 // --- End Logging Macros ---
 
 
+/* --- Free-Space Map --- */
+
+/** @brief True if the free-space map shows `cluster` as free. */
+static inline bool fat_cluster_is_free(const fat_fs_t *fs, uint32_t cluster)
+{
+    return (fs->free_map[cluster / 32] & (1u << (cluster % 32))) == 0;
+}
+
+/**
+ * @brief Builds the free-space map from the in-memory FAT.
+ * Bits for clusters 0, 1 and past the last data cluster are set so that
+ * they are never handed out.
+ * @return FS_SUCCESS, or FS_ERR_OUT_OF_MEMORY (the driver then scans the FAT).
+ */
+int fat_build_free_map(fat_fs_t *fs)
+{
+    KERNEL_ASSERT(fs != NULL && fs->fat_table != NULL, "FAT table must be loaded first");
+
+    uint32_t max_cluster = fs->total_data_clusters + 1;
+    size_t words = (size_t)max_cluster / 32 + 1;
+    fs->free_map = kmalloc(words * sizeof(uint32_t));
+    if (!fs->free_map) return FS_ERR_OUT_OF_MEMORY;
+    memset(fs->free_map, 0xFF, words * sizeof(uint32_t));
+
+    fs->free_clusters = 0;
+    for (uint32_t cluster = 2; cluster <= max_cluster; cluster++) {
+        uint32_t entry_value;
+        if (fat_get_cluster_entry(fs, cluster, &entry_value) != FS_SUCCESS) continue; // Leave it marked used
+        if (entry_value == 0) {
+            fs->free_map[cluster / 32] &= ~(1u << (cluster % 32));
+            fs->free_clusters++;
+        }
+    }
+    fs->next_free_hint = 2;
+    return FS_SUCCESS;
+}
+
+/**
+ * @brief Looks for `want` free clusters in a row starting in [from, to].
+ * Runs may extend past `to`. Updates *best / *best_len with the longest run
+ * seen (measured up to `want`).
+ * @return true once a run of `want` clusters is found.
+ */
+static bool fat_scan_free_run(const fat_fs_t *fs, uint32_t from, uint32_t to, uint32_t want,
+                              uint32_t *best, uint32_t *best_len)
+{
+    uint32_t max_cluster = fs->total_data_clusters + 1;
+    uint32_t cluster = from;
+    while (cluster <= to) {
+        if (fs->free_map[cluster / 32] == 0xFFFFFFFFu) { // Whole word in use
+            cluster = (cluster | 31) + 1;
+            continue;
+        }
+        if (!fat_cluster_is_free(fs, cluster)) { cluster++; continue; }
+
+        uint32_t len = 1;
+        while (len < want && cluster + len <= max_cluster && fat_cluster_is_free(fs, cluster + len)) len++;
+        if (len > *best_len) {
+            *best = cluster;
+            *best_len = len;
+        }
+        if (len >= want) return true;
+        cluster += len + 1; // cluster + len is in use or past the end
+    }
+    return false;
+}
+
+/**
+ * @brief Next-fit search for a run of free clusters.
+ * Searches from fs->next_free_hint to the end of the volume, then wraps to
+ * the start. Takes the first run of `want` clusters; failing that, the
+ * longest shorter run seen.
+ * @return First cluster of the run (0 if none), with its length in *len_out.
+ */
+static uint32_t fat_find_free_run(const fat_fs_t *fs, uint32_t want, uint32_t *len_out)
+{
+    uint32_t max_cluster = fs->total_data_clusters + 1;
+    uint32_t hint = (fs->next_free_hint >= 2 && fs->next_free_hint <= max_cluster) ? fs->next_free_hint : 2;
+    uint32_t best = 0, best_len = 0;
+
+    if (!fat_scan_free_run(fs, hint, max_cluster, want, &best, &best_len) && hint > 2) {
+        fat_scan_free_run(fs, 2, hint - 1, want, &best, &best_len);
+    }
+    *len_out = best_len;
+    return best;
+}
+
 /**
  * @brief Finds the first available (zero-entry) cluster in the FAT table.
+ * Only used when the free-space map could not be allocated.
  * @param fs Pointer to the FAT filesystem structure.
  * @return The cluster number if found (>=2), or 0 on error or if no free cluster.
  * @note Assumes caller holds fs->lock.
@@ -75,52 +165,91 @@ static uint32_t find_free_cluster(fat_fs_t *fs)
 
 
 /**
- * @brief Allocates a new cluster, marks it as EOC, and optionally links it from a previous cluster.
+ * @brief Allocates a run of contiguous clusters, chains them and optionally links them from a previous cluster.
+ *
+ * A file is continued in place when the cluster after previous_cluster is
+ * free; otherwise the run comes from a next-fit search of the free-space
+ * map, so consecutive allocations for different files do not interleave
+ * in a single region.
  * @param fs Pointer to the FAT filesystem structure.
  * @param previous_cluster The cluster number to link from (0 if this is the first cluster).
- * @return The newly allocated cluster number (>=2), or 0 on failure.
+ * @param count Clusters wanted; fewer (but at least one) may be returned.
+ * @param allocated_out (Optional) Receives the number of clusters allocated.
+ * @return The first cluster of the run (>=2), or 0 on failure.
  * @note Assumes caller holds fs->lock.
  */
-uint32_t fat_allocate_cluster(fat_fs_t *fs, uint32_t previous_cluster)
+uint32_t fat_allocate_run(fat_fs_t *fs, uint32_t previous_cluster, uint32_t count, uint32_t *allocated_out)
 {
     KERNEL_ASSERT(fs != NULL, "FAT filesystem context cannot be NULL");
+    if (allocated_out) *allocated_out = 0;
 
     if (!fs->fat_table) {
         FAT_ALLOC_ERROR("FAT table not loaded.");
         return 0;
     }
+    if (count == 0) count = 1;
 
-    uint32_t new_cluster = find_free_cluster(fs);
-    if (new_cluster < 2) { // find_free_cluster returns 0 on error or no space, cluster < 2 is invalid
-        FAT_ALLOC_WARN("find_free_cluster failed or no space available.");
-        return 0;
+    uint32_t max_cluster = fs->total_data_clusters + 1;
+    uint32_t first = 0, run_len = 0;
+    if (fs->free_map) {
+        if (fs->free_clusters == 0) {
+            FAT_ALLOC_WARN("No free clusters left on device.");
+            return 0;
+        }
+        if (previous_cluster >= 2 && previous_cluster < max_cluster &&
+            fat_cluster_is_free(fs, previous_cluster + 1)) {
+            first = previous_cluster + 1;
+            run_len = 1;
+            while (run_len < count && first + run_len <= max_cluster && fat_cluster_is_free(fs, first + run_len)) {
+                run_len++;
+            }
+        } else {
+            first = fat_find_free_run(fs, count, &run_len);
+        }
+    } else {
+        first = find_free_cluster(fs);
+        run_len = 1;
     }
-    FAT_ALLOC_DEBUG("Found free cluster %lu to allocate.", (unsigned long)new_cluster);
-
-    // Mark the new cluster as End-Of-Chain in the FAT
-    if (fat_set_cluster_entry(fs, new_cluster, fs->eoc_marker) != FS_SUCCESS) {
-        FAT_ALLOC_ERROR("Failed to mark cluster %lu as EOC.", (unsigned long)new_cluster);
-        // Technically, the cluster is still marked free if this fails immediately, but it's an error state.
+    if (first < 2 || run_len == 0) {
+        FAT_ALLOC_WARN("No free cluster found (free count %lu).", (unsigned long)fs->free_clusters);
         return 0;
     }
-    FAT_ALLOC_DEBUG("Marked cluster %lu as EOC.", (unsigned long)new_cluster);
+    FAT_ALLOC_DEBUG("Allocating %lu cluster(s) from %lu.", (unsigned long)run_len, (unsigned long)first);
+
+    // Chain the run in order, ending with EOC, before linking it in
+    for (uint32_t i = 0; i < run_len; i++) {
+        uint32_t value = (i + 1 < run_len) ? first + i + 1 : fs->eoc_marker;
+        if (fat_set_cluster_entry(fs, first + i, value) != FS_SUCCESS) {
+            FAT_ALLOC_ERROR("Failed to set FAT entry for cluster %lu.", (unsigned long)(first + i));
+            while (i-- > 0) fat_set_cluster_entry(fs, first + i, 0); // Best effort rollback
+            return 0;
+        }
+    }
 
-    // If there's a previous cluster, link it to the new one
+    // If there's a previous cluster, link it to the new run
     if (previous_cluster >= 2) {
-        FAT_ALLOC_DEBUG("Linking previous cluster %lu to new cluster %lu.", (unsigned long)previous_cluster, (unsigned long)new_cluster);
-        if (fat_set_cluster_entry(fs, previous_cluster, new_cluster) != FS_SUCCESS) {
-            FAT_ALLOC_ERROR("Failed to link cluster %lu -> %lu.", (unsigned long)previous_cluster, (unsigned long)new_cluster);
-            // Rollback: Mark the new_cluster as free again since linking failed.
-            fat_set_cluster_entry(fs, new_cluster, 0); // Best effort rollback
+        if (fat_set_cluster_entry(fs, previous_cluster, first) != FS_SUCCESS) {
+            FAT_ALLOC_ERROR("Failed to link cluster %lu -> %lu.", (unsigned long)previous_cluster, (unsigned long)first);
+            for (uint32_t i = 0; i < run_len; i++) fat_set_cluster_entry(fs, first + i, 0); // Best effort rollback
             return 0;
         }
-        FAT_ALLOC_DEBUG("Successfully linked cluster %lu -> %lu.", (unsigned long)previous_cluster, (unsigned long)new_cluster);
-    } else {
-        FAT_ALLOC_DEBUG("No valid previous cluster (%lu), allocating as a new chain start.", (unsigned long)previous_cluster);
     }
 
-    FAT_ALLOC_INFO("Successfully allocated cluster %lu.", (unsigned long)new_cluster);
-    return new_cluster;
+    fs->next_free_hint = (first + run_len <= max_cluster) ? first + run_len : 2;
+    if (allocated_out) *allocated_out = run_len;
+    return first;
+}
+
+/**
+ * @brief Allocates a new cluster, marks it as EOC, and optionally links it from a previous cluster.
+ * @param fs Pointer to the FAT filesystem structure.
+ * @param previous_cluster The cluster number to link from (0 if this is the first cluster).
+ * @return The newly allocated cluster number (>=2), or 0 on failure.
+ * @note Assumes caller holds fs->lock.
+ */
+uint32_t fat_allocate_cluster(fat_fs_t *fs, uint32_t previous_cluster)
+{
+    return fat_allocate_run(fs, previous_cluster, 1, NULL);
 }
 
 
@@ -309,6 +438,9 @@ int fat_create_file(fat_fs_t        *fs,
         return ret;
     }
 
+    // Negative dentries for the new name or any alias of it are now wrong
+    dcache_invalidate_parent(fs, parent_dir_actual_cluster);
+
     // 7. Success: Output details of the created SFN entry
     *dir_cluster_out = free_slot_dir_cluster;      // Directory where entry was placed
     *dir_offset_out = current_write_offset;      // Offset of the SFN part of the entry
@@ -344,6 +476,8 @@ int fat_truncate_file(fat_fs_t *fs,
         return FS_ERR_IS_A_DIRECTORY;
     }
 
+    pagecache_invalidate_file(fs, FAT_FILE_INO(entry_dir_cluster, entry_offset_in_dir));
+
     // 1. Free the file's cluster chain, if any
     uint32_t first_data_cluster = fat_get_entry_cluster(entry);
     uint32_t original_size = entry->file_size;
@@ -389,4 +523,157 @@ int fat_truncate_file(fat_fs_t *fs,
     return FS_SUCCESS;
 }
 
+/* --- Extent Map --- */
+
+#define FAT_EXTENT_INITIAL_CAPACITY 8
+
+/**
+ * @brief Adds file cluster `index`, stored at disk `cluster`, to the end of
+ * the extent map, growing the last run when the cluster follows it on disk.
+ * @return false if `index` does not directly follow the map or the map could
+ * not grow; the map is then left as it was (still a valid prefix).
+ */
+static bool fat_extent_push(fat_file_context_t *fctx, uint32_t index, uint32_t cluster)
+{
+    if (index != fctx->extent_mapped) return false;
+
+    if (fctx->extent_count > 0) {
+        fat_extent_t *last = &fctx->extents[fctx->extent_count - 1];
+        if (last->disk_cluster + last->length == cluster) {
+            last->length++;
+            fctx->extent_mapped++;
+            return true;
+        }
+    }
+
+    if (fctx->extent_count == fctx->extent_capacity) {
+        uint32_t new_capacity = fctx->extent_capacity ? fctx->extent_capacity * 2 : FAT_EXTENT_INITIAL_CAPACITY;
+        fat_extent_t *grown = kmalloc(new_capacity * sizeof(fat_extent_t));
+        if (!grown) {
+            FAT_ALLOC_WARN("No memory to grow extent map to %lu runs; seeks past cluster %lu walk the FAT.",
+                           (unsigned long)new_capacity, (unsigned long)fctx->extent_mapped);
+            return false;
+        }
+        if (fctx->extents) {
+            memcpy(grown, fctx->extents, fctx->extent_count * sizeof(fat_extent_t));
+            kfree(fctx->extents);
+        }
+        fctx->extents = grown;
+        fctx->extent_capacity = new_capacity;
+    }
+
+    fat_extent_t *ext = &fctx->extents[fctx->extent_count++];
+    ext->file_cluster = index;
+    ext->disk_cluster = cluster;
+    ext->length = 1;
+    fctx->extent_mapped++;
+    return true;
+}
+
+/**
+ * @brief Maps a file cluster index to its disk cluster.
+ *
+ * Indices the extent map already covers are found by binary search over its
+ * runs. Anything beyond is found by walking the FAT from the end of the map,
+ * recording the clusters passed so the next lookup does not walk them again.
+ * @note Assumes caller holds fs->lock.
+ */
+int fat_extent_lookup(fat_fs_t *fs, fat_file_context_t *fctx, uint32_t index,
+                      uint32_t *cluster_out, uint32_t *chain_len_out)
+{
+    KERNEL_ASSERT(fs != NULL && fctx != NULL && cluster_out != NULL, "NULL pointer argument");
+
+    if (index < fctx->extent_mapped) {
+        // Last run starting at or before index
+        uint32_t lo = 0, hi = fctx->extent_count - 1;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (fctx->extents[mid].file_cluster <= index) lo = mid;
+            else hi = mid - 1;
+        }
+        const fat_extent_t *ext = &fctx->extents[lo];
+        *cluster_out = ext->disk_cluster + (index - ext->file_cluster);
+        return FS_SUCCESS;
+    }
+
+    uint32_t pos, cluster;
+    if (fctx->extent_mapped > 0) {
+        const fat_extent_t *last = &fctx->extents[fctx->extent_count - 1];
+        pos = fctx->extent_mapped - 1;
+        cluster = last->disk_cluster + last->length - 1;
+    } else {
+        if (fctx->first_cluster < 2) {
+            *cluster_out = 0;
+            if (chain_len_out) *chain_len_out = 0;
+            return FS_ERR_EOF;
+        }
+        pos = 0;
+        cluster = fctx->first_cluster;
+        fat_extent_push(fctx, 0, cluster);
+    }
+
+    bool recording = (fctx->extent_mapped == pos + 1);
+    while (pos < index) {
+        uint32_t next_cluster;
+        int result = fat_get_next_cluster(fs, cluster, &next_cluster);
+        if (result != FS_SUCCESS) return result;
+
+        if (next_cluster >= fs->eoc_marker) {
+            *cluster_out = cluster;
+            if (chain_len_out) *chain_len_out = pos + 1;
+            return FS_ERR_EOF;
+        }
+        if (next_cluster < 2 || pos >= fs->total_data_clusters) {
+            FAT_ALLOC_ERROR("Broken chain after cluster %lu (next %lu, file cluster %lu).",
+                            (unsigned long)cluster, (unsigned long)next_cluster, (unsigned long)pos);
+            return FS_ERR_CORRUPT;
+        }
+
+        pos++;
+        cluster = next_cluster;
+        if (recording) recording = fat_extent_push(fctx, pos, cluster);
+    }
+
+    *cluster_out = cluster;
+    return FS_SUCCESS;
+}
+
+/**
+ * @brief Records a newly linked cluster in the extent map.
+ * @note Assumes caller holds fs->lock.
+ */
+void fat_extent_append(fat_file_context_t *fctx, uint32_t index, uint32_t cluster)
+{
+    KERNEL_ASSERT(fctx != NULL, "NULL file context");
+    (void)fat_extent_push(fctx, index, cluster);
+}
+
+/**
+ * @brief Drops the mapping of file clusters at or beyond `clusters`, e.g.
+ * after the chain was cut there. Passing 0 frees the map.
+ * @note Assumes caller holds fs->lock.
+ */
+void fat_extent_truncate(fat_file_context_t *fctx, uint32_t clusters)
+{
+    KERNEL_ASSERT(fctx != NULL, "NULL file context");
+    if (clusters == 0) {
+        if (fctx->extents) kfree(fctx->extents);
+        fctx->extents = NULL;
+        fctx->extent_count = 0;
+        fctx->extent_capacity = 0;
+        fctx->extent_mapped = 0;
+        return;
+    }
+    if (clusters >= fctx->extent_mapped) return;
+
+    while (fctx->extent_count > 0 && fctx->extents[fctx->extent_count - 1].file_cluster >= clusters) {
+        fctx->extent_count--;
+    }
+    KERNEL_ASSERT(fctx->extent_count > 0, "Extent map lost its first run");
+    fat_extent_t *last = &fctx->extents[fctx->extent_count - 1];
+    last->length = clusters - last->file_cluster;
+    fctx->extent_mapped = clusters;
+}
+
+
 // --- End of file fat_alloc.c ---
\ No newline at end of file
@@ -22,6 +22,7 @@
  // Implemented in fat_fs.c
  extern void *fat_mount_internal(const char *device);
  extern int   fat_unmount_internal(void *fs_context);
+ extern int   fat_sync_internal(void *fs_context);
  
  // Implemented in fat_dir.c
  extern vnode_t *fat_open_internal(void *fs_context, const char *path, int flags);
@@ -33,6 +34,8 @@
  extern int   fat_write_internal(file_t *file, const void *buf, size_t len);
  extern int   fat_close_internal(file_t *file);
  extern off_t fat_lseek_internal(file_t *file, off_t offset, int whence);
+ extern int   fat_fsync_internal(file_t *file);
+ extern int   fat_identify_internal(file_t *file, vfs_file_id_t *id_out);
  
  /* --- Static VFS Driver Structure --- */
  // Defines the FAT filesystem driver interface for the VFS.
@@ -47,6 +50,9 @@
      .lseek   = fat_lseek_internal,    // Lseek function pointer
      .readdir = fat_readdir_internal,  // Readdir function pointer
      .unlink  = fat_unlink_internal,   // Unlink function pointer
+     .fsync   = fat_fsync_internal,    // Fsync function pointer
+     .sync    = fat_sync_internal,     // Sync function pointer
+     .identify = fat_identify_internal, // Identify function pointer (page cache)
      // Add .mkdir, .rmdir, .stat, etc. here if/when implemented
      .next    = NULL                 // Linked list pointer for VFS internal use
  };
@@ -17,7 +17,7 @@
 #include "fat_lfn.h"    // LFN specific helpers (checksum, reconstruct, generate)
 #include "fat_io.h"     // read_cluster_cached, write_cluster_cached (indirectly via helpers)
 #include "buffer_cache.h" // Buffer cache access (buffer_get, buffer_release, etc.)
-#include "spinlock.h"   // Locking primitives
+#include "mutex.h"      // fs->lock
 #include "terminal.h"   // Logging (printk equivalent)
 #include "sys_file.h"   // O_* flags definitions (O_CREAT, O_TRUNC, etc.)
 #include "kmalloc.h"    // Kernel memory allocation
@@ -26,6 +26,9 @@
 #include "types.h"      // struct dirent, uint*_t etc.
 #include <string.h>     // memcpy, memcmp, memset, strlen, strchr, strrchr, strtok
 #include "assert.h"     // KERNEL_ASSERT
+#include "dcache.h"     // Directory-entry cache
+#include "pagecache.h"  // pagecache_invalidate_file
+#include "libc/ctype.h" // toupper (dentry cache keys)
 
 // --- Local Definitions ---
 // (Keep DT_* defines as before)
@@ -46,6 +49,10 @@ extern vfs_driver_t fat_vfs_driver;
 
 // --- Static Helper Prototypes ---
 static void fat_format_short_name_impl(const uint8_t name_8_3[11], char *out_name);
+static int fat_find_in_dir_cached(fat_fs_t *fs, uint32_t dir_cluster, const char *component,
+                                  fat_dir_entry_t *entry_out,
+                                  uint32_t *entry_offset_in_dir_out,
+                                  uint32_t *first_lfn_offset_out);
 
 // --- Logging Macros ---
 // (Keep logging macros as before)
@@ -91,7 +98,7 @@ static void fat_format_short_name_impl(const uint8_t name_8_3[11], char *out_nam
          return NULL;
      }
 
-     uintptr_t irq_flags = spinlock_acquire_irqsave(&fs->lock);
+     mutex_lock(&fs->lock);
      FAT_DEBUG_LOG("Lock acquired.");
 
      fat_dir_entry_t entry;
@@ -244,7 +251,7 @@ static void fat_format_short_name_impl(const uint8_t name_8_3[11], char *out_nam
 
      // --- Success ---
      FAT_DEBUG_LOG("Step 6: Success Path.");
-     spinlock_release_irqrestore(&fs->lock, irq_flags);
+     mutex_unlock(&fs->lock);
      FAT_DEBUG_LOG("Lock released.");
      FAT_INFO_LOG("Open successful: path='%s', vnode=%p, size=%lu", path ? path : "<NULL>", vnode, (unsigned long)file_ctx->file_size);
      return vnode;
@@ -255,7 +262,7 @@ static void fat_format_short_name_impl(const uint8_t name_8_3[11], char *out_nam
      FAT_ERROR_LOG("Open failed: path='%s', error=%d (%s)", path ? path : "<NULL>", ret_err, fs_strerror(ret_err)); // Log the final error
      if (vnode) { FAT_DEBUG_LOG("Freeing vnode %p", vnode); kfree(vnode); }
      if (file_ctx) { FAT_DEBUG_LOG("Freeing file_ctx %p", file_ctx); kfree(file_ctx); }
-     spinlock_release_irqrestore(&fs->lock, irq_flags);
+     mutex_unlock(&fs->lock);
      FAT_DEBUG_LOG("Lock released.");
      return NULL;
  }
@@ -287,7 +294,7 @@ int fat_readdir_internal(file_t *dir_file, struct dirent *d_entry_out, size_t en
     fat_fs_t *fs = fctx->fs;
     FAT_DEBUG_LOG("Context valid: fs=%p, first_cluster=%lu", fs, (unsigned long)fctx->first_cluster);
 
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&fs->lock);
+    mutex_lock(&fs->lock);
 
     // --- State Management ---
     FAT_DEBUG_LOG("Checking readdir state: requested_idx=%lu, last_idx=%lu, current_cluster=%lu, current_offset=%lu",
@@ -314,7 +321,7 @@ int fat_readdir_internal(file_t *dir_file, struct dirent *d_entry_out, size_t en
     } else if (entry_index != fctx->readdir_last_index + 1) {
         FAT_WARN_LOG("Non-sequential index requested (%lu requested, %lu expected). Seeking not implemented, failing.", // Now uses DEBUG log
                      (unsigned long)entry_index, (unsigned long)(fctx->readdir_last_index + 1));
-        spinlock_release_irqrestore(&fs->lock, irq_flags);
+        mutex_unlock(&fs->lock);
         return FS_ERR_INVALID_PARAM;
     }
 
@@ -322,7 +329,7 @@ int fat_readdir_internal(file_t *dir_file, struct dirent *d_entry_out, size_t en
      uint8_t *sector_buffer = kmalloc(fs->bytes_per_sector);
     if (!sector_buffer) {
         FAT_ERROR_LOG("Failed to allocate %u bytes for sector buffer.", fs->bytes_per_sector);
-        spinlock_release_irqrestore(&fs->lock, irq_flags);
+        mutex_unlock(&fs->lock);
         return FS_ERR_OUT_OF_MEMORY;
     }
     FAT_DEBUG_LOG("Allocated sector buffer at %p (%u bytes).", sector_buffer, fs->bytes_per_sector);
@@ -482,7 +489,7 @@ readdir_done:
     FAT_DEBUG_LOG("Exiting: Releasing lock, freeing buffer %p, returning status %d (%s).",
                    sector_buffer, ret, fs_strerror(ret));
     kfree(sector_buffer);
-    spinlock_release_irqrestore(&fs->lock, irq_flags);
+    mutex_unlock(&fs->lock);
     return ret;
 }
 
@@ -494,7 +501,7 @@ int fat_unlink_internal(void *fs_context, const char *path)
      fat_fs_t *fs = (fat_fs_t*)fs_context;
      if (!fs || !path) return FS_ERR_INVALID_PARAM;
 
-     uintptr_t irq_flags = spinlock_acquire_irqsave(&fs->lock);
+     mutex_lock(&fs->lock);
      int ret = FS_SUCCESS; // Assume success initially
 
      // 1. Split path into parent directory path and final component name
@@ -531,9 +538,8 @@ int fat_unlink_internal(void *fs_context, const char *path)
      fat_dir_entry_t entry_to_delete;
      uint32_t entry_offset;            // Offset of the 8.3 entry
      uint32_t first_lfn_offset = (uint32_t)-1; // Offset of the first LFN entry (if any)
-     int find_res = fat_find_in_dir(fs, parent_cluster, component_name,
-                                    &entry_to_delete, NULL, 0, // Don't need LFN name buffer here
-                                    &entry_offset, &first_lfn_offset);
+     int find_res = fat_find_in_dir_cached(fs, parent_cluster, component_name,
+                                           &entry_to_delete, &entry_offset, &first_lfn_offset);
 
      if (find_res != FS_SUCCESS) {
          ret = find_res; // File/component not found in parent directory, or I/O error
@@ -574,6 +580,10 @@ int fat_unlink_internal(void *fs_context, const char *path)
          mark_start_offset = first_lfn_offset; // Start marking from the first LFN entry
      }
 
+     // The name and its aliases (short name, other cases) are gone
+     dcache_invalidate_parent(fs, parent_cluster);
+     pagecache_invalidate_file(fs, FAT_FILE_INO(parent_cluster, entry_offset));
+
      int mark_res = mark_directory_entries_deleted(fs, parent_cluster,
                                                  mark_start_offset,
                                                  num_entries_to_mark,
@@ -591,7 +601,7 @@ int fat_unlink_internal(void *fs_context, const char *path)
      // Fall through to return FS_SUCCESS unless an error occurred and wasn't fatal
 
  unlink_fail_locked:
-     spinlock_release_irqrestore(&fs->lock, irq_flags);
+     mutex_unlock(&fs->lock);
      return ret; // Return final status
  }
 
@@ -616,7 +626,8 @@ int fat_find_in_dir(fat_fs_t *fs,
 
     uint32_t current_cluster = dir_cluster;
     bool scanning_fixed_root = (fs->type != FAT_TYPE_FAT32 && dir_cluster == 0);
-    uint32_t current_byte_offset = 0;
+    uint32_t current_byte_offset = 0; // Within current_cluster
+    uint32_t chain_byte_base = 0;     // Offset of current_cluster within the directory
 
     if (lfn_out && lfn_max_len > 0) lfn_out[0] = '\0';
     if (first_lfn_offset_out) *first_lfn_offset_out = (uint32_t)-1;
@@ -661,7 +672,7 @@ int fat_find_in_dir(fat_fs_t *fs,
 
         for (size_t e_idx = 0; e_idx < entries_per_sector; e_idx++) {
             fat_dir_entry_t *de = (fat_dir_entry_t*)(sector_data + e_idx * sizeof(fat_dir_entry_t));
-            uint32_t entry_abs_offset = current_byte_offset + (uint32_t)(e_idx * sizeof(fat_dir_entry_t));
+            uint32_t entry_abs_offset = chain_byte_base + current_byte_offset + (uint32_t)(e_idx * sizeof(fat_dir_entry_t));
 
             FAT_DEBUG_LOG("Entry %lu (abs_offset %lu): Name[0]=0x%02x, Attr=0x%02x",
                           (unsigned long)e_idx, (unsigned long)entry_abs_offset, de->name[0], de->attr);
@@ -714,6 +725,7 @@ int fat_find_in_dir(fat_fs_t *fs,
             if (next_c >= fs->eoc_marker) { ret = FS_ERR_NOT_FOUND; break; }
             current_cluster = next_c;
             current_byte_offset = 0;
+            chain_byte_base += fs->cluster_size_bytes;
         }
     } // End while loop
 
@@ -725,6 +737,120 @@ find_done:
 }
 
 
+// ==========================================================================
+// == Directory-entry cache ==
+// ==========================================================================
+
+// What the dentry cache remembers about a name found by fat_find_in_dir.
+// Only the location is cached; the entry itself is re-read on a hit so its
+// size and first cluster are always current.
+typedef struct {
+    uint32_t entry_offset;       // Offset of the 8.3 entry within the directory
+    uint32_t first_lfn_offset;   // Offset of its first LFN entry, or (uint32_t)-1
+} fat_dcache_data_t;
+
+/**
+ * @brief Builds the cache key for a component: FAT names match regardless of
+ * case, so the key is upper-cased.
+ * @return false if the component is too long to cache.
+ */
+static bool fat_dcache_key(const char *component, char key[DCACHE_NAME_MAX + 1])
+{
+    size_t i = 0;
+    for (; component[i]; i++) {
+        if (i >= DCACHE_NAME_MAX) return false;
+        key[i] = (char)toupper((unsigned char)component[i]);
+    }
+    key[i] = '\0';
+    return true;
+}
+
+/**
+ * @brief Reads the 8.3 entry at a directory offset through the buffer cache.
+ * @return FS_SUCCESS, or FS_ERR_NOT_FOUND if the slot no longer holds a live 8.3 entry.
+ */
+static int fat_read_dir_entry_at(fat_fs_t *fs, uint32_t dir_cluster, uint32_t dir_offset,
+                                 fat_dir_entry_t *entry_out)
+{
+    uint32_t sector_offset_in_chain = dir_offset / fs->bytes_per_sector;
+    uint32_t offset_in_sector = dir_offset % fs->bytes_per_sector;
+    uint32_t lba;
+
+    if (dir_cluster == 0 && fs->type != FAT_TYPE_FAT32) {
+        if (sector_offset_in_chain >= fs->root_dir_sectors) return FS_ERR_NOT_FOUND;
+        lba = fs->root_dir_start_lba + sector_offset_in_chain;
+    } else if (dir_cluster >= 2) {
+        uint32_t current_cluster = dir_cluster;
+        for (uint32_t i = 0; i < sector_offset_in_chain / fs->sectors_per_cluster; i++) {
+            uint32_t next_cluster;
+            int ret = fat_get_next_cluster(fs, current_cluster, &next_cluster);
+            if (ret != FS_SUCCESS) return ret;
+            if (next_cluster >= fs->eoc_marker) return FS_ERR_NOT_FOUND;
+            current_cluster = next_cluster;
+        }
+        uint32_t cluster_lba = fat_cluster_to_lba(fs, current_cluster);
+        if (cluster_lba == 0) return FS_ERR_IO;
+        lba = cluster_lba + sector_offset_in_chain % fs->sectors_per_cluster;
+    } else {
+        return FS_ERR_INVALID_PARAM;
+    }
+
+    buffer_t *b = buffer_get(fs->disk_ptr->cache_dev_id, lba);
+    if (!b) return FS_ERR_IO;
+    memcpy(entry_out, b->data + offset_in_sector, sizeof(*entry_out));
+    buffer_release(b);
+
+    if (entry_out->name[0] == FAT_DIR_ENTRY_UNUSED || entry_out->name[0] == FAT_DIR_ENTRY_DELETED ||
+        (entry_out->attr & FAT_ATTR_LONG_NAME_MASK) == FAT_ATTR_LONG_NAME ||
+        (entry_out->attr & FAT_ATTR_VOLUME_ID)) {
+        return FS_ERR_NOT_FOUND;
+    }
+    return FS_SUCCESS;
+}
+
+/**
+ * @brief fat_find_in_dir through the directory-entry cache.
+ * Hits cost one buffer-cache lookup instead of a directory scan; names known
+ * to be missing fail without any I/O. Misses scan and fill the cache.
+ * @note Assumes caller holds fs->lock.
+ */
+static int fat_find_in_dir_cached(fat_fs_t *fs, uint32_t dir_cluster, const char *component,
+                                  fat_dir_entry_t *entry_out,
+                                  uint32_t *entry_offset_in_dir_out,
+                                  uint32_t *first_lfn_offset_out)
+{
+    char key[DCACHE_NAME_MAX + 1];
+    bool cacheable = fat_dcache_key(component, key);
+
+    if (cacheable) {
+        fat_dcache_data_t data;
+        int cached = dcache_lookup(fs, dir_cluster, key, &data, sizeof(data));
+        if (cached == DCACHE_NEGATIVE) return FS_ERR_NOT_FOUND;
+        if (cached == DCACHE_HIT) {
+            if (fat_read_dir_entry_at(fs, dir_cluster, data.entry_offset, entry_out) == FS_SUCCESS) {
+                *entry_offset_in_dir_out = data.entry_offset;
+                if (first_lfn_offset_out) *first_lfn_offset_out = data.first_lfn_offset;
+                return FS_SUCCESS;
+            }
+            FAT_WARN_LOG("Stale dentry for '%s' in dir cluster %lu; rescanning.", component, (unsigned long)dir_cluster);
+            dcache_invalidate(fs, dir_cluster, key);
+        }
+    }
+
+    fat_dcache_data_t data;
+    int ret = fat_find_in_dir(fs, dir_cluster, component, entry_out, NULL, 0,
+                              &data.entry_offset, &data.first_lfn_offset);
+    if (ret == FS_SUCCESS) {
+        *entry_offset_in_dir_out = data.entry_offset;
+        if (first_lfn_offset_out) *first_lfn_offset_out = data.first_lfn_offset;
+        if (cacheable) dcache_insert(fs, dir_cluster, key, &data, sizeof(data));
+    } else if (ret == FS_ERR_NOT_FOUND && cacheable) {
+        dcache_insert_negative(fs, dir_cluster, key);
+    }
+    return ret;
+}
+
+
 // ==========================================================================
 // == fat_lookup_path - Definition should remain here ==
 // ==========================================================================
@@ -761,6 +887,8 @@ int fat_lookup_path(fat_fs_t *fs, const char *path,
     if (!path_copy) return FS_ERR_OUT_OF_MEMORY;
     strcpy(path_copy, path);
 
+    if (lfn_out && lfn_max_len > 0) lfn_out[0] = '\0';
+
     char *component = strtok(path_copy, "/");
     uint32_t current_dir_cluster = (fs->type == FAT_TYPE_FAT32) ? fs->root_cluster : 0;
     fat_dir_entry_t current_entry;
@@ -775,9 +903,8 @@ int fat_lookup_path(fat_fs_t *fs, const char *path,
 
         previous_dir_cluster = current_dir_cluster;
         uint32_t component_entry_offset;
-        int find_comp_res = fat_find_in_dir(fs, current_dir_cluster, component,
-                                             &current_entry, lfn_out, lfn_max_len,
-                                             &component_entry_offset, NULL);
+        int find_comp_res = fat_find_in_dir_cached(fs, current_dir_cluster, component,
+                                                    &current_entry, &component_entry_offset, NULL);
         if (find_comp_res != FS_SUCCESS) { ret = find_comp_res; goto lookup_done; }
 
         char* next_component = strtok(NULL, "/");
@@ -841,7 +968,7 @@ int read_directory_sector(fat_fs_t *fs, uint32_t cluster,
         return FS_ERR_INVALID_PARAM;
     }
 
-    buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, lba);
+    buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, lba);
     if (!b) return FS_ERR_IO;
     memcpy(buffer, b->data, fs->bytes_per_sector);
     buffer_release(b);
@@ -891,7 +1018,7 @@ int update_directory_entry(fat_fs_t *fs,
         return FS_ERR_INVALID_PARAM;
     }
 
-    buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, lba);
+    buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, lba);
     if (!b) return FS_ERR_IO;
     memcpy(b->data + offset_in_sector, new_entry, sizeof(fat_dir_entry_t));
     buffer_mark_dirty(b);
@@ -943,7 +1070,7 @@ int mark_directory_entries_deleted(fat_fs_t *fs,
              lba = cluster_lba + sector_in_final_cluster;
          } else { result = FS_ERR_INVALID_PARAM; break; }
 
-        buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, lba);
+        buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, lba);
         if (!b) { result = FS_ERR_IO; break; }
 
         bool buffer_dirtied = false;
@@ -1009,7 +1136,7 @@ int write_directory_entries(fat_fs_t *fs, uint32_t dir_cluster,
              lba = cluster_lba + sector_in_final_cluster;
          } else { result = FS_ERR_INVALID_PARAM; break; }
 
-        buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, lba);
+        buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, lba);
         if (!b) { result = FS_ERR_IO; break; }
 
         size_t bytes_to_write_this_sector = sector_size - offset_in_sector;
@@ -1190,7 +1317,7 @@ int find_free_directory_slot(fat_fs_t    *fs,
         }
         for (uint32_t s = 0; s < fs->sectors_per_cluster; ++s) {
             FAT_DEBUG_LOG("Zeroing sector %lu (LBA %lu) of new cluster %lu", (unsigned long)s, (unsigned long)(lba+s), (unsigned long)new_clu);
-            buffer_t *b = buffer_get(fs->disk_ptr->blk_dev.device_name, lba + s);
+            buffer_t *b = buffer_get(fs->disk_ptr->cache_dev_id, lba + s);
             if (!b) {
                 FAT_ERROR_LOG("Failed to get buffer for LBA %lu during zeroing!", (unsigned long)(lba+s));
                 status = FS_ERR_IO;
@@ -8,11 +8,12 @@
  #include "fat_fs.h"     // Our function declarations
  #include "fat_core.h"   // Core FAT structures and constants
  #include "fat_utils.h"  // fat_cluster_to_lba (needed for geometry checks?) - maybe not needed here directly
+ #include "fat_alloc.h"  // fat_build_free_map
  #include "disk.h"       // For reading boot sector, FAT sectors
  #include "buffer_cache.h" // Buffer cache for disk I/O
  #include "kmalloc.h"    // Kernel memory allocation
  #include "terminal.h"   // Logging
- #include "spinlock.h"   // Spinlock initialization
+ #include "mutex.h"      // fs->lock
  #include "fs_errno.h"   // Filesystem error codes
  #include <string.h>     // memcpy, memset, memcmp
  #include "assert.h"     // KERNEL_ASSERT
@@ -34,6 +35,12 @@
   * @return FS_SUCCESS or negative error code.
   */
  static int flush_fat_table(fat_fs_t *fs);
+
+ /**
+  * @brief Buffer cache flusher hook: moves FAT changes into the cache.
+  * @param ctx The fat_fs_t it was registered with.
+  */
+ static void fat_writeback_hook(void *ctx);
  
  
  /* --- VFS Mount/Unmount Implementations --- */
@@ -61,13 +68,13 @@
          goto mount_fail;
      }
      memset(fs, 0, sizeof(*fs));
-     spinlock_init(&fs->lock); // Initialize the lock early
+     mutex_init(&fs->lock); // Initialize the lock early
      fs->fat_table = NULL; // Ensure fat_table is NULL initially for cleanup logic
      fs->fat_dirty = false; // Initialize dirty flag
  
      // 2. Read Boot Sector (LBA 0) using Buffer Cache
-     //    Buffer cache implicitly looks up the disk_t based on device_name.
-     bs_buf = buffer_get(device_name, 0);
+     //    The device must have been registered with the buffer cache by name.
+     bs_buf = buffer_get(buffer_device_id(device_name), 0);
      if (!bs_buf) {
          terminal_printf("[FAT Mount] Error: Failed to read boot sector (LBA 0) for device '%s' via buffer cache.\n", device_name);
          result = FS_ERR_IO;
@@ -196,6 +203,11 @@
          goto mount_fail; // fs itself will be freed below
      }
  
+     // The flusher copies FAT changes into the buffer cache in the background
+     if (buffer_cache_register_writeback_hook(fat_writeback_hook, fs) != FS_SUCCESS) {
+         terminal_write("[FAT Mount] Warning: No write-back hook slot; FAT is written at sync/unmount only.\n");
+     }
+
      // --- Mount Successful ---
      terminal_printf("[FAT Mount] Mount successful for device '%s'. Type: FAT%d\n",
                       device_name, (fs->type == FAT_TYPE_FAT12) ? 12 : (fs->type == FAT_TYPE_FAT16 ? 16 : 32));
@@ -213,6 +225,8 @@
          if (fs->fat_table) {
              kfree(fs->fat_table);
          }
+         if (fs->fat_dirty_sectors) kfree(fs->fat_dirty_sectors);
+         if (fs->free_map) kfree(fs->free_map);
          kfree(fs); // Free the main fs structure
      }
      // fs_set_errno(result); // Set thread-local errno maybe
@@ -234,9 +248,12 @@
                              fs->disk_ptr->blk_dev.device_name : "(unknown device)";
      terminal_printf("[FAT Unmount] Unmounting FAT filesystem for %s (context @ 0x%p)...\n", dev_name, fs);
  
+     // Waits for a running flusher pass over this fs; must precede taking fs->lock
+     buffer_cache_unregister_writeback_hook(fat_writeback_hook, fs);
+
      // Acquire lock to ensure exclusive access during unmount
      // This prevents races if another thread tries accessing the FS during unmount.
-     uintptr_t irq_flags = spinlock_acquire_irqsave(&fs->lock);
+     mutex_lock(&fs->lock);
  
      int result = FS_SUCCESS;
  
@@ -251,6 +268,10 @@
          // Free the FAT table memory regardless of flush success
          kfree(fs->fat_table);
          fs->fat_table = NULL;
+         if (fs->fat_dirty_sectors) kfree(fs->fat_dirty_sectors);
+         fs->fat_dirty_sectors = NULL;
+         if (fs->free_map) kfree(fs->free_map);
+         fs->free_map = NULL;
      }
  
      // 2. Optionally sync the entire buffer cache for the device. Good practice.
@@ -262,7 +283,7 @@
      }
  
      // 3. Release the lock before freeing the context structure itself
-     spinlock_release_irqrestore(&fs->lock, irq_flags);
+     mutex_unlock(&fs->lock);
  
      // 4. Free the filesystem context structure
      kfree(fs);
@@ -272,7 +293,33 @@
  }
  
  
+ /**
+  * @brief Writes the FAT and all dirty blocks of the filesystem's disk to
+  * stable storage.
+  */
+ int fat_sync_internal(void *fs_context)
+ {
+     fat_fs_t *fs = (fat_fs_t*)fs_context;
+     if (!fs || !fs->disk_ptr) return FS_ERR_INVALID_PARAM;
+
+     mutex_lock(&fs->lock);
+     int result = flush_fat_table(fs);
+     mutex_unlock(&fs->lock);
+
+     int sync_result = buffer_cache_sync_device(fs->disk_ptr->cache_dev_id);
+     return (result != FS_SUCCESS) ? result : sync_result;
+ }
+ 
+ 
  /* --- Static Helper Implementations --- */
+
+ static void fat_writeback_hook(void *ctx)
+ {
+     fat_fs_t *fs = (fat_fs_t*)ctx;
+     mutex_lock(&fs->lock);
+     if (fs->fat_dirty) flush_fat_table(fs); // Leaves the FAT dirty on error; retried next pass
+     mutex_unlock(&fs->lock);
+ }
  
  /**
   * @brief Loads the entire FAT table from disk into memory.
@@ -318,7 +365,7 @@
  
      for (uint32_t sector_index = 0; sector_index < fs->fat_size_sectors; sector_index++) {
          uint32_t lba = fs->fat_start_lba + sector_index;
-         buffer_t* sector_buf = buffer_get(fs->disk_ptr->blk_dev.device_name, lba);
+         buffer_t* sector_buf = buffer_get(fs->disk_ptr->cache_dev_id, lba);
          if (!sector_buf) {
              terminal_printf("[FAT Load FAT] Error: Failed to get buffer for FAT sector %u (LBA %u).\n", sector_index, lba);
              kfree(fs->fat_table); // Clean up allocation
@@ -337,6 +384,18 @@
          current_fat_ptr += fs->bytes_per_sector;
      }
  
+     // Without the map every flush compares the whole table, which still works
+     fs->fat_dirty_sectors = kmalloc((fs->fat_size_sectors + 7) / 8);
+     if (fs->fat_dirty_sectors) memset(fs->fat_dirty_sectors, 0, (fs->fat_size_sectors + 7) / 8);
+
+     // Likewise without the free-space map allocation falls back to scanning the FAT
+     if (fat_build_free_map(fs) == FS_SUCCESS) {
+         terminal_printf("[FAT Load FAT] %lu of %lu data clusters free.\n",
+                         (unsigned long)fs->free_clusters, (unsigned long)fs->total_data_clusters);
+     } else {
+         terminal_write("[FAT Load FAT] Warning: No memory for the free-space map; allocation will scan the FAT.\n");
+     }
+
      fs->fat_dirty = false; // Mark FAT as clean initially after loading
      terminal_write("[FAT Load FAT] FAT table loaded successfully.\n");
      return FS_SUCCESS;
@@ -362,19 +421,19 @@
          return FS_ERR_INTERNAL; // Indicates FS struct wasn't properly initialized
      }
  
-     terminal_printf("[FAT Flush FAT] Flushing %u modified FAT sectors via buffer cache...\n", fs->fat_size_sectors);
      int sectors_written = 0;
      int errors_encountered = 0;
      const uint8_t *current_fat_ptr = (const uint8_t *)fs->fat_table;
  
-     // Iterate through each sector of the FAT table
+     // Iterate through the sectors changed since the last flush (all if untracked)
      for (uint32_t i = 0; i < fs->fat_size_sectors; i++) {
+         if (fs->fat_dirty_sectors && !(fs->fat_dirty_sectors[i / 8] & (1u << (i % 8)))) continue;
          uint32_t target_lba = fs->fat_start_lba + i;
          const uint8_t *fat_sector_in_memory = current_fat_ptr + (i * fs->bytes_per_sector);
  
          // Get the corresponding buffer from the cache
          // This might read from disk if not present, but that's okay.
-         buffer_t *cached_buf = buffer_get(fs->disk_ptr->blk_dev.device_name, target_lba);
+         buffer_t *cached_buf = buffer_get(fs->disk_ptr->cache_dev_id, target_lba);
          if (!cached_buf) {
              terminal_printf("[FAT Flush FAT] Error: Failed to get buffer for LBA %u (FAT sector %u).\n", target_lba, i);
              errors_encountered++;
@@ -392,12 +451,12 @@
  
          // Release the buffer (decrements ref count)
          buffer_release(cached_buf);
+         if (fs->fat_dirty_sectors) fs->fat_dirty_sectors[i / 8] &= (uint8_t)~(1u << (i % 8));
      }
  
      // Only clear the dirty flag if no errors occurred during the flush attempt
      if (errors_encountered == 0) {
          fs->fat_dirty = false;
-         terminal_printf("[FAT Flush FAT] Flush complete. %d sectors written.\n", sectors_written);
          return FS_SUCCESS;
      } else {
          terminal_printf("[FAT Flush FAT] Flush completed with %d errors. %d sectors written. FAT remains marked dirty.\n",
@@ -24,7 +24,7 @@
 #include "fat_alloc.h"      // fat_get_next_cluster, fat_allocate_cluster
 #include "fat_dir.h"        // update_directory_entry (needed for close/flush), read_directory_sector (used in close)
 #include "buffer_cache.h"   // buffer_get, buffer_release, buffer_mark_dirty
-#include "spinlock.h"       // spinlock_t, spinlock_acquire_irqsave, spinlock_release_irqrestore
+#include "mutex.h"          // fs->lock
 #include "serial.h"         // serial_write, serial_print_hex
 #include "sys_file.h"       // O_* flags, SEEK_* defines
 #include "kmalloc.h"        // Kernel memory allocation (kfree - needed by helpers)
@@ -37,12 +37,18 @@
 #include <libc/stdarg.h>    // varargs for printf (though not used in macros now)
 #include "time.h"           // kernel_get_time(), kernel_time_t (placeholder)
 #include "terminal.h"       // terminal_printf FOR FORMATTED LOGGING
+#include "fat_fs.h"         // fat_sync_internal (fsync)
+#include "pagecache.h"      // pagecache_invalidate_range
 
 /* --- Helper Macros --- */
 #ifndef MIN
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+/* --- Read-Ahead Tuning --- */
+#define FAT_RA_MIN_WINDOW   (8 * 1024)    // Window when a file starts being read sequentially
+#define FAT_RA_MAX_WINDOW   (128 * 1024)  // Largest window (one full-size disk request)
+
 /* --- Cluster I/O Helpers --- */
 
 /**
@@ -91,7 +97,7 @@ int read_cluster_cached(fat_fs_t *fs, uint32_t cluster, uint32_t offset_in_locat
         uint32_t current_lba = start_lba + sec_idx;
         // serial_write("[FAT_IO] Reading LBA: 0x"); serial_print_hex(current_lba); serial_write("\n");
 
-        buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, current_lba);
+        buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, current_lba);
         if (!b) {
             terminal_printf("[FAT_IO_ERR] read_cluster_cached: Buffer get failed for LBA 0x%lx\n", (unsigned long)current_lba);
             return FS_ERR_IO;
@@ -143,7 +149,7 @@ int write_cluster_cached(fat_fs_t *fs, uint32_t cluster, uint32_t offset_in_clus
         uint32_t current_lba = cluster_lba + sec_idx;
         // serial_write("[FAT_IO] Writing LBA: 0x"); serial_print_hex(current_lba); serial_write("\n");
 
-        buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, current_lba);
+        buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, current_lba);
         if (!b) {
             terminal_printf("[FAT_IO_ERR] write_cluster_cached: Buffer get failed for LBA 0x%lx\n", (unsigned long)current_lba);
             result = FS_ERR_IO; goto write_cluster_cleanup;
@@ -172,6 +178,99 @@ write_cluster_cleanup:
 }
 
 
+/* --- Read-Ahead --- */
+
+/**
+ * @brief Pulls the sectors holding file bytes [start, end) into the buffer
+ * cache. `cluster` is the file's cluster that begins at byte `cluster_pos`
+ * (at or before `start`). Runs of physically contiguous clusters in the
+ * chain are read with one request each.
+ */
+static void fat_prefetch_range(fat_fs_t *fs, fat_file_context_t *fctx, uint32_t cluster,
+                               uint32_t cluster_pos, uint32_t start, uint32_t end)
+{
+    uint32_t cluster_size = fs->cluster_size_bytes;
+    uint32_t sector_size = fs->bytes_per_sector;
+
+    while (cluster >= 2 && cluster < fs->eoc_marker && cluster_pos < end) {
+        // Extend the run while the next cluster follows on disk
+        uint32_t run_first = cluster;
+        uint32_t run_pos = cluster_pos;
+        uint32_t next_cluster = 0;
+        for (;;) {
+            cluster_pos += cluster_size;
+            if (cluster_pos >= end) break;
+
+            mutex_lock(&fs->lock);
+            int result = fat_extent_lookup(fs, fctx, cluster_pos / cluster_size, &next_cluster, NULL);
+            mutex_unlock(&fs->lock);
+            if (result == FS_ERR_EOF) { next_cluster = fs->eoc_marker; break; }
+            if (result != FS_SUCCESS) return;
+            if (next_cluster != cluster + 1) break;
+            cluster = next_cluster;
+        }
+
+        uint32_t from = (start > run_pos) ? start : run_pos;
+        uint32_t to = MIN(end, cluster_pos);
+        if (from < to) {
+            uint32_t first_sector = (from - run_pos) / sector_size;
+            uint32_t last_sector = (to - 1 - run_pos) / sector_size;
+            uint32_t lba = fat_cluster_to_lba(fs, run_first);
+            if (lba == 0) return;
+            if (buffer_prefetch(fs->disk_ptr->cache_dev_id, lba + first_sector,
+                                last_sector - first_sector + 1) < 0) {
+                return; // Read-ahead is a hint; the demand read reports errors
+            }
+        }
+        cluster = next_cluster;
+    }
+}
+
+/**
+ * @brief Read-ahead for a read of file bytes [start, end).
+ *
+ * A read that starts where the previous one ended is sequential: the window
+ * doubles (up to FAT_RA_MAX_WINDOW) and, once the reader has used half of
+ * the data already read ahead, the next window beyond `end` is fetched along
+ * with whatever part of the read itself is missing. Any other read halves the
+ * window, turning read-ahead off below FAT_RA_MIN_WINDOW; the clusters of the
+ * read itself are still fetched in as few requests as possible.
+ */
+static void fat_readahead(fat_fs_t *fs, fat_file_context_t *fctx, uint32_t cluster, uint32_t cluster_pos,
+                          uint32_t start, uint32_t end, uint32_t file_size)
+{
+    uint32_t from = start;
+    uint32_t to = end;
+
+    mutex_lock(&fs->lock);
+    if (start == fctx->ra_next_offset) {
+        fctx->ra_window = fctx->ra_window ? MIN(fctx->ra_window * 2, FAT_RA_MAX_WINDOW) : FAT_RA_MIN_WINDOW;
+    } else {
+        fctx->ra_window /= 2;
+        if (fctx->ra_window < FAT_RA_MIN_WINDOW) fctx->ra_window = 0;
+        fctx->ra_end_offset = 0;
+    }
+    fctx->ra_next_offset = end;
+
+    if (fctx->ra_window) {
+        uint32_t ra_end = fctx->ra_end_offset;
+        if (ra_end < end || ra_end - end < fctx->ra_window / 2) {
+            uint64_t target = (uint64_t)end + fctx->ra_window;
+            to = (target < file_size) ? (uint32_t)target : file_size;
+            if (ra_end > from) from = ra_end;
+            fctx->ra_end_offset = to;
+        } else {
+            to = from; // Still well ahead of the reader
+        }
+    }
+    mutex_unlock(&fs->lock);
+
+    if (from < to) {
+        fat_prefetch_range(fs, fctx, cluster, cluster_pos, from, to);
+    }
+}
+
+
 /* --- VFS Operation Implementations --- */
 
 /**
@@ -194,15 +293,14 @@ int fat_read_internal(file_t *file, void *buf, size_t len)
         return FS_ERR_IS_A_DIRECTORY;
     }
 
-    uintptr_t irq_flags;
     int result = FS_SUCCESS;
     size_t total_bytes_read = 0;
 
-    irq_flags = spinlock_acquire_irqsave(&fs->lock);
+    mutex_lock(&fs->lock);
     off_t current_offset = file->offset;
     uint32_t file_size = fctx->file_size;
     uint32_t first_cluster = fctx->first_cluster;
-    spinlock_release_irqrestore(&fs->lock, irq_flags);
+    mutex_unlock(&fs->lock);
 
     // terminal_printf("[FAT_IO] fat_read: Offset=0x%llx, ReqLen=0x%zx, FileSize=0x%lx, FirstClu=0x%lx\n", (unsigned long long)current_offset, len, (unsigned long)file_size, (unsigned long)first_cluster);
 
@@ -235,25 +333,27 @@ int fat_read_internal(file_t *file, void *buf, size_t len)
     uint32_t cluster_index_to_seek = (uint32_t)(current_offset / cluster_size);
     uint32_t offset_in_first_read_cluster = (uint32_t)(current_offset % cluster_size);
 
-    // Traverse cluster chain to the starting cluster for the read
-    for (uint32_t i = 0; i < cluster_index_to_seek; i++) {
-        uint32_t next_cluster;
-        irq_flags = spinlock_acquire_irqsave(&fs->lock);
-        result = fat_get_next_cluster(fs, current_cluster_num, &next_cluster);
-        spinlock_release_irqrestore(&fs->lock, irq_flags);
+    // Find the starting cluster for the read through the extent map
+    mutex_lock(&fs->lock);
+    result = fat_extent_lookup(fs, fctx, cluster_index_to_seek, &current_cluster_num, NULL);
+    mutex_unlock(&fs->lock);
 
-        if (result != FS_SUCCESS) {
-            terminal_printf("[FAT_IO_ERR] fat_read: Seek failed getting next cluster from 0x%lx\n", (unsigned long)current_cluster_num);
-            return FS_ERR_IO;
-        }
-        if (next_cluster >= fs->eoc_marker) {
-            serial_write("[FAT_IO_ERR] fat_read: Seek failed - EOC found prematurely\n");
-            return FS_ERR_CORRUPT;
-        }
-        current_cluster_num = next_cluster;
+    if (result == FS_ERR_EOF) {
+        serial_write("[FAT_IO_ERR] fat_read: Seek failed - EOC found prematurely\n");
+        return FS_ERR_CORRUPT;
+    }
+    if (result != FS_SUCCESS) {
+        terminal_printf("[FAT_IO_ERR] fat_read: Seek to file cluster %lu failed (err %d)\n", (unsigned long)cluster_index_to_seek, result);
+        return (result == FS_ERR_CORRUPT) ? result : FS_ERR_IO;
     }
+    uint32_t current_cluster_index = cluster_index_to_seek;
     // serial_write("[FAT_IO] fat_read: Seeked to StartClu=0x"); serial_print_hex(current_cluster_num); serial_write(", OffsetInClu=0x"); serial_print_hex(offset_in_first_read_cluster); serial_write("\n");
 
+    // Batch the clusters this read needs (plus the read-ahead window) into
+    // multi-sector requests; the loop below then copies from the cache
+    fat_readahead(fs, fctx, current_cluster_num, cluster_index_to_seek * (uint32_t)cluster_size,
+                  (uint32_t)current_offset, (uint32_t)(current_offset + len), file_size);
+
     // Read data cluster by cluster
     uint32_t current_offset_in_cluster = offset_in_first_read_cluster;
     while (total_bytes_read < len) {
@@ -281,15 +381,18 @@ int fat_read_internal(file_t *file, void *buf, size_t len)
 
         if (total_bytes_read < len) { // Need to move to the next cluster
             uint32_t next_cluster;
-            irq_flags = spinlock_acquire_irqsave(&fs->lock);
-            result = fat_get_next_cluster(fs, current_cluster_num, &next_cluster);
-            spinlock_release_irqrestore(&fs->lock, irq_flags);
+            mutex_lock(&fs->lock);
+            result = fat_extent_lookup(fs, fctx, current_cluster_index + 1, &next_cluster, NULL);
+            mutex_unlock(&fs->lock);
 
-            if (result != FS_SUCCESS) {
+            if (result == FS_ERR_EOF) {
+                next_cluster = fs->eoc_marker;
+            } else if (result != FS_SUCCESS) {
                 terminal_printf("[FAT_IO_ERR] fat_read: Failed to get next cluster after 0x%lx\n", (unsigned long)current_cluster_num);
                 result = FS_ERR_IO; goto cleanup_read;
             }
             current_cluster_num = next_cluster;
+            current_cluster_index++;
             if (current_cluster_num >= fs->eoc_marker) { // Reached EOC marker
                 // This means we've read all allocated clusters, but `len` (derived from file_size) might have expected more.
                 // This implies a mismatch between file_size and actual chain length.
@@ -309,6 +412,53 @@ cleanup_read:
 }
 
 
+/**
+ * @brief Writes a dirty context's size and first cluster back to its
+ * directory entry (in the buffer cache). Caller holds fs->lock.
+ */
+static int fat_flush_dir_entry_locked(fat_fs_t *fs, fat_file_context_t *fctx)
+{
+    // terminal_printf("[FAT_IO] fat_flush_dir_entry: Updating dir entry (DirClu=0x%lx, DirOff=0x%lx)\n", (unsigned long)fctx->dir_entry_cluster, (unsigned long)fctx->dir_entry_offset);
+
+    // This part updates the directory entry on disk with new size, first cluster, and timestamps.
+    // It's crucial for data integrity.
+    int update_result = FS_SUCCESS;
+    fat_dir_entry_t existing_entry; // Temporary stack storage
+    uint8_t *sector_buf = kmalloc(fs->bytes_per_sector); // Buffer for sector read/write
+    if (!sector_buf) {
+        serial_write("[FAT_IO_ERR] fat_flush_dir_entry: Failed to alloc sector_buf for dir update\n");
+        return FS_ERR_OUT_OF_MEMORY;
+    }
+
+    // Read the sector containing the directory entry
+    int read_sec_res = read_directory_sector(fs, fctx->dir_entry_cluster, fctx->dir_entry_offset / fs->bytes_per_sector, sector_buf);
+    if (read_sec_res == FS_SUCCESS) {
+        memcpy(&existing_entry, sector_buf + (fctx->dir_entry_offset % fs->bytes_per_sector), sizeof(fat_dir_entry_t));
+
+        // Update fields from context
+        existing_entry.file_size = fctx->file_size;
+        existing_entry.first_cluster_low = (uint16_t)(fctx->first_cluster & 0xFFFF);
+        existing_entry.first_cluster_high = (uint16_t)((fctx->first_cluster >> 16) & 0xFFFF);
+
+        // TODO: Update timestamps (write_time, write_date, last_access_date)
+        // fat_get_current_timestamp(&existing_entry.write_time, &existing_entry.write_date);
+        // existing_entry.last_access_date = existing_entry.write_date; // Or specific access date logic
+
+        // Write the modified entry back
+        update_result = update_directory_entry(fs, fctx->dir_entry_cluster, fctx->dir_entry_offset, &existing_entry);
+        if (update_result == FS_SUCCESS) {
+            fctx->dirty = false; // Clear dirty flag ONLY on successful write-back
+        } else {
+            terminal_printf("[FAT_IO_ERR] fat_flush_dir_entry: Failed to update directory entry (err %d)\n", update_result);
+        }
+    } else {
+        terminal_printf("[FAT_IO_ERR] fat_flush_dir_entry: Failed to read dir sector for update (err %d)\n", read_sec_res);
+        update_result = read_sec_res;
+    }
+    kfree(sector_buf);
+    return update_result;
+}
+
 /**
  * @brief Closes an opened file. Updates directory entry if modified.
  */
@@ -322,49 +472,12 @@ int fat_close_internal(file_t *file)
     // terminal_printf("[FAT_IO] fat_close: Closing fctx=0x%p, dirty=0x%x\n", fctx, (unsigned int)fctx->dirty);
 
     int update_result = FS_SUCCESS;
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&fs->lock);
-
+    mutex_lock(&fs->lock);
     if (fctx->dirty) {
-        // terminal_printf("[FAT_IO] fat_close: Context dirty. Updating dir entry (DirClu=0x%lx, DirOff=0x%lx)\n", (unsigned long)fctx->dir_entry_cluster, (unsigned long)fctx->dir_entry_offset);
-        
-        // This part updates the directory entry on disk with new size, first cluster, and timestamps.
-        // It's crucial for data integrity.
-        fat_dir_entry_t existing_entry; // Temporary stack storage
-        uint8_t *sector_buf = kmalloc(fs->bytes_per_sector); // Buffer for sector read/write
-        if (!sector_buf) {
-            serial_write("[FAT_IO_ERR] fat_close: Failed to alloc sector_buf for dir update\n");
-            update_result = FS_ERR_OUT_OF_MEMORY;
-        } else {
-            // Read the sector containing the directory entry
-            int read_sec_res = read_directory_sector(fs, fctx->dir_entry_cluster, fctx->dir_entry_offset / fs->bytes_per_sector, sector_buf);
-            if (read_sec_res == FS_SUCCESS) {
-                memcpy(&existing_entry, sector_buf + (fctx->dir_entry_offset % fs->bytes_per_sector), sizeof(fat_dir_entry_t));
-
-                // Update fields from context
-                existing_entry.file_size = fctx->file_size;
-                existing_entry.first_cluster_low = (uint16_t)(fctx->first_cluster & 0xFFFF);
-                existing_entry.first_cluster_high = (uint16_t)((fctx->first_cluster >> 16) & 0xFFFF);
-                
-                // TODO: Update timestamps (write_time, write_date, last_access_date)
-                // fat_get_current_timestamp(&existing_entry.write_time, &existing_entry.write_date);
-                // existing_entry.last_access_date = existing_entry.write_date; // Or specific access date logic
-
-                // Write the modified entry back
-                update_result = update_directory_entry(fs, fctx->dir_entry_cluster, fctx->dir_entry_offset, &existing_entry);
-                if (update_result == FS_SUCCESS) {
-                    fctx->dirty = false; // Clear dirty flag ONLY on successful write-back
-                    // serial_write("[FAT_IO] fat_close: Directory entry update successful.\n");
-                } else {
-                    terminal_printf("[FAT_IO_ERR] fat_close: Failed to update directory entry (err %d)\n", update_result);
-                }
-            } else {
-                terminal_printf("[FAT_IO_ERR] fat_close: Failed to read dir sector for update (err %d)\n", read_sec_res);
-                update_result = read_sec_res;
-            }
-            kfree(sector_buf);
-        }
+        update_result = fat_flush_dir_entry_locked(fs, fctx);
     }
-    spinlock_release_irqrestore(&fs->lock, irq_flags);
+    fat_extent_truncate(fctx, 0);
+    mutex_unlock(&fs->lock);
 
     kfree(fctx);
     file->vnode->data = NULL;
@@ -373,6 +486,45 @@ int fat_close_internal(file_t *file)
     return update_result;
 }
 
+/**
+ * @brief Makes an open file durable. Implements VFS fsync.
+ */
+int fat_fsync_internal(file_t *file)
+{
+    if (!file || !file->vnode || !file->vnode->data) { return FS_ERR_BAD_F; }
+    fat_file_context_t *fctx = (fat_file_context_t*)file->vnode->data;
+    KERNEL_ASSERT(fctx->fs != NULL, "FAT context missing FS pointer");
+    fat_fs_t *fs = fctx->fs;
+
+    int result = FS_SUCCESS;
+    mutex_lock(&fs->lock);
+    if (fctx->dirty) {
+        result = fat_flush_dir_entry_locked(fs, fctx);
+    }
+    mutex_unlock(&fs->lock);
+    if (result != FS_SUCCESS) return result;
+
+    // The file's clusters may sit anywhere on the disk, so sync the whole
+    // filesystem: FAT, directory entry and data go out in one sorted batch
+    return fat_sync_internal(fs);
+}
+
+
+/**
+ * @brief Reports the file's page cache identity. Implements VFS identify.
+ */
+int fat_identify_internal(file_t *file, vfs_file_id_t *id_out)
+{
+    if (!file || !file->vnode || !file->vnode->data || !id_out) { return FS_ERR_BAD_F; }
+    fat_file_context_t *fctx = (fat_file_context_t*)file->vnode->data;
+    KERNEL_ASSERT(fctx->fs != NULL, "FAT context missing FS pointer");
+    if (fctx->is_directory) { return FS_ERR_IS_A_DIRECTORY; }
+
+    id_out->sb = fctx->fs;
+    id_out->ino = FAT_FILE_INO(fctx->dir_entry_cluster, fctx->dir_entry_offset);
+    return FS_SUCCESS;
+}
+
 
 /**
  * @brief Writes data to an opened file. Implements VFS write.
@@ -399,13 +551,12 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
         return FS_ERR_PERMISSION_DENIED;
     }
 
-    uintptr_t irq_flags;
     int result = FS_SUCCESS;
     size_t total_bytes_written = 0;
     bool file_metadata_changed = false; // Tracks if first_cluster or file_size changes
 
     // Determine write position
-    irq_flags = spinlock_acquire_irqsave(&fs->lock);
+    mutex_lock(&fs->lock);
     off_t current_offset = file->offset;
     uint32_t file_size_before_write = fctx->file_size;
     uint32_t first_cluster_before_write = fctx->first_cluster; // For checking if it's newly allocated
@@ -413,12 +564,12 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
     if (file->flags & O_APPEND) { current_offset = (off_t)file_size_before_write; }
     
     if (current_offset < 0) {
-        spinlock_release_irqrestore(&fs->lock, irq_flags);
+        mutex_unlock(&fs->lock);
         serial_write("[FAT_IO_ERR] fat_write: Negative file offset\n");
         return FS_ERR_INVALID_PARAM;
     }
     uint32_t current_first_cluster = fctx->first_cluster; // Use this for the rest of the write logic
-    spinlock_release_irqrestore(&fs->lock, irq_flags);
+    mutex_unlock(&fs->lock);
 
     // terminal_printf("[FAT_IO] fat_write: Offset=0x%llx, ReqLen=0x%zx, FileSize=0x%lx, FirstClu=0x%lx\n", (unsigned long long)current_offset, len, (unsigned long)file_size_before_write, (unsigned long)current_first_cluster);
 
@@ -435,10 +586,10 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
             return FS_ERR_INVALID_PARAM;
         }
         // terminal_printf("[FAT_IO] fat_write: Allocating initial cluster for empty file (Offset: %lld).\n", (long long)current_offset);
-        irq_flags = spinlock_acquire_irqsave(&fs->lock);
+        mutex_lock(&fs->lock);
         uint32_t new_cluster = fat_allocate_cluster(fs, 0); // Allocate and mark as EOC
         if (new_cluster < 2) {
-            spinlock_release_irqrestore(&fs->lock, irq_flags);
+            mutex_unlock(&fs->lock);
             serial_write("[FAT_IO_ERR] fat_write: Failed to allocate initial cluster (no space?)\n");
             return FS_ERR_NO_SPACE;
         }
@@ -455,11 +606,13 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
             fat_free_cluster_chain(fs, new_cluster); // Free the just-allocated cluster
             fctx->first_cluster = 0;                 // Revert context
             current_first_cluster = 0;
-            spinlock_release_irqrestore(&fs->lock, irq_flags);
+            fat_extent_truncate(fctx, 0);
+            mutex_unlock(&fs->lock);
             return rc_update_clu;
         }
+        fat_extent_append(fctx, 0, new_cluster);
         // terminal_printf("[FAT_IO] fat_write: Allocated initial cluster 0x%lx and updated dir entry.\n", (unsigned long)new_cluster);
-        spinlock_release_irqrestore(&fs->lock, irq_flags);
+        mutex_unlock(&fs->lock);
     }
     KERNEL_ASSERT(current_first_cluster >= 2 || len == 0, "First cluster invalid after initial check/alloc for non-zero write");
 
@@ -469,34 +622,37 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
     uint32_t cluster_index_to_seek = (uint32_t)(current_offset / cluster_size);
     uint32_t offset_in_first_write_cluster = (uint32_t)(current_offset % cluster_size);
 
-    for (uint32_t i = 0; i < cluster_index_to_seek; i++) {
-        uint32_t next_cluster;
-        bool allocated_new_in_seek = false;
-        
-        irq_flags = spinlock_acquire_irqsave(&fs->lock);
-        int find_result = fat_get_next_cluster(fs, current_cluster_num, &next_cluster);
+    if (cluster_index_to_seek > 0) {
+        uint32_t chain_len = 0;
+        mutex_lock(&fs->lock);
+        int find_result = fat_extent_lookup(fs, fctx, cluster_index_to_seek, &current_cluster_num, &chain_len);
+        if (find_result == FS_ERR_EOF) {
+            // Chain ends before the write offset: extend it up to there
+            uint32_t i = chain_len;
+            while (i <= cluster_index_to_seek) {
+                // terminal_printf("[FAT_IO] fat_write: Seek/Extend: Allocating new cluster after 0x%lx\n", (unsigned long)current_cluster_num);
+                uint32_t run_len = 0;
+                uint32_t run_first = fat_allocate_run(fs, current_cluster_num, cluster_index_to_seek - i + 1, &run_len); // Allocates AND links
+                if (run_first < 2) {
+                    mutex_unlock(&fs->lock);
+                    serial_write("[FAT_IO_ERR] fat_write: Seek/Extend: Failed to allocate cluster (no space?)\n");
+                    result = FS_ERR_NO_SPACE; goto cleanup_write;
+                }
+                for (uint32_t j = 0; j < run_len; j++) fat_extent_append(fctx, i + j, run_first + j);
+                fctx->dirty = true; // FAT chain changed
+                file_metadata_changed = true; // File structure changed
+                current_cluster_num = run_first + run_len - 1;
+                i += run_len;
+            }
+            find_result = FS_SUCCESS;
+        }
+        mutex_unlock(&fs->lock);
         if (find_result != FS_SUCCESS) {
-            spinlock_release_irqrestore(&fs->lock, irq_flags);
-            terminal_printf("[FAT_IO_ERR] fat_write: Seek/Extend: Error getting next cluster from 0x%lx\n", (unsigned long)current_cluster_num);
+            terminal_printf("[FAT_IO_ERR] fat_write: Seek/Extend: Error finding file cluster %lu (err %d)\n", (unsigned long)cluster_index_to_seek, find_result);
             result = FS_ERR_IO; goto cleanup_write;
         }
-
-        if (next_cluster >= fs->eoc_marker) { // Need to allocate a new cluster
-            // terminal_printf("[FAT_IO] fat_write: Seek/Extend: Allocating new cluster after 0x%lx\n", (unsigned long)current_cluster_num);
-            next_cluster = fat_allocate_cluster(fs, current_cluster_num); // Allocates AND links
-            if (next_cluster < 2) {
-                spinlock_release_irqrestore(&fs->lock, irq_flags);
-                serial_write("[FAT_IO_ERR] fat_write: Seek/Extend: Failed to allocate cluster (no space?)\n");
-                result = FS_ERR_NO_SPACE; goto cleanup_write;
-            }
-            fctx->dirty = true; // FAT chain changed
-            file_metadata_changed = true; // File structure changed
-            allocated_new_in_seek = true;
-        }
-        spinlock_release_irqrestore(&fs->lock, irq_flags);
-        current_cluster_num = next_cluster;
-        // if (allocated_new_in_seek) terminal_printf("[FAT_IO] fat_write: Seek/Extend: Allocated new cluster 0x%lx\n", (unsigned long)current_cluster_num);
     }
+    uint32_t current_cluster_index = cluster_index_to_seek;
     // serial_write("[FAT_IO] fat_write: Seek/Extend successful. StartClu=0x"); serial_print_hex(current_cluster_num); serial_write(", OffsetInClu=0x"); serial_print_hex(offset_in_first_write_cluster); serial_write("\n");
 
     // Write data cluster by cluster, allocating as needed
@@ -529,15 +685,22 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
             bool allocated_new_in_loop = false;
             int alloc_res = FS_SUCCESS;
             
-            irq_flags = spinlock_acquire_irqsave(&fs->lock);
-            int find_res = fat_get_next_cluster(fs, current_cluster_num, &next_cluster);
-            if (find_res == FS_SUCCESS && next_cluster >= fs->eoc_marker) { // End of chain, need to allocate
+            mutex_lock(&fs->lock);
+            int find_res = fat_extent_lookup(fs, fctx, current_cluster_index + 1, &next_cluster, NULL);
+            if (find_res == FS_ERR_EOF) { // End of chain, need to allocate
                 // terminal_printf("[FAT_IO] fat_write: Allocating next cluster after 0x%lx (EOC found)\n", (unsigned long)current_cluster_num);
-                next_cluster = fat_allocate_cluster(fs, current_cluster_num);
+                // Allocate what the rest of this write needs as one run if possible
+                size_t remaining = len - total_bytes_written;
+                uint32_t want = (uint32_t)((remaining + cluster_size - 1) / cluster_size);
+                uint32_t run_len = 0;
+                next_cluster = fat_allocate_run(fs, current_cluster_num, want, &run_len);
                 if (next_cluster < 2) {
                     alloc_res = FS_ERR_NO_SPACE;
                     serial_write("[FAT_IO_ERR] fat_write: Failed to allocate next cluster (no space?)\n");
                 } else {
+                    for (uint32_t j = 0; j < run_len; j++) {
+                        fat_extent_append(fctx, current_cluster_index + 1 + j, next_cluster + j);
+                    }
                     fctx->dirty = true;
                     file_metadata_changed = true;
                     allocated_new_in_loop = true;
@@ -547,13 +710,14 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
                 terminal_printf("[FAT_IO_ERR] fat_write: Failed to get next cluster after 0x%lx during write loop\n", (unsigned long)current_cluster_num);
             }
             // If find_res == FS_SUCCESS and next_cluster is valid data cluster, we just use it.
-            spinlock_release_irqrestore(&fs->lock, irq_flags);
+            mutex_unlock(&fs->lock);
 
             if (alloc_res != FS_SUCCESS) {
                 result = alloc_res;
                 goto cleanup_write;
             }
             current_cluster_num = next_cluster;
+            current_cluster_index++;
             // if (allocated_new_in_loop) terminal_printf("[FAT_IO] fat_write: Allocated next cluster 0x%lx in loop\n", (unsigned long)current_cluster_num);
         }
     }
@@ -562,7 +726,7 @@ int fat_write_internal(file_t *file, const void *buf, size_t len)
 
 cleanup_write:
     // Update file offset and size in context
-    irq_flags = spinlock_acquire_irqsave(&fs->lock);
+    mutex_lock(&fs->lock);
     off_t final_offset = current_offset + total_bytes_written;
     file->offset = final_offset; // Update VFS file handle offset
 
@@ -586,7 +750,12 @@ cleanup_write:
         // serial_write("[FAT_IO] fat_write: Marked context dirty due to metadata change.\n");
     }
     // TODO: Timestamp update logic would go here and set fctx->dirty = true;
-    spinlock_release_irqrestore(&fs->lock, irq_flags);
+    mutex_unlock(&fs->lock);
+
+    if (total_bytes_written > 0) {
+        pagecache_invalidate_range(fs, FAT_FILE_INO(fctx->dir_entry_cluster, fctx->dir_entry_offset),
+                                   current_offset, total_bytes_written);
+    }
 
     // terminal_printf("[FAT_IO] fat_write: Exit. TotalWritten=0x%zx, Result=%d\n", total_bytes_written, result);
     return (result < 0) ? result : (int)total_bytes_written;
@@ -601,9 +770,9 @@ off_t fat_lseek_internal(file_t *file, off_t offset, int whence) {
     fat_file_context_t *fctx = (fat_file_context_t*)file->vnode->data;
     KERNEL_ASSERT(fctx->fs != NULL, "FAT context missing FS pointer");
 
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&fctx->fs->lock);
+    mutex_lock(&fctx->fs->lock);
     off_t file_size = (off_t)fctx->file_size; // Read under lock
-    spinlock_release_irqrestore(&fctx->fs->lock, irq_flags);
+    mutex_unlock(&fctx->fs->lock);
 
     off_t current_offset = file->offset; // Current offset from file_t, not fctx
     off_t new_offset;
@@ -718,7 +887,7 @@ int update_directory_entry_first_cluster_now(fat_fs_t *fs, fat_file_context_t *f
 
     // Now, get the buffer for the target LBA, modify, mark dirty, and release.
     // terminal_printf("[FAT_IO_Update] Modifying directory sector at LBA %lu\n", (unsigned long)target_lba);
-    buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, target_lba);
+    buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, target_lba);
     if (!b) {
         terminal_printf("[FAT_IO_ERR] DirEntry Update: Failed to get buffer for LBA %lu\n", (unsigned long)target_lba);
         return FS_ERR_IO;
@@ -794,7 +963,7 @@ int update_directory_entry_size_now(fat_fs_t *fs, fat_file_context_t *fctx) {
 
     // Read-Modify-Write the directory sector via buffer cache
     // terminal_printf("[FAT_IO_Update] Modifying directory sector for size at LBA %lu\n", (unsigned long)target_lba);
-    buffer_t* b = buffer_get(fs->disk_ptr->blk_dev.device_name, target_lba);
+    buffer_t* b = buffer_get(fs->disk_ptr->cache_dev_id, target_lba);
     if (!b) {
         terminal_printf("[FAT_IO_ERR] DirEntry Update: Failed to get buffer for LBA %lu (size update)\n", (unsigned long)target_lba);
         return FS_ERR_IO;
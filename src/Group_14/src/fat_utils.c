@@ -178,7 +178,24 @@ int fat_set_cluster_entry(fat_fs_t *fs, uint32_t cluster, uint32_t value) {
         FAT16[cluster] = (uint16_t)value;
     }
 
+    // Keep the free-space map in step with the table
+    if (fs->free_map && cluster <= fs->total_data_clusters + 1) {
+        uint32_t bit = 1u << (cluster % 32);
+        bool was_used = (fs->free_map[cluster / 32] & bit) != 0;
+        if (value == 0 && was_used) {
+            fs->free_map[cluster / 32] &= ~bit;
+            fs->free_clusters++;
+        } else if (value != 0 && !was_used) {
+            fs->free_map[cluster / 32] |= bit;
+            fs->free_clusters--;
+        }
+    }
+
     fs->fat_dirty = true; // Mark FAT as modified, needs flushing later
+    if (fs->fat_dirty_sectors) {
+        uint32_t sector = (cluster * (fs->type == FAT_TYPE_FAT32 ? 4u : 2u)) / fs->bytes_per_sector;
+        fs->fat_dirty_sectors[sector / 8] |= (uint8_t)(1u << (sector % 8));
+    }
     return FS_SUCCESS;
 }
 
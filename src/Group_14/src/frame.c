@@ -19,6 +19,8 @@
 #include "types.h"            // For uintptr_t, size_t, bool
 #include "multiboot2.h"       // For parsing the memory map provided by the bootloader
 #include "assert.h"           // For KERNEL_ASSERT and KERNEL_PANIC_HALT
+#include "get_cpu_id.h"       // For per-CPU frame cache selection, MAX_CPUS
+#include "cpuid.h"            // For SSE2 detection (non-temporal page clears)
 
 // --- Compile-time Sanity Checks ---
 #ifndef PAGE_SIZE
@@ -81,6 +83,50 @@ static uintptr_t g_highest_address_aligned = 0;
 static spinlock_t g_frame_lock;
 // Actual size allocated by the buddy allocator for the refcount array.
 static size_t g_refcount_array_alloc_size = 0;
+// Page-run descriptors: run length in pages for each run head, indexed by
+// (PFN - g_run_first_pfn). Only buddy heap frames can head a run.
+static uint16_t *g_frame_run_pages = NULL;
+static size_t g_run_first_pfn = 0;
+static size_t g_run_pfn_count = 0;
+#define FRAME_RUN_MAX_PAGES 0xFFFFu // Run length must fit a uint16_t descriptor
+
+// --- Per-CPU Frame Cache ---
+// Each CPU keeps a small ring of free frames (refcount 0) so that frame_alloc /
+// put_frame avoid the global buddy lock. The ring has a hot end (recently freed,
+// likely still in cache; allocations come from here) and a cold end (fresh from
+// the buddy; drains go from here). Refills and drains move FRAME_PCP batches.
+#define FRAME_PCP_CAPACITY      128 // Ring size, power of two
+#define FRAME_PCP_DEFAULT_BATCH 32
+#define FRAME_PCP_DEFAULT_LOW   0   // Refill when count drops to this
+#define FRAME_PCP_DEFAULT_HIGH  96  // Drain when count exceeds this
+
+typedef struct frame_pcp {
+    spinlock_t lock;                        // Uncontended except for remote drains
+    uintptr_t frames[FRAME_PCP_CAPACITY];   // Physical addresses
+    uint32_t head;                          // Next slot at the hot end
+    uint32_t count;
+    frame_pcp_stats_t stats;
+} frame_pcp_t;
+
+static frame_pcp_t g_frame_pcp[MAX_CPUS];
+static volatile bool g_frame_pcp_enabled = false; // Set once frame_init completes
+static uint32_t g_frame_pcp_batch = FRAME_PCP_DEFAULT_BATCH;
+static uint32_t g_frame_pcp_low = FRAME_PCP_DEFAULT_LOW;
+static uint32_t g_frame_pcp_high = FRAME_PCP_DEFAULT_HIGH;
+
+// --- Pre-zeroed Frame Pool ---
+// Free frames (refcount 0) that the idle task has already cleared, so fault
+// handlers can map them without zeroing on the faulting path.
+#define FRAME_ZERO_POOL_CAPACITY 256 // 1 MiB of pre-zeroed frames
+
+static uintptr_t g_zero_pool[FRAME_ZERO_POOL_CAPACITY]; // Physical addresses
+static uint32_t g_zero_pool_count = 0;
+static spinlock_t g_zero_pool_lock;
+static uint32_t g_zero_pool_hits = 0;        // frame_alloc_zeroed served from the pool
+static uint32_t g_zero_pool_misses = 0;      // frame_alloc_zeroed had to clear synchronously
+static uint32_t g_zero_pool_idle_zeroed = 0; // Frames cleared by frame_zero_pool_refill
+static uint32_t g_zero_pool_reclaimed = 0;   // Pool frames handed to frame_alloc on OOM
+static bool g_have_movnti = false;           // SSE2 present: clear with non-temporal stores
 
 // External dependency (provided by paging subsystem)
 extern uint32_t g_kernel_page_directory_phys; // Physical address of initial PD
@@ -145,6 +191,34 @@ static size_t get_required_buddy_allocation_size(size_t total_size) {
     return power_of_2;
 }
 
+/**
+ * @brief Returns the smallest buddy order whose block holds a given size.
+ * @param size Size in bytes (at least 1).
+ * @return Order, or -1 if the size exceeds the largest buddy block.
+ */
+static int size_to_buddy_order(size_t size) {
+    size_t block = get_required_buddy_allocation_size(size);
+    if (block == SIZE_MAX || block == 0) return -1;
+    return __builtin_ctz(block);
+}
+
+/**
+ * @brief Returns pages [first, end) of a buddy block to the buddy allocator.
+ * The range is split into the largest pieces that are naturally aligned
+ * relative to the block start, so each piece is a valid buddy block.
+ * @param block_virt Virtual address of the (original) buddy block.
+ * @param first First page index to release.
+ * @param end One past the last page index to release.
+ */
+static void frame_release_pages(uintptr_t block_virt, size_t first, size_t end) {
+    while (first < end) {
+        int k = first ? __builtin_ctz(first) : (MAX_ORDER - FRAME_BUDDY_ORDER);
+        while (first + ((size_t)1 << k) > end) k--;
+        buddy_free_raw((void*)(block_virt + first * PAGE_SIZE), FRAME_BUDDY_ORDER + k);
+        first += (size_t)1 << k;
+    }
+}
+
 /**
  * @brief Marks a physical memory range as reserved in the refcount array.
  * Used during initialization to prevent allocation of critical areas.
@@ -341,6 +415,23 @@ mark_reserved_range(g_frame_refcounts_phys,
                   g_frame_refcounts_phys + g_refcount_array_alloc_size,
                   "Refcount Arr");
 }
+// --- Step 5b: Page-run descriptor array (covers the buddy heap only) ---
+g_run_first_pfn = addr_to_pfn(buddy_heap_phys_start);
+g_run_pfn_count = addr_to_pfn(ALIGN_UP(buddy_heap_phys_end, PAGE_SIZE)) - g_run_first_pfn;
+size_t run_array_bytes = g_run_pfn_count * sizeof(uint16_t);
+int run_array_order = size_to_buddy_order(run_array_bytes);
+if (run_array_order < FRAME_BUDDY_ORDER) run_array_order = FRAME_BUDDY_ORDER;
+void *run_array_virt = buddy_alloc_raw(run_array_order);
+if (!run_array_virt) {
+    // Not fatal: frame_alloc_run() reports failure and kmalloc falls back to buddy
+    terminal_write("   [WARNING] Could not allocate page-run descriptor array; page runs disabled.\n");
+    g_run_pfn_count = 0;
+} else {
+    memset(run_array_virt, 0, run_array_bytes);
+    g_frame_run_pages = (uint16_t*)run_array_virt;
+    uintptr_t run_array_phys = (uintptr_t)run_array_virt - KERNEL_SPACE_VIRT_START;
+    mark_reserved_range(run_array_phys, run_array_phys + ((size_t)1 << run_array_order), "Run Desc Arr");
+}
 // ***** Optional: Mark the gap between kernel end and buddy start if significant *****
 // uintptr_t kernel_or_pd_end = (g_kernel_page_directory_phys > kernel_phys_end) ?
 //                             (g_kernel_page_directory_phys + PAGE_SIZE) : kernel_phys_end;
@@ -397,10 +488,226 @@ if (available_count == 0 && g_total_frames > 256) {
 terminal_write("   [WARNING] Zero available frames detected after initialization!\n");
 }
 
+for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    spinlock_init(&g_frame_pcp[cpu].lock);
+}
+g_frame_pcp_enabled = true;
+
+spinlock_init(&g_zero_pool_lock);
+uint32_t cpuid_eax, cpuid_ebx, cpuid_ecx, cpuid_edx;
+cpuid(1, &cpuid_eax, &cpuid_ebx, &cpuid_ecx, &cpuid_edx);
+g_have_movnti = (cpuid_edx & (1u << 26)) != 0; // SSE2
+terminal_printf("   Pre-zeroed frame pool: capacity %u, clearing with %s\n",
+         (unsigned)FRAME_ZERO_POOL_CAPACITY, g_have_movnti ? "movnti" : "rep stosd");
+terminal_printf("   Per-CPU frame cache: batch=%lu low=%lu high=%lu (capacity %u)\n",
+         (unsigned long)g_frame_pcp_batch, (unsigned long)g_frame_pcp_low,
+         (unsigned long)g_frame_pcp_high, (unsigned)FRAME_PCP_CAPACITY);
+
 terminal_write("[Frame] Frame manager initialization complete.\n");
 return 0; // Success
 }
 
+//----------------------------------------------------------------------------
+// Per-CPU Frame Cache
+//----------------------------------------------------------------------------
+
+#define FRAME_PCP_MASK (FRAME_PCP_CAPACITY - 1)
+
+/** @brief Pushes a frame at the cold end (used by refill). Lock held. */
+static inline void pcp_push_cold(frame_pcp_t *pcp, uintptr_t phys) {
+    pcp->frames[(pcp->head - pcp->count - 1) & FRAME_PCP_MASK] = phys;
+    pcp->count++;
+}
+
+/** @brief Pops a frame from the cold end (used by drain). Lock held, count > 0. */
+static inline uintptr_t pcp_pop_cold(frame_pcp_t *pcp) {
+    uintptr_t phys = pcp->frames[(pcp->head - pcp->count) & FRAME_PCP_MASK];
+    pcp->count--;
+    return phys;
+}
+
+/**
+ * @brief Moves up to one batch of frames from the buddy allocator into the cache.
+ * One buddy lock acquisition for the whole batch. Lock held.
+ */
+static void frame_pcp_refill(frame_pcp_t *pcp) {
+    void *blocks[FRAME_PCP_CAPACITY];
+    uint32_t want = g_frame_pcp_batch;
+    if (want > FRAME_PCP_CAPACITY - pcp->count) want = FRAME_PCP_CAPACITY - pcp->count;
+
+    int got = buddy_alloc_raw_batch(FRAME_BUDDY_ORDER, blocks, (int)want);
+    for (int i = 0; i < got; i++) {
+        pcp_push_cold(pcp, (uintptr_t)blocks[i] - KERNEL_SPACE_VIRT_START);
+    }
+    pcp->stats.refills++;
+}
+
+/** @brief Returns up to 'n' cold frames to the buddy allocator. Lock held. */
+static void frame_pcp_drain(frame_pcp_t *pcp, uint32_t n) {
+    void *blocks[FRAME_PCP_CAPACITY];
+    if (n > pcp->count) n = pcp->count;
+    for (uint32_t i = 0; i < n; i++) {
+        blocks[i] = (void*)(pcp_pop_cold(pcp) + KERNEL_SPACE_VIRT_START);
+    }
+    if (n > 0) {
+        buddy_free_raw_batch(blocks, (int)n, FRAME_BUDDY_ORDER);
+        pcp->stats.drains++;
+    }
+}
+
+/**
+ * @brief Takes a free frame from this CPU's cache, refilling it when it runs low.
+ * @return Physical address (refcount still 0), or 0 if the cache cannot help.
+ */
+static uintptr_t frame_pcp_alloc(void) {
+    if (!g_frame_pcp_enabled) return 0;
+    uintptr_t irq_flags = local_irq_save(); // Pins us to this CPU
+    int cpu = get_cpu_id();
+    if (cpu < 0 || cpu >= MAX_CPUS) {
+        local_irq_restore(irq_flags);
+        return 0;
+    }
+    frame_pcp_t *pcp = &g_frame_pcp[cpu];
+    uintptr_t lock_flags = spinlock_acquire_irqsave(&pcp->lock);
+    if (pcp->count <= g_frame_pcp_low) {
+        frame_pcp_refill(pcp);
+    }
+    uintptr_t phys = 0;
+    if (pcp->count > 0) {
+        pcp->head = (pcp->head - 1) & FRAME_PCP_MASK;
+        pcp->count--;
+        phys = pcp->frames[pcp->head];
+        pcp->stats.alloc_hits++;
+    } else {
+        pcp->stats.alloc_misses++;
+    }
+    spinlock_release_irqrestore(&pcp->lock, lock_flags);
+    local_irq_restore(irq_flags);
+    return phys;
+}
+
+/**
+ * @brief Puts a frame whose refcount just reached 0 at the hot end of this CPU's cache.
+ * @return true if cached, false if the caller must free it to the buddy itself.
+ */
+static bool frame_pcp_free(uintptr_t phys) {
+    if (!g_frame_pcp_enabled) return false;
+    uintptr_t irq_flags = local_irq_save();
+    int cpu = get_cpu_id();
+    if (cpu < 0 || cpu >= MAX_CPUS) {
+        local_irq_restore(irq_flags);
+        return false;
+    }
+    frame_pcp_t *pcp = &g_frame_pcp[cpu];
+    uintptr_t lock_flags = spinlock_acquire_irqsave(&pcp->lock);
+    if (pcp->count == FRAME_PCP_CAPACITY) {
+        frame_pcp_drain(pcp, g_frame_pcp_batch); // Only reachable while watermarks change
+    }
+    pcp->frames[pcp->head] = phys;
+    pcp->head = (pcp->head + 1) & FRAME_PCP_MASK;
+    pcp->count++;
+    pcp->stats.frees++;
+    if (pcp->count > g_frame_pcp_high) {
+        frame_pcp_drain(pcp, g_frame_pcp_batch);
+    }
+    spinlock_release_irqrestore(&pcp->lock, lock_flags);
+    local_irq_restore(irq_flags);
+    return true;
+}
+
+void frame_pcp_drain_all(void) {
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        frame_pcp_t *pcp = &g_frame_pcp[cpu];
+        uintptr_t lock_flags = spinlock_acquire_irqsave(&pcp->lock);
+        while (pcp->count > 0) {
+            frame_pcp_drain(pcp, g_frame_pcp_batch);
+        }
+        spinlock_release_irqrestore(&pcp->lock, lock_flags);
+    }
+}
+
+bool frame_pcp_set_enabled(bool enabled) {
+    bool was_enabled = g_frame_pcp_enabled;
+    g_frame_pcp_enabled = enabled;
+    if (!enabled) {
+        frame_pcp_drain_all();
+    }
+    return was_enabled;
+}
+
+int frame_pcp_set_watermarks(uint32_t low, uint32_t high, uint32_t batch) {
+    // A refill at 'low' must fit, and a drain must bring the count back under 'high'
+    if (batch == 0 || low + batch > high || high >= FRAME_PCP_CAPACITY) {
+        return -1;
+    }
+    g_frame_pcp_low = low;
+    g_frame_pcp_high = high;
+    g_frame_pcp_batch = batch;
+    return 0;
+}
+
+void frame_pcp_get_stats(int cpu, frame_pcp_stats_t *out, uint32_t *out_count) {
+    if (cpu < 0 || cpu >= MAX_CPUS || !out) return;
+    frame_pcp_t *pcp = &g_frame_pcp[cpu];
+    uintptr_t lock_flags = spinlock_acquire_irqsave(&pcp->lock);
+    *out = pcp->stats;
+    if (out_count) *out_count = pcp->count;
+    spinlock_release_irqrestore(&pcp->lock, lock_flags);
+}
+
+/**
+ * @brief Marks a privately held free frame (per-CPU cache or zero pool) allocated.
+ * Only the current holder can reach the frame, so no lock is needed for the 0 -> 1.
+ */
+static inline void frame_claim_private(uintptr_t phys) {
+    size_t pfn = addr_to_pfn(phys);
+    FRAME_ASSERT(pfn < g_total_frames, "Private free frame PFN out of range!");
+    FRAME_ASSERT(g_frame_refcounts[pfn] == 0, "Private free frame has non-zero refcount!");
+    g_frame_refcounts[pfn] = 1;
+}
+
+/**
+ * @brief Clears one page through its kernel direct mapping.
+ * Uses movnti when SSE2 is available so background zeroing does not evict
+ * the working set from the cache; otherwise rep stosd.
+ */
+static void frame_clear_page(void *virt) {
+    if (g_have_movnti) {
+        uint32_t *p = (uint32_t *)virt;
+        uint32_t *end = p + PAGE_SIZE / sizeof(uint32_t);
+        uint32_t zero = 0;
+        for (; p < end; p += 4) {
+            asm volatile ("movnti %1, 0(%0)\n\t"
+                          "movnti %1, 4(%0)\n\t"
+                          "movnti %1, 8(%0)\n\t"
+                          "movnti %1, 12(%0)"
+                          : : "r"(p), "r"(zero) : "memory");
+        }
+        asm volatile ("sfence" ::: "memory");
+    } else {
+        uint32_t count = PAGE_SIZE / sizeof(uint32_t);
+        asm volatile ("cld; rep stosl"
+                      : "+D"(virt), "+c"(count)
+                      : "a"(0)
+                      : "memory");
+    }
+}
+
+/**
+ * @brief Pops one frame from the zero pool, or returns 0 if it is empty.
+ * @param hit_counter Statistic bumped (under the pool lock) on success.
+ */
+static uintptr_t frame_zero_pool_pop(uint32_t *hit_counter) {
+    uintptr_t phys = 0;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_zero_pool_lock);
+    if (g_zero_pool_count > 0) {
+        phys = g_zero_pool[--g_zero_pool_count];
+        (*hit_counter)++;
+    }
+    spinlock_release_irqrestore(&g_zero_pool_lock, irq_flags);
+    return phys;
+}
+
 //----------------------------------------------------------------------------
 // Core Allocation/Deallocation Functions
 //----------------------------------------------------------------------------
@@ -412,11 +719,25 @@ return 0; // Success
 uintptr_t frame_alloc(void) {
     const int frame_req_order = FRAME_BUDDY_ORDER; // Use defined constant
 
+    // Fast path: per-CPU cache. A cached frame has refcount 0 and is owned by
+    // this CPU's cache alone, so nothing else can touch its count concurrently.
+    uintptr_t cached_phys = frame_pcp_alloc();
+    if (cached_phys) {
+        frame_claim_private(cached_phys);
+        return cached_phys;
+    }
+
     FRAME_PRINT(2, "[Frame Alloc] Requesting order %d from buddy allocator...\n", frame_req_order);
     void* block_virt = buddy_alloc_raw(frame_req_order);
     FRAME_PRINT(2, "[Frame Alloc] buddy_alloc_raw returned VIRT=%p\n", block_virt);
 
     if (!block_virt) {
+        // Last resort: pre-zeroed frames are still free memory
+        uintptr_t pooled_phys = frame_zero_pool_pop(&g_zero_pool_reclaimed);
+        if (pooled_phys) {
+            frame_claim_private(pooled_phys);
+            return pooled_phys;
+        }
         FRAME_PRINT(0, "[Frame Alloc ERR] Buddy allocation failed (out of memory?)!\n");
         return 0; // Indicate failure
     }
@@ -535,6 +856,9 @@ void put_frame(uintptr_t phys_addr) {
         // as the buddy allocator has its own internal locking.
         spinlock_release_irqrestore(&g_frame_lock, irq_flags);
 
+        if (frame_pcp_free(phys_addr)) {
+            return;
+        }
         FRAME_PRINT(2, "[Put Frame] Refcount is zero, freeing VIRT=%p (order %d) to buddy system.\n",
                       (void*)virt_addr, FRAME_BUDDY_ORDER);
         buddy_free_raw((void*)virt_addr, FRAME_BUDDY_ORDER);
@@ -545,6 +869,254 @@ void put_frame(uintptr_t phys_addr) {
     }
 }
 
+void put_frame_batch(uintptr_t *frames, uint32_t count) {
+    if (!frames || count == 0) return;
+
+    // Pass 1: drop the references under one lock, compacting frames that hit zero
+    uint32_t nfree = 0;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_frame_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        uintptr_t phys = frames[i];
+        size_t pfn = addr_to_pfn(phys);
+        if ((phys % PAGE_SIZE) != 0 || pfn >= g_total_frames) {
+            spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+            FRAME_PANIC("put_frame_batch called with an invalid frame address!");
+            return;
+        }
+        if (g_frame_refcounts[pfn] == 0) {
+            spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+            FRAME_PANIC("Double free detected in put_frame_batch!");
+            return;
+        }
+        if (--g_frame_refcounts[pfn] == 0) {
+            frames[nfree++] = phys;
+        }
+    }
+    spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+
+    // Pass 2: refill this CPU's cache up to 'high' while holding its lock once
+    uint32_t next = 0;
+    if (g_frame_pcp_enabled && nfree > 0) {
+        uintptr_t cpu_flags = local_irq_save();
+        int cpu = get_cpu_id();
+        if (cpu >= 0 && cpu < MAX_CPUS) {
+            frame_pcp_t *pcp = &g_frame_pcp[cpu];
+            uintptr_t lock_flags = spinlock_acquire_irqsave(&pcp->lock);
+            while (next < nfree && pcp->count < g_frame_pcp_high) {
+                pcp->frames[pcp->head] = frames[next++];
+                pcp->head = (pcp->head + 1) & FRAME_PCP_MASK;
+                pcp->count++;
+                pcp->stats.frees++;
+            }
+            spinlock_release_irqrestore(&pcp->lock, lock_flags);
+        }
+        local_irq_restore(cpu_flags);
+    }
+
+    // Pass 3: the remainder goes to the buddy, one buddy lock hold per chunk
+    void *blocks[FRAME_PCP_CAPACITY];
+    while (next < nfree) {
+        int n = 0;
+        while (next < nfree && n < FRAME_PCP_CAPACITY) {
+            blocks[n++] = (void*)(frames[next++] + KERNEL_SPACE_VIRT_START);
+        }
+        buddy_free_raw_batch(blocks, n, FRAME_BUDDY_ORDER);
+    }
+}
+
+/**
+ * @brief Allocates a physically contiguous run of page frames.
+ * The backing buddy block is rounded up to a power of two and the unused tail
+ * is returned immediately, so a run wastes less than one page.
+ * @param npages Number of pages in the run.
+ * @return Physical address of the first frame, or 0 on failure.
+ */
+uintptr_t frame_alloc_run(size_t npages) {
+    if (npages == 0 || !g_frame_run_pages || npages > FRAME_RUN_MAX_PAGES) return 0;
+    if (npages > (SIZE_MAX / PAGE_SIZE)) return 0;
+
+    int order = size_to_buddy_order(npages * PAGE_SIZE);
+    if (order < 0) return 0;
+
+    void *block_virt = buddy_alloc_raw(order);
+    if (!block_virt) {
+        FRAME_PRINT(0, "[Frame Run ERR] Buddy allocation of order %d failed!\n", order);
+        return 0;
+    }
+    size_t block_pages = (size_t)1 << (order - FRAME_BUDDY_ORDER);
+    frame_release_pages((uintptr_t)block_virt, npages, block_pages);
+
+    uintptr_t run_phys = (uintptr_t)block_virt - KERNEL_SPACE_VIRT_START;
+    size_t head_pfn = addr_to_pfn(run_phys);
+    FRAME_ASSERT(head_pfn >= g_run_first_pfn && head_pfn + npages <= g_run_first_pfn + g_run_pfn_count,
+                 "Page run outside the buddy heap range!");
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_frame_lock);
+    for (size_t i = 0; i < npages; i++) {
+        FRAME_ASSERT(g_frame_refcounts[head_pfn + i] == 0, "Allocating run frame with non-zero refcount!");
+        g_frame_refcounts[head_pfn + i] = 1;
+    }
+    g_frame_run_pages[head_pfn - g_run_first_pfn] = (uint16_t)npages;
+    spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+
+    FRAME_PRINT(1, "[Frame Run] Allocated %lu pages at PHYS=%#lx (order %d)\n",
+                (unsigned long)npages, (unsigned long)run_phys, order);
+    return run_phys;
+}
+
+/**
+ * @brief Returns the length of the page run headed at a physical address.
+ * @param phys_addr Physical address of the first frame of the run.
+ * @return Number of pages, or 0 if phys_addr does not head a run.
+ */
+size_t frame_run_pages(uintptr_t phys_addr) {
+    if (!g_frame_run_pages || (phys_addr % PAGE_SIZE) != 0) return 0;
+    size_t pfn = addr_to_pfn(phys_addr);
+    if (pfn < g_run_first_pfn || pfn >= g_run_first_pfn + g_run_pfn_count) return 0;
+    return g_frame_run_pages[pfn - g_run_first_pfn];
+}
+
+/**
+ * @brief Frees a page run allocated with frame_alloc_run().
+ * Every frame in the run must still hold exactly one reference.
+ * @param phys_addr Physical address of the first frame of the run.
+ */
+void frame_free_run(uintptr_t phys_addr) {
+    size_t npages = frame_run_pages(phys_addr);
+    if (npages == 0) {
+        terminal_printf("[Frame Run ERR] %#lx is not the head of a page run.\n", (unsigned long)phys_addr);
+        FRAME_PANIC("frame_free_run called on an address that does not head a run");
+        return;
+    }
+    size_t head_pfn = addr_to_pfn(phys_addr);
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_frame_lock);
+    for (size_t i = 0; i < npages; i++) {
+        if (g_frame_refcounts[head_pfn + i] != 1) {
+            spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+            FRAME_PANIC("Page run frame has unexpected refcount on free (shared or double free)!");
+            return;
+        }
+        g_frame_refcounts[head_pfn + i] = 0;
+    }
+    g_frame_run_pages[head_pfn - g_run_first_pfn] = 0;
+    spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+
+    frame_release_pages(phys_addr + KERNEL_SPACE_VIRT_START, 0, npages);
+}
+
+/**
+ * @brief Allocates a zeroed 4MB-aligned block of independently refcounted frames.
+ * The buddy heap start is aligned to the largest block size, so an order-22
+ * block is physically aligned to PAGE_SIZE_LARGE as PSE requires.
+ * @return Physical address of the block, or 0 on failure.
+ */
+uintptr_t frame_alloc_large_page(void) {
+    if (!g_frame_refcounts) return 0;
+    int order = size_to_buddy_order(PAGE_SIZE_LARGE);
+    if (order < 0) return 0;
+
+    void *block_virt = buddy_alloc_raw(order);
+    if (!block_virt) {
+        FRAME_PRINT(1, "[Frame Large] Buddy allocation of order %d failed.\n", order);
+        return 0;
+    }
+    uintptr_t phys = (uintptr_t)block_virt - KERNEL_SPACE_VIRT_START;
+    if (phys % PAGE_SIZE_LARGE != 0) {
+        buddy_free_raw(block_virt, order);
+        FRAME_PRINT(0, "[Frame Large ERR] Block PHYS=%#lx is not 4MB aligned.\n", (unsigned long)phys);
+        return 0;
+    }
+
+    for (size_t i = 0; i < PAGES_PER_TABLE; i++) {
+        frame_clear_page((void *)((uintptr_t)block_virt + i * PAGE_SIZE));
+    }
+
+    size_t head_pfn = addr_to_pfn(phys);
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_frame_lock);
+    for (size_t i = 0; i < PAGES_PER_TABLE; i++) {
+        FRAME_ASSERT(g_frame_refcounts[head_pfn + i] == 0, "Allocating large page frame with non-zero refcount!");
+        g_frame_refcounts[head_pfn + i] = 1;
+    }
+    spinlock_release_irqrestore(&g_frame_lock, irq_flags);
+    return phys;
+}
+
+//----------------------------------------------------------------------------
+// Pre-zeroed Frame Pool
+//----------------------------------------------------------------------------
+
+/**
+ * @brief Allocates a frame whose contents are all zero.
+ * Takes a frame the idle task cleared in advance when one is available and
+ * falls back to frame_alloc() plus a synchronous clear otherwise.
+ * @return Physical address of the zeroed frame (refcount 1), or 0 if OOM.
+ */
+uintptr_t frame_alloc_zeroed(void) {
+    uintptr_t phys = frame_zero_pool_pop(&g_zero_pool_hits);
+    if (phys) {
+        frame_claim_private(phys);
+        return phys;
+    }
+    phys = frame_alloc();
+    if (!phys) return 0;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_zero_pool_lock);
+    g_zero_pool_misses++;
+    spinlock_release_irqrestore(&g_zero_pool_lock, irq_flags);
+    frame_clear_page((void *)(phys + KERNEL_SPACE_VIRT_START));
+    return phys;
+}
+
+/**
+ * @brief Clears up to 'max_frames' free frames into the zero pool.
+ * Called from the idle task with interrupts enabled; the clear itself runs
+ * without locks so the idle task stays preemptible.
+ * @return Number of frames added to the pool (0 when the pool is full or OOM).
+ */
+uint32_t frame_zero_pool_refill(uint32_t max_frames) {
+    uint32_t added = 0;
+    while (added < max_frames && g_zero_pool_count < FRAME_ZERO_POOL_CAPACITY) {
+        uintptr_t phys = frame_pcp_alloc();
+        if (!phys) {
+            void *block_virt = buddy_alloc_raw(FRAME_BUDDY_ORDER);
+            if (!block_virt) break;
+            phys = (uintptr_t)block_virt - KERNEL_SPACE_VIRT_START;
+        }
+        frame_clear_page((void *)(phys + KERNEL_SPACE_VIRT_START));
+
+        uintptr_t irq_flags = spinlock_acquire_irqsave(&g_zero_pool_lock);
+        bool stored = false;
+        if (g_zero_pool_count < FRAME_ZERO_POOL_CAPACITY) {
+            g_zero_pool[g_zero_pool_count++] = phys;
+            g_zero_pool_idle_zeroed++;
+            stored = true;
+        }
+        spinlock_release_irqrestore(&g_zero_pool_lock, irq_flags);
+
+        if (!stored) { // Filled concurrently; hand the frame back
+            if (!frame_pcp_free(phys)) {
+                buddy_free_raw((void *)(phys + KERNEL_SPACE_VIRT_START), FRAME_BUDDY_ORDER);
+            }
+            break;
+        }
+        added++;
+    }
+    return added;
+}
+
+/** @brief Fills a structure with current zero pool statistics. */
+void frame_zero_pool_get_stats(frame_zero_pool_stats_t *stats) {
+    if (!stats) return;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_zero_pool_lock);
+    stats->pool_count = g_zero_pool_count;
+    stats->capacity = FRAME_ZERO_POOL_CAPACITY;
+    stats->hits = g_zero_pool_hits;
+    stats->misses = g_zero_pool_misses;
+    stats->idle_zeroed = g_zero_pool_idle_zeroed;
+    stats->reclaimed = g_zero_pool_reclaimed;
+    spinlock_release_irqrestore(&g_zero_pool_lock, irq_flags);
+}
+
 //----------------------------------------------------------------------------
 // Reference Count Management Functions
 //----------------------------------------------------------------------------
@@ -27,6 +27,7 @@
 #include <assert.h>       // KERNEL_ASSERT, KERNEL_PANIC_HALT
 #include <terminal.h>     // terminal_printf/write (for general logging)
 #include <block_device.h> // Declaration for ata_primary_irq_handler
+#include <apic.h>         // Local APIC vectors and EOI
 
 //============================================================================
 // Definitions and Constants
@@ -99,6 +100,11 @@ extern void irq4();  extern void irq5();  extern void irq6();  extern void irq7(
 extern void irq8();  extern void irq9();  extern void irq10(); extern void irq11();
 extern void irq12(); extern void irq13(); extern void irq14(); extern void irq15();
 
+// Local APIC stubs (timer, reschedule IPI, spurious); see apic.h
+extern void apic_timer_stub();
+extern void apic_resched_stub();
+extern void apic_spurious_stub();
+
 // Assembly System Call handler stub (vector 0x80)
 // Handles transition from user mode, saving state, calling syscall dispatcher, restoring state, iret.
 extern void syscall_handler_asm();
@@ -313,12 +319,20 @@ void default_isr_handler(isr_frame_t* frame) {
  * default handler. Sends EOI to the PIC for hardware interrupts.
  */
 void isr_common_handler(isr_frame_t* frame) {
-    serial_write("[IDT] Enter isr_common_handler\n");
-
     // Basic validation of the frame pointer itself
     if (!frame) { KERNEL_PANIC_HALT("isr_common_handler received NULL frame!"); }
 
     uint32_t vector = frame->int_no;
+    bool is_irq = vector >= PIC1_START_VECTOR && vector < PIC2_START_VECTOR + 8;
+    // The local APIC vectors fire on every CPU at up to 1 kHz; keep them off the serial log
+    if (vector < APIC_TIMER_VECTOR) serial_write("[IDT] Enter isr_common_handler\n");
+
+    // The local APIC is acknowledged before the handler: a handler that
+    // switches tasks may not come back here for a long time, and the APIC
+    // would hold back every interrupt of equal or lower priority until then
+    if (apic_is_enabled() && (is_irq || vector >= APIC_TIMER_VECTOR)) {
+        lapic_eoi();
+    }
 
     // Validate vector range
     if (vector >= IDT_ENTRIES) {
@@ -349,7 +363,7 @@ void isr_common_handler(isr_frame_t* frame) {
 
     // Send End-of-Interrupt (EOI) signal *after* the handler has run
     // ONLY for hardware interrupts originating from the PICs (vectors 32-47 typically).
-    if (vector >= PIC1_START_VECTOR && vector < PIC2_START_VECTOR + 8) {
+    if (is_irq && !apic_is_enabled()) {
        pic_send_eoi(vector);
     }
 }
@@ -422,6 +436,11 @@ void idt_init(void) {
     idt_set_gate_internal(IRQ0_VECTOR + 14, (uint32_t)irq14, KERNEL_CS_SELECTOR, IDT_FLAG_INTERRUPT_GATE); // Primary ATA HD
     idt_set_gate_internal(IRQ0_VECTOR + 15, (uint32_t)irq15, KERNEL_CS_SELECTOR, IDT_FLAG_INTERRUPT_GATE); // Secondary ATA HD
 
+    // --- Local APIC vectors (unused until apic_init switches delivery over) ---
+    idt_set_gate_internal(APIC_TIMER_VECTOR, (uint32_t)apic_timer_stub, KERNEL_CS_SELECTOR, IDT_FLAG_INTERRUPT_GATE);
+    idt_set_gate_internal(APIC_RESCHED_VECTOR, (uint32_t)apic_resched_stub, KERNEL_CS_SELECTOR, IDT_FLAG_INTERRUPT_GATE);
+    idt_set_gate_internal(APIC_SPURIOUS_VECTOR, (uint32_t)apic_spurious_stub, KERNEL_CS_SELECTOR, IDT_FLAG_INTERRUPT_GATE);
+
     // --- Register System Call Gate ---
     terminal_write("[IDT] Registering System Call handler...\n");
     // Use DPL=3 to allow user mode code to trigger this interrupt via INT 0x80
@@ -447,4 +466,13 @@ void idt_init(void) {
     pic_unmask_required_irqs();
 
     terminal_write("[IDT] Setup complete.\n");
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Loads the shared IDT on an application processor.
+ * @details The table is built once by idt_init on the BSP; every CPU points
+ * its IDTR at the same entries.
+ */
+void idt_load(void) {
+    idt_flush((uintptr_t)&idtp);
+}
@@ -5,6 +5,8 @@
 ;  • Correct stack-frame layout for C side (isr_frame_t).
 ;  • Optional one-byte debug marker per entry/exit (serial @115 200 8N1).
 ;  • Zero dynamic symbols: everything resolved at link-time.
+;  • Local APIC vectors (timer, reschedule IPI, spurious) share the same
+;    common stub; see apic.h.
 ;  ---------------------------------------------------------------------------
 ;  Build-time feature flags
 ;     DEBUG_IRQ_STUBS  – emit ‘@’ on entry / ‘#’ on exit of common stub
@@ -26,7 +28,10 @@
 ; Segments & constants
 ; -----------------------------------------------------------------------------
 KERNEL_DS       equ     0x10              ; must match your GDT
+PERCPU_DS       equ     0x30              ; GDT_PERCPU_SELECTOR (this CPU's cpu_t)
 IRQ_BASE_VEC    equ     32               ; PIC remap base (0x20)
+APIC_TIMER_VEC  equ     0xEF             ; APIC_TIMER_VECTOR
+APIC_RESCHED_VEC equ    0xF0             ; APIC_RESCHED_VECTOR
 
 ; -----------------------------------------------------------------------------
 ; Public IRQ labels (used by idt.c)
@@ -36,6 +41,9 @@ IRQ_BASE_VEC    equ     32               ; PIC remap base (0x20)
         global  irq %+ i
 %assign i i+1
 %endrep
+        global  apic_timer_stub
+        global  apic_resched_stub
+        global  apic_spurious_stub
 
 ; -----------------------------------------------------------------------------
 ; Macro: DECL_IRQ <n>
@@ -56,6 +64,23 @@ irq%1:                                  ; label visible to linker
 %assign i i+1
 %endrep
 
+; -----------------------------------------------------------------------------
+; Local APIC vectors
+; -----------------------------------------------------------------------------
+apic_timer_stub:
+        push    dword 0
+        push    dword APIC_TIMER_VEC
+        jmp     irq_common_stub
+
+apic_resched_stub:
+        push    dword 0
+        push    dword APIC_RESCHED_VEC
+        jmp     irq_common_stub
+
+; A spurious interrupt is not in service at the APIC: no EOI, nothing to do
+apic_spurious_stub:
+        iret
+
 ; -----------------------------------------------------------------------------
 ; Common stub – builds isr_frame_t, calls C, restores context, IRET
 ; -----------------------------------------------------------------------------
@@ -83,6 +108,7 @@ irq_common_stub:
         mov     ds, ax
         mov     es, ax
         mov     fs, ax
+        mov     ax, PERCPU_DS
         mov     gs, ax
 
         ; ---- Call into C (argument = current ESP) ----
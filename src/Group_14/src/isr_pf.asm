@@ -13,6 +13,7 @@ extern serial_putc_asm ; External ASM function for serial output
 
 ; Define the Kernel Code Segment selector value from your GDT
 %define KERNEL_CODE_SELECTOR 0x08 ; Common value, adjust if yours is different
+%define PERCPU_DATA_SELECTOR 0x30 ; GDT_PERCPU_SELECTOR (this CPU's cpu_t)
 
 isr14:
     mov al, 'F' ; 'F' for Page Fault
@@ -39,7 +40,9 @@ isr14:
     push fs
     push gs
 
-
+    ; 3. GS is cleared on the way to user mode; the C side needs this CPU's cpu_t
+    mov ax, PERCPU_DATA_SELECTOR
+    mov gs, ax
 
     ; --- Stack Layout Confirmation ... (rest of the file remains the same) ---
 
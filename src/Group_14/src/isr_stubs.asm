@@ -18,6 +18,7 @@ global isr16, isr17, isr18, isr19
 
 ; Define Kernel Data Segment selector (Must match irq_stubs.asm and gdt.c)
 KERNEL_DATA_SEG equ 0x10
+PERCPU_DATA_SEG equ 0x30 ; GDT_PERCPU_SELECTOR (this CPU's cpu_t)
 
 ; Common macro for ISRs WITHOUT an error code pushed by CPU
 ; We push a dummy error code 0.
@@ -108,6 +109,7 @@ common_interrupt_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, PERCPU_DATA_SEG
     mov gs, ax     ; GS is now set (original was saved by initial push gs)
 
     ; 4. Call the C handler, passing a pointer to the saved state.
@@ -7,20 +7,34 @@ bits 32
 global jump_to_user_mode
 
 ; Function signature:
-; void jump_to_user_mode(uint32_t *kernel_stack_ptr, uint32_t *page_directory_phys);
+; void jump_to_user_mode(uint32_t **old_esp_ptr, uint32_t *kernel_stack_ptr, uint32_t *page_directory_phys);
 ; Args:
-;   [ebp+8]  = kernel_stack_ptr (points to prepared iret frame)
-;   [ebp+12] = page_directory_phys (physical address of user PD)
+;   [ebp+8]  = old_esp_ptr (where the outgoing task's ESP is saved; NULL = don't save)
+;   [ebp+12] = kernel_stack_ptr (points to prepared iret frame)
+;   [ebp+16] = page_directory_phys (physical address of user PD)
+;
+; The outgoing task's context is saved in the same layout as context_switch,
+; so a later context_switch back to it returns normally from this call.
 
 jump_to_user_mode:
-    cli             ; Disable interrupts before critical state change
-
     push ebp
     mov ebp, esp
 
-    ; Get arguments
-    mov edx, [ebp + 8]  ; kernel_stack_ptr (points to prepared iret frame)
-    mov eax, [ebp + 12] ; page_directory_phys
+    ; Save the outgoing task's kernel context (same order as context_switch)
+    push ds
+    push es
+    push fs
+    push gs
+    pushfd
+    pushad
+
+    cli             ; Disable interrupts before critical state change
+
+    ; Get arguments. Once the old ESP is published another CPU may resume the
+    ; outgoing task on this stack, so saving it must come last.
+    mov ebx, [ebp + 8]  ; old_esp_ptr
+    mov edx, [ebp + 12] ; kernel_stack_ptr (points to prepared iret frame)
+    mov eax, [ebp + 16] ; page_directory_phys
 
     ; Switch Page Directory if needed
     mov ecx, cr3        ; Get current CR3
@@ -32,6 +46,13 @@ jump_to_user_mode:
     mov cr3, eax        ; Load process page directory physical address
 
 .skip_cr3_load:
+    test ebx, ebx
+    jz .skip_esp_save
+    cmp ebx, 0xC0000000 ; Static idle TCBs are never saved (see context_switch.asm)
+    jb .skip_esp_save
+    mov [ebx], esp      ; Save ESP pointing at the saved context
+
+.skip_esp_save:
     ; Switch stack pointer to the prepared frame location saved in edx
     mov esp, edx        ; ESP now points to the IRET frame
 
@@ -44,4 +65,4 @@ jump_to_user_mode:
     cli
 .halt_loop:
     hlt
-    jmp .halt_loop
\ No newline at end of file
+    jmp .halt_loop
@@ -0,0 +1,761 @@
+/**
+ * @file kbench.c
+ * @brief In-kernel microbenchmarks, compiled only when KERNEL_BENCH is defined.
+ *
+ * Benchmarks run once at boot with interrupts still disabled so that the TSC
+ * deltas are not polluted by IRQ handlers or preemption. Every workload is
+ * driven by a fixed-seed PRNG, so runs are comparable across builds.
+ */
+
+#include "kbench.h"
+
+#ifdef KERNEL_BENCH
+
+#include "buddy.h"
+#include "slab.h"
+#include "kmalloc.h"
+#include "kmalloc_internal.h"
+#include "percpu_alloc.h"
+#include "get_cpu_id.h"
+#include "frame.h"
+#include "mm.h"
+#include "mmu_gather.h"
+#include "block_device.h"
+#include "buffer_cache.h"
+#include "fs_config.h"
+#include "dcache.h"
+#include "process.h"
+#include "vfs.h"
+#include "sys_file.h"
+#include "paging.h"
+#include "port_io.h"
+#include "pit.h"
+#include "terminal.h"
+#include "serial.h"
+#include <libc/string.h> // memset
+#include <libc/stdio.h> // snprintf
+
+// === Configuration ===
+#define KBENCH_LIVE_OBJECTS  2048 // Objects held live by the batch workloads
+#define KBENCH_CHURN_OPS     4096 // Alloc/free pairs in the churn workload
+#define KBENCH_CHURN_SIZE    64
+#define KBENCH_ORDER_SIZE    128  // Object size for the LIFO/FIFO workloads
+#define KBENCH_MAX_SIZE      2048 // Largest request; fits every layer's slab classes
+
+#define KBENCH_FRAME_BATCH   512  // Frames held live per round of the frame churn
+#define KBENCH_FRAME_ROUNDS  8
+#define KBENCH_STORM_BASE    0x40000000u // User VA for the fault-storm VMA
+#define KBENCH_STORM_PAGES   4096        // 16 MiB of anonymous memory
+#define KBENCH_TEARDOWN_ROUNDS 8         // Address spaces built and destroyed per teardown variant
+#define KBENCH_BLOCK_CHUNK   (64 * 1024)       // Bytes per block_device_read
+#define KBENCH_BLOCK_BYTES   (8 * 1024 * 1024) // Sequential span read per variant
+#define KBENCH_BCACHE_HOT    32   // Metadata blocks looked up round-robin (boot sector, FAT)
+#define KBENCH_BCACHE_STREAM 8192 // Blocks streamed through the cache, 8x its capacity
+#define KBENCH_BCACHE_STREAM_LBA 8192 // First streamed block, past the FAT metadata
+#define KBENCH_DCACHE_OPENS  512  // Opens per path in the dentry cache workload
+#define KBENCH_DCACHE_PATH   "/bin/shell.elf"
+#define KBENCH_DCACHE_MISSING "/bin/missing.elf"
+#define KBENCH_EXEC_ROUNDS   16   // Processes created and destroyed per executable
+#define KBENCH_EXEC_SMALL    "/hello.elf"
+#define KBENCH_EXEC_LARGE    "/bigelf.elf" // bigelf.c: ~1 MiB of initialised data
+#define KBENCH_BCACHE_META_EVERY 48 // Streamed blocks per metadata lookup: each hot block
+                                    // is reused after 1536 streamed blocks, more than LRU holds
+
+_Static_assert(KBENCH_STORM_PAGES <= KBENCH_MAX_SAMPLES, "Sample buffers too small");
+_Static_assert(KBENCH_LIVE_OBJECTS <= KBENCH_MAX_SAMPLES, "Sample buffers too small");
+_Static_assert(KBENCH_CHURN_OPS <= KBENCH_MAX_SAMPLES, "Sample buffers too small");
+_Static_assert(KBENCH_BCACHE_STREAM <= KBENCH_MAX_SAMPLES, "Sample buffers too small");
+
+// === State ===
+static void *s_objs[KBENCH_LIVE_OBJECTS];
+static uint32_t s_alloc_samples[KBENCH_MAX_SAMPLES];
+static uint32_t s_free_samples[KBENCH_MAX_SAMPLES];
+static uint32_t s_rng_state = 0x2545F491u;
+static uint32_t s_tsc_overhead = 0;
+static uint32_t s_tsc_khz = 0;
+static uintptr_t s_frames[KBENCH_FRAME_BATCH];
+
+/** @brief Small xorshift PRNG so that every run uses the same sequence. */
+static inline uint32_t kbench_rand(void) {
+    uint32_t x = s_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rng_state = x;
+    return x;
+}
+
+/** @brief Measures the cost of back-to-back rdtsc so it can be subtracted from samples. */
+static void kbench_calibrate(void) {
+    uint32_t best = 0xFFFFFFFFu;
+    for (int i = 0; i < 64; i++) {
+        uint64_t t0 = kbench_rdtsc();
+        uint64_t t1 = kbench_rdtsc();
+        uint64_t d = t1 - t0;
+        if (d < best) best = (uint32_t)d;
+    }
+    s_tsc_overhead = best;
+}
+
+/**
+ * @brief Measures the TSC frequency against a 10 ms one-shot on PIT channel 2.
+ * Channel 2 is polled through port 0x61, so this works before IRQs are enabled.
+ */
+static void kbench_calibrate_tsc_khz(void) {
+    const uint16_t pit_count = (uint16_t)(PIT_BASE_FREQUENCY / 100); // 10 ms
+    uint8_t saved = inb(PC_SPEAKER_PORT);
+    outb(PC_SPEAKER_PORT, (uint8_t)((saved & ~0x02) | 0x01)); // Gate on, speaker off
+    outb(PIT_CMD_PORT, 0xB0);                                  // Ch2, lo/hi, mode 0
+    outb(PIT_CHANNEL2_PORT, (uint8_t)(pit_count & 0xFF));
+    outb(PIT_CHANNEL2_PORT, (uint8_t)(pit_count >> 8));
+    uint64_t t0 = kbench_rdtsc();
+    while (!(inb(PC_SPEAKER_PORT) & 0x20)) { } // OUT2 goes high at terminal count
+    uint64_t t1 = kbench_rdtsc();
+    outb(PC_SPEAKER_PORT, saved);
+    s_tsc_khz = (uint32_t)((t1 - t0) / 10);
+}
+
+uint32_t kbench_sample(uint64_t start, uint64_t end) {
+    uint64_t d = end - start;
+    if (d > 0xFFFFFFFFull) return 0xFFFFFFFFu;
+    return (d > s_tsc_overhead) ? (uint32_t)d - s_tsc_overhead : 0;
+}
+
+/** @brief Shell sort (Ciura gaps); fine for a few thousand samples with no allocation. */
+static void kbench_sort(uint32_t *a, uint32_t n) {
+    static const uint32_t gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        uint32_t gap = gaps[g];
+        for (uint32_t i = gap; i < n; i++) {
+            uint32_t v = a[i];
+            uint32_t j = i;
+            while (j >= gap && a[j - gap] > v) {
+                a[j] = a[j - gap];
+                j -= gap;
+            }
+            a[j] = v;
+        }
+    }
+}
+
+void kbench_report(const char *layer, const char *workload, const char *op,
+                   uint32_t *samples, uint32_t count) {
+    char line[160];
+    if (count == 0) {
+        snprintf(line, sizeof(line), "BENCH,%s,%s,%s,0,0,0,0,0\n", layer, workload, op);
+        serial_write(line);
+        return;
+    }
+    if (count > KBENCH_MAX_SAMPLES) count = KBENCH_MAX_SAMPLES;
+
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) sum += samples[i];
+    kbench_sort(samples, count);
+
+    unsigned avg = (unsigned)(sum / count);
+    unsigned p50 = samples[count / 2];
+    unsigned p99 = samples[(count * 99) / 100];
+    unsigned max = samples[count - 1];
+    snprintf(line, sizeof(line), "BENCH,%s,%s,%s,%u,%u,%u,%u,%u\n",
+             layer, workload, op, (unsigned)count, avg, p50, p99, max);
+    serial_write(line);
+}
+
+// === Allocator Layers ===
+
+typedef struct kbench_layer {
+    const char *name;
+    void *(*alloc)(size_t size);
+    void (*free)(void *ptr);
+} kbench_layer_t;
+
+static void *kb_buddy_alloc(size_t size) { return BUDDY_ALLOC(size); }
+static void kb_buddy_free(void *ptr) { BUDDY_FREE(ptr); }
+
+static void *kb_kmalloc(size_t size) { return kmalloc(size); }
+static void kb_kfree(void *ptr) { kfree(ptr); }
+
+// Slab layer: one private cache per power-of-two class from 32 to 2048 bytes
+#define KBENCH_SLAB_CLASSES 7
+static slab_cache_t *s_slab_caches[KBENCH_SLAB_CLASSES];
+static const char *s_slab_names[KBENCH_SLAB_CLASSES] = {
+    "kbench_32", "kbench_64", "kbench_128", "kbench_256", "kbench_512", "kbench_1024", "kbench_2048"
+};
+
+static slab_cache_t *kb_slab_cache_for(size_t size) {
+    size_t class_size = 32;
+    for (int i = 0; i < KBENCH_SLAB_CLASSES; i++, class_size <<= 1) {
+        if (size <= class_size) return s_slab_caches[i];
+    }
+    return NULL;
+}
+static void *kb_slab_alloc(size_t size) {
+    slab_cache_t *cache = kb_slab_cache_for(size);
+    return cache ? slab_alloc(cache) : NULL;
+}
+static void kb_slab_free(void *ptr) { slab_free(NULL, ptr); }
+
+// Per-CPU layer: the owning cache is stashed in the object's first word for the free
+static void *kb_percpu_alloc(size_t size) {
+    slab_cache_t *cache = NULL;
+    size_t total = ALIGN_UP(KALLOC_HEADER_SIZE + size, KMALLOC_MIN_ALIGNMENT);
+    void *obj = percpu_kmalloc(total, get_cpu_id(), &cache);
+    if (obj) *(slab_cache_t **)obj = cache;
+    return obj;
+}
+static void kb_percpu_free(void *ptr) { percpu_kfree(ptr, *(slab_cache_t **)ptr); }
+
+static const kbench_layer_t s_layers[] = {
+    { "buddy",   kb_buddy_alloc,  kb_buddy_free  },
+    { "slab",    kb_slab_alloc,   kb_slab_free   },
+    { "kmalloc", kb_kmalloc,      kb_kfree       },
+    { "percpu",  kb_percpu_alloc, kb_percpu_free },
+};
+
+/** @brief Random power-of-two size class between 32 and KBENCH_MAX_SIZE. */
+static inline size_t kbench_rand_class(void) {
+    return (size_t)32 << (kbench_rand() % KBENCH_SLAB_CLASSES);
+}
+
+/** @brief Random byte size between 16 and KBENCH_MAX_SIZE. */
+static inline size_t kbench_rand_size(void) {
+    return 16 + (kbench_rand() % (KBENCH_MAX_SIZE - 16 + 1));
+}
+
+// === Workloads ===
+
+/** @brief Times one allocation into s_objs[idx]; returns false on failure. */
+static inline bool kb_timed_alloc(const kbench_layer_t *l, int idx, size_t size, uint32_t *sample) {
+    uint64_t t0 = kbench_rdtsc();
+    s_objs[idx] = l->alloc(size);
+    *sample = kbench_sample(t0, kbench_rdtsc());
+    return s_objs[idx] != NULL;
+}
+
+/** @brief Times freeing s_objs[idx] (if set) and clears the slot. */
+static inline bool kb_timed_free(const kbench_layer_t *l, int idx, uint32_t *sample) {
+    if (!s_objs[idx]) return false;
+    uint64_t t0 = kbench_rdtsc();
+    l->free(s_objs[idx]);
+    *sample = kbench_sample(t0, kbench_rdtsc());
+    s_objs[idx] = NULL;
+    return true;
+}
+
+/** @brief Same-size churn: alloc immediately followed by free. */
+static void kbench_churn(const kbench_layer_t *l) {
+    uint32_t na = 0, nf = 0;
+    for (int i = 0; i < KBENCH_CHURN_OPS; i++) {
+        if (kb_timed_alloc(l, 0, KBENCH_CHURN_SIZE, &s_alloc_samples[na])) na++;
+        if (kb_timed_free(l, 0, &s_free_samples[nf])) nf++;
+    }
+    kbench_report(l->name, "churn", "alloc", s_alloc_samples, na);
+    kbench_report(l->name, "churn", "free", s_free_samples, nf);
+}
+
+/** @brief Mixed size classes, freed in allocation order. */
+static void kbench_mixed(const kbench_layer_t *l) {
+    uint32_t na = 0, nf = 0;
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        if (kb_timed_alloc(l, i, kbench_rand_class(), &s_alloc_samples[na])) na++;
+    }
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        if (kb_timed_free(l, i, &s_free_samples[nf])) nf++;
+    }
+    kbench_report(l->name, "mixed", "alloc", s_alloc_samples, na);
+    kbench_report(l->name, "mixed", "free", s_free_samples, nf);
+}
+
+/** @brief Fixed-size batch freed in LIFO (reverse) or FIFO (allocation) order. */
+static void kbench_order(const kbench_layer_t *l, bool lifo) {
+    uint32_t na = 0, nf = 0;
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        if (kb_timed_alloc(l, i, KBENCH_ORDER_SIZE, &s_alloc_samples[na])) na++;
+    }
+    for (int k = 0; k < KBENCH_LIVE_OBJECTS; k++) {
+        int i = lifo ? (KBENCH_LIVE_OBJECTS - 1 - k) : k;
+        if (kb_timed_free(l, i, &s_free_samples[nf])) nf++;
+    }
+    const char *name = lifo ? "lifo" : "fifo";
+    kbench_report(l->name, name, "alloc", s_alloc_samples, na);
+    kbench_report(l->name, name, "free", s_free_samples, nf);
+}
+
+/**
+ * @brief Fragmentation: fill with random sizes, free a random half, then time
+ * allocations into the holes and the final random-order teardown.
+ */
+static void kbench_frag(const kbench_layer_t *l) {
+    uint32_t na = 0, nf = 0, dummy;
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        kb_timed_alloc(l, i, kbench_rand_size(), &dummy);
+    }
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        if (kbench_rand() & 1) kb_timed_free(l, i, &dummy);
+    }
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        if (s_objs[i]) continue;
+        if (kb_timed_alloc(l, i, kbench_rand_size(), &s_alloc_samples[na])) na++;
+    }
+    // Fisher-Yates shuffle so the teardown frees neighbours in random order
+    for (int i = KBENCH_LIVE_OBJECTS - 1; i > 0; i--) {
+        int j = (int)(kbench_rand() % (uint32_t)(i + 1));
+        void *tmp = s_objs[i];
+        s_objs[i] = s_objs[j];
+        s_objs[j] = tmp;
+    }
+    for (int i = 0; i < KBENCH_LIVE_OBJECTS; i++) {
+        if (kb_timed_free(l, i, &s_free_samples[nf])) nf++;
+    }
+    kbench_report(l->name, "frag", "alloc", s_alloc_samples, na);
+    kbench_report(l->name, "frag", "free", s_free_samples, nf);
+}
+
+void kbench_alloc_suite(void) {
+    size_t class_size = 32;
+    for (int i = 0; i < KBENCH_SLAB_CLASSES; i++, class_size <<= 1) {
+        s_slab_caches[i] = slab_create(s_slab_names[i], class_size, 0, 0, NULL, NULL);
+    }
+
+    for (size_t i = 0; i < sizeof(s_layers) / sizeof(s_layers[0]); i++) {
+        const kbench_layer_t *l = &s_layers[i];
+        s_rng_state = 0x2545F491u; // Same sequence for every layer
+        kbench_churn(l);
+        kbench_mixed(l);
+        kbench_order(l, true);
+        kbench_order(l, false);
+        kbench_frag(l);
+    }
+
+    // Magazine hits vs. trips to the cache lock, over all workloads of the slab layer
+    char line[128];
+    for (int i = 0; i < KBENCH_SLAB_CLASSES; i++) {
+        if (!s_slab_caches[i]) continue;
+        unsigned long allocs, frees, hits, misses;
+        slab_cache_stats(s_slab_caches[i], &allocs, &frees, &hits, &misses);
+        snprintf(line, sizeof(line), "# slab %s allocs=%lu frees=%lu mag_hits=%lu mag_misses=%lu\n",
+                 s_slab_names[i], allocs, frees, hits, misses);
+        serial_write(line);
+        slab_destroy(s_slab_caches[i]);
+        s_slab_caches[i] = NULL;
+    }
+}
+
+// === Frame Allocator ===
+
+/** @brief Batched frame_alloc/put_frame rounds with the per-CPU cache on or off. */
+static void kbench_frame_churn(bool pcp) {
+    const char *workload = pcp ? "churn_pcp" : "churn_nopcp";
+    uint32_t na = 0, nf = 0;
+    frame_pcp_set_enabled(pcp);
+    for (int round = 0; round < KBENCH_FRAME_ROUNDS; round++) {
+        int live = 0;
+        for (int i = 0; i < KBENCH_FRAME_BATCH; i++) {
+            uint64_t t0 = kbench_rdtsc();
+            uintptr_t f = frame_alloc();
+            uint32_t d = kbench_sample(t0, kbench_rdtsc());
+            if (!f) break;
+            s_frames[live++] = f;
+            if (na < KBENCH_MAX_SAMPLES) s_alloc_samples[na++] = d;
+        }
+        // Free in reverse so the hot end of the cache is exercised LIFO
+        while (live > 0) {
+            uint64_t t0 = kbench_rdtsc();
+            put_frame(s_frames[--live]);
+            uint32_t d = kbench_sample(t0, kbench_rdtsc());
+            if (nf < KBENCH_MAX_SAMPLES) s_free_samples[nf++] = d;
+        }
+    }
+    kbench_report("frame", workload, "alloc", s_alloc_samples, na);
+    kbench_report("frame", workload, "free", s_free_samples, nf);
+}
+
+/**
+ * @brief Allocates an empty page directory for a benchmark address space.
+ * @param loadable Also copy the kernel PDEs and set the recursive entry, so
+ *                 the directory can be loaded into CR3.
+ * @return Physical address, or 0 on failure.
+ */
+static uintptr_t kbench_new_pd(bool loadable) {
+    uintptr_t pd_phys = frame_alloc();
+    if (!pd_phys) return 0;
+    uint32_t *pd_virt = paging_temp_map(pd_phys, PTE_KERNEL_DATA_FLAGS);
+    if (!pd_virt) { put_frame(pd_phys); return 0; }
+    memset(pd_virt, 0, PAGE_SIZE);
+    if (loadable) {
+        pd_virt[0] = g_kernel_page_directory_virt[0];
+        for (uint32_t i = KERNEL_PDE_INDEX; i < RECURSIVE_PDE_INDEX; i++) {
+            pd_virt[i] = g_kernel_page_directory_virt[i];
+        }
+        pd_virt[RECURSIVE_PDE_INDEX] = (pd_phys & PAGING_ADDR_MASK) | PAGE_PRESENT | PAGE_RW;
+    }
+    paging_temp_unmap(pd_virt);
+    return pd_phys;
+}
+
+/**
+ * @brief Page-fault storm: demand-faults every page of a fresh anonymous VMA
+ * through handle_vma_fault (frame_alloc + zero + PTE install), then tears the
+ * address space down. The trap entry itself is not included.
+ */
+static void kbench_fault_storm(bool pcp) {
+    const char *workload = pcp ? "fault_storm_pcp" : "fault_storm_nopcp";
+    char line[128];
+    frame_pcp_set_enabled(pcp);
+
+    uintptr_t pd_phys = kbench_new_pd(false);
+    if (!pd_phys) { serial_write("# fault_storm: no frame for page directory\n"); return; }
+
+    mm_struct_t *mm = create_mm((uint32_t *)pd_phys);
+    uintptr_t end = KBENCH_STORM_BASE + KBENCH_STORM_PAGES * PAGE_SIZE;
+    vma_struct_t *vma = mm ? insert_vma(mm, KBENCH_STORM_BASE, end,
+                                        VM_READ | VM_WRITE | VM_USER | VM_ANONYMOUS,
+                                        PTE_USER_DATA_FLAGS, NULL, 0) : NULL;
+    if (!vma) {
+        serial_write("# fault_storm: could not set up address space\n");
+        if (mm) destroy_mm(mm);
+        put_frame(pd_phys);
+        return;
+    }
+
+    uint32_t n = 0;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < KBENCH_STORM_PAGES; i++) {
+        uint64_t t0 = kbench_rdtsc();
+        int r = handle_vma_fault(mm, vma, KBENCH_STORM_BASE + i * PAGE_SIZE, PAGE_FAULT_WRITE);
+        uint64_t t1 = kbench_rdtsc();
+        if (r != 0) break;
+        total += t1 - t0;
+        s_alloc_samples[n++] = kbench_sample(t0, t1);
+    }
+    destroy_mm(mm); // Unmaps the VMA and releases every frame and page table
+    put_frame(pd_phys);
+
+    kbench_report("frame", workload, "fault", s_alloc_samples, n);
+    if (n > 0 && total > 0 && s_tsc_khz > 0) {
+        uint32_t per_sec = (uint32_t)(((uint64_t)n * s_tsc_khz * 1000ull) / total);
+        snprintf(line, sizeof(line), "# frame %s faults_per_sec=%u\n", workload, (unsigned)per_sec);
+        serial_write(line);
+    }
+}
+
+void kbench_frame_suite(void) {
+    bool was_enabled = frame_pcp_set_enabled(true);
+    kbench_frame_churn(false);
+    kbench_frame_churn(true);
+    kbench_fault_storm(false);
+    kbench_fault_storm(true);
+    frame_pcp_set_enabled(was_enabled);
+}
+
+// === Address Space Teardown ===
+
+static inline uint32_t kbench_read_cr3(void) {
+    uint32_t v;
+    asm volatile ("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+static inline void kbench_write_cr3(uint32_t v) {
+    asm volatile ("mov %0, %%cr3" :: "r"(v) : "memory");
+}
+
+/**
+ * @brief Times destroy_mm on a fully populated 16 MiB anonymous VMA.
+ * @param gather Batch invalidations and frame frees through mmu_gather.
+ * @param live   Run with the address space loaded in CR3 and every page
+ *               touched, as when a process exits, so the TLB really holds
+ *               its entries; otherwise the teardown needs no TLB work.
+ */
+static void kbench_teardown(bool gather, bool live) {
+    const char *workload = live ? (gather ? "teardown_live_gather" : "teardown_live_nogather")
+                                : (gather ? "teardown_gather" : "teardown_nogather");
+    char line[160];
+    uint32_t n = 0;
+    mmu_gather_stats_t before, after;
+    bool was_enabled = mmu_gather_set_enabled(gather);
+    mmu_gather_get_stats(&before);
+
+    for (int round = 0; round < KBENCH_TEARDOWN_ROUNDS; round++) {
+        uintptr_t pd_phys = kbench_new_pd(live);
+        if (!pd_phys) break;
+        mm_struct_t *mm = create_mm((uint32_t *)pd_phys);
+        uintptr_t end = KBENCH_STORM_BASE + KBENCH_STORM_PAGES * PAGE_SIZE;
+        vma_struct_t *vma = mm ? insert_vma(mm, KBENCH_STORM_BASE, end,
+                                            VM_READ | VM_WRITE | VM_USER | VM_ANONYMOUS,
+                                            PTE_USER_DATA_FLAGS, NULL, 0) : NULL;
+        if (!vma) {
+            if (mm) destroy_mm(mm);
+            put_frame(pd_phys);
+            break;
+        }
+        uint32_t old_cr3 = kbench_read_cr3();
+        if (live) kbench_write_cr3((uint32_t)pd_phys);
+        for (uint32_t i = 0; i < KBENCH_STORM_PAGES; i++) {
+            uintptr_t va = KBENCH_STORM_BASE + i * PAGE_SIZE;
+            if (handle_vma_fault(mm, vma, va, PAGE_FAULT_WRITE) != 0) break;
+            if (live) (void)*(volatile uint32_t *)va; // Pull the translation into the TLB
+        }
+
+        uint64_t t0 = kbench_rdtsc();
+        destroy_mm(mm);
+        uint64_t t1 = kbench_rdtsc();
+        s_free_samples[n++] = kbench_sample(t0, t1);
+
+        if (live) kbench_write_cr3(old_cr3);
+        put_frame(pd_phys);
+    }
+
+    mmu_gather_get_stats(&after);
+    mmu_gather_set_enabled(was_enabled);
+    kbench_report("mm", workload, "destroy", s_free_samples, n);
+    snprintf(line, sizeof(line), "# mm %s cr3_reloads=%u invlpg_pages=%u frames=%u\n", workload,
+             (unsigned)(after.cr3_reloads - before.cr3_reloads),
+             (unsigned)(after.invlpg_pages - before.invlpg_pages),
+             (unsigned)(after.frames_freed - before.frames_freed));
+    serial_write(line);
+}
+
+void kbench_teardown_suite(void) {
+    kbench_teardown(false, false);
+    kbench_teardown(true, false);
+    kbench_teardown(false, true);
+    kbench_teardown(true, true);
+}
+
+/**
+ * @brief Reads KBENCH_BLOCK_BYTES sequentially from the start of the disk in
+ * KBENCH_BLOCK_CHUNK requests, with DMA either allowed or forced off.
+ */
+static void kbench_block_seq_read(block_device_t *dev, bool dma) {
+    char line[96];
+    const char *op = dma ? "dma" : "pio";
+    uint32_t sectors = KBENCH_BLOCK_CHUNK / dev->sector_size;
+    uint32_t chunks = KBENCH_BLOCK_BYTES / KBENCH_BLOCK_CHUNK;
+    if ((uint64_t)chunks * sectors > dev->total_sectors) {
+        chunks = (uint32_t)(dev->total_sectors / sectors);
+    }
+
+    void *buf = kmalloc(KBENCH_BLOCK_CHUNK);
+    if (!buf) { serial_write("# ata: no buffer\n"); return; }
+
+    bool was_enabled = block_device_set_dma_enabled(dma);
+    uint64_t total = 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < chunks && n < KBENCH_MAX_SAMPLES; i++) {
+        uint64_t t0 = kbench_rdtsc();
+        int r = block_device_read(dev, (uint64_t)i * sectors, buf, sectors);
+        uint64_t t1 = kbench_rdtsc();
+        if (r != BLOCK_ERR_OK) break;
+        total += t1 - t0;
+        s_alloc_samples[n++] = kbench_sample(t0, t1);
+    }
+    block_device_set_dma_enabled(was_enabled);
+    kfree(buf);
+
+    kbench_report("ata", "seq_read_64k", op, s_alloc_samples, n);
+    if (n > 0 && total > 0 && s_tsc_khz > 0) {
+        uint64_t kib = (uint64_t)n * (KBENCH_BLOCK_CHUNK / 1024);
+        uint32_t kib_per_sec = (uint32_t)((kib * s_tsc_khz * 1000ull) / total);
+        snprintf(line, sizeof(line), "# ata seq_read_64k %s kib_per_sec=%u\n", op, (unsigned)kib_per_sec);
+        serial_write(line);
+    }
+}
+
+void kbench_block_suite(void) {
+    static block_device_t dev; // Second handle on the mounted root disk; only read here
+    if (block_device_init(ROOT_DEVICE_NAME, &dev) != BLOCK_ERR_OK) {
+        serial_write("# ata: " ROOT_DEVICE_NAME " not available\n");
+        return;
+    }
+    if (!dev.dma_supported) serial_write("# ata: DMA not available, both rows use PIO\n");
+    kbench_block_seq_read(&dev, false);
+    kbench_block_seq_read(&dev, true);
+}
+
+/**
+ * @brief A long sequential read through the buffer cache with a metadata
+ * lookup every KBENCH_BCACHE_META_EVERY blocks, with 2Q or plain LRU
+ * replacement. Starts from an empty cache with the hot set loaded once.
+ */
+static void kbench_bcache_mixed(uint32_t dev_id, bool scan_resistant) {
+    char line[96];
+    const char *op = scan_resistant ? "2q" : "lru";
+    bool was_enabled = buffer_cache_set_scan_resistant(scan_resistant);
+    buffer_invalidate_device(dev_id);
+
+    for (uint32_t i = 0; i < KBENCH_BCACHE_HOT; i++) {
+        buffer_t *b = buffer_get(dev_id, i);
+        if (b) buffer_release(b);
+    }
+
+    buffer_cache_stats_t before, after;
+    buffer_cache_get_stats(&before);
+    uint32_t n = 0;
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < KBENCH_BCACHE_STREAM; i++) {
+        uint64_t t0 = kbench_rdtsc();
+        buffer_t *b = buffer_get(dev_id, KBENCH_BCACHE_STREAM_LBA + i);
+        uint64_t t1 = kbench_rdtsc();
+        if (!b) break;
+        buffer_release(b);
+        s_alloc_samples[n++] = kbench_sample(t0, t1);
+
+        if (i % KBENCH_BCACHE_META_EVERY == KBENCH_BCACHE_META_EVERY - 1) {
+            t0 = kbench_rdtsc();
+            b = buffer_get(dev_id, m % KBENCH_BCACHE_HOT);
+            t1 = kbench_rdtsc();
+            if (!b) break;
+            buffer_release(b);
+            s_free_samples[m++] = kbench_sample(t0, t1);
+        }
+    }
+    buffer_cache_get_stats(&after);
+    buffer_cache_set_scan_resistant(was_enabled);
+
+    kbench_report("bcache", "meta_get", op, s_free_samples, m);
+    kbench_report("bcache", "stream_get", op, s_alloc_samples, n);
+    if (m > 0) {
+        // Streamed blocks are all distinct, so every hit is a metadata hit
+        uint32_t hits = after.hits - before.hits;
+        uint32_t ghost_hits = 0;
+        for (uint32_t i = 0; i < BUFFER_CACHE_SHARDS; i++) {
+            ghost_hits += after.shards[i].ghost_hits - before.shards[i].ghost_hits;
+        }
+        snprintf(line, sizeof(line), "# bcache mixed %s meta_hit_pct=%u ghost_hits=%u evictions=%u\n", op,
+                 (unsigned)((hits * 100u) / m), (unsigned)ghost_hits,
+                 (unsigned)(after.evictions - before.evictions));
+        serial_write(line);
+    }
+}
+
+void kbench_bcache_suite(void) {
+    uint32_t dev_id = buffer_device_id(ROOT_DEVICE_NAME);
+    if (dev_id == 0) {
+        serial_write("# bcache: " ROOT_DEVICE_NAME " not registered\n");
+        return;
+    }
+    buffer_cache_sync(); // Invalidation below drops cached data, dirty or not
+    kbench_bcache_mixed(dev_id, false);
+    kbench_bcache_mixed(dev_id, true);
+}
+
+/**
+ * @brief Opens (and closes) an existing and a missing path repeatedly with
+ * the dentry cache off or on.
+ */
+static void kbench_dcache_open(bool enabled) {
+    char line[96];
+    const char *op = enabled ? "cached" : "uncached";
+    bool was_enabled = dcache_set_enabled(enabled);
+
+    dcache_stats_t before, after;
+    dcache_get_stats(&before);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < KBENCH_DCACHE_OPENS; i++) {
+        uint64_t t0 = kbench_rdtsc();
+        file_t *f = vfs_open(KBENCH_DCACHE_PATH, O_RDONLY);
+        uint64_t t1 = kbench_rdtsc();
+        if (!f) break;
+        vfs_close(f);
+        s_alloc_samples[n++] = kbench_sample(t0, t1);
+    }
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < KBENCH_DCACHE_OPENS; i++) {
+        uint64_t t0 = kbench_rdtsc();
+        file_t *f = vfs_open(KBENCH_DCACHE_MISSING, O_RDONLY);
+        uint64_t t1 = kbench_rdtsc();
+        if (f) { vfs_close(f); break; }
+        s_free_samples[m++] = kbench_sample(t0, t1);
+    }
+    dcache_get_stats(&after);
+    dcache_set_enabled(was_enabled);
+
+    kbench_report("dcache", "open_hit", op, s_alloc_samples, n);
+    kbench_report("dcache", "open_missing", op, s_free_samples, m);
+    snprintf(line, sizeof(line), "# dcache %s hits=%u negative_hits=%u misses=%u\n", op,
+             (unsigned)(after.hits - before.hits),
+             (unsigned)(after.negative_hits - before.negative_hits),
+             (unsigned)(after.misses - before.misses));
+    serial_write(line);
+}
+
+void kbench_dcache_suite(void) {
+    kbench_dcache_open(false);
+    kbench_dcache_open(true);
+}
+
+/**
+ * @brief Creates and destroys a user process from one executable repeatedly.
+ * The process is never scheduled, so "create" is the cost of exec up to the
+ * first instruction: PCB, page directory, stacks and the ELF load. Also
+ * prints the most memory one new process held before running.
+ */
+static void kbench_exec(const char *path, const char *workload) {
+    char line[96];
+    uint32_t n = 0;
+    size_t max_committed = 0;
+    for (uint32_t i = 0; i < KBENCH_EXEC_ROUNDS; i++) {
+        size_t free_before = buddy_free_space();
+        uint64_t t0 = kbench_rdtsc();
+        pcb_t *proc = create_user_process(path);
+        uint64_t t1 = kbench_rdtsc();
+        if (!proc) break;
+        size_t free_after = buddy_free_space();
+        if (free_before > free_after && free_before - free_after > max_committed) {
+            max_committed = free_before - free_after;
+        }
+        uint64_t t2 = kbench_rdtsc();
+        destroy_process(proc);
+        uint64_t t3 = kbench_rdtsc();
+        s_alloc_samples[n] = kbench_sample(t0, t1);
+        s_free_samples[n] = kbench_sample(t2, t3);
+        n++;
+    }
+    if (n == 0) {
+        snprintf(line, sizeof(line), "# exec: cannot create a process from %s\n", path);
+        serial_write(line);
+        return;
+    }
+    kbench_report("exec", workload, "create", s_alloc_samples, n);
+    kbench_report("exec", workload, "destroy", s_free_samples, n);
+    snprintf(line, sizeof(line), "# exec %s committed_kib=%lu\n", workload,
+             (unsigned long)(max_committed / 1024));
+    serial_write(line);
+}
+
+void kbench_exec_suite(void) {
+    kbench_exec(KBENCH_EXEC_SMALL, "hello");
+    kbench_exec(KBENCH_EXEC_LARGE, "bigelf");
+}
+
+void kbench_run_boot(void) {
+    char line[80];
+    terminal_write("[Bench] Running boot-time benchmarks (results on COM1)...\n");
+    kbench_calibrate();
+    kbench_calibrate_tsc_khz();
+
+    serial_write("BENCH-BEGIN\n");
+    snprintf(line, sizeof(line), "# rdtsc_overhead_cyc=%u tsc_khz=%u\n",
+             (unsigned)s_tsc_overhead, (unsigned)s_tsc_khz);
+    serial_write(line);
+    serial_write("# layer,workload,op,count,avg_cyc,p50_cyc,p99_cyc,max_cyc\n");
+    kbench_alloc_suite();
+    kbench_frame_suite();
+    kbench_teardown_suite();
+
+    terminal_write("[Bench] Boot-time benchmarks done.\n");
+}
+
+void kbench_run_late(void) {
+    terminal_write("[Bench] Running device benchmarks (results on COM1)...\n");
+    kbench_block_suite();
+    kbench_bcache_suite();
+    kbench_dcache_suite();
+    kbench_exec_suite();
+    serial_write("BENCH-END\n");
+
+    terminal_write("[Bench] Done.\n");
+}
+
+#endif // KERNEL_BENCH
@@ -34,11 +34,16 @@
 #include "kmalloc.h"
 #include "process.h"
 #include "scheduler.h"
+#include "smp.h"
 #include "syscall.h"
 #include "vfs.h"
 #include "mount.h"
 #include "fs_init.h"
 #include "fs_errno.h"
+#include "buffer_cache.h"
+#ifdef KERNEL_BENCH
+#include "kbench.h"
+#endif
 
 // === Drivers ===
 #include "pit.h"
@@ -64,6 +69,10 @@
 // Path for the initial test program and the system shell
 #define INITIAL_TEST_PROGRAM_PATH "/hello.elf"
 #define SYSTEM_SHELL_PATH         "/bin/shell.elf"
+#define FORK_BENCH_PROGRAM_PATH   "/forkbench.elf"
+#define SCHED_BENCH_PROGRAM_PATH  "/schedbench.elf"
+#define SMP_BENCH_PROGRAM_PATH    "/smpbench.elf"
+#define SYSCALL_BENCH_PROGRAM_PATH "/syscallbench.elf"
 
 // === Linker Symbols (Physical Addresses) ===
 extern uint8_t _kernel_start_phys;
@@ -81,7 +90,8 @@ static bool parse_memory_map_for_heap(struct multiboot_tag_mmap *mmap_tag,
                                       uintptr_t *out_total_mem_span,
                                       uintptr_t *out_heap_base, size_t *out_heap_size);
 static bool initialize_memory_management(uint32_t mb_info_phys); // Corrected name
-static void launch_program(const char *path_on_disk, const char *program_description);
+static uint32_t launch_program(const char *path_on_disk, const char *program_description, uint32_t parent_pid);
+static void launch_user_programs(void);
 
 //-----------------------------------------------------------------------------
 // Multiboot Information Parsing (Physical & Virtual)
@@ -126,6 +136,16 @@ static struct multiboot_tag *find_multiboot_tag_virt(uintptr_t mb_info_virt, uin
     return NULL;
 }
 
+/** @brief The RSDP the boot loader copied into the Multiboot info, or NULL (smp_init then scans the BIOS areas). */
+static const void *find_acpi_rsdp(void) {
+    struct multiboot_tag_new_acpi *new_acpi = (struct multiboot_tag_new_acpi *)
+        find_multiboot_tag_virt(g_multiboot_info_virt_addr_global, MULTIBOOT_TAG_TYPE_ACPI_NEW);
+    if (new_acpi) return new_acpi->rsdp;
+    struct multiboot_tag_old_acpi *old_acpi = (struct multiboot_tag_old_acpi *)
+        find_multiboot_tag_virt(g_multiboot_info_virt_addr_global, MULTIBOOT_TAG_TYPE_ACPI_OLD);
+    return old_acpi ? old_acpi->rsdp : NULL;
+}
+
 //-----------------------------------------------------------------------------
 // Memory Initialization
 //-----------------------------------------------------------------------------
@@ -288,22 +308,70 @@ static bool initialize_memory_management(uint32_t mb_info_phys) { // Corrected n
 //-----------------------------------------------------------------------------
 // Initial Process Launch Helper
 //-----------------------------------------------------------------------------
-static void launch_program(const char *path_on_disk, const char *program_description) {
+/**
+ * @brief Creates and schedules a user process from @p path_on_disk.
+ * @param parent_pid PID that may waitpid() on it, or IDLE_TASK_PID for none.
+ * @return The new PID, or 0 if the process could not be started.
+ */
+static uint32_t launch_program(const char *path_on_disk, const char *program_description, uint32_t parent_pid) {
     terminal_printf("[Kernel] Attempting to launch %s from '%s'...\n", program_description, path_on_disk);
     pcb_t *proc_pcb = create_user_process(path_on_disk);
 
     if (proc_pcb) {
+        proc_pcb->parent_pid = parent_pid; // Set before the task can run and exit
+        uint32_t pid = proc_pcb->pid;
         if (scheduler_add_task(proc_pcb) == 0) {
-            terminal_printf("  [OK] %s (PID %lu) scheduled successfully.\n", program_description, (unsigned long)proc_pcb->pid);
-        } else {
-            terminal_printf("  [ERROR] Failed to add %s (PID %lu) to scheduler!\n", program_description, (unsigned long)proc_pcb->pid);
-            destroy_process(proc_pcb);
+            terminal_printf("  [OK] %s (PID %lu) scheduled successfully.\n", program_description, (unsigned long)pid);
+            return pid;
         }
+        terminal_printf("  [ERROR] Failed to add %s (PID %lu) to scheduler!\n", program_description, (unsigned long)pid);
+        destroy_process(proc_pcb);
     } else {
         terminal_printf("  [ERROR] Failed to create process for %s from '%s'.\n", program_description, path_on_disk);
     }
+    return 0;
+}
+
+/** @brief Launches the test suite and the shell. */
+static void launch_user_programs(void) {
+    launch_program(INITIAL_TEST_PROGRAM_PATH, "Test Suite", IDLE_TASK_PID);
+    terminal_write("[Kernel Debug] KBC Status after hello.elf launch: 0x");
+    serial_print_hex(inb(KBC_STATUS_PORT));
+    serial_write("\n");
+    launch_program(SYSTEM_SHELL_PATH, "System Shell", IDLE_TASK_PID);
 }
 
+#ifdef KERNEL_BENCH
+/**
+ * @brief Kernel thread that runs the user-space benchmarks one at a time.
+ * Each bench starts only after the previous one has exited, so they never
+ * compete for CPUs and skew each other's numbers; the test suite and shell
+ * follow once the last one is done.
+ */
+static void bench_runner_thread(void) {
+    static const struct { const char *path; const char *description; } benches[] = {
+        { FORK_BENCH_PROGRAM_PATH,    "fork() Benchmark" },
+        { SCHED_BENCH_PROGRAM_PATH,   "Scheduling Latency Benchmark" },
+        { SMP_BENCH_PROGRAM_PATH,     "SMP Scaling Benchmark" },
+        { SYSCALL_BENCH_PROGRAM_PATH, "System Call Entry Benchmark" },
+    };
+    uint32_t self = get_current_task()->pid;
+
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        uint32_t pid = launch_program(benches[i].path, benches[i].description, self);
+        if (pid == 0) continue;
+        uint32_t exit_code = 0;
+        if (scheduler_reap_child(self, pid, &exit_code) == 0) {
+            terminal_printf("[Kernel] %s (PID %lu) finished with code %lu.\n",
+                            benches[i].description, (unsigned long)pid, (unsigned long)exit_code);
+        }
+    }
+
+    launch_user_programs();
+    remove_current_task_with_code(0); // A kernel thread must not return
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Kernel Main Entry Point
 //-----------------------------------------------------------------------------
@@ -328,6 +396,9 @@ void main(uint32_t magic, uint32_t mb_info_phys_addr) {
     terminal_write("[Kernel] Initializing core systems (pre-interrupts)...\n");
     gdt_init();
     initialize_memory_management(g_multiboot_info_phys_addr_global); // Corrected function name call
+#ifdef KERNEL_BENCH
+    kbench_run_boot();
+#endif
     idt_init();
     init_pit();
     keyboard_init();
@@ -336,6 +407,9 @@ void main(uint32_t magic, uint32_t mb_info_phys_addr) {
 
     terminal_write("[Kernel] Initializing Filesystem Layer...\n");
     bool fs_ready = (fs_init() == FS_SUCCESS);
+#ifdef KERNEL_BENCH
+    kbench_run_late();
+#endif
     if (fs_ready) {
         terminal_write("  [OK] Filesystem initialized and root mounted.\n");
     } else {
@@ -346,11 +420,20 @@ void main(uint32_t magic, uint32_t mb_info_phys_addr) {
     serial_write("\n");
 
     if (fs_ready) {
-        launch_program(INITIAL_TEST_PROGRAM_PATH, "Test Suite");
-        terminal_write("[Kernel Debug] KBC Status after hello.elf launch: 0x");
-        serial_print_hex(inb(KBC_STATUS_PORT));
-        serial_write("\n");
-        launch_program(SYSTEM_SHELL_PATH, "System Shell");
+        // Writes reach the disk in the background from here on
+        if (buffer_cache_start_flusher() != FS_SUCCESS) {
+            terminal_write("  [WARN] Buffer cache flusher not started; data is written on sync/eviction only.\n");
+        }
+#ifdef KERNEL_BENCH
+        pcb_t *runner = create_kernel_thread(bench_runner_thread);
+        if (!runner || scheduler_add_task(runner) != 0) {
+            terminal_write("  [ERROR] Benchmark runner not started; launching user programs directly.\n");
+            if (runner) destroy_process(runner);
+            launch_user_programs();
+        }
+#else
+        launch_user_programs();
+#endif
         terminal_write("[Kernel Debug] KBC Status before final sti: 0x");
         serial_print_hex(inb(KBC_STATUS_PORT));
         serial_write("\n");
@@ -402,6 +485,8 @@ void main(uint32_t magic, uint32_t mb_info_phys_addr) {
     terminal_write("[Kernel] Finalizing setup and enabling interrupts...\n");
     syscall_init();
     scheduler_start();
+    // Starts the other CPUs, which pick up work from here on
+    smp_init(find_acpi_rsdp());
     terminal_printf("\n[Kernel] Initialization complete. UiAOS %s operational. Enabling interrupts.\n", KERNEL_VERSION_STRING);
     terminal_write("================================================================================\n\n");
 
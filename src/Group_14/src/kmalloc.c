@@ -10,6 +10,7 @@
  #include "terminal.h"
  #include "types.h"
  #include "paging.h" // For PAGE_SIZE definition
+ #include "frame.h"  // For frame_alloc_run (large-object page runs)
  #include <libc/stdint.h> // Corrected include path
 
  
@@ -57,24 +58,43 @@
  static uint32_t g_kmalloc_slab_alloc_count = 0;
  static uint32_t g_kmalloc_slab_free_count = 0;
  
+ // Size -> class lookup, one entry per KMALLOC_LUT_GRANULE bytes of total size
+ #define KMALLOC_LUT_SHIFT 3
+ #define KMALLOC_LUT_GRANULE (1u << KMALLOC_LUT_SHIFT)
+ #define KMALLOC_LUT_ENTRIES ((ALIGN_UP(KALLOC_HEADER_SIZE + SLAB_ALLOC_MAX_USER_SIZE, KMALLOC_MIN_ALIGNMENT) >> KMALLOC_LUT_SHIFT) + 2)
+ static uint8_t g_kmalloc_class_lut[KMALLOC_LUT_ENTRIES];
+ static size_t g_kmalloc_lut_max_total = 0;
+
+ /**
+  * @brief Fills g_kmalloc_class_lut from the created caches' slot sizes.
+  * Entry k holds the smallest class whose slot fits every total size in
+  * ((k-1)*granule, k*granule], or 0xFF if none does.
+  */
+ static void kmalloc_build_class_lut(void) {
+     g_kmalloc_lut_max_total = 0;
+     for (size_t k = 0; k < KMALLOC_LUT_ENTRIES; k++) {
+         size_t bucket_max = k << KMALLOC_LUT_SHIFT;
+         g_kmalloc_class_lut[k] = 0xFF;
+         for (size_t i = 0; i < NUM_KMALLOC_SIZE_CLASSES; i++) {
+             if (global_slab_caches[i] && global_slab_caches[i]->internal_slot_size >= bucket_max) {
+                 g_kmalloc_class_lut[k] = (uint8_t)i;
+                 g_kmalloc_lut_max_total = bucket_max;
+                 break;
+             }
+         }
+     }
+ }
+
  /**
   * @brief Finds smallest global slab cache for the *total* size needed.
+  * Constant time: one table lookup indexed by the rounded-up size.
   * @param total_required_size Size needed (user + header, aligned).
   * @return Pointer to the slab_cache_t, or NULL.
   */
  static slab_cache_t* get_global_slab_cache(size_t total_required_size) {
-     for (size_t i = 0; i < NUM_KMALLOC_SIZE_CLASSES; i++) {
-          // Check if the cache exists and its object size is sufficient
-          if (global_slab_caches[i] && global_slab_caches[i]->internal_slot_size >= total_required_size) {
-             // Check if this cache is the *best* fit (i.e., previous wasn't smaller and sufficient)
-             // This assumes kmalloc_user_size_classes maps directly to cache suitability.
-             // A more robust check might compare internal_slot_size directly.
-             if (i == 0 || !global_slab_caches[i-1] || global_slab_caches[i-1]->internal_slot_size < total_required_size) {
-                 return global_slab_caches[i];
-             }
-          }
-     }
-     return NULL; // No suitable cache found
+     if (total_required_size > g_kmalloc_lut_max_total) return NULL;
+     uint8_t idx = g_kmalloc_class_lut[(total_required_size + KMALLOC_LUT_GRANULE - 1) >> KMALLOC_LUT_SHIFT];
+     return (idx == 0xFF) ? NULL : global_slab_caches[idx];
  }
  #endif // !USE_PERCPU_ALLOC
  
@@ -107,6 +127,21 @@
     return power_of_2;
 }
  
+ /**
+  * @brief Allocates a large object as a run of whole pages from the frame allocator.
+  * The returned pointer is page-aligned and carries no in-band header; kfree()
+  * recovers the length from the page-run descriptor array.
+  * @param user_size Requested size in bytes.
+  * @return Page-aligned kernel virtual address, or NULL on failure.
+  */
+ static void *kmalloc_large(size_t user_size) {
+     if (user_size > SIZE_MAX - (PAGE_SIZE - 1)) return NULL;
+     size_t npages = ALIGN_UP(user_size, PAGE_SIZE) / PAGE_SIZE;
+     uintptr_t phys = frame_alloc_run(npages);
+     if (!phys) return NULL;
+     return (void *)(phys + KERNEL_SPACE_VIRT_START);
+ }
+
  //----------------------------------------------------------------------------
  // Public API Implementation
  //----------------------------------------------------------------------------
@@ -154,6 +189,7 @@
               }
          }
      }
+     kmalloc_build_class_lut();
      if (!overall_success) {
          terminal_write("[kmalloc] Warning: Some global slab caches failed to initialize.\n");
      } else {
@@ -199,6 +235,13 @@
 #endif
     }
 
+    // Large-object path: whole page runs, size kept in the page-run descriptors
+    if (user_size > SLAB_ALLOC_MAX_USER_SIZE) {
+        void *large = kmalloc_large(user_size);
+        if (large) return large;
+        // Run allocation unavailable (early boot or no contiguous pages), fall back to buddy
+    }
+
     // Buddy Allocator Path
     actual_alloc_size = buddy_get_expected_allocation_size(total_required_size);
     if (actual_alloc_size == SIZE_MAX) { return NULL; } // Use SIZE_MAX check
@@ -227,6 +270,19 @@ allocation_success:
  
 void kfree(void *ptr) {
     if (ptr == NULL) return;
+
+    // Page-aligned pointers can only come from the large-object path: every other
+    // allocation is preceded by a kmalloc header inside the same block.
+    if (((uintptr_t)ptr & (PAGE_SIZE - 1)) == 0) {
+        uintptr_t phys = (uintptr_t)ptr - KERNEL_SPACE_VIRT_START;
+        if (frame_run_pages(phys) == 0) {
+            terminal_printf("[kfree] Error: Page-aligned pointer %p is not a kmalloc page run!\n", ptr);
+            return;
+        }
+        frame_free_run(phys);
+        return;
+    }
+
     kmalloc_header_t *header = (kmalloc_header_t *)((uintptr_t)ptr - KALLOC_HEADER_SIZE);
     void* original_alloc_ptr = (void*)header;
 
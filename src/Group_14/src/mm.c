@@ -11,8 +11,10 @@
  #include "terminal.h"   // For logging (terminal_printf)
  #include "buddy.h"      // Underlying physical allocator (called by frame allocator) - Needed indirectly
  #include "frame.h"      // Frame allocator header (frame_alloc, put_frame, get_frame_refcount)
+ #include "mmu_gather.h" // Batched TLB invalidation for unmap/teardown
  #include "paging.h"     // For mapping pages, flags, KERNEL_SPACE_VIRT_START, paging_temp_map/unmap, paging_invalidate_page, paging_unmap_range
- #include "vfs.h"        // For file_t definition (though not used directly here, included for completeness)
+ #include "vfs.h"        // file_t, vfs_file_dup/vfs_close for file-backed VMAs
+ #include "pagecache.h"  // pagecache_get_page (file-backed faults)
  #include "fs_errno.h"   // For error codes (EFAULT, ENOMEM, EPERM, etc.)
  #include "rbtree.h"     // RB Tree header
  #include "process.h"    // For pcb_t, get_current_process
@@ -49,10 +51,16 @@
  // --- Forward Declarations ---
  static vma_struct_t* find_vma_locked(mm_struct_t *mm, uintptr_t addr);
  static vma_struct_t* insert_vma_locked(mm_struct_t *mm, vma_struct_t* new_vma);
- static int remove_vma_range_locked(mm_struct_t *mm, uintptr_t start, size_t length);
+ static int remove_vma_range_locked(mm_struct_t *mm, uintptr_t start, size_t length, vma_struct_t **freed);
  static uint32_t* get_pte_ptr(mm_struct_t *mm, uintptr_t vaddr, bool allocate_pt);
  // <<<--- ADDED FORWARD DECLARATION --->>>
  static void destroy_vma_node_callback(vma_struct_t *vma_node, void *data);
+
+ // Traversal context for destroy_mm: the mm plus the gather shared by all its VMAs
+ typedef struct destroy_mm_ctx {
+     mm_struct_t *mm;
+     mmu_gather_t tlb;
+ } destroy_mm_ctx_t;
  
  
  // --- VMA Struct Allocation Helpers ---
@@ -62,13 +70,23 @@
      return vma;
  }
  
- // Frees the VMA structure and associated resources (like file handle ref count)
+ // Frees the VMA structure and associated resources (like file handle ref count).
+ // Not under mm->lock: dropping the last file reference closes the file, which
+ // takes filesystem mutexes and may write to disk.
  static void free_vma_resources(vma_struct_t* vma) {
      if (!vma) return;
-     // TODO: If file-backed, decrement file reference count (vfs_file_put?)
-     // if (vma->vm_file) { vfs_file_put(vma->vm_file); } // Assuming vfs_file_put exists
+     if (vma->vm_file) { vfs_close(vma->vm_file); } // Drop the VMA's file reference
      kfree(vma); // Free the vma_struct itself
  }
+
+ // Frees the VMAs remove_vma_range_locked unlinked, after mm->lock is released
+ static void free_vma_list(vma_struct_t *list) {
+     while (list) {
+         vma_struct_t *next = list->free_next;
+         free_vma_resources(list);
+         list = next;
+     }
+ }
  
  // --- MM Struct Management ---
  
@@ -115,8 +133,13 @@
  
      if (root) {
          serial_write("[destroy_mm] Traversing VMA tree...\n"); // <-- Logging
-         // Perform post-order traversal of RB Tree to unmap and free nodes
-         rbtree_postorder_traverse(root, destroy_vma_node_callback, mm); // Pass mm for context
+         // Perform post-order traversal of RB Tree to unmap and free nodes.
+         // One gather for the whole address space: a single TLB flush at the end
+         // (none if this mm is not loaded) and frames freed in batches.
+         destroy_mm_ctx_t ctx = { .mm = mm };
+         if (mm->pgd_phys) mmu_gather_init(&ctx.tlb, mm->pgd_phys, true);
+         rbtree_postorder_traverse(root, destroy_vma_node_callback, &ctx);
+         if (mm->pgd_phys) mmu_gather_finish(&ctx.tlb);
          serial_write("[destroy_mm] VMA traversal complete.\n"); // <-- Logging
      } else {
          serial_write("[destroy_mm] VMA tree is empty, skipping traversal.\n"); // <-- Logging
@@ -132,7 +155,8 @@
  // Helper callback for destroy_mm traversal
  // (Includes logging added previously)
  static void destroy_vma_node_callback(vma_struct_t *vma_node, void *data) {
-    mm_struct_t *mm = (mm_struct_t*)data;
+    destroy_mm_ctx_t *ctx = (destroy_mm_ctx_t*)data;
+    mm_struct_t *mm = ctx ? ctx->mm : NULL;
     if (!vma_node) {
         serial_write("[destroy_vma_cb] Warning: Callback invoked with NULL vma_node.\n");
         return;
@@ -163,7 +187,7 @@
         // Only proceed if size is greater than 0, as paging_unmap_range handles 0 size internally now.
         int ret = 0; // Assume success for zero size
         if (vma_size > 0) {
-            ret = paging_unmap_range(mm->pgd_phys, vma_node->vm_start, vma_size);
+            ret = paging_unmap_range_gather(&ctx->tlb, vma_node->vm_start, vma_size);
         } else {
             // If size is 0, no unmapping needed, but log it for clarity if desired
             serial_write("  Skipping paging_unmap_range for zero-sized VMA.\n");
@@ -274,7 +298,7 @@
      vma->vm_end = end;
      vma->vm_flags = vm_flags;
      vma->page_prot = page_prot;
-     vma->vm_file = file; // Note: This doesn't take ownership or increment refcount here
+     vma->vm_file = file ? vfs_file_dup(file) : NULL; // The VMA holds its own file reference
      vma->vm_offset = offset;
      vma->vm_mm = mm;
      // RB node fields initialized by rb_tree_insert_at
@@ -284,15 +308,59 @@
      spinlock_release_irqrestore(&mm->lock, irq_flags);
  
      if (!result) {
-         free_vma_resources(vma); // Free struct if insertion failed
+         free_vma_resources(vma); // Free struct (and file reference) if insertion failed
          return NULL;
      }
-     // TODO: If file-backed, increment file reference count NOW (e.g., vfs_file_dup(file))
-     // if (vma->vm_file) { vfs_file_dup(vma->vm_file); } // Requires vfs_file_dup
      return result;
  }
  
  
+ /**
+  * Clones src's VMAs and page mappings into a new mm_struct (fork).
+  */
+ mm_struct_t *copy_mm(mm_struct_t *src, uint32_t *dst_pgd_phys) {
+     if (!src || !src->pgd_phys || !dst_pgd_phys) return NULL;
+
+     mm_struct_t *dst = create_mm(dst_pgd_phys);
+     if (!dst) return NULL;
+
+     int ret = 0;
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&src->lock);
+     for (struct rb_node *node = rb_tree_first(&src->vma_tree); node; node = rb_node_next(node)) {
+         vma_struct_t *vma = rb_entry(node, vma_struct_t, rb_node);
+         vma_struct_t *copy = alloc_vma_struct();
+         if (!copy) { ret = -FS_ERR_OUT_OF_MEMORY; break; }
+         copy->vm_start = vma->vm_start;
+         copy->vm_end = vma->vm_end;
+         copy->vm_flags = vma->vm_flags;
+         copy->page_prot = vma->page_prot;
+         copy->vm_file = vma->vm_file ? vfs_file_dup(vma->vm_file) : NULL;
+         copy->vm_offset = vma->vm_offset;
+         if (!insert_vma_locked(dst, copy)) {
+             free_vma_resources(copy);
+             ret = -FS_ERR_INTERNAL;
+             break;
+         }
+         // Page tables only: frames are shared and write-protected, never copied here
+         bool cow = (vma->vm_flags & VM_WRITE) && !(vma->vm_flags & VM_SHARED);
+         ret = paging_copy_range_cow(dst_pgd_phys, src->pgd_phys, vma->vm_start, vma->vm_end, cow);
+         if (ret != 0) break;
+     }
+     dst->start_code = src->start_code; dst->end_code = src->end_code;
+     dst->start_data = src->start_data; dst->end_data = src->end_data;
+     dst->start_brk = src->start_brk;   dst->end_brk = src->end_brk;
+     dst->start_stack = src->start_stack;
+     spinlock_release_irqrestore(&src->lock, irq_flags);
+
+     if (ret != 0) {
+         terminal_printf("[MM] copy_mm: failed (code %d), tearing down partial copy.\n", ret);
+         destroy_mm(dst); // Unmaps whatever was copied into dst_pgd_phys
+         return NULL;
+     }
+     return dst;
+ }
+
+
  // --- Page Fault Handling ---
  
  // get_pte_ptr helper function (maps PD/PT temporarily)
@@ -336,8 +404,8 @@
              goto fail_gpp; // PT doesn't exist, fail
          }
  
-         // Allocate a new frame for the Page Table
-         pt_phys_addr_val = frame_alloc();
+         // Allocate a new, already zeroed frame for the Page Table
+         pt_phys_addr_val = frame_alloc_zeroed();
          if (pt_phys_addr_val == 0) {
              terminal_printf("[get_pte_ptr] Error: Failed to allocate frame for new PT (PDE[%lu]).\n", (unsigned long)pd_idx);
              goto fail_gpp;
@@ -345,15 +413,6 @@
          allocated_pt_frame = true;
          // terminal_printf("[get_pte_ptr] Allocated new PT frame %#lx for PDE[%lu]\n", pt_phys_addr_val, pd_idx);
  
-         // Map the NEW PT frame temporarily to zero it out
-         void* temp_pt_zero_map = paging_temp_map(pt_phys_addr_val, PTE_KERNEL_DATA_FLAGS);
-         if (!temp_pt_zero_map) {
-             terminal_printf("[get_pte_ptr] Error: Failed to temp map new PT frame %#lx for zeroing.\n", (unsigned long)pt_phys_addr_val);
-             goto fail_gpp; // Free frame in cleanup
-         }
-         memset(temp_pt_zero_map, 0, PAGE_SIZE);
-         paging_temp_unmap(temp_pt_zero_map); // Unmap after zeroing
- 
          // Set the PDE in the temporarily mapped target PD
          // Use USER flags if the eventual PTE will need them (most flexible)
          uint32_t pde_flags = PAGE_PRESENT | PAGE_RW | PAGE_USER; // Common flags for a PT PDE
@@ -361,9 +420,12 @@
          // TLB invalidation is handled by caller or context switch
  
      } else if (pde & PAGE_SIZE_4MB) {
-         // Cannot get a PTE pointer if the PDE maps a 4MB page
-         terminal_printf("[get_pte_ptr] Error: Cannot get PTE for V=%p; PDE[%lu] is a 4MB page.\n", (void*)vaddr, (unsigned long)pd_idx);
-         goto fail_gpp;
+         // A 4MB page has no PTE; split it so the caller can work on one 4KB page (e.g. COW)
+         if (paging_split_large_pde(proc_pd_virt, pd_idx) != 0) {
+             terminal_printf("[get_pte_ptr] Error: Cannot get PTE for V=%p; failed to split 4MB PDE[%lu].\n", (void*)vaddr, (unsigned long)pd_idx);
+             goto fail_gpp;
+         }
+         pt_phys_addr_val = (uintptr_t)(proc_pd_virt[pd_idx] & PAGING_ADDR_MASK);
      } else {
          // PDE is present and points to a 4KB Page Table
          pt_phys_addr_val = (uintptr_t)(pde & PAGING_ADDR_MASK);
@@ -402,6 +464,81 @@
      return NULL; // Indicate failure
  }
  
+ /**
+  * @brief Backs the 4MB block around fault_address with one PSE page.
+  * Only used when the block lies entirely inside an anonymous VM_HUGEPAGE VMA
+  * and nothing is mapped there yet; otherwise returns -1 and the caller falls
+  * back to a 4KB page. The page is mapped with the VMA's own protection (not
+  * read-only first): a later COW fault splits it through get_pte_ptr().
+  */
+ static int handle_vma_fault_large(mm_struct_t *mm, vma_struct_t *vma, uintptr_t fault_address) {
+     uintptr_t block = PAGE_LARGE_ALIGN_DOWN(fault_address);
+     if (!g_pse_supported || (vma->vm_flags & VM_FILEBACKED) ||
+         block < vma->vm_start || vma->vm_end - block < PAGE_SIZE_LARGE) {
+         return -1;
+     }
+
+     uint32_t *pd_virt = paging_temp_map((uintptr_t)mm->pgd_phys, PTE_KERNEL_READONLY_FLAGS);
+     if (!pd_virt) return -1;
+     uint32_t pde = pd_virt[PDE_INDEX(block)];
+     paging_temp_unmap(pd_virt);
+     if (pde & PAGE_PRESENT) return -1;
+
+     uintptr_t phys = frame_alloc_large_page();
+     if (!phys) return -1;
+
+     if (paging_map_range(mm->pgd_phys, block, phys, PAGE_SIZE_LARGE, vma->page_prot | PAGE_SIZE_4MB) != 0) {
+         for (size_t i = 0; i < PAGES_PER_TABLE; i++) {
+             put_frame(phys + i * PAGE_SIZE);
+         }
+         return -1;
+     }
+     paging_invalidate_page((void*)block);
+     return 0;
+ }
+
+ /**
+  * @brief Maps one page of a file-backed VMA from the page cache.
+  * A read fault maps the cached frame itself, read-only, so every process
+  * mapping the page shares it; a later write to a private mapping then
+  * copies it through the COW path (the cache's reference keeps the count
+  * above 1). A write fault on a private mapping copies straight away rather
+  * than faulting twice. Shared mappings are never writable (see do_mmap).
+  */
+ static int handle_vma_fault_file(mm_struct_t *mm, vma_struct_t *vma, uintptr_t page_addr, bool is_write) {
+     if (!vma->vm_file) return -FS_ERR_INTERNAL;
+     off_t file_offset = (off_t)(vma->vm_offset + (page_addr - vma->vm_start));
+
+     uintptr_t cache_phys = 0;
+     int ret = pagecache_get_page(vma->vm_file, file_offset, &cache_phys);
+     if (ret != FS_SUCCESS) {
+         terminal_printf("[PF File] Error: Page cache read failed for V=%p (err %d)\n", (void*)page_addr, ret);
+         return ret;
+     }
+
+     uintptr_t phys_page = cache_phys;
+     uint32_t map_flags = vma->page_prot & ~PAGE_RW;
+     if (is_write) {
+         phys_page = frame_alloc();
+         if (!phys_page) { put_frame(cache_phys); return -FS_ERR_OUT_OF_MEMORY; }
+         void* temp_src = paging_temp_map(cache_phys, PTE_KERNEL_READONLY_FLAGS);
+         void* temp_dst = paging_temp_map(phys_page, PTE_KERNEL_DATA_FLAGS);
+         if (temp_src && temp_dst) memcpy(temp_dst, temp_src, PAGE_SIZE);
+         if (temp_dst) paging_temp_unmap(temp_dst);
+         if (temp_src) paging_temp_unmap(temp_src);
+         put_frame(cache_phys);
+         if (!temp_src || !temp_dst) { put_frame(phys_page); return -FS_ERR_INTERNAL; }
+         map_flags = vma->page_prot | PAGE_RW;
+     }
+
+     uint32_t* pte_ptr = get_pte_ptr(mm, page_addr, true);
+     if (!pte_ptr) { put_frame(phys_page); return -FS_ERR_IO; }
+     *pte_ptr = (phys_page & PAGING_ADDR_MASK) | map_flags | PAGE_PRESENT;
+     paging_temp_unmap((void*)PAGE_ALIGN_DOWN((uintptr_t)pte_ptr));
+     paging_invalidate_page((void*)page_addr);
+     return 0;
+ }
+
  /**
   * Handles a page fault for a given VMA. Includes COW using reference counting.
   */
@@ -413,7 +550,6 @@
      bool is_write = (error_code & PAGE_FAULT_WRITE) != 0; // Assumes PAGE_FAULT_WRITE is defined (e.g., 0x2)
      bool present = (error_code & PAGE_FAULT_PRESENT) != 0; // Assumes PAGE_FAULT_PRESENT is defined (e.g., 0x1)
      uintptr_t phys_page = 0;       // For allocating new frames
-     void* temp_addr_for_copy = NULL; // For mapping frames for memcpy/memset
  
      // --- Permission Checks (Simplified, assumes VMA lookup already done) ---
      if (is_write && !(vma->vm_flags & VM_WRITE)) return -FS_ERR_PERMISSION_DENIED;
@@ -494,30 +630,19 @@
  
      // --- Handle Non-Present Page Fault (Allocate and Map) ---
      // terminal_printf("[PF Handle] NP Fault: V=%p\n", (void*)fault_address);
-     phys_page = frame_alloc(); // 1. Allocate frame
-     if (!phys_page) { return -FS_ERR_OUT_OF_MEMORY; }
-     // terminal_printf("   Allocated phys frame: %#lx\n", phys_page);
- 
-     // 2. Map frame temporarily into kernel to populate
-     temp_addr_for_copy = paging_temp_map(phys_page, PTE_KERNEL_DATA_FLAGS);
-     if (!temp_addr_for_copy) {
-         put_frame(phys_page); return -FS_ERR_IO;
-     }
- 
-     // 3. Populate frame
      if (vma->vm_flags & VM_FILEBACKED) {
-         terminal_printf("   Populating from file (TODO) V=%p P=%#lx\n", (void*)page_addr, (unsigned long)phys_page);
-         // TODO: Implement file read logic here
-         // Need vma->vm_file, vma->vm_offset, page_addr - vma->vm_start
-         memset(temp_addr_for_copy, 0, PAGE_SIZE); // Placeholder
-     } else { // Anonymous VMA
-         // terminal_printf("   Zeroing anonymous page V=%p P=%#lx\n", (void*)page_addr, phys_page);
-         memset(temp_addr_for_copy, 0, PAGE_SIZE);
+         return handle_vma_fault_file(mm, vma, page_addr, is_write);
      }
+     if ((vma->vm_flags & VM_HUGEPAGE) && handle_vma_fault_large(mm, vma, fault_address) == 0) {
+         return 0;
+     }
+     // 1. Allocate a zero-filled frame (usually pre-zeroed by the idle task,
+     //    so no clear happens on the faulting path)
+     phys_page = frame_alloc_zeroed();
+     if (!phys_page) { return -FS_ERR_OUT_OF_MEMORY; }
+     // terminal_printf("   Allocated phys frame: %#lx\n", phys_page);
  
-     // 4. Unmap temporary kernel mapping
-     paging_temp_unmap(temp_addr_for_copy);
-     temp_addr_for_copy = NULL; // Mark as unmapped
+     // 2-4. Anonymous VMA: frame is already zeroed
  
      // 5. Map frame into process space via PTE
      pte_ptr = get_pte_ptr(mm, page_addr, true); // Allocate PT if needed
@@ -553,8 +678,10 @@
  
  /**
   * remove_vma_range_locked
+  * VMAs that go away are pushed onto *freed rather than freed here; the
+  * caller hands the list to free_vma_list once it has dropped mm->lock.
   */
- static int remove_vma_range_locked(mm_struct_t *mm, uintptr_t start, size_t length) {
+ static int remove_vma_range_locked(mm_struct_t *mm, uintptr_t start, size_t length, vma_struct_t **freed) {
      uintptr_t end = start + length;
      if (start >= end) return -FS_ERR_INVALID_PARAM;
  
@@ -563,6 +690,8 @@
      struct rb_node *node = NULL;
      struct rb_node *next_node = NULL;
      node = rb_tree_first(&mm->vma_tree);
+     mmu_gather_t tlb; // Shared by every overlapping VMA; flushed on every exit below
+     mmu_gather_init(&tlb, mm->pgd_phys, false);
  
      while (node) {
          vma_struct_t *vma = rb_entry(node, vma_struct_t, rb_node);
@@ -584,8 +713,8 @@
          if (overlap_start < overlap_end) {
              // terminal_printf("   Overlap found: VMA [0x%x-0x%x) overlaps request [0x%x-0x%x) => unmap [0x%x-0x%x)\n", vma->vm_start, vma->vm_end, start, end, overlap_start, overlap_end);
  
-             result = paging_unmap_range(mm->pgd_phys, overlap_start, overlap_end - overlap_start);
-             if (result != 0) { return result; } // Stop on error
+             result = paging_unmap_range_gather(&tlb, overlap_start, overlap_end - overlap_start);
+             if (result != 0) { mmu_gather_finish(&tlb); return result; } // Stop on error
  
              bool remove_original = false;
              vma_struct_t* created_second_part = NULL;
@@ -596,8 +725,9 @@
              } else if (vma->vm_start < start && vma->vm_end > end) { // Case 2: Split
                  // terminal_write("     VMA split needed.\n");
                  created_second_part = alloc_vma_struct();
-                 if (!created_second_part) return -FS_ERR_OUT_OF_MEMORY;
+                 if (!created_second_part) { mmu_gather_finish(&tlb); return -FS_ERR_OUT_OF_MEMORY; }
                  memcpy(created_second_part, vma, sizeof(vma_struct_t)); // Copy original VMA data
+                 if (created_second_part->vm_file) vfs_file_dup(created_second_part->vm_file);
                  created_second_part->vm_start = end; // Set new start for second part
                  // Adjust file offset if file-backed
                  if (created_second_part->vm_flags & VM_FILEBACKED) {
@@ -605,7 +735,8 @@
                       size_t diff = end - vma->vm_start;
                       if (created_second_part->vm_offset > SIZE_MAX - diff) {
                            terminal_printf("Warning: VMA split offset overflow!\n"); // Handle error appropriately
-                           free_vma_resources(created_second_part); return -FS_ERR_INVALID_PARAM;
+                           created_second_part->free_next = *freed; *freed = created_second_part;
+                           mmu_gather_finish(&tlb); return -FS_ERR_INVALID_PARAM;
                       }
                       created_second_part->vm_offset += diff;
                  }
@@ -621,7 +752,7 @@
                  if (vma->vm_flags & VM_FILEBACKED) {
                       size_t diff = end - vma->vm_start;
                       if (vma->vm_offset > SIZE_MAX - diff) {
-                          terminal_printf("Warning: VMA shrink offset overflow!\n"); return -FS_ERR_INVALID_PARAM;
+                          terminal_printf("Warning: VMA shrink offset overflow!\n"); mmu_gather_finish(&tlb); return -FS_ERR_INVALID_PARAM;
                       }
                       vma->vm_offset += diff;
                  }
@@ -640,6 +771,7 @@
                       // If not starting exactly at VMA start, we cannot easily shrink start.
                       // Return error or handle more complex RB tree update.
                       terminal_printf("Error: Cannot currently handle removing VMA partial overlap at the beginning.\n");
+                      mmu_gather_finish(&tlb);
                       return -FS_ERR_NOT_SUPPORTED;
                   }
              }
@@ -647,7 +779,8 @@
              if (remove_original) {
                  rb_tree_remove(&mm->vma_tree, node);
                  mm->map_count--;
-                 free_vma_resources(vma); // Free the VMA struct
+                 vma->free_next = *freed; // Freed by the caller once mm->lock is released
+                 *freed = vma;
              }
              if (created_second_part) {
                   // Need to insert the split part back into the tree
@@ -667,6 +800,7 @@
          } // End if overlap
          node = next_node; // Move to the next node saved earlier
      } // End while loop
+     mmu_gather_finish(&tlb);
      return result;
  }
  
@@ -676,8 +810,123 @@
   */
  int remove_vma_range(mm_struct_t *mm, uintptr_t start, size_t length) {
      if (!mm || length == 0) return -FS_ERR_INVALID_PARAM;
+     vma_struct_t *freed = NULL;
      uintptr_t irq_flags = spinlock_acquire_irqsave(&mm->lock);
-     int result = remove_vma_range_locked(mm, start, length);
+     int result = remove_vma_range_locked(mm, start, length, &freed);
      spinlock_release_irqrestore(&mm->lock, irq_flags);
+     free_vma_list(freed);
      return result;
- }
\ No newline at end of file
+ }
+
+ // --- mmap / munmap ---
+
+ /**
+  * Finds the lowest free, page-aligned gap of @p len bytes in the mmap area.
+  * Assumes lock held. Returns 0 if there is none.
+  */
+ static uintptr_t get_unmapped_area_locked(mm_struct_t *mm, size_t len) {
+     uintptr_t candidate = USER_MMAP_BASE;
+     for (struct rb_node *node = rb_tree_first(&mm->vma_tree); node; node = rb_node_next(node)) {
+         vma_struct_t *vma = rb_entry(node, vma_struct_t, rb_node);
+         if (vma->vm_end <= candidate) continue;
+         if (vma->vm_start >= candidate && vma->vm_start - candidate >= len) break; // Gap before this VMA fits
+         candidate = vma->vm_end;
+     }
+     if (candidate >= USER_STACK_BOTTOM_VIRT || USER_STACK_BOTTOM_VIRT - candidate < len) return 0;
+     return candidate;
+ }
+
+ /**
+  * Creates a mapping (the body of the mmap syscall).
+  */
+ int do_mmap(mm_struct_t *mm, uintptr_t addr, size_t length, uint32_t prot, uint32_t flags,
+             file_t *file, size_t offset, uintptr_t *addr_out) {
+     if (!mm || !addr_out || length == 0 || length > USER_STACK_BOTTOM_VIRT) return FS_ERR_INVALID_PARAM;
+     uint32_t sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+     if (sharing != MAP_SHARED && sharing != MAP_PRIVATE) return FS_ERR_INVALID_PARAM;
+     size_t len = PAGE_ALIGN_UP(length);
+     bool anonymous = (flags & MAP_ANONYMOUS) != 0;
+
+     uint32_t vm_flags = VM_USER | (anonymous ? VM_ANONYMOUS : VM_FILEBACKED);
+     if (prot & PROT_READ)   vm_flags |= VM_READ;
+     if (prot & PROT_WRITE)  vm_flags |= VM_WRITE | VM_READ; // x86 pages cannot be write-only
+     if (prot & PROT_EXEC)   vm_flags |= VM_EXEC | VM_READ;
+     if (sharing == MAP_SHARED) vm_flags |= VM_SHARED;
+     uint32_t page_prot = PAGE_PRESENT | PAGE_USER;
+     if (prot & PROT_WRITE) page_prot |= PAGE_RW;
+     if (!(prot & PROT_EXEC) && g_nx_supported) page_prot |= PAGE_NX_BIT;
+
+     if (!anonymous) {
+         if (!file) return FS_ERR_BAD_F;
+         if (offset % PAGE_SIZE) return FS_ERR_INVALID_PARAM;
+         if (offset > SIZE_MAX - len) return FS_ERR_OVERFLOW;
+         // Pages come from the page cache, which needs the file's identity
+         vfs_file_id_t id;
+         int id_res = vfs_identify(file, &id);
+         if (id_res != FS_SUCCESS) return id_res;
+         // Nothing writes mapped pages back to the file, so shared file
+         // mappings stay read-only; private ones copy on write
+         if (sharing == MAP_SHARED && (prot & PROT_WRITE)) return FS_ERR_NOT_SUPPORTED;
+     } else {
+         file = NULL;
+         offset = 0;
+     }
+
+     vma_struct_t *vma = alloc_vma_struct();
+     if (!vma) return FS_ERR_OUT_OF_MEMORY;
+     vma->vm_flags = vm_flags;
+     vma->page_prot = page_prot;
+     vma->vm_file = file ? vfs_file_dup(file) : NULL;
+     vma->vm_offset = offset;
+     vma->vm_mm = mm;
+
+     int result = FS_SUCCESS;
+     vma_struct_t *freed = NULL; // Mappings replaced by MAP_FIXED
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&mm->lock);
+     uintptr_t start = 0;
+     if (flags & MAP_FIXED) {
+         if ((addr % PAGE_SIZE) != 0 || addr < PAGE_SIZE || addr >= USER_STACK_BOTTOM_VIRT ||
+             USER_STACK_BOTTOM_VIRT - addr < len) {
+             result = FS_ERR_INVALID_PARAM;
+         } else if (remove_vma_range_locked(mm, addr, len, &freed) != 0) { // Replaces whatever was there
+             result = FS_ERR_BUSY;
+         } else {
+             start = addr;
+         }
+     } else {
+         // The address is only a hint: use it if the range is free, else search
+         uintptr_t hint = PAGE_ALIGN_DOWN(addr);
+         if (hint >= USER_MMAP_BASE && hint < USER_STACK_BOTTOM_VIRT && USER_STACK_BOTTOM_VIRT - hint >= len &&
+             !rbtree_find_overlap(mm->vma_tree.root, hint, hint + len)) {
+             start = hint;
+         } else {
+             start = get_unmapped_area_locked(mm, len);
+             if (!start) result = FS_ERR_OUT_OF_MEMORY;
+         }
+     }
+     if (result == FS_SUCCESS) {
+         vma->vm_start = start;
+         vma->vm_end = start + len;
+         if (!insert_vma_locked(mm, vma)) result = FS_ERR_INTERNAL;
+     }
+     spinlock_release_irqrestore(&mm->lock, irq_flags);
+     free_vma_list(freed);
+
+     if (result != FS_SUCCESS) {
+         free_vma_resources(vma);
+         return result;
+     }
+     *addr_out = start; // Pages are faulted in on first touch
+     return FS_SUCCESS;
+ }
+
+ /**
+  * Removes mappings (the body of the munmap syscall).
+  */
+ int do_munmap(mm_struct_t *mm, uintptr_t addr, size_t length) {
+     if (!mm || length == 0 || (addr % PAGE_SIZE) != 0) return FS_ERR_INVALID_PARAM;
+     size_t len = PAGE_ALIGN_UP(length);
+     if (addr >= KERNEL_SPACE_VIRT_START || KERNEL_SPACE_VIRT_START - addr < len) return FS_ERR_INVALID_PARAM;
+     int result = remove_vma_range(mm, addr, len);
+     return (result > 0) ? -result : result; // remove_vma_range reports -FS_ERR_* values
+ }
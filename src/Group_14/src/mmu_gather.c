@@ -0,0 +1,117 @@
+/**
+ * @file mmu_gather.c
+ * @brief Batched TLB invalidation and frame release (see mmu_gather.h).
+ */
+
+#include "mmu_gather.h"
+#include "paging.h"   // paging_invalidate_page, PAGE_SIZE, PAGING_ADDR_MASK
+#include "frame.h"    // put_frame, put_frame_batch
+#include "assert.h"   // KERNEL_ASSERT
+
+static volatile bool g_mmu_gather_enabled = true;
+static mmu_gather_stats_t g_mmu_gather_stats;
+
+static inline uint32_t read_cr3(void) {
+    uint32_t v;
+    asm volatile("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+/** @brief Drops every non-global TLB entry on this CPU. */
+static inline void reload_cr3(void) {
+    asm volatile("mov %%cr3, %%eax\n\t"
+                 "mov %%eax, %%cr3" ::: "eax", "memory");
+}
+
+/** @brief Invalidates [start, end) on this CPU right away. */
+static void invalidate_now(mmu_gather_t *tlb, uintptr_t start, uintptr_t end) {
+    if (!tlb->tlb_live || end <= start) return;
+    for (uintptr_t va = start; va < end; va += PAGE_SIZE) {
+        paging_invalidate_page((void*)va);
+        if (va > UINTPTR_MAX - PAGE_SIZE) break;
+    }
+}
+
+void mmu_gather_init(mmu_gather_t *tlb, uint32_t *pd_phys, bool fullmm) {
+    KERNEL_ASSERT(tlb != NULL, "mmu_gather_init: NULL gather");
+    tlb->pd_phys = (uintptr_t)pd_phys;
+    tlb->tlb_live = (read_cr3() & PAGING_ADDR_MASK) == (tlb->pd_phys & PAGING_ADDR_MASK);
+    tlb->fullmm = fullmm;
+    tlb->start = 0;
+    tlb->end = 0;
+    tlb->nr_frames = 0;
+}
+
+void mmu_gather_add_range(mmu_gather_t *tlb, uintptr_t vaddr, size_t size) {
+    uintptr_t start = PAGE_ALIGN_DOWN(vaddr);
+    uintptr_t end = (vaddr > UINTPTR_MAX - size) ? PAGE_ALIGN_DOWN(UINTPTR_MAX) : PAGE_ALIGN_UP(vaddr + size);
+    if (end <= start) return;
+
+    if (!g_mmu_gather_enabled) {
+        invalidate_now(tlb, start, end);
+        return;
+    }
+    if (tlb->start == tlb->end) {
+        tlb->start = start;
+        tlb->end = end;
+    } else {
+        if (start < tlb->start) tlb->start = start;
+        if (end > tlb->end) tlb->end = end;
+    }
+}
+
+void mmu_gather_add_frame(mmu_gather_t *tlb, uintptr_t frame_phys) {
+    if (!g_mmu_gather_enabled) {
+        put_frame(frame_phys);
+        g_mmu_gather_stats.frames_freed++;
+        return;
+    }
+    if (tlb->nr_frames == MMU_GATHER_BATCH) {
+        mmu_gather_flush(tlb);
+    }
+    tlb->frames[tlb->nr_frames++] = frame_phys;
+}
+
+void mmu_gather_flush(mmu_gather_t *tlb) {
+    bool have_range = tlb->end > tlb->start;
+    if (!have_range && tlb->nr_frames == 0) return;
+    g_mmu_gather_stats.flushes++;
+
+    // 1. TLB first: after this no translation to a gathered frame survives
+    if (have_range) {
+        if (!tlb->tlb_live) {
+            g_mmu_gather_stats.skipped++;
+        } else {
+            uint32_t pages = (uint32_t)((tlb->end - tlb->start) / PAGE_SIZE);
+            if (tlb->fullmm || pages > MMU_GATHER_INVLPG_MAX_PAGES) {
+                reload_cr3();
+                g_mmu_gather_stats.cr3_reloads++;
+            } else {
+                invalidate_now(tlb, tlb->start, tlb->end);
+                g_mmu_gather_stats.invlpg_pages += pages;
+            }
+        }
+        tlb->start = tlb->end = 0;
+    }
+
+    // 2. Then the frames, in one batch
+    if (tlb->nr_frames > 0) {
+        g_mmu_gather_stats.frames_freed += tlb->nr_frames;
+        put_frame_batch(tlb->frames, tlb->nr_frames);
+        tlb->nr_frames = 0;
+    }
+}
+
+void mmu_gather_finish(mmu_gather_t *tlb) {
+    mmu_gather_flush(tlb);
+}
+
+bool mmu_gather_set_enabled(bool enabled) {
+    bool was_enabled = g_mmu_gather_enabled;
+    g_mmu_gather_enabled = enabled;
+    return was_enabled;
+}
+
+void mmu_gather_get_stats(mmu_gather_stats_t *out) {
+    if (out) *out = g_mmu_gather_stats;
+}
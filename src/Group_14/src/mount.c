@@ -10,6 +10,8 @@
  #include "string.h"         // For strcmp, strlen, strcpy
  #include "types.h"
  #include "fs_errno.h"
+ #include "dcache.h"         // dcache_invalidate_fs
+ #include "pagecache.h"      // pagecache_invalidate_fs
  
  /**
   * @brief Mounts a filesystem onto a specified mount point.
@@ -141,6 +143,9 @@
  
  
      // 4. Call the Driver's Unmount Implementation
+     // Cached names must not outlive the context (its address may be reused)
+     dcache_invalidate_fs(mnt->fs_context);
+     pagecache_invalidate_fs(mnt->fs_context);
      terminal_printf("[Mount API] Calling driver '%s' to unmount context 0x%p for '%s'...\n",
                     mnt->fs_name, mnt->fs_context, mount_point);
      int driver_unmount_result = driver->unmount(mnt->fs_context);
@@ -0,0 +1,75 @@
+/**
+ * @file mutex.c
+ * @brief Sleeping mutex (see mutex.h).
+ */
+
+#include "mutex.h"
+#include "scheduler.h"
+#include "assert.h"
+
+void mutex_init(mutex_t *mutex) {
+    spinlock_init(&mutex->lock);
+    mutex->locked = false;
+    mutex->owner = NULL;
+    mutex->wait_head = NULL;
+    mutex->wait_tail = NULL;
+}
+
+void mutex_lock(mutex_t *mutex) {
+    KERNEL_ASSERT(mutex != NULL, "NULL mutex in mutex_lock");
+    bool waited = false;
+    for (;;) {
+        bool can_block = scheduler_can_block();
+        uint32_t eflags;
+        asm volatile("pushf; pop %0; cli" : "=r"(eflags));
+        uintptr_t irq_flags = spinlock_acquire_irqsave(&mutex->lock);
+        tcb_t *self = g_scheduler_ready ? get_current_task() : NULL;
+
+        if (waited && mutex->owner == self) {
+            // Handed over by mutex_unlock
+        } else if (!mutex->locked) {
+            mutex->locked = true;
+            mutex->owner = self;
+        } else {
+            KERNEL_ASSERT(!self || mutex->owner != self, "mutex_lock: already held by this task");
+            if (can_block) {
+                if (self->wait_reason != mutex) { // Not still queued from a spurious wakeup
+                    self->wait_next = NULL;
+                    self->wait_prev = mutex->wait_tail;
+                    self->wait_reason = mutex;
+                    if (mutex->wait_tail) mutex->wait_tail->wait_next = self; else mutex->wait_head = self;
+                    mutex->wait_tail = self;
+                }
+                self->state = TASK_BLOCKED;
+                waited = true;
+            }
+            spinlock_release_irqrestore(&mutex->lock, irq_flags); // Interrupts stay off
+            if (can_block) schedule(); // Woken by mutex_unlock, which made us the owner
+            if (eflags & 0x200) asm volatile("sti");
+            if (!can_block) asm volatile("pause");
+            continue;
+        }
+        spinlock_release_irqrestore(&mutex->lock, irq_flags);
+        if (eflags & 0x200) asm volatile("sti");
+        return;
+    }
+}
+
+void mutex_unlock(mutex_t *mutex) {
+    KERNEL_ASSERT(mutex != NULL, "NULL mutex in mutex_unlock");
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&mutex->lock);
+    KERNEL_ASSERT(mutex->locked, "mutex_unlock: mutex not held");
+    tcb_t *next = mutex->wait_head;
+    if (next) {
+        mutex->wait_head = next->wait_next;
+        if (mutex->wait_head) mutex->wait_head->wait_prev = NULL; else mutex->wait_tail = NULL;
+        next->wait_next = next->wait_prev = NULL;
+        next->wait_reason = NULL;
+        mutex->owner = next; // Stays locked: nobody can slip in before the waiter runs
+        scheduler_unblock_task(next);
+    } else {
+        mutex->locked = false;
+        mutex->owner = NULL;
+    }
+    spinlock_release_irqrestore(&mutex->lock, irq_flags);
+}
@@ -0,0 +1,266 @@
+/**
+ * @file pagecache.c
+ * @brief Page cache (see pagecache.h).
+ *
+ * Same layout as the dentry cache: a static pool of entries, hashed into
+ * bucket chains and threaded on one LRU list, under one spinlock. Misses are
+ * filled without the lock (the read may go to disk); an invalidation that
+ * races with a fill bumps s_inval_seq, and the fill then hands its frame to
+ * the caller without caching it.
+ */
+
+#include "pagecache.h"
+#include "frame.h"
+#include "paging.h"
+#include "spinlock.h"
+#include "terminal.h"
+#include "string.h"
+#include "fs_errno.h"
+#include "assert.h"
+
+typedef struct pagecache_entry {
+    const void *sb;
+    uint64_t ino;
+    uint32_t index;                   // Page index within the file
+    uint32_t hash;
+    uintptr_t phys;                   // Frame; the cache owns one reference
+    bool in_use;
+    struct pagecache_entry *hash_next;
+    struct pagecache_entry *lru_prev; // Towards the most recently used entry
+    struct pagecache_entry *lru_next;
+} pagecache_entry_t;
+
+_Static_assert((PAGECACHE_BUCKETS & (PAGECACHE_BUCKETS - 1)) == 0, "PAGECACHE_BUCKETS must be a power of two");
+
+// Above this many pages, a range invalidation scans the pool instead of probing each page
+#define PAGECACHE_PROBE_MAX  32
+
+static pagecache_entry_t s_entries[PAGECACHE_PAGES];
+static pagecache_entry_t *s_buckets[PAGECACHE_BUCKETS];
+static pagecache_entry_t *s_lru_head;   // Most recently used
+static pagecache_entry_t *s_lru_tail;
+static pagecache_entry_t *s_free_list;  // Unused entries, chained through hash_next
+static spinlock_t s_pagecache_lock;
+static uint32_t s_inval_seq;            // Bumped by every invalidation
+static pagecache_stats_t s_stats;
+
+static uint32_t pagecache_hash(const void *sb, uint64_t ino, uint32_t index)
+{
+    uint32_t h = (uint32_t)ino * 0x9E3779B1u;
+    h ^= (uint32_t)(ino >> 32) * 0x85EBCA6Bu;
+    h ^= index * 0xC2B2AE35u;
+    h ^= (uint32_t)(uintptr_t)sb >> 4;
+    return h ^ (h >> 16);
+}
+
+static void lru_unlink(pagecache_entry_t *e)
+{
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else s_lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else s_lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_head(pagecache_entry_t *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = s_lru_head;
+    if (s_lru_head) s_lru_head->lru_prev = e;
+    s_lru_head = e;
+    if (!s_lru_tail) s_lru_tail = e;
+}
+
+/** @brief Finds a page. Caller holds s_pagecache_lock. */
+static pagecache_entry_t *pagecache_find_locked(const void *sb, uint64_t ino, uint32_t index, uint32_t hash)
+{
+    for (pagecache_entry_t *e = s_buckets[hash & (PAGECACHE_BUCKETS - 1)]; e; e = e->hash_next) {
+        if (e->hash == hash && e->sb == sb && e->ino == ino && e->index == index) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Unhashes a page, drops the cache's frame reference and returns the
+ * entry to the free list. Caller holds s_pagecache_lock.
+ */
+static void pagecache_remove_locked(pagecache_entry_t *e)
+{
+    pagecache_entry_t **link = &s_buckets[e->hash & (PAGECACHE_BUCKETS - 1)];
+    while (*link && *link != e) link = &(*link)->hash_next;
+    KERNEL_ASSERT(*link == e, "pagecache entry missing from its bucket");
+    *link = e->hash_next;
+
+    lru_unlink(e);
+    put_frame(e->phys);
+    e->phys = 0;
+    e->in_use = false;
+    e->hash_next = s_free_list;
+    s_free_list = e;
+    s_stats.pages--;
+}
+
+void pagecache_init(void)
+{
+    spinlock_init(&s_pagecache_lock);
+    memset(s_entries, 0, sizeof(s_entries));
+    memset(s_buckets, 0, sizeof(s_buckets));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_lru_head = s_lru_tail = NULL;
+    s_free_list = NULL;
+    s_inval_seq = 0;
+    for (int i = PAGECACHE_PAGES - 1; i >= 0; i--) {
+        s_entries[i].hash_next = s_free_list;
+        s_free_list = &s_entries[i];
+    }
+    terminal_printf("[PageCache] Initialized (%u pages, %u buckets).\n",
+                    (unsigned)PAGECACHE_PAGES, (unsigned)PAGECACHE_BUCKETS);
+}
+
+int pagecache_get_page(file_t *file, off_t offset, uintptr_t *phys_out)
+{
+    if (!file || !phys_out || offset < 0 || (offset % PAGE_SIZE) != 0) return FS_ERR_INVALID_PARAM;
+
+    vfs_file_id_t id;
+    int result = vfs_identify(file, &id);
+    if (result != FS_SUCCESS) return result;
+    uint32_t index = (uint32_t)(offset / PAGE_SIZE);
+    uint32_t hash = pagecache_hash(id.sb, id.ino, index);
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pagecache_lock);
+    pagecache_entry_t *e = pagecache_find_locked(id.sb, id.ino, index, hash);
+    if (e) {
+        lru_unlink(e);
+        lru_push_head(e);
+        frame_incref(e->phys);
+        *phys_out = e->phys;
+        s_stats.hits++;
+        spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+        return FS_SUCCESS;
+    }
+    s_stats.misses++;
+    uint32_t seq = s_inval_seq;
+    spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+
+    // Zeroed frame: a short read at end of file leaves the tail zero
+    uintptr_t phys = frame_alloc_zeroed();
+    if (!phys) return FS_ERR_OUT_OF_MEMORY;
+    void *dst = paging_temp_map(phys, PTE_KERNEL_DATA_FLAGS);
+    if (!dst) {
+        put_frame(phys);
+        return FS_ERR_INTERNAL;
+    }
+    int bytes_read = vfs_pread(file, dst, PAGE_SIZE, offset);
+    paging_temp_unmap(dst);
+    if (bytes_read < 0) {
+        put_frame(phys);
+        return bytes_read;
+    }
+
+    uintptr_t duplicate = 0;
+    irq_flags = spinlock_acquire_irqsave(&s_pagecache_lock);
+    e = pagecache_find_locked(id.sb, id.ino, index, hash);
+    if (e) {
+        // Another fault filled the same page first; use that one
+        lru_unlink(e);
+        lru_push_head(e);
+        frame_incref(e->phys);
+        duplicate = phys;
+        phys = e->phys;
+    } else if (seq == s_inval_seq) {
+        if (!s_free_list) {
+            KERNEL_ASSERT(s_lru_tail != NULL, "pagecache: no free entry and empty LRU");
+            pagecache_remove_locked(s_lru_tail);
+            s_stats.evictions++;
+        }
+        e = s_free_list;
+        s_free_list = e->hash_next;
+        e->sb = id.sb;
+        e->ino = id.ino;
+        e->index = index;
+        e->hash = hash;
+        e->phys = phys;
+        e->in_use = true;
+        e->hash_next = s_buckets[hash & (PAGECACHE_BUCKETS - 1)];
+        s_buckets[hash & (PAGECACHE_BUCKETS - 1)] = e;
+        lru_push_head(e);
+        frame_incref(phys); // The cache's reference; the caller keeps the allocation's
+        s_stats.pages++;
+        s_stats.fills++;
+    }
+    // else: the file changed while we read it, so the page may be stale for
+    // later faults; the caller still gets it, uncached
+    spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+
+    if (duplicate) put_frame(duplicate);
+    *phys_out = phys;
+    return FS_SUCCESS;
+}
+
+void pagecache_invalidate_range(const void *sb, uint64_t ino, off_t offset, size_t len)
+{
+    if (len == 0 || offset < 0) return;
+    uint32_t first = (uint32_t)(offset / PAGE_SIZE);
+    uint32_t last = (uint32_t)(((uint64_t)offset + len - 1) / PAGE_SIZE);
+
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pagecache_lock);
+    s_inval_seq++;
+    if (s_stats.pages > 0) {
+        if (last - first < PAGECACHE_PROBE_MAX) {
+            for (uint32_t index = first; index <= last; index++) {
+                pagecache_entry_t *e = pagecache_find_locked(sb, ino, index, pagecache_hash(sb, ino, index));
+                if (e) {
+                    pagecache_remove_locked(e);
+                    s_stats.invalidations++;
+                }
+            }
+        } else {
+            for (int i = 0; i < PAGECACHE_PAGES; i++) {
+                pagecache_entry_t *e = &s_entries[i];
+                if (e->in_use && e->sb == sb && e->ino == ino && e->index >= first && e->index <= last) {
+                    pagecache_remove_locked(e);
+                    s_stats.invalidations++;
+                }
+            }
+        }
+    }
+    spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+}
+
+void pagecache_invalidate_file(const void *sb, uint64_t ino)
+{
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pagecache_lock);
+    s_inval_seq++;
+    for (int i = 0; i < PAGECACHE_PAGES && s_stats.pages > 0; i++) {
+        pagecache_entry_t *e = &s_entries[i];
+        if (e->in_use && e->sb == sb && e->ino == ino) {
+            pagecache_remove_locked(e);
+            s_stats.invalidations++;
+        }
+    }
+    spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+}
+
+void pagecache_invalidate_fs(const void *sb)
+{
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pagecache_lock);
+    s_inval_seq++;
+    for (int i = 0; i < PAGECACHE_PAGES && s_stats.pages > 0; i++) {
+        pagecache_entry_t *e = &s_entries[i];
+        if (e->in_use && e->sb == sb) {
+            pagecache_remove_locked(e);
+            s_stats.invalidations++;
+        }
+    }
+    spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+}
+
+void pagecache_get_stats(pagecache_stats_t *stats)
+{
+    if (!stats) return;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pagecache_lock);
+    *stats = s_stats;
+    spinlock_release_irqrestore(&s_pagecache_lock, irq_flags);
+}
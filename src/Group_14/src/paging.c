@@ -17,6 +17,7 @@
  #include "msr.h"                // For MSR read/write (EFER)
  #include "assert.h"             // For KERNEL_ASSERT
 #include "serial.h"             // Serial port logging
+#include "mmu_gather.h"         // Batched TLB invalidation / frame release
 
  // --- Constants and Macros ---
  #ifndef PAGING_PANIC
@@ -40,7 +41,7 @@
  // Note: PAGING_TEMP_VADDR is now managed dynamically by the temp map allocator.
 
  // --- Debugging Control ---
- #define PAGING_DEBUG 1 // Set to 0 to disable debug prints
+ #define PAGING_DEBUG 0 // Set to 1 to enable debug prints
 
  // --- ADDED DEBUG MACRO DEFINITION ---
  #if PAGING_DEBUG
@@ -545,6 +546,7 @@
                       (unsigned long)flags);
 
       int page_count = 0;
+      int large_count = 0;
       int safety_counter = 0;
       const int max_pages_early = (1024 * 1024 * 1024) / PAGE_SIZE;
 
@@ -581,6 +583,20 @@
           uintptr_t pt_phys_addr;
           volatile uint32_t* pt_phys_ptr;
 
+          // Higher-half direct map: cover whole, aligned 4MB blocks with a single
+          // PSE PDE. Saves a PT frame per 4MB and keeps heap walks to one TLB entry per 4MB.
+          if (map_to_higher_half && g_pse_supported && !(pde & PAGE_PRESENT) &&
+              (current_phys % PAGE_SIZE_LARGE) == 0 &&
+              (end_phys - current_phys) >= PAGE_SIZE_LARGE) {
+              uint32_t large_flags = (flags & (PAGE_RW | PAGE_USER | PAGE_PWT | PAGE_PCD)) | PAGE_PRESENT | PAGE_SIZE_4MB;
+              pd_phys_ptr[pd_idx] = (current_phys & PAGING_PDE_ADDR_MASK_4MB) | large_flags;
+              page_count += PAGES_PER_TABLE;
+              large_count++;
+              if (current_phys > UINTPTR_MAX - PAGE_SIZE_LARGE) { break; }
+              current_phys += PAGE_SIZE_LARGE;
+              continue;
+          }
+
           if (!(pde & PAGE_PRESENT)) {
               uint32_t* new_pt = allocate_page_table_phys(true);
               if (!new_pt) {
@@ -631,7 +647,7 @@
           current_phys += PAGE_SIZE;
       }
 
-      terminal_printf("  Mapped %d pages for region.\n", page_count);
+      terminal_printf("  Mapped %d pages for region (%d as 4MB pages).\n", page_count, large_count * (int)PAGES_PER_TABLE);
       return 0; // Success
  }
 
@@ -830,6 +846,20 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
 
  // Post-Activation Mapping Functions
 
+ /**
+  * @brief True if a 4MB PDE already maps vaddr to paddr with at least the
+  * RW/USER access a 4KB mapping with pte_flags would grant, and with the same
+  * PCD/PWT caching (an MMIO page must not stay cached through a RAM mapping).
+  */
+ static inline bool large_pde_satisfies(uint32_t pde, uintptr_t vaddr, uintptr_t paddr, uint32_t pte_flags) {
+     uintptr_t mapped = (pde & PAGING_PDE_ADDR_MASK_4MB) + (vaddr & (PAGE_SIZE_LARGE - 1));
+     if (PAGE_ALIGN_DOWN(mapped) != PAGE_ALIGN_DOWN(paddr)) return false;
+     const uint32_t cache_bits = PAGE_PCD | PAGE_PWT;
+     if ((pde & cache_bits) != (pte_flags & cache_bits)) return false;
+     uint32_t needed = pte_flags & (PAGE_RW | PAGE_USER);
+     return (pde & needed) == needed;
+ }
+
  static int map_page_internal(uint32_t *target_page_directory_phys,
                              uintptr_t vaddr,
                              uintptr_t paddr,
@@ -928,6 +958,18 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
             uintptr_t pt_phys_addr = 0;
             bool pt_allocated_here = false;
 
+            if ((pde & PAGE_PRESENT) && (pde & PAGE_SIZE_4MB)) {
+                if (large_pde_satisfies(pde, aligned_vaddr, aligned_paddr, pte_final_flags)) {
+                    return 0;
+                }
+                if (paging_split_large_pde(g_kernel_page_directory_virt, pd_idx) != 0) {
+                    terminal_printf("[Map Internal] Error: Cannot map 4KB page inside 4MB page at V=%p (PDE[%lu]=0x%lx)\n",
+                    (void*)aligned_vaddr, (unsigned long)pd_idx, (unsigned long)pde);
+                    return KERN_EPERM;
+                }
+                pde = g_kernel_page_directory_virt[pd_idx];
+            }
+
             if (!(pde & PAGE_PRESENT)) {
                 pt_phys_addr = frame_alloc();
                 if (pt_phys_addr == 0) {
@@ -946,10 +988,6 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
                 pt_virt = (uint32_t*)(RECURSIVE_PDE_VADDR + (pd_idx * PAGE_SIZE));
                 memset(pt_virt, 0, PAGE_SIZE);
 
-            } else if (pde & PAGE_SIZE_4MB) {
-                 terminal_printf("[Map Internal] Error: Attempted 4KB map over existing 4MB page at V=%p (PDE[%lu]=0x%lx)\n",
-                 (void*)aligned_vaddr, (unsigned long)pd_idx, (unsigned long)pde);
-                 return KERN_EPERM;
             } else {
                 pt_phys_addr = pde & PAGING_ADDR_MASK;
                 pt_virt = (uint32_t*)(RECURSIVE_PDE_VADDR + (pd_idx * PAGE_SIZE));
@@ -1025,12 +1063,20 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
              goto cleanup_other_pd;
 
         } else {
-            if (pde & PAGE_PRESENT) {
-                if (pde & PAGE_SIZE_4MB) {
+            if ((pde & PAGE_PRESENT) && (pde & PAGE_SIZE_4MB)) {
+                if (large_pde_satisfies(pde, aligned_vaddr, aligned_paddr, pte_final_flags)) {
+                    ret = 0;
+                    goto cleanup_other_pd;
+                }
+                if (paging_split_large_pde(target_pd_virt_temp, pd_idx) != 0) {
                     terminal_printf("[Map Internal] Error: OTHER PD 4KB conflict w 4MB at PDE[%lu] V=%p\n", (unsigned long)pd_idx, (void*)aligned_vaddr);
                     ret = KERN_EPERM;
                     goto cleanup_other_pd;
                 }
+                pde = target_pd_virt_temp[pd_idx];
+            }
+
+            if (pde & PAGE_PRESENT) {
                 pt_phys = pde & PAGING_ADDR_MASK;
                 uint32_t needed_pde_flags = pde_final_flags & ~PAGE_SIZE_4MB;
                 uint32_t current_pde_flags = pde & (PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_PWT | PAGE_PCD);
@@ -1174,6 +1220,13 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
       terminal_printf("[Map Range] Mapping V=[0x%#lx-0x%#lx) to P=[0x%#lx...) Flags=0x%lx (Masked=0x%lx)\n",
         (unsigned long)v_start, (unsigned long)v_end, (unsigned long)p_start, (unsigned long)flags, (unsigned long)masked_flags);
 
+      // 4MB pages: automatic for kernel ranges, opt-in (PAGE_SIZE_4MB in flags) for user
+      // ranges, whose frames stay individually refcounted and are split on partial unmap.
+      bool is_current_pd = (g_kernel_page_directory_virt != NULL &&
+                            (uintptr_t)page_directory_phys == g_kernel_page_directory_phys);
+      bool allow_large = g_pse_supported && g_kernel_page_directory_virt != NULL &&
+                         (!(masked_flags & PAGE_USER) || (masked_flags & PAGE_SIZE_4MB));
+
       uintptr_t current_v = v_start;
       uintptr_t current_p = p_start;
       int mapped_pages = 0;
@@ -1191,7 +1244,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
               break;
           }
 
-          bool possible_large = g_pse_supported &&
+          bool possible_large = allow_large &&
                                 (current_v % PAGE_SIZE_LARGE == 0) &&
                                 (current_p % PAGE_SIZE_LARGE == 0) &&
                                 (remaining_v_size >= PAGE_SIZE_LARGE);
@@ -1200,26 +1253,26 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
 
           if (possible_large) {
               uint32_t pd_idx_check = PDE_INDEX(current_v);
-              uint32_t existing_pde_check = 0;
+              uint32_t existing_pde_check = PAGE_PRESENT;
 
-              if (g_kernel_page_directory_virt != NULL && (uintptr_t)page_directory_phys == g_kernel_page_directory_phys) {
+              if (is_current_pd) {
                   existing_pde_check = g_kernel_page_directory_virt[pd_idx_check];
-              } else if (g_kernel_page_directory_virt != NULL) {
-                  terminal_printf("[Map Range] Warning: Cannot check PDE for non-current PD %p. Forcing 4KB.\n", (void*)page_directory_phys);
-                  existing_pde_check = PAGE_PRESENT;
-              }
-
-              if (!(existing_pde_check & PAGE_PRESENT)) {
-                   use_large = true;
               } else {
-                   use_large = false;
+                  uint32_t *pd_check_virt = paging_temp_map((uintptr_t)page_directory_phys, PTE_KERNEL_READONLY_FLAGS);
+                  if (pd_check_virt) {
+                      existing_pde_check = pd_check_virt[pd_idx_check];
+                      paging_temp_unmap(pd_check_virt);
+                  }
               }
+
+              // Only an empty PDE can become a 4MB page; a PT that is already there may hold other pages
+              use_large = !(existing_pde_check & PAGE_PRESENT);
           }
 
           int result = map_page_internal(page_directory_phys,
                                          current_v,
                                          current_p,
-                                         masked_flags,
+                                         masked_flags & ~PAGE_SIZE_4MB,
                                          use_large);
 
           if (result != 0) {
@@ -1392,6 +1445,8 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
       terminal_printf("[FreeUser] Freeing user space mappings for PD Phys %p\n", (void*)page_directory_phys);
 
       uint32_t* target_pd_virt_temp = NULL;
+      mmu_gather_t tlb;
+      mmu_gather_init(&tlb, page_directory_phys, true);
 
       // FIX: Use paging_temp_map instead of paging_temp_map_vaddr
       target_pd_virt_temp = paging_temp_map((uintptr_t)page_directory_phys, PTE_KERNEL_DATA_FLAGS);
@@ -1409,7 +1464,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
                   for (size_t f = 0; f < PAGES_PER_TABLE; ++f) {
                       uintptr_t frame_addr = frame_base + f * PAGE_SIZE;
                       if(frame_addr < frame_base) break;
-                      put_frame(frame_addr);
+                      mmu_gather_add_frame(&tlb, frame_addr);
                   }
                    terminal_printf("  Freed 4MB Page Frames for PDE[%zu]\n", i);
               } else {
@@ -1423,7 +1478,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
                            uint32_t pte = target_pt_virt_temp[j];
                            if (pte & PAGE_PRESENT) {
                                uintptr_t frame_phys = pte & PAGING_PTE_ADDR_MASK;
-                               put_frame(frame_phys);
+                               mmu_gather_add_frame(&tlb, frame_phys);
                            }
                        }
                        // FIX: Use paging_temp_unmap instead of paging_temp_unmap_vaddr
@@ -1431,14 +1486,16 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
                    } else {
                        terminal_printf("[FreeUser] Warning: Failed to temp map PT 0x%#lx from PDE[%zu] - frames leak!\n", (unsigned long)pt_phys, i);
                    }
-                  put_frame(pt_phys);
+                  mmu_gather_add_frame(&tlb, pt_phys);
               }
               target_pd_virt_temp[i] = 0;
+              mmu_gather_add_range(&tlb, (uintptr_t)i << PAGING_PDE_SHIFT, PAGE_SIZE_LARGE);
           }
       }
 
       // FIX: Use paging_temp_unmap instead of paging_temp_unmap_vaddr
       paging_temp_unmap(target_pd_virt_temp);
+      mmu_gather_finish(&tlb);
       terminal_printf("[FreeUser] User space mappings cleared for PD Phys %p\n", (void*)page_directory_phys);
  }
 
@@ -1562,32 +1619,114 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
       return new_pd_phys;
  }
 
+ int paging_copy_range_cow(uint32_t *dst_pd_phys, uint32_t *src_pd_phys,
+                           uintptr_t start, uintptr_t end, bool cow) {
+      start = PAGE_ALIGN_DOWN(start);
+      end = PAGE_ALIGN_UP(end);
+      if (!dst_pd_phys || !src_pd_phys || end > KERNEL_SPACE_VIRT_START || start > end) {
+          return KERN_EINVAL;
+      }
+      if (start == end) return 0;
 
- // --- Page Fault Handler ---
- void page_fault_handler(registers_t *regs) { // <-- Use isr_frame_t
-    serial_write("[PF] Enter C page_fault_handler\n");
-    uintptr_t fault_addr;
-    asm volatile("mov %%cr2, %0" : "=r"(fault_addr));
+      uint32_t *src_pd = paging_temp_map((uintptr_t)src_pd_phys, PTE_KERNEL_DATA_FLAGS);
+      uint32_t *dst_pd = src_pd ? paging_temp_map((uintptr_t)dst_pd_phys, PTE_KERNEL_DATA_FLAGS) : NULL;
+      if (!dst_pd) {
+          if (src_pd) paging_temp_unmap(src_pd);
+          return KERN_ENOMEM;
+      }
 
-    if (!regs) { // <-- Use frame
-        terminal_printf("\n--- PAGE FAULT (#PF) --- \n");
-        terminal_printf(" FATAL ERROR: frame pointer is NULL in page_fault_handler!\n");
-        KERNEL_PANIC_HALT("Page Fault with NULL frame structure");
-        return;
-    }
+      int ret = 0;
+      bool wrprotected = false; // Source PTEs lost PAGE_RW: its TLB must be flushed
+      uintptr_t va = start;
+      while (va < end && ret == 0) {
+          uint32_t pd_idx = PDE_INDEX(va);
+          uintptr_t block_start = (uintptr_t)pd_idx << PAGING_PDE_SHIFT;
+          uintptr_t block_end = block_start + PAGE_SIZE_LARGE;
+          uintptr_t chunk_end = (block_end < end) ? block_end : end;
+          uint32_t spde = src_pd[pd_idx];
+
+          if (!(spde & PAGE_PRESENT)) { va = chunk_end; continue; }
+          if (dst_pd[pd_idx] & PAGE_SIZE_4MB) { ret = KERN_EEXIST; break; }
+
+          if (spde & PAGE_SIZE_4MB) {
+              if (block_start >= start && block_end <= end) {
+                  // Whole 4MB page inside the range: share it as one PDE
+                  if (dst_pd[pd_idx] & PAGE_PRESENT) { ret = KERN_EEXIST; break; }
+                  if (cow && (spde & PAGE_RW)) {
+                      spde &= ~PAGE_RW;
+                      src_pd[pd_idx] = spde;
+                      wrprotected = true;
+                  }
+                  uintptr_t frame_base = spde & PAGING_PDE_ADDR_MASK_4MB;
+                  for (uint32_t f = 0; f < PAGES_PER_TABLE; f++) {
+                      frame_incref(frame_base + f * PAGE_SIZE);
+                  }
+                  dst_pd[pd_idx] = spde;
+                  va = chunk_end;
+                  continue;
+              }
+              // Range ends inside the large page: fall back to 4KB PTEs
+              ret = paging_split_large_pde(src_pd, pd_idx);
+              if (ret != 0) break;
+              spde = src_pd[pd_idx];
+          }
 
-    uint32_t error_code = regs->err_code; // <-- Use frame
+          uint32_t dpde = dst_pd[pd_idx];
+          if (!(dpde & PAGE_PRESENT)) {
+              uintptr_t pt_phys = frame_alloc_zeroed();
+              if (!pt_phys) { ret = KERN_ENOMEM; break; }
+              dpde = (pt_phys & PAGING_ADDR_MASK) | (spde & PAGING_FLAG_MASK);
+              dst_pd[pd_idx] = dpde;
+          }
 
-    // Decode error code bits
-    bool non_present       = !(error_code & 0x1); // Corrected: 0 = Not Present
+          uint32_t *src_pt = paging_temp_map(spde & PAGING_PDE_ADDR_MASK_4KB, PTE_KERNEL_DATA_FLAGS);
+          uint32_t *dst_pt = src_pt ? paging_temp_map(dpde & PAGING_PDE_ADDR_MASK_4KB, PTE_KERNEL_DATA_FLAGS) : NULL;
+          if (!dst_pt) {
+              if (src_pt) paging_temp_unmap(src_pt);
+              ret = KERN_ENOMEM;
+              break;
+          }
+          for (uint32_t j = PTE_INDEX(va); va < chunk_end; j++, va += PAGE_SIZE) {
+              uint32_t spte = src_pt[j];
+              if (!(spte & PAGE_PRESENT)) continue;
+              if (cow && (spte & PAGE_RW)) {
+                  spte &= ~PAGE_RW;
+                  src_pt[j] = spte;
+                  wrprotected = true;
+              }
+              frame_incref(spte & PAGING_PTE_ADDR_MASK);
+              dst_pt[j] = spte;
+          }
+          paging_temp_unmap(dst_pt);
+          paging_temp_unmap(src_pt);
+      }
+
+      paging_temp_unmap(dst_pd);
+      paging_temp_unmap(src_pd);
+
+      if (wrprotected) {
+          // Only needed when the source directory is live (fork from the running
+          // process); mmu_gather picks invlpg or a CR3 reload by range size.
+          mmu_gather_t tlb;
+          mmu_gather_init(&tlb, src_pd_phys, false);
+          mmu_gather_add_range(&tlb, start, end - start);
+          mmu_gather_finish(&tlb);
+      }
+      return ret;
+ }
+
+
+ // --- Page Fault Handler ---
+
+ /** @brief Prints the fault and register state; only for faults that are not resolved. */
+ static void page_fault_report(const registers_t *regs, uintptr_t fault_addr, uint32_t current_pid) {
+    uint32_t error_code = regs->err_code;
+    bool non_present       = !(error_code & 0x1);
     bool write_fault       = (error_code & 0x2);
-    bool user_mode         = (error_code & 0x4); // Fault occurred while CPL=3?
+    bool user_mode         = (error_code & 0x4);
     bool reserved_bit      = (error_code & 0x8);
     bool instruction_fetch = (error_code & 0x10);
 
-    pcb_t* current_process = get_current_process();
-    uint32_t current_pid = current_process ? current_process->pid : (uint32_t)-1;
-
     terminal_printf("\n--- PAGE FAULT (#PF) ---\n");
     // Use %lu for pid (uint32_t), %p for address, %lx for error_code
     terminal_printf(" PID: %lu, Addr: %p, ErrCode: 0x%lx\n",
@@ -1622,8 +1761,35 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
                         (unsigned long)regs->useresp, // <-- Use frame
                         (unsigned long)regs->ss);     // <-- Use frame
     }
+ }
+
+ void page_fault_handler(registers_t *regs) { // <-- Use isr_frame_t
+    uintptr_t fault_addr;
+    asm volatile("mov %%cr2, %0" : "=r"(fault_addr));
+
+    if (!regs) { // <-- Use frame
+        terminal_printf("\n--- PAGE FAULT (#PF) --- \n");
+        terminal_printf(" FATAL ERROR: frame pointer is NULL in page_fault_handler!\n");
+        KERNEL_PANIC_HALT("Page Fault with NULL frame structure");
+        return;
+    }
+
+    uint32_t error_code = regs->err_code; // <-- Use frame
+
+    // Decode error code bits
+    bool non_present       = !(error_code & 0x1); // Corrected: 0 = Not Present
+    bool write_fault       = (error_code & 0x2);
+    bool user_mode         = (error_code & 0x4); // Fault occurred while CPL=3?
+    bool reserved_bit      = (error_code & 0x8);
+    bool instruction_fetch = (error_code & 0x10);
+
+    PAGING_DEBUG_PRINTF("Fault at %p, ErrCode: 0x%lx\n", (void*)fault_addr, (unsigned long)error_code);
+
+    pcb_t* current_process = get_current_process();
+    uint32_t current_pid = current_process ? current_process->pid : (uint32_t)-1;
 
     if (!user_mode) { // Check error code flag: Did the fault *occur* while CPL=0?
+        page_fault_report(regs, fault_addr, current_pid);
         terminal_printf(" Reason: Fault occurred in Supervisor Mode!\n");
         if (reserved_bit) terminal_printf(" CRITICAL: Reserved bit set in paging structure accessed by kernel at VAddr %p!\n", (void*)fault_addr);
 
@@ -1642,7 +1808,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
     }
 
     // --- User Mode Fault ---
-    terminal_printf(" Reason: Fault occurred in User Mode.\n");
+    // Demand-paging and COW faults are routine: details are only printed when the process is killed
 
     if (!current_process) {
         terminal_printf("  Error: No current process available for user fault! Addr=%p\n", (void*)fault_addr);
@@ -1673,7 +1839,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
         goto kill_process;
     }
 
-    terminal_printf("  Searching for VMA covering faulting address %p...\n", (void*)fault_addr);
+    PAGING_DEBUG_PRINTF("Searching for VMA covering faulting address %p...\n", (void*)fault_addr);
     vma_struct_t *vma = find_vma(mm, fault_addr);
 
     if (!vma) {
@@ -1682,7 +1848,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
         goto kill_process;
     }
 
-    terminal_printf("  VMA Found: [%#lx - %#lx) Flags: %c%c%c PageProt: 0x%lx\n",
+    PAGING_DEBUG_PRINTF("VMA Found: [%#lx - %#lx) Flags: %c%c%c PageProt: 0x%lx\n",
         (unsigned long)vma->vm_start, (unsigned long)vma->vm_end,
         (vma->vm_flags & VM_READ) ? 'R' : '-',
         (vma->vm_flags & VM_WRITE) ? 'W' : '-',
@@ -1707,12 +1873,11 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
          goto kill_process;
      }
 
-    terminal_printf("  Attempting to handle fault via VMA operations (Demand Paging / COW)...\n");
+    PAGING_DEBUG_PRINTF("Attempting to handle fault via VMA operations (Demand Paging / COW)...\n");
     int handle_result = handle_vma_fault(mm, vma, fault_addr, error_code);
 
     if (handle_result == 0) {
-        terminal_printf("  VMA fault handler succeeded. Resuming process PID %lu.\n", (unsigned long)current_pid);
-        terminal_printf("--------------------------\n");
+        PAGING_DEBUG_PRINTF("VMA fault handler succeeded. Resuming process PID %lu.\n", (unsigned long)current_pid);
         return; // Resume process
     } else {
         terminal_printf("  Error: handle_vma_fault failed with code %d. Terminating process.\n", handle_result);
@@ -1721,6 +1886,7 @@ int paging_setup_early_maps(uintptr_t page_directory_phys,
 
 kill_process:
     terminal_printf("--- Unhandled User Page Fault ---\n");
+    page_fault_report(regs, fault_addr, current_pid);
     terminal_printf(" Terminating Process PID %lu.\n", (unsigned long)current_pid);
     terminal_printf("--------------------------\n");
 
@@ -1756,6 +1922,49 @@ kill_process:
      return true;
  }
 
+ // --- Large Page Splitting ---
+
+ int paging_split_large_pde(uint32_t *pd_virt, uint32_t pd_idx) {
+      if (!pd_virt || pd_idx >= KERNEL_PDE_INDEX) {
+          // Kernel PDEs are copied into every process directory; splitting one
+          // here would leave the copies pointing at the old 4MB page.
+          terminal_printf("[Split] Error: Refusing to split PDE[%lu] (NULL PD or kernel range).\n", (unsigned long)pd_idx);
+          return KERN_EPERM;
+      }
+
+      uint32_t pde = pd_virt[pd_idx];
+      if ((pde & (PAGE_PRESENT | PAGE_SIZE_4MB)) != (PAGE_PRESENT | PAGE_SIZE_4MB)) {
+          return KERN_EINVAL;
+      }
+
+      uintptr_t pt_phys = frame_alloc();
+      if (!pt_phys) {
+          terminal_printf("[Split] Error: Failed to allocate PT for PDE[%lu].\n", (unsigned long)pd_idx);
+          return KERN_ENOMEM;
+      }
+      uint32_t *pt_virt = paging_temp_map(pt_phys, PTE_KERNEL_DATA_FLAGS);
+      if (!pt_virt) {
+          terminal_printf("[Split] Error: Failed to temp map new PT %#lx.\n", (unsigned long)pt_phys);
+          put_frame(pt_phys);
+          return KERN_ENOMEM;
+      }
+
+      // Same frames, same permissions; PAGE_SIZE_4MB is the PAT bit in a PTE so it must go.
+      uintptr_t frame_base = pde & PAGING_PDE_ADDR_MASK_4MB;
+      uint32_t pte_flags = pde & (PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_PWT | PAGE_PCD |
+                                  PAGE_ACCESSED | PAGE_DIRTY | PAGE_GLOBAL | PAGE_NX_BIT);
+      for (uint32_t i = 0; i < PAGES_PER_TABLE; i++) {
+          pt_virt[i] = (uint32_t)(frame_base + i * PAGE_SIZE) | pte_flags;
+      }
+      paging_temp_unmap(pt_virt);
+
+      // The PT is fully populated before it becomes visible, so the range never goes unmapped.
+      pd_virt[pd_idx] = (pt_phys & PAGING_ADDR_MASK) | PDE_FLAGS_FROM_PTE(pde) | PAGE_PRESENT;
+      // INVLPG on any address inside a large page drops the whole 4MB TLB entry
+      paging_invalidate_page((void*)((uintptr_t)pd_idx << PAGING_PDE_SHIFT));
+      return 0;
+ }
+
  // --- TLB Flushing ---
 
  void tlb_flush_range(void* start_vaddr, size_t size) {
@@ -1832,9 +2041,8 @@ static uintptr_t temp_vaddr_alloc(void) {
         KERNEL_PANIC_HALT("Temporary VA allocator used before initialization!");
     }
 
-    // ---> FIX #2: Add Lock <---
-    // Requires functions like spinlock_acquire_irqsave from your spinlock.h
-    // uint32_t irq_flags = spinlock_acquire_irqsave(&g_temp_va_lock);
+    // Other CPUs allocate slots too
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_temp_va_lock);
     uintptr_t allocated_vaddr = 0;
 
     // FIX: Use unsigned int for loop variable matching KERNEL_TEMP_MAP_COUNT type
@@ -1846,9 +2054,7 @@ static uintptr_t temp_vaddr_alloc(void) {
         }
     }
 
-    // ---> FIX #2: Release Lock <---
-    // Requires functions like spinlock_release_irqrestore from your spinlock.h
-    // spinlock_release_irqrestore(&g_temp_va_lock, irq_flags);
+    spinlock_release_irqrestore(&g_temp_va_lock, irq_flags);
 
     if (allocated_vaddr == 0) {
         terminal_printf("[TempVA Alloc] Warning: Out of temporary virtual addresses!\n");
@@ -1866,9 +2072,7 @@ static void temp_vaddr_free(uintptr_t vaddr) {
 
     int bit = (vaddr - KERNEL_TEMP_MAP_START) / PAGE_SIZE;
 
-    // ---> FIX #2: Add Lock <---
-    // Requires functions like spinlock_acquire_irqsave from your spinlock.h
-    // uint32_t irq_flags = spinlock_acquire_irqsave(&g_temp_va_lock);
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_temp_va_lock);
 
     if (!bitmap_test(g_temp_va_bitmap, bit)) {
         terminal_printf("[TempVA Free] Warning: Double free detected for address %p (bit %d)\n", (void*)vaddr, bit);
@@ -1876,9 +2080,7 @@ static void temp_vaddr_free(uintptr_t vaddr) {
         bitmap_clear(g_temp_va_bitmap, bit);
     }
 
-    // ---> FIX #2: Release Lock <---
-    // Requires functions like spinlock_release_irqrestore from your spinlock.h
-    // spinlock_release_irqrestore(&g_temp_va_lock, irq_flags);
+    spinlock_release_irqrestore(&g_temp_va_lock, irq_flags);
 }
 
 
@@ -2000,6 +2202,19 @@ void copy_kernel_pde_entries(uint32_t *dst_pd)
 }
 
 int paging_unmap_range(uint32_t *page_directory_phys, uintptr_t virt_start_addr, size_t memsz) {
+    if (!page_directory_phys) {
+        terminal_printf("[Unmap Range] Error: Invalid Page Directory pointer (NULL).\n");
+        return -1;
+    }
+    mmu_gather_t tlb;
+    mmu_gather_init(&tlb, page_directory_phys, false);
+    int ret = paging_unmap_range_gather(&tlb, virt_start_addr, memsz);
+    mmu_gather_finish(&tlb);
+    return ret;
+}
+
+int paging_unmap_range_gather(mmu_gather_t *tlb, uintptr_t virt_start_addr, size_t memsz) {
+    uint32_t *page_directory_phys = tlb ? (uint32_t*)tlb->pd_phys : NULL;
     PAGING_DEBUG_PRINTF("Enter: V=[0x%#lx - 0x%#lx) in PD Phys %p",
         (unsigned long)virt_start_addr, (unsigned long)(virt_start_addr + memsz), (void*)page_directory_phys);
 
@@ -2087,12 +2302,30 @@ int paging_unmap_range(uint32_t *page_directory_phys, uintptr_t virt_start_addr,
              continue;
         }
 
-        // This function cannot handle unmapping parts of a 4MB page
         if (pde & PAGE_SIZE_4MB) {
-            terminal_printf("[Unmap Range] Error: Cannot unmap range overlapping 4MB page at V=0x%#lx (PDE[%u]=0x%lx).\n",
-                            (unsigned long)v_addr, pd_idx, (unsigned long)pde);
-            if (!is_current_pd) paging_temp_unmap(target_pd_virt); // Unmap temp PD if used
-            return -1; // Indicate error
+            uintptr_t large_base = PAGE_LARGE_ALIGN_DOWN(v_addr);
+            if (v_addr == large_base && v_end - large_base >= PAGE_SIZE_LARGE) {
+                // Whole 4MB page goes: drop the PDE, then its 1024 frame references
+                uintptr_t frame_base = pde & PAGING_PDE_ADDR_MASK_4MB;
+                PAGING_DEBUG_PRINTF("  Unmapping 4MB page V=%p (PDE[%u]=0x%lx)", (void*)large_base, (unsigned int)pd_idx, (unsigned long)pde);
+                target_pd_virt[pd_idx] = 0;
+                mmu_gather_add_range(tlb, large_base, PAGE_SIZE_LARGE);
+                for (size_t f = 0; f < PAGES_PER_TABLE; ++f) {
+                    mmu_gather_add_frame(tlb, frame_base + f * PAGE_SIZE);
+                }
+                unmapped_count += PAGES_PER_TABLE;
+                uintptr_t next_v_addr = large_base + PAGE_SIZE_LARGE;
+                if (next_v_addr <= v_addr) { v_addr = v_end; } else { v_addr = next_v_addr; }
+                continue;
+            }
+            // Partial unmap: turn the 4MB page into a PT of 4KB pages and unmap those below
+            if (paging_split_large_pde(target_pd_virt, pd_idx) != 0) {
+                terminal_printf("[Unmap Range] Error: Failed to split 4MB page at V=0x%#lx (PDE[%u]=0x%lx).\n",
+                                (unsigned long)v_addr, pd_idx, (unsigned long)pde);
+                if (!is_current_pd) paging_temp_unmap(target_pd_virt); // Unmap temp PD if used
+                return -1; // Indicate error
+            }
+            pde = target_pd_virt[pd_idx];
         }
 
         // PDE points to a 4KB Page Table
@@ -2132,8 +2365,7 @@ int paging_unmap_range(uint32_t *page_directory_phys, uintptr_t virt_start_addr,
                 PAGING_DEBUG_PRINTF("  Unmapping V=%p (PTE[%u]=0x%lx -> P=%#lx)",
                                     (void*)v_addr, pt_idx, (unsigned long)pte, (unsigned long)frame_phys);
                 pt_virt[pt_idx] = 0; // Clear the PTE
-                paging_invalidate_page((void*)v_addr); // Invalidate TLB for this virtual address
-                put_frame(frame_phys); // Free the underlying physical frame
+                mmu_gather_add_page(tlb, v_addr, frame_phys); // Invalidate + free once the batch flushes
                 unmapped_count++; // Increment count of unmapped pages
             }
 
@@ -2154,9 +2386,9 @@ int paging_unmap_range(uint32_t *page_directory_phys, uintptr_t virt_start_addr,
                 PAGING_DEBUG_PRINTF("PT at Phys 0x%#lx (PDE[%lu]) became empty. Freeing PT.",
                                     (unsigned long)pt_phys, (unsigned long)pd_idx);
                 target_pd_virt[pd_idx] = 0; // Clear the PDE in the target PD
-                // Invalidate TLB for an address covered by this PDE
-                paging_invalidate_page((void*)start_addr_of_pt_range);
-                put_frame(pt_phys); // Free the page table frame itself
+                // The PT frame may still sit in the paging-structure caches; free it after the flush too
+                mmu_gather_add_range(tlb, start_addr_of_pt_range, PAGE_SIZE);
+                mmu_gather_add_frame(tlb, pt_phys);
                 pt_freed = true; // Mark that the PT was freed
             }
         }
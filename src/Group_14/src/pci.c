@@ -0,0 +1,61 @@
+/**
+ * @file pci.c
+ * @brief PCI configuration-space access (see pci.h).
+ */
+
+#include "pci.h"
+#include "port_io.h"
+
+/** @brief Builds the CONFIG_ADDRESS value for a dword-aligned register. */
+static inline uint32_t pci_config_address(pci_addr_t addr, uint8_t offset) {
+    return 0x80000000u |
+           ((uint32_t)addr.bus << 16) |
+           ((uint32_t)(addr.device & 0x1F) << 11) |
+           ((uint32_t)(addr.function & 0x07) << 8) |
+           (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(pci_addr_t addr, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(addr, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_config_read16(pci_addr_t addr, uint8_t offset) {
+    return (uint16_t)(pci_config_read32(addr, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(pci_addr_t addr, uint8_t offset) {
+    return (uint8_t)(pci_config_read32(addr, offset) >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(pci_addr_t addr, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(addr, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_config_write16(pci_addr_t addr, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t dword = pci_config_read32(addr, offset);
+    dword = (dword & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_config_write32(addr, offset, dword);
+}
+
+bool pci_find_class(uint8_t class_code, uint8_t subclass, pci_addr_t *out) {
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t dev = 0; dev < 32; dev++) {
+            pci_addr_t a = { (uint8_t)bus, dev, 0 };
+            if (pci_config_read16(a, PCI_VENDOR_ID) == 0xFFFF) continue;
+            uint8_t functions = (pci_config_read8(a, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+            for (uint8_t fn = 0; fn < functions; fn++) {
+                a.function = fn;
+                if (pci_config_read16(a, PCI_VENDOR_ID) == 0xFFFF) continue;
+                if (pci_config_read8(a, PCI_CLASS) == class_code &&
+                    pci_config_read8(a, PCI_SUBCLASS) == subclass) {
+                    if (out) *out = a;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -40,9 +40,7 @@
 
  // *** The _Static_assert line that was here has been completely removed. ***
 
- #ifndef MAX_CPUS
- #define MAX_CPUS 4 // Adjust as needed for your target
- #endif
+ // MAX_CPUS comes from get_cpu_id.h (via slab.h), shared with the slab magazine layer
 
  // ---------------------------------------------------------------------------
  // Data Structures
@@ -57,18 +55,42 @@
  // Array of per-CPU allocator structures
  static cpu_allocator_t cpu_allocators[MAX_CPUS];
 
+ // Size -> class lookup, one entry per PERCPU_LUT_GRANULE bytes of total size.
+ // Built once in percpu_kmalloc_init(); replaces a linear scan on every kmalloc.
+ #define PERCPU_LUT_SHIFT 3
+ #define PERCPU_LUT_GRANULE (1u << PERCPU_LUT_SHIFT)
+ #define PERCPU_MAX_TOTAL_SIZE ALIGN_UP(KALLOC_HEADER_SIZE + SLAB_ALLOC_MAX_USER_SIZE, KMALLOC_MIN_ALIGNMENT)
+ #define PERCPU_LUT_ENTRIES ((PERCPU_MAX_TOTAL_SIZE + PERCPU_LUT_GRANULE - 1) / PERCPU_LUT_GRANULE + 1)
+ static uint8_t percpu_class_lut[PERCPU_LUT_ENTRIES];
+
  // ---------------------------------------------------------------------------
  // Internal Helper - Find matching size class index for *total* size
  // ---------------------------------------------------------------------------
- // get_size_class_index_for_total (Use size_t for loop)
-static int get_size_class_index_for_total(size_t total_size) {
-    // Use size_t for loop variable
-    for (size_t i = 0; i < NUM_PERCPU_SIZE_CLASSES; i++) {
-        if (total_size <= percpu_total_size_classes[i]) {
-            return (int)i; // Cast index back to int
-        }
+ /**
+  * @brief Fills percpu_class_lut. Entry k covers total sizes in
+  * ((k-1)*granule, k*granule]; the bucket's upper bound is clamped to the
+  * largest class so that class stays reachable when it is not granule-aligned.
+  */
+ static void build_size_class_lut(void) {
+     size_t largest = percpu_total_size_classes[NUM_PERCPU_SIZE_CLASSES - 1];
+     for (size_t k = 0; k < PERCPU_LUT_ENTRIES; k++) {
+         size_t bucket_max = k * PERCPU_LUT_GRANULE;
+         if (bucket_max > largest) bucket_max = largest;
+         percpu_class_lut[k] = (uint8_t)(NUM_PERCPU_SIZE_CLASSES - 1);
+         for (size_t i = 0; i < NUM_PERCPU_SIZE_CLASSES; i++) {
+             if (bucket_max <= percpu_total_size_classes[i]) {
+                 percpu_class_lut[k] = (uint8_t)i;
+                 break;
+             }
+         }
+     }
+ }
+
+ static inline int get_size_class_index_for_total(size_t total_size) {
+    if (total_size > percpu_total_size_classes[NUM_PERCPU_SIZE_CLASSES - 1]) {
+        return -1; // Size too large for any defined class
     }
-    return -1; // Size too large for any defined class
+    return percpu_class_lut[(total_size + PERCPU_LUT_GRANULE - 1) >> PERCPU_LUT_SHIFT];
 }
 
  // ---------------------------------------------------------------------------
@@ -86,6 +108,7 @@ static int get_size_class_index_for_total(size_t total_size) {
     }
 
     terminal_write("[percpu] Initializing per-CPU slab caches...\n");
+    build_size_class_lut();
     bool success = true;
     for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
         cpu_allocators[cpu].alloc_count = 0;
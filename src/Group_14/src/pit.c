@@ -4,6 +4,13 @@
  * pit.c
  * Programmable Interval Timer (PIT) driver for x86 (32-bit).
  * Updated to use isr_frame_t and aggressive workaround for 64-bit division.
+ *
+ * Channel 0 normally ticks periodically (mode 2, rate generator). In
+ * tickless mode the scheduler may switch it to a one-shot count (mode 0,
+ * interrupt on terminal count) while no task is waiting for the CPU. Time
+ * that passes in one-shot mode is read back from the counter and credited
+ * to the scheduler in whole ticks; leftover counts carry over, so the tick
+ * count does not drift however often the mode changes.
  */
 
  #include "pit.h"
@@ -14,11 +21,25 @@
  #include "scheduler.h" // Need scheduler_tick() or schedule() declaration
  #include "types.h"     // Ensure bool is defined via types.h -> stdbool.h
  #include "assert.h"    // For KERNEL_ASSERT
+ #include "spinlock.h"
+ #include "apic.h"      // IRQ 0 arrives through the IOAPIC once it is enabled
  #include <libc/stdint.h> // For UINT32_MAX
 
  // Global state variables
  // static volatile uint32_t pit_ticks = 0; // Can be removed if using scheduler_get_ticks()
 
+ // Dynamic tick state; guarded by s_pit_lock (any CPU may restart the tick)
+ static spinlock_t s_pit_lock;
+ static volatile bool s_tick_stopped;            // Channel 0 is counting a one-shot period
+ static bool s_swallow_irq;             // The pending one-shot IRQ was credited by pit_tick_restart
+ static uint32_t s_carry_counts;        // Counts elapsed but not yet credited as a whole tick
+ static uint32_t s_oneshot_start_carry; // s_carry_counts when the one-shot was armed
+ static uint32_t s_oneshot_counts;      // Counts programmed for the one-shot
+ static uint32_t s_oneshot_credited;    // Ticks of the one-shot already credited
+ static pit_stats_t s_stats;
+
+ _Static_assert(PIT_ONESHOT_MAX_TICKS * DIVIDER <= 0xFFFF, "PIT_ONESHOT_MAX_TICKS does not fit the 16-bit counter");
+
  // Define TARGET_FREQUENCY if not defined elsewhere (e.g., in pit.h or build system)
  #ifndef TARGET_FREQUENCY
  #define TARGET_FREQUENCY 1000 // Default to 1000 Hz if not defined
@@ -90,17 +111,6 @@
  }
 
 
- /**
-  * PIT IRQ handler:
-  * Calls the scheduler's tick function.
-  */
- static void pit_irq_handler(isr_frame_t *frame) {
-    serial_write("[PIT] Enter pit_irq_handler\n");
-     (void)frame;
-     // --- Call scheduler tick handler ---
-     scheduler_tick(); // <<< Ensure this matches your advanced scheduler function name
- }
-
  /**
   * Returns the current tick count since PIT initialization.
   * (Delegates to scheduler if scheduler manages the global tick)
@@ -123,7 +133,7 @@
       if (divisor > 0xFFFF) divisor = 0xFFFF; // Clamp to max 16-bit value
       if (divisor < 1) divisor = 1;          // Minimum divisor is 1
 
-      outb(PIT_CMD_PORT, 0x36); // Channel 0, Lobyt/Hibyte, Mode 3 (Square Wave)
+      outb(PIT_CMD_PORT, 0x34); // Channel 0, Lobyt/Hibyte, Mode 2 (Rate Generator; count is readable)
       io_wait(); // Short delay after command write
       uint16_t divisor_16 = (uint16_t)divisor;
       outb(PIT_CHANNEL0_PORT, (uint8_t)(divisor_16 & 0xFF)); // Send low byte
@@ -133,17 +143,213 @@
  }
 
 
+ // --- Dynamic Tick ---
+
+ /** Reads channel 0's count; out_high is set once a one-shot has run out. */
+ static uint16_t pit_read_count(bool *out_high) {
+     outb(PIT_CMD_PORT, 0xC2); // Read-back: latch status and count of channel 0
+     uint8_t status = inb(PIT_CHANNEL0_PORT);
+     uint8_t lo = inb(PIT_CHANNEL0_PORT);
+     uint8_t hi = inb(PIT_CHANNEL0_PORT);
+     *out_high = (status & 0x80) != 0;
+     return (uint16_t)((hi << 8) | lo);
+ }
+
+ /**
+  * True if IRQ 0 is raised but not yet delivered. With the APICs it is only
+  * visible at the BSP's local APIC, so only the BSP may stop the tick.
+  */
+ static bool pit_irq_pending(void) {
+     if (apic_is_enabled()) return lapic_vector_pending(IRQ0_VECTOR);
+     outb(PIC1_CMD_PORT, 0x0A); // OCW3: read IRR
+     return (inb(PIC1_CMD_PORT) & 0x01) != 0;
+ }
+
+ static void pit_program_oneshot(uint16_t counts) {
+     outb(PIT_CMD_PORT, 0x30); // Channel 0, Lobyte/Hibyte, Mode 0 (Interrupt on Terminal Count)
+     outb(PIT_CHANNEL0_PORT, (uint8_t)(counts & 0xFF));
+     outb(PIT_CHANNEL0_PORT, (uint8_t)(counts >> 8));
+ }
+
+ /**
+  * Works out how many whole ticks of the one-shot have passed that are not
+  * credited yet, and keeps the remainder in s_carry_counts.
+  */
+ static uint32_t pit_oneshot_collect(bool *expired) {
+     bool out_high;
+     uint16_t count = pit_read_count(&out_high);
+     uint32_t elapsed = s_oneshot_start_carry;
+     if (out_high) {
+         elapsed += s_oneshot_counts;
+     } else if (count <= s_oneshot_counts) {
+         elapsed += s_oneshot_counts - count;
+     } // else: the count is not loaded yet, nothing has passed
+     uint32_t ticks = elapsed / DIVIDER;
+     uint32_t fresh = ticks - s_oneshot_credited;
+     s_oneshot_credited = ticks;
+     s_carry_counts = elapsed % DIVIDER;
+     s_stats.stopped_ticks += fresh;
+     *expired = out_high;
+     return fresh;
+ }
+
+ void pit_tick_stop(uint32_t ticks) {
+     if (!PIT_TICKLESS) return;
+     if (ticks == 0) ticks = 1;
+     if (ticks > PIT_ONESHOT_MAX_TICKS) ticks = PIT_ONESHOT_MAX_TICKS;
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pit_lock);
+
+     if (s_tick_stopped) {
+         // Re-arm: credit what has passed. If the old count already ran out,
+         // its pending IRQ finds the new count running and is ignored.
+         bool expired;
+         uint32_t fresh = pit_oneshot_collect(&expired);
+         if (fresh) scheduler_account_ticks(fresh);
+     } else {
+         // Leaving periodic mode: keep the part of the current period that has passed
+         bool out_high;
+         uint16_t count = pit_read_count(&out_high);
+         if (pit_irq_pending() && !s_swallow_irq) {
+             // A full period ended but its IRQ has not run; it will be ignored, so credit it here
+             scheduler_account_ticks(1);
+             if (ticks > 1) ticks--;
+         }
+         if (count > 0 && count <= DIVIDER) {
+             s_carry_counts += DIVIDER - count;
+             if (s_carry_counts >= DIVIDER) {
+                 scheduler_account_ticks(1);
+                 s_carry_counts -= DIVIDER;
+             }
+         }
+     }
+
+     s_oneshot_start_carry = s_carry_counts;
+     s_oneshot_counts = ticks * DIVIDER - s_carry_counts;
+     s_oneshot_credited = 0;
+     s_carry_counts = 0;
+     pit_program_oneshot((uint16_t)s_oneshot_counts);
+     s_tick_stopped = true;
+     s_swallow_irq = false;
+     s_stats.oneshots++;
+     spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+ }
+
+ void pit_tick_restart(void) {
+     if (!s_tick_stopped) return; // Common case, no lock needed
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pit_lock);
+     if (!s_tick_stopped) {
+         spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+         return;
+     }
+     bool expired;
+     uint32_t fresh = pit_oneshot_collect(&expired);
+     s_tick_stopped = false;
+     set_pit_frequency(TARGET_FREQUENCY);
+     if (fresh) scheduler_account_ticks(fresh);
+     if (expired) {
+         s_swallow_irq = true; // Its IRQ is still pending at the PIC
+     } else {
+         s_stats.early_restarts++;
+     }
+     spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+ }
+
+ void pit_tick_sync(void) {
+     if (!s_tick_stopped) return;
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pit_lock);
+     if (s_tick_stopped) {
+         bool expired;
+         uint32_t fresh = pit_oneshot_collect(&expired);
+         if (fresh) scheduler_account_ticks(fresh);
+     }
+     spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+ }
+
+ bool pit_tick_stopped(void) {
+     return s_tick_stopped;
+ }
+
+ void pit_get_stats(pit_stats_t *stats) {
+     if (!stats) return;
+     uint32_t eflags;
+     asm volatile("pushf; pop %0; cli" : "=r"(eflags));
+     *stats = s_stats;
+     if (eflags & 0x200) asm volatile("sti");
+ }
+
+ /**
+  * PIT IRQ handler:
+  * Calls the scheduler's tick function. After a one-shot period, first
+  * credits the ticks it covered and returns to the periodic tick.
+  */
+ static void pit_irq_handler(isr_frame_t *frame) {
+    serial_write("[PIT] Enter pit_irq_handler\n");
+     (void)frame;
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&s_pit_lock);
+     s_stats.irqs++;
+     if (s_tick_stopped) {
+         bool expired;
+         uint32_t fresh = pit_oneshot_collect(&expired);
+         if (!expired) {
+             // A periodic IRQ that was already pending when the tick stopped
+             if (fresh) scheduler_account_ticks(fresh);
+             spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+             return;
+         }
+         s_tick_stopped = false;
+         set_pit_frequency(TARGET_FREQUENCY);
+         s_stats.oneshot_expiries++;
+         // scheduler_tick() below counts the last tick and runs the timers due
+         if (fresh > 1) scheduler_account_ticks(fresh - 1);
+         if (fresh == 0) {
+             spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+             return;
+         }
+     } else if (s_swallow_irq) {
+         s_swallow_irq = false;
+         spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+         return;
+     }
+     spinlock_release_irqrestore(&s_pit_lock, irq_flags);
+     // --- Call scheduler tick handler ---
+     scheduler_tick(); // <<< Ensure this matches your advanced scheduler function name
+ }
+
  /**
   * Initializes the PIT:
   * Registers the IRQ handler and sets the desired frequency.
   */
  void init_pit(void) {
      // pit_ticks = 0; // Local tick count likely not needed if scheduler manages it
+     spinlock_init(&s_pit_lock);
      register_int_handler(32, pit_irq_handler, NULL); // Register IRQ 0 (vector 32)
      set_pit_frequency(TARGET_FREQUENCY);
      terminal_printf("[PIT] Initialized (Target Frequency: %lu Hz)\n", (unsigned long)TARGET_FREQUENCY);
  }
 
+ /**
+  * Busy-waits on channel 2 (the speaker channel, with the speaker output
+  * off), which needs neither interrupts nor channel 0. Used to calibrate the
+  * local APIC timer and to time the AP startup sequence.
+  */
+ void pit_busy_wait_us(uint32_t us) {
+     uint8_t port61 = inb(PC_SPEAKER_PORT);
+     while (us) {
+         uint32_t chunk = us > 50000 ? 50000 : us; // 50 ms fits the 16-bit count
+         uint32_t counts = chunk * 1193 / 1000;
+         if (counts == 0) counts = 1;
+         outb(PC_SPEAKER_PORT, (port61 & ~0x02) | 0x01); // Gate on, speaker off
+         outb(PIT_CMD_PORT, 0xB0); // Channel 2, Lobyte/Hibyte, Mode 0 (OUT2 rises at terminal count)
+         outb(PIT_CHANNEL2_PORT, (uint8_t)(counts & 0xFF));
+         outb(PIT_CHANNEL2_PORT, (uint8_t)(counts >> 8));
+         while (!(inb(PC_SPEAKER_PORT) & 0x20)) {
+             asm volatile("pause");
+         }
+         us -= chunk;
+     }
+     outb(PC_SPEAKER_PORT, port61);
+ }
+
  /**
   * Busy-wait sleep (high CPU usage).
   * Uses the 32-bit workaround calculation.
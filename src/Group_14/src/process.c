@@ -16,14 +16,12 @@
  #include "types.h"          // Core type definitions
  #include "string.h"         // For memset, memcpy
  #include "scheduler.h"      // For get_current_task() etc. (Adapt based on scheduler API)
- #include "read_file.h"      // For read_file() helper
  #include "frame.h"          // For frame_alloc, put_frame
  #include "kmalloc_internal.h" // For ALIGN_UP (used by PAGE_ALIGN_UP in paging.h)
  #include "elf.h"            // ELF header definitions
  #include <libc/stddef.h>    // For NULL
  #include "assert.h"         // For KERNEL_ASSERT
  #include "gdt.h"            // For GDT_USER_CODE_SELECTOR, GDT_USER_DATA_SELECTOR
- #include "tss.h"            // For tss_set_kernel_stack
  #include "sys_file.h"       // For sys_close() definition and sys_file_t type <-- Added include
  #include "fs_limits.h"      // For MAX_FD <-- Added include
  #include "fs_errno.h"       // For error codes (ENOENT, ENOEXEC, ENOMEM, EIO) <-- Added include
@@ -78,13 +76,23 @@
  extern uint32_t g_kernel_page_directory_phys; // Physical address of kernel's page directory
  extern bool g_nx_supported;                   // NX support flag
  
- // Process ID counter - NEEDS LOCKING FOR SMP
+ // Process ID counter; taken with atomic_fetch_add_u32, forks run on every CPU
  static uint32_t next_pid = 1;
- // TODO: Add spinlock_t g_pid_lock;
  
- // Simple linear allocator for kernel stack virtual addresses
- // WARNING: Placeholder only! Not suitable for production/SMP. Needs proper allocator.
+ // Simple linear allocator for kernel stack virtual addresses (ranges are not reused)
  static uintptr_t g_next_kernel_stack_virt_base = KERNEL_STACK_VIRT_START;
+ static spinlock_t g_kernel_stack_va_lock; // Protects g_next_kernel_stack_virt_base
+
+ /**
+  * Gives back a kernel stack range reserved by allocate_kernel_stack after a
+  * failure. Only the most recent reservation can be rewound; if another fork
+  * reserved after it, the range is left unused rather than handed out twice.
+  */
+ static void release_kernel_stack_va(uintptr_t base, uintptr_t end) {
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&g_kernel_stack_va_lock);
+     if (g_next_kernel_stack_virt_base == end) g_next_kernel_stack_virt_base = base;
+     spinlock_release_irqrestore(&g_kernel_stack_va_lock, irq_flags);
+ }
  // TODO: Replace with a proper kernel virtual address space allocator (e.g., using VMAs)
  
  // ------------------------------------------------------------------------
@@ -92,9 +100,11 @@
  // ------------------------------------------------------------------------
  static bool allocate_kernel_stack(pcb_t *proc);
  static int load_elf_and_init_memory(const char *path, mm_struct_t *mm, uint32_t *entry_point, uintptr_t *initial_brk);
- static int copy_elf_segment_data(uintptr_t frame_paddr, const uint8_t* file_data_buffer, size_t file_buffer_offset, size_t size_to_copy, size_t zero_padding);
+ static int populate_elf_partial_page(mm_struct_t *mm, file_t *file, uintptr_t page_v, off_t file_offset, size_t file_bytes, uint32_t page_prot);
  static void prepare_initial_kernel_stack(pcb_t *proc);
+ static void prepare_fork_kernel_stack(pcb_t *child, const isr_frame_t *parent_regs);
  extern void copy_kernel_pde_entries(uint32_t *new_pd_virt); // From paging.c
+ extern void fork_child_return(void);                        // From syscall.asm
  
  // --- FD Management Function Prototypes (implementation below) ---
  void process_init_fds(pcb_t *proc);
@@ -125,7 +135,7 @@
      size_t total_alloc_size = num_pages_with_guard * PAGE_SIZE; // Total size including guard
 
      // *** GUARD PAGE FIX: Ensure log message reflects the extra page ***
-     terminal_printf("  Allocating %lu pages + 1 guard page (%lu bytes total) for kernel stack...\n",
+     PROC_DEBUG_PRINTF("Allocating %lu pages + 1 guard page (%lu bytes total) for kernel stack...\n",
                      (unsigned long)num_usable_pages, (unsigned long)total_alloc_size);
 
      // Use kmalloc for the temporary array holding physical frame addresses
@@ -152,16 +162,20 @@
      }
      proc->kernel_stack_phys_base = (uint32_t)phys_frames[0];
      // *** GUARD PAGE FIX: Update log message ***
-     terminal_printf("  Successfully allocated %lu physical frames (incl. guard) for kernel stack.\n", (unsigned long)allocated_count);
+     PROC_DEBUG_PRINTF("Allocated %lu physical frames (incl. guard) for kernel stack.\n", (unsigned long)allocated_count);
 
      // 2. Allocate Virtual Range (Allocate for num_pages_with_guard)
      PROC_DEBUG_PRINTF("[Process DEBUG %s:%d] Allocating virtual range...\n", __func__, __LINE__);
-     // TODO: Add locking for g_next_kernel_stack_virt_base in SMP
+     uintptr_t va_flags = spinlock_acquire_irqsave(&g_kernel_stack_va_lock);
      uintptr_t kstack_virt_base = g_next_kernel_stack_virt_base;
      // *** GUARD PAGE FIX: Use total size including guard ***
      uintptr_t kstack_virt_end_with_guard = kstack_virt_base + total_alloc_size;
      // Check for overflow and exceeding bounds
-     if (kstack_virt_base < KERNEL_STACK_VIRT_START || kstack_virt_end_with_guard > KERNEL_STACK_VIRT_END || kstack_virt_end_with_guard <= kstack_virt_base) {
+     bool va_ok = !(kstack_virt_base < KERNEL_STACK_VIRT_START || kstack_virt_end_with_guard > KERNEL_STACK_VIRT_END ||
+                    kstack_virt_end_with_guard <= kstack_virt_base);
+     if (va_ok) g_next_kernel_stack_virt_base = kstack_virt_end_with_guard; // Advance allocator
+     spinlock_release_irqrestore(&g_kernel_stack_va_lock, va_flags);
+     if (!va_ok) {
         terminal_printf("[Process] ERROR: Kernel stack virtual address range invalid or exhausted [%#lx - %#lx).\n",
                         (unsigned long)kstack_virt_base, (unsigned long)kstack_virt_end_with_guard);
         // Free allocated physical frames
@@ -169,10 +183,9 @@
         kfree(phys_frames);
         return false;
      }
-     g_next_kernel_stack_virt_base = kstack_virt_end_with_guard; // Advance allocator
      KERNEL_ASSERT((kstack_virt_base % PAGE_SIZE) == 0, "Kernel stack virt base not page aligned");
      // *** GUARD PAGE FIX: Update log message ***
-     terminal_printf("  Allocated kernel stack VIRTUAL range (incl. guard): [%#lx - %#lx)\n",
+     PROC_DEBUG_PRINTF("Allocated kernel stack VIRTUAL range (incl. guard): [%#lx - %#lx)\n",
                      (unsigned long)kstack_virt_base, (unsigned long)kstack_virt_end_with_guard);
 
      // 3. Map Physical Frames to Virtual Range in Kernel Page Directory
@@ -187,7 +200,7 @@
             terminal_printf("[Process] ERROR: Kernel page directory physical address not set for mapping.\n");
             for(size_t j = 0; j < num_pages_with_guard; ++j) { if (phys_frames[j] != 0) put_frame(phys_frames[j]); }
             kfree(phys_frames);
-            g_next_kernel_stack_virt_base = kstack_virt_base; // Roll back VA allocator
+            release_kernel_stack_va(kstack_virt_base, kstack_virt_end_with_guard);
             return false;
          }
          int map_res = paging_map_single_4k((uint32_t*)g_kernel_page_directory_phys, target_vaddr, phys_addr, PTE_KERNEL_DATA_FLAGS);
@@ -200,7 +213,7 @@
                 if (phys_frames[j] != 0) put_frame(phys_frames[j]);
             }
             kfree(phys_frames);
-            g_next_kernel_stack_virt_base = kstack_virt_base; // Roll back VA allocator
+            release_kernel_stack_va(kstack_virt_base, kstack_virt_end_with_guard);
             return false;
          }
      }
@@ -214,11 +227,11 @@
      uint32_t test_value = 0xDEADBEEF;
      uint32_t read_back1 = 0, read_back2 = 0;
 
-     terminal_printf("  Writing test value to stack bottom: %p\n", (void*)stack_bottom_ptr);
+     PROC_DEBUG_PRINTF("Writing test value to stack bottom: %p\n", (void*)stack_bottom_ptr);
      *stack_bottom_ptr = test_value;
      read_back1 = *stack_bottom_ptr;
 
-     terminal_printf("  Writing test value to stack top word: %p\n", (void*)stack_top_word_ptr);
+     PROC_DEBUG_PRINTF("Writing test value to stack top word: %p\n", (void*)stack_top_word_ptr);
      *stack_top_word_ptr = test_value;
      read_back2 = *stack_top_word_ptr;
 
@@ -231,7 +244,7 @@
          // *** GUARD PAGE FIX: Free all frames ***
          for(size_t i=0; i<num_pages_with_guard; ++i) { if(phys_frames[i]) put_frame(phys_frames[i]); }
          kfree(phys_frames);
-         g_next_kernel_stack_virt_base = kstack_virt_base; // Roll back VA allocator
+         release_kernel_stack_va(kstack_virt_base, kstack_virt_end_with_guard);
          return false;
      }
      PROC_DEBUG_PRINTF("[Process DEBUG %s:%d] Kernel stack write test PASSED (usable range).\n", __func__, __LINE__);
@@ -243,14 +256,13 @@
      kfree(phys_frames); // Free the temporary array
 
      // *** GUARD PAGE FIX: Update log message ***
-     terminal_printf("  Kernel stack mapped (incl. guard): PhysBase=%#lx, VirtBase=%#lx, Usable VirtTop=%p\n",
+     PROC_DEBUG_PRINTF("Kernel stack mapped (incl. guard): PhysBase=%#lx, VirtBase=%#lx, Usable VirtTop=%p\n",
                      (unsigned long)proc->kernel_stack_phys_base,
                      (unsigned long)kstack_virt_base,
                      (void*)proc->kernel_stack_vaddr_top);
 
-     // 6. Update TSS ESP0 using the (unchanged) value of kernel_stack_vaddr_top
-     terminal_printf("  Updating TSS esp0 = %p\n", (void*)proc->kernel_stack_vaddr_top);
-     tss_set_kernel_stack((uint32_t)proc->kernel_stack_vaddr_top);
+     // TSS.esp0 is pointed here by perform_context_switch when the task runs;
+     // setting it now would move the caller's (e.g. a forking parent's) stack
 
      PROC_DEBUG_PRINTF("[Process DEBUG %s:%d] Exit OK\n", __func__, __LINE__);
      return true; // Success
@@ -277,95 +289,65 @@
  }
  
  // ------------------------------------------------------------------------
- // copy_elf_segment_data - Populate a physical frame with ELF data
+ // populate_elf_partial_page - Build the page where file data meets .bss
  // ------------------------------------------------------------------------
  /**
-  * @brief Copies data from an ELF file buffer into a physical memory frame,
-  * handling zero-padding (BSS). Uses temporary kernel mapping.
-  * @param frame_paddr Physical address of the destination frame (must be page-aligned).
-  * @param file_data_buffer Pointer to the buffer containing the entire ELF file data.
-  * @param file_buffer_offset Offset within file_data_buffer where data for this frame starts.
-  * @param size_to_copy Number of bytes to copy from the file buffer.
-  * @param zero_padding Number of bytes to zero-fill after the copied data.
-  * @return 0 on success, -1 on failure (e.g., temp mapping failed).
+  * @brief Fills and maps the one page of a segment that holds both the end of
+  * its file data and the start of its .bss.
+  * @details A file-backed page would show whatever the file holds past
+  * p_filesz, so this page is built privately instead: a zeroed frame with only
+  * the segment's file bytes read into it.
+  * @param mm Pointer to the process's memory management structure.
+  * @param file The executable.
+  * @param page_v Page-aligned user virtual address of the page.
+  * @param file_offset File offset corresponding to page_v.
+  * @param file_bytes Bytes of file data at the start of the page (< PAGE_SIZE).
+  * @param page_prot Page flags for the mapping.
+  * @return 0 on success, negative error code on failure.
   */
- static int copy_elf_segment_data(uintptr_t frame_paddr,
-                                 const uint8_t* file_data_buffer,
-                                 size_t file_buffer_offset,
-                                 size_t size_to_copy,
-                                 size_t zero_padding)
-{
-     PROC_DEBUG_PRINTF("Enter P=%#lx, offset=%lu, copy=%lu, zero=%lu\n", (unsigned long)frame_paddr, (unsigned long)file_buffer_offset, (unsigned long)size_to_copy, (unsigned long)zero_padding);
-     KERNEL_ASSERT(frame_paddr != 0 && (frame_paddr % PAGE_SIZE) == 0, "copy_elf_segment_data: Invalid physical address");
-     KERNEL_ASSERT(size_to_copy + zero_padding <= PAGE_SIZE, "ELF copy + zero exceeds frame");
- 
-     // Sanity check the input parameters
-     if (!file_data_buffer && size_to_copy > 0) {
-         terminal_printf("[Process] copy_elf_segment_data: ERROR: NULL file_data_buffer with non-zero copy size.\n");
-         return -1;
-     }
+ static int populate_elf_partial_page(mm_struct_t *mm, file_t *file, uintptr_t page_v,
+                                      off_t file_offset, size_t file_bytes, uint32_t page_prot)
+ {
+     KERNEL_ASSERT(file_bytes > 0 && file_bytes < PAGE_SIZE, "populate_elf_partial_page: Invalid size");
 
-     if (file_buffer_offset > 0 && !file_data_buffer) {
-         terminal_printf("[Process] copy_elf_segment_data: ERROR: Non-zero file offset with NULL file_data_buffer.\n");
-         return -1;
-     }
+     uintptr_t phys_page = frame_alloc_zeroed();
+     if (!phys_page) return -ENOMEM;
 
-     // Temporarily map the physical frame into kernel space
-     PROC_DEBUG_PRINTF("Calling paging_temp_map for P=%#lx\n", (unsigned long)frame_paddr);
-     // Use PTE_KERNEL_DATA_FLAGS to ensure it's writable by kernel
-     void* temp_vaddr = paging_temp_map(frame_paddr, PTE_KERNEL_DATA_FLAGS);
- 
-     if (temp_vaddr == NULL) {
-         terminal_printf("[Process] copy_elf_segment_data: ERROR: paging_temp_map failed (paddr=%#lx).\n", (unsigned long)frame_paddr);
-         return -1;
+     void *temp_vaddr = paging_temp_map(phys_page, PTE_KERNEL_DATA_FLAGS);
+     if (!temp_vaddr) {
+         put_frame(phys_page);
+         return -EIO;
      }
-     PROC_DEBUG_PRINTF("paging_temp_map returned V=%p\n", temp_vaddr);
- 
-     // Copy data from ELF file buffer - with added validation
-     if (size_to_copy > 0) {
-         PROC_DEBUG_PRINTF("memcpy: dst=%p, src=%p + %lu, size=%lu\n", temp_vaddr, file_data_buffer, (unsigned long)file_buffer_offset, (unsigned long)size_to_copy);
-         KERNEL_ASSERT(file_data_buffer != NULL, "copy_elf_segment_data: NULL file_data_buffer");
-         
-         // Extra debug to see what we're copying - print first few bytes
-         if (PROCESS_DEBUG && size_to_copy >= 4) {
-             const uint8_t* src = file_data_buffer + file_buffer_offset;
-             PROC_DEBUG_PRINTF("First 4 bytes: %02x %02x %02x %02x\n", 
-                             src[0], src[1], src[2], src[3]);
-         }
-         
-         // Do the actual copy
-         memcpy(temp_vaddr, file_data_buffer + file_buffer_offset, size_to_copy);
-         
-         // Verify the copy succeeded
-         if (PROCESS_DEBUG && size_to_copy >= 4) {
-             const uint8_t* dst = (const uint8_t*)temp_vaddr;
-             PROC_DEBUG_PRINTF("Verify first 4 bytes: %02x %02x %02x %02x\n", 
-                             dst[0], dst[1], dst[2], dst[3]);
-         }
+     int bytes_read = vfs_pread(file, temp_vaddr, file_bytes, file_offset);
+     paging_temp_unmap(temp_vaddr);
+     if (bytes_read < 0 || (size_t)bytes_read != file_bytes) {
+         terminal_printf("[Process] load_elf: ERROR: Short read (%d of %lu bytes) at offset %#lx.\n",
+                         bytes_read, (unsigned long)file_bytes, (unsigned long)file_offset);
+         put_frame(phys_page);
+         return -EIO;
      }
-     
-     // Zero out the BSS portion within this page
-     if (zero_padding > 0) {
-         PROC_DEBUG_PRINTF("memset: dst=%p + %lu, val=0, size=%lu\n", temp_vaddr, (unsigned long)size_to_copy, (unsigned long)zero_padding);
-         memset((uint8_t*)temp_vaddr + size_to_copy, 0, zero_padding);
+
+     // Mapping takes over the frame's reference
+     if (paging_map_single_4k(mm->pgd_phys, page_v, phys_page, page_prot) != 0) {
+         put_frame(phys_page);
+         return -ENOMEM;
      }
- 
-     // Unmap the specific temporary kernel mapping
-     PROC_DEBUG_PRINTF("Calling paging_temp_unmap for V=%p\n", temp_vaddr);
-     paging_temp_unmap(temp_vaddr);
-     PROC_DEBUG_PRINTF("Exit OK\n");
-     return 0; // success
-}
+     return 0;
+ }
  
  
  // ------------------------------------------------------------------------
- // load_elf_and_init_memory - Load ELF, setup VMAs, populate pages
+ // load_elf_and_init_memory - Load ELF headers, set up demand-paged VMAs
  // ------------------------------------------------------------------------
  /**
-  * @brief Loads an ELF executable from a file buffer, validates it, creates
-  * Virtual Memory Areas (VMAs) for LOAD segments, allocates physical frames,
-  * copies segment data, and maps the frames into the process's address space.
-  * @param path Path to the executable (used for logging).
+  * @brief Loads an ELF executable, validates it and creates Virtual Memory
+  * Areas (VMAs) for its LOAD segments. Nothing but the headers is read here.
+  * @details Each segment's file data becomes a private file-backed VMA, so
+  * its pages fault in through the page cache on first touch; a write copies
+  * the page (COW). The rest of the segment (.bss) is an anonymous VMA that
+  * faults in zero-filled. The only page populated up front is one shared by
+  * the end of the file data and the start of .bss, which must be partly zero.
+  * @param path Path to the executable.
   * @param mm Pointer to the process's memory management structure.
   * @param entry_point Output parameter for the ELF entry point virtual address.
   * @param initial_brk Output parameter for the initial program break address (end of loaded data).
@@ -379,55 +361,71 @@
       PROC_DEBUG_PRINTF("Enter path='%s', mm=%p", path ? path : "<NULL>", mm);
       KERNEL_ASSERT(path != NULL && mm != NULL && entry_point != NULL && initial_brk != NULL, "load_elf: Invalid arguments");
 
-      size_t file_size = 0;
-      uint8_t *file_data = NULL;
-      uintptr_t phys_page = 0; // Tracks a potentially allocated frame that needs freeing on error
+      Elf32_Ehdr ehdr;
+      Elf32_Phdr *phdr_table = NULL;
+      vfs_file_id_t file_id;
       int result = -1; // Default to error
 
-      // 1. Read ELF file using the read_file helper
-      PROC_DEBUG_PRINTF("Reading file '%s'", path);
-      file_data = (uint8_t*)read_file(path, &file_size); // read_file allocates buffer
-      if (!file_data) {
-          terminal_printf("[Process] load_elf: ERROR: Failed to read file '%s'.\n", path);
-          result = -ENOENT; // File not found or read error
-          goto cleanup_load_elf;
+      // 1. Open the ELF file. The VMAs take their own references to it.
+      file_t *file = vfs_open(path, O_RDONLY);
+      if (!file) {
+          terminal_printf("[Process] load_elf: ERROR: Failed to open file '%s'.\n", path);
+          return -ENOENT;
       }
-      PROC_DEBUG_PRINTF("File read: size=%lu bytes, buffer=%p", (unsigned long)file_size, file_data);
-      if (file_size < sizeof(Elf32_Ehdr)) {
-          terminal_printf("[Process] load_elf: ERROR: File '%s' is too small to be an ELF file (size %lu).\n", path, (unsigned long)file_size);
+      off_t file_size = vfs_lseek(file, 0, SEEK_END);
+      if (file_size < (off_t)sizeof(Elf32_Ehdr)) {
+          terminal_printf("[Process] load_elf: ERROR: File '%s' is too small to be an ELF file (size %ld).\n", path, (long)file_size);
           result = -ENOEXEC; // Exec format error
           goto cleanup_load_elf;
       }
+      if (vfs_identify(file, &file_id) != FS_SUCCESS) {
+          terminal_printf("[Process] load_elf: ERROR: Filesystem of '%s' cannot back file mappings.\n", path);
+          result = -ENOEXEC;
+          goto cleanup_load_elf;
+      }
 
-      // 2. Parse and Validate ELF Header
-      PROC_DEBUG_PRINTF("Parsing ELF header...");
-      Elf32_Ehdr *ehdr = (Elf32_Ehdr *)file_data;
+      // 2. Read and Validate ELF Header
+      PROC_DEBUG_PRINTF("Reading ELF header...");
+      if (vfs_pread(file, &ehdr, sizeof(ehdr), 0) != (int)sizeof(ehdr)) {
+          terminal_printf("[Process] load_elf: ERROR: Failed to read ELF header of '%s'.\n", path);
+          result = -EIO; goto cleanup_load_elf;
+      }
 
       // Check ELF Magic Number, Class, Type, Machine, Program Header Table validity
-      if (ehdr->e_ident[EI_MAG0] != ELFMAG0 || ehdr->e_ident[EI_MAG1] != ELFMAG1 ||
-          ehdr->e_ident[EI_MAG2] != ELFMAG2 || ehdr->e_ident[EI_MAG3] != ELFMAG3) {
+      if (ehdr.e_ident[EI_MAG0] != ELFMAG0 || ehdr.e_ident[EI_MAG1] != ELFMAG1 ||
+          ehdr.e_ident[EI_MAG2] != ELFMAG2 || ehdr.e_ident[EI_MAG3] != ELFMAG3) {
           terminal_printf("[Process] load_elf: ERROR: Invalid ELF magic number for '%s'.\n", path);
           result = -ENOEXEC; goto cleanup_load_elf;
       }
-      if (ehdr->e_ident[EI_CLASS] != ELFCLASS32 || ehdr->e_type != ET_EXEC || ehdr->e_machine != EM_386) {
+      if (ehdr.e_ident[EI_CLASS] != ELFCLASS32 || ehdr.e_type != ET_EXEC || ehdr.e_machine != EM_386) {
            terminal_printf("[Process] load_elf: ERROR: ELF file '%s' is not a 32-bit i386 executable.\n", path);
            result = -ENOEXEC; goto cleanup_load_elf;
       }
-       if (ehdr->e_phoff == 0 || ehdr->e_phnum == 0 ||
-           (ehdr->e_phoff + (uint64_t)ehdr->e_phnum * ehdr->e_phentsize) > file_size) {
-           terminal_printf("[Process] load_elf: ERROR: Invalid program header table in '%s'.\n", path);
-           result = -ENOEXEC; goto cleanup_load_elf;
-       }
+      if (ehdr.e_phoff == 0 || ehdr.e_phnum == 0 || ehdr.e_phentsize != sizeof(Elf32_Phdr) ||
+          (ehdr.e_phoff + (uint64_t)ehdr.e_phnum * sizeof(Elf32_Phdr)) > (uint64_t)file_size) {
+          terminal_printf("[Process] load_elf: ERROR: Invalid program header table in '%s'.\n", path);
+          result = -ENOEXEC; goto cleanup_load_elf;
+      }
 
-      *entry_point = ehdr->e_entry;
+      *entry_point = ehdr.e_entry;
       terminal_printf("  ELF Entry Point: %#lx\n", (unsigned long)*entry_point);
 
-      // 3. Process Program Headers (Segments)
-      PROC_DEBUG_PRINTF("Processing %u program headers...", (unsigned)ehdr->e_phnum);
-      Elf32_Phdr *phdr_table = (Elf32_Phdr *)(file_data + ehdr->e_phoff);
+      // 3. Read the Program Header Table
+      size_t phdr_table_size = (size_t)ehdr.e_phnum * sizeof(Elf32_Phdr);
+      phdr_table = (Elf32_Phdr *)kmalloc(phdr_table_size);
+      if (!phdr_table) {
+          result = -ENOMEM; goto cleanup_load_elf;
+      }
+      if (vfs_pread(file, phdr_table, phdr_table_size, (off_t)ehdr.e_phoff) != (int)phdr_table_size) {
+          terminal_printf("[Process] load_elf: ERROR: Failed to read program headers of '%s'.\n", path);
+          result = -EIO; goto cleanup_load_elf;
+      }
+
+      // 4. Create VMAs for the LOAD segments
+      PROC_DEBUG_PRINTF("Processing %u program headers...", (unsigned)ehdr.e_phnum);
       uintptr_t highest_addr_loaded = 0;
 
-      for (Elf32_Half i = 0; i < ehdr->e_phnum; i++) {
+      for (Elf32_Half i = 0; i < ehdr.e_phnum; i++) {
           Elf32_Phdr *phdr = &phdr_table[i];
           PROC_DEBUG_PRINTF(" Segment %u: Type=%lu", (unsigned)i, (unsigned long)phdr->p_type);
 
@@ -437,7 +435,7 @@
               continue;
           }
 
-          // Validate segment addresses and sizes (remain the same)
+          // Validate segment addresses and sizes
           if (phdr->p_vaddr < USER_SPACE_START_VIRT || phdr->p_vaddr >= KERNEL_VIRT_BASE) {
               terminal_printf("  -> Error: Segment %d VAddr %#lx out of user space bounds for '%s'.\n", (int)i, (unsigned long)phdr->p_vaddr, path);
               result = -ENOEXEC; goto cleanup_load_elf;
@@ -450,10 +448,15 @@
                terminal_printf("  -> Error: Segment %d filesz (%lu) > memsz (%lu) for '%s'.\n", (int)i, (unsigned long)phdr->p_filesz, (unsigned long)phdr->p_memsz, path);
                result = -ENOEXEC; goto cleanup_load_elf;
            }
-           if (phdr->p_offset + phdr->p_filesz < phdr->p_offset || phdr->p_offset + phdr->p_filesz > file_size) {
+           if (phdr->p_offset + phdr->p_filesz < phdr->p_offset || phdr->p_offset + phdr->p_filesz > (uint32_t)file_size) {
                terminal_printf("  -> Error: Segment %d file range [%#lx-%#lx) exceeds file size (%lu) for '%s'.\n", (int)i, (unsigned long)phdr->p_offset, (unsigned long)(phdr->p_offset + phdr->p_filesz), (unsigned long)file_size, path);
                result = -ENOEXEC; goto cleanup_load_elf;
            }
+           // File pages are mapped whole, so file and memory must agree below page granularity
+           if ((phdr->p_offset % PAGE_SIZE) != (phdr->p_vaddr % PAGE_SIZE)) {
+               terminal_printf("  -> Error: Segment %d offset %#lx and VAddr %#lx differ within a page for '%s'.\n", (int)i, (unsigned long)phdr->p_offset, (unsigned long)phdr->p_vaddr, path);
+               result = -ENOEXEC; goto cleanup_load_elf;
+           }
 
           terminal_printf("  Segment %d: VAddr=%#lx, MemSz=%lu, FileSz=%lu, Offset=%#lx, Flags=%c%c%c",
                           (int)i, (unsigned long)phdr->p_vaddr, (unsigned long)phdr->p_memsz, (unsigned long)phdr->p_filesz, (unsigned long)phdr->p_offset,
@@ -461,13 +464,18 @@
                           (phdr->p_flags & PF_W) ? 'W' : '-',
                           (phdr->p_flags & PF_X) ? 'X' : '-');
 
-          // Calculate page-aligned virtual memory range for the VMA
+          // Page-aligned ranges: [vm_start, file_vm_end) is mapped from the
+          // file, [file_vm_end, vm_end) is anonymous (.bss). A last file page
+          // that .bss shares goes to the anonymous part.
           uintptr_t vm_start = PAGE_ALIGN_DOWN(phdr->p_vaddr);
           uintptr_t vm_end = PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_memsz);
-          if (vm_end <= vm_start) continue; // Skip zero-sized VMA after alignment
+          uintptr_t file_end = phdr->p_vaddr + phdr->p_filesz;
+          bool has_bss = phdr->p_memsz > phdr->p_filesz;
+          uintptr_t file_vm_end = has_bss ? PAGE_ALIGN_DOWN(file_end) : PAGE_ALIGN_UP(file_end);
+          if (phdr->p_filesz == 0) file_vm_end = vm_start;
+          size_t file_vm_offset = PAGE_ALIGN_DOWN(phdr->p_offset);
 
-          // --- FIXED: Correct VMA and Page Flag Derivation ---
-          uint32_t vma_flags = VM_USER | VM_ANONYMOUS; // Base VMA flags (ANONYMOUS assumes no file backing *yet*)
+          uint32_t vma_flags = VM_USER; // Base VMA flags
           uint32_t page_prot = PAGE_PRESENT | PAGE_USER; // Base Page flags
 
           // Set VMA flags based on ELF permissions
@@ -483,92 +491,46 @@
           if (!(phdr->p_flags & PF_X) && g_nx_supported) {
               page_prot |= PAGE_NX_BIT;
           }
-          // --- END FIX ---
 
-          terminal_printf("  -> VMA [%#lx - %#lx), VMA Flags=%#x, PageProt=%#x",
-                          (unsigned long)vm_start, (unsigned long)vm_end, (unsigned)vma_flags, (unsigned)page_prot);
-
-          // Insert VMA for this segment
-          // TODO: If implementing file-backed pages later, pass file pointer and offset here
-          if (!insert_vma(mm, vm_start, vm_end, vma_flags, page_prot, NULL, 0)) {
-              terminal_printf("[Process] load_elf: ERROR: Failed to insert VMA for segment %d of '%s'.\n", (int)i, path);
-              result = -ENOMEM; // VMA insertion likely failed due to memory
-              goto cleanup_load_elf;
+          if (file_vm_end > vm_start) {
+              terminal_printf("  -> File VMA [%#lx - %#lx) at offset %#lx, VMA Flags=%#x, PageProt=%#x",
+                              (unsigned long)vm_start, (unsigned long)file_vm_end, (unsigned long)file_vm_offset,
+                              (unsigned)(vma_flags | VM_FILEBACKED), (unsigned)page_prot);
+              if (!insert_vma(mm, vm_start, file_vm_end, vma_flags | VM_FILEBACKED, page_prot, file, file_vm_offset)) {
+                  terminal_printf("[Process] load_elf: ERROR: Failed to insert file VMA for segment %d of '%s'.\n", (int)i, path);
+                  result = -ENOMEM; // VMA insertion likely failed due to memory
+                  goto cleanup_load_elf;
+              }
           }
-
-          // Allocate frames, populate data, and map pages for this segment
-          terminal_printf("  -> Mapping and populating pages...");
-          for (uintptr_t page_v = vm_start; page_v < vm_end; page_v += PAGE_SIZE) {
-              PROC_DEBUG_PRINTF("    Processing page V=%p...", (void*)page_v);
-              phys_page = frame_alloc(); // Allocate a physical frame
-              if (!phys_page) {
-                  terminal_printf("[Process] load_elf: ERROR: Failed to allocate frame for V=%p in '%s'.\n", (void*)page_v, path);
+          if (vm_end > file_vm_end) {
+              terminal_printf("  -> Anon VMA [%#lx - %#lx), VMA Flags=%#x, PageProt=%#x",
+                              (unsigned long)file_vm_end, (unsigned long)vm_end,
+                              (unsigned)(vma_flags | VM_ANONYMOUS), (unsigned)page_prot);
+              if (!insert_vma(mm, file_vm_end, vm_end, vma_flags | VM_ANONYMOUS, page_prot, NULL, 0)) {
+                  terminal_printf("[Process] load_elf: ERROR: Failed to insert .bss VMA for segment %d of '%s'.\n", (int)i, path);
                   result = -ENOMEM;
-                  goto cleanup_load_elf; // phys_page != 0 will be handled in cleanup
-              }
-              PROC_DEBUG_PRINTF("     Allocated frame P=%#lx", (unsigned long)phys_page);
-
-              // Calculate data/padding for this specific page (logic remains the same)
-              size_t copy_size_this_page = 0;
-              size_t zero_padding_this_page = 0;
-              size_t file_buffer_offset = 0;
-              uintptr_t file_copy_start_vaddr = phdr->p_vaddr;
-              uintptr_t file_copy_end_vaddr = phdr->p_vaddr + phdr->p_filesz;
-              uintptr_t page_start_vaddr = page_v;
-              uintptr_t page_end_vaddr = page_v + PAGE_SIZE;
-              uintptr_t copy_v_start = MAX(page_start_vaddr, file_copy_start_vaddr);
-              uintptr_t copy_v_end = MIN(page_end_vaddr, file_copy_end_vaddr);
-              copy_size_this_page = (copy_v_end > copy_v_start) ? (copy_v_end - copy_v_start) : 0;
-              if (copy_size_this_page > 0) {
-                  file_buffer_offset = (copy_v_start - phdr->p_vaddr) + phdr->p_offset;
-                  if (file_buffer_offset + copy_size_this_page > file_size || file_buffer_offset < phdr->p_offset) {
-                      terminal_printf("[Process] load_elf: ERROR: File offset calculation error for V=%p in '%s'.\n", (void*)page_v, path);
-                      result = -ENOEXEC; goto cleanup_load_elf;
-                  }
-              }
-              uintptr_t mem_end_vaddr = phdr->p_vaddr + phdr->p_memsz;
-              uintptr_t zero_v_start = page_start_vaddr + copy_size_this_page;
-              uintptr_t zero_v_end = MIN(page_end_vaddr, mem_end_vaddr);
-              zero_padding_this_page = (zero_v_end > zero_v_start) ? (zero_v_end - zero_v_start) : 0;
-              if (copy_size_this_page + zero_padding_this_page > PAGE_SIZE) {
-                  terminal_printf("[Process] load_elf: ERROR: Calculated copy+zero size (%lu) exceeds PAGE_SIZE for V=%p in '%s'.\n",
-                                  (unsigned long)(copy_size_this_page + zero_padding_this_page), (void*)page_v, path);
-                  result = -ENOEXEC; goto cleanup_load_elf;
-              }
-              PROC_DEBUG_PRINTF("     CopySize=%lu, ZeroPadding=%lu, FileOffset=%lu", (unsigned long)copy_size_this_page, (unsigned long)zero_padding_this_page, (unsigned long)file_buffer_offset);
-
-              // Populate the allocated physical frame
-              if (copy_elf_segment_data(phys_page, file_data, file_buffer_offset, copy_size_this_page, zero_padding_this_page) != 0) {
-                  terminal_printf("[Process] load_elf: ERROR: copy_elf_segment_data failed for V=%p in '%s'.\n", (void*)page_v, path);
-                  result = -EIO; // Indicate an I/O related error during population
-                  goto cleanup_load_elf; // phys_page will be handled in cleanup
+                  goto cleanup_load_elf;
               }
-
-              // Map the populated frame into the process's address space using the derived page protection flags
-              PROC_DEBUG_PRINTF("     Mapping V=%p -> P=%#lx with prot %#x", (void*)page_v, (unsigned long)phys_page, (unsigned)page_prot);
-              int map_res = paging_map_single_4k(mm->pgd_phys, page_v, phys_page, page_prot);
-              if (map_res != 0) {
-                  terminal_printf("[Process] load_elf: ERROR: paging_map_single_4k failed for V=%p -> P=%#lx in '%s' (err %d).\n",
-                                  (void*)page_v, (unsigned long)phys_page, path, map_res);
-                  put_frame(phys_page); // Free the frame since mapping failed
-                  phys_page = 0; // Reset tracker
-                  result = -ENOMEM; // Mapping failure likely due to page table allocation
+          }
+          if (has_bss && phdr->p_filesz > 0 && (file_end % PAGE_SIZE) != 0) {
+              result = populate_elf_partial_page(mm, file, file_vm_end,
+                                                 (off_t)(file_vm_offset + (file_vm_end - vm_start)),
+                                                 file_end - file_vm_end, page_prot);
+              if (result != 0) {
+                  terminal_printf("[Process] load_elf: ERROR: Failed to populate V=%p in '%s' (err %d).\n", (void*)file_vm_end, path, result);
                   goto cleanup_load_elf;
               }
-              // Mapping successful, frame ownership transferred to page tables. Reset tracker.
-              phys_page = 0;
-          } // End loop for pages within a segment
+          }
 
           // Update the highest virtual address loaded so far
           uintptr_t current_segment_end = phdr->p_vaddr + phdr->p_memsz;
-          if (current_segment_end < phdr->p_vaddr) current_segment_end = UINTPTR_MAX; // Handle overflow
           if (current_segment_end > highest_addr_loaded) {
               highest_addr_loaded = current_segment_end;
           }
           PROC_DEBUG_PRINTF("  Segment %u processed. highest_addr_loaded=%#lx", (unsigned)i, (unsigned long)highest_addr_loaded);
       } // End loop through segments
 
-      // 4. Set Initial Program Break (end of loaded data, page-aligned up)
+      // 5. Set Initial Program Break (end of loaded data, page-aligned up)
       *initial_brk = PAGE_ALIGN_UP(highest_addr_loaded);
       if (*initial_brk < highest_addr_loaded && highest_addr_loaded != 0) *initial_brk = UINTPTR_MAX; // Handle overflow
       terminal_printf("  ELF load complete. initial_brk=%#lx\n", (unsigned long)*initial_brk);
@@ -576,11 +538,8 @@
 
   cleanup_load_elf:
       PROC_DEBUG_PRINTF("Cleanup: result=%d", result);
-      if (file_data) { kfree(file_data); } // Free the buffer allocated by read_file
-      if (phys_page != 0) { // Free frame if allocation failed mid-segment
-         PROC_DEBUG_PRINTF("  Freeing dangling phys_page P=%#lx", (unsigned long)phys_page);
-          put_frame(phys_page);
-      }
+      if (phdr_table) { kfree(phdr_table); }
+      vfs_close(file); // Drop our reference; the file VMAs keep theirs
       PROC_DEBUG_PRINTF("Exit result=%d", result);
       return result;
  }
@@ -661,6 +620,48 @@
  }
  
  
+ /**
+  * @brief Creates a kernel thread (see process.h).
+  * The stack gets the same frame the idle task starts from, so the first
+  * context_switch into the thread "returns" into @p entry.
+  */
+ pcb_t *create_kernel_thread(void (*entry)(void))
+ {
+     KERNEL_ASSERT(entry != NULL, "create_kernel_thread: NULL entry");
+
+     pcb_t *proc = (pcb_t *)kmalloc(sizeof(pcb_t));
+     if (!proc) {
+         terminal_write("[Process] ERROR: kmalloc PCB failed for kernel thread.\n");
+         return NULL;
+     }
+     memset(proc, 0, sizeof(pcb_t));
+     proc->pid = atomic_fetch_add_u32(&next_pid, 1);
+     proc->page_directory_phys = (uint32_t *)g_kernel_page_directory_phys;
+     proc->entry_point = (uint32_t)(uintptr_t)entry;
+     proc->is_kernel_thread = true;
+     process_init_fds(proc);
+
+     if (!allocate_kernel_stack(proc)) {
+         kfree(proc);
+         return NULL;
+     }
+
+     uint32_t *kstack_ptr = proc->kernel_stack_vaddr_top;
+     *(--kstack_ptr) = proc->entry_point;     // RetAddr for context_switch's 'ret'
+     *(--kstack_ptr) = 0;                     // Dummy EBP for context_switch's 'pop ebp'
+     *(--kstack_ptr) = GDT_PERCPU_SELECTOR;  // GS: this CPU's cpu_t
+     *(--kstack_ptr) = KERNEL_DATA_SELECTOR;  // FS
+     *(--kstack_ptr) = KERNEL_DATA_SELECTOR;  // ES
+     *(--kstack_ptr) = KERNEL_DATA_SELECTOR;  // DS
+     *(--kstack_ptr) = 0x00000202;            // EFLAGS (IF=1)
+     for (int i = 0; i < 8; i++) *(--kstack_ptr) = 0; // PUSHAD dummy regs
+     proc->kernel_esp_for_switch = (uint32_t)kstack_ptr;
+
+     terminal_printf("[Process] Created kernel thread PID %lu.\n", (unsigned long)proc->pid);
+     return proc;
+ }
+
+
  /**
  * @brief Creates a new user process by loading an ELF executable.
  * Sets up PCB, memory space (page directory, VMAs), kernel stack,
@@ -697,7 +698,7 @@
          return NULL;
      }
      memset(proc, 0, sizeof(pcb_t));
-     proc->pid = next_pid++; // TODO: Lock this for SMP
+     proc->pid = atomic_fetch_add_u32(&next_pid, 1);
      PROC_DEBUG_PRINTF("[Process DEBUG %s:%d] PCB allocated at %p, PID=%lu\n", __func__, __LINE__, proc, (unsigned long)proc->pid);
 
      // === Step 1.5: Initialize File Descriptors and Lock ===
@@ -885,6 +886,91 @@
      return NULL; // Indicate failure
  }
  
+ // ------------------------------------------------------------------------
+ // process_fork - Duplicate the calling process (copy-on-write)
+ // ------------------------------------------------------------------------
+ /**
+  * @brief Builds the forked child's first kernel stack.
+  * The top holds a copy of the parent's syscall frame with EAX = 0 (fork's
+  * return value in the child). Below it sits a same-privilege IRET frame that
+  * sends jump_to_user_mode to fork_child_return, which pops the copied frame
+  * exactly like the INT 0x80 exit path does.
+  */
+ static void prepare_fork_kernel_stack(pcb_t *child, const isr_frame_t *parent_regs) {
+      uint32_t *kstack_ptr = (uint32_t*)child->kernel_stack_vaddr_top;
+
+      kstack_ptr -= sizeof(isr_frame_t) / sizeof(uint32_t);
+      isr_frame_t *frame = (isr_frame_t*)kstack_ptr;
+      memcpy(frame, parent_regs, sizeof(isr_frame_t));
+      frame->eax = 0;
+
+      *(--kstack_ptr) = 0x00000002;             // EFLAGS (IF=0 until the final IRET)
+      *(--kstack_ptr) = KERNEL_CODE_SELECTOR;   // CS
+      *(--kstack_ptr) = (uint32_t)fork_child_return; // EIP
+      child->kernel_esp_for_switch = (uint32_t)kstack_ptr;
+ }
+
+ /**
+  * @brief Creates a child of @p parent that resumes from the same syscall.
+  * Only page tables are copied: all user frames are shared, with private
+  * writable ones write-protected for copy-on-write. Open files are shared
+  * with the parent, including their offsets.
+  */
+ pcb_t *process_fork(pcb_t *parent, const isr_frame_t *parent_regs)
+ {
+     KERNEL_ASSERT(parent != NULL && parent_regs != NULL, "process_fork: NULL parent or frame");
+     if (!parent->mm || !parent->page_directory_phys) return NULL;
+
+     pcb_t *child = (pcb_t *)kmalloc(sizeof(pcb_t));
+     if (!child) {
+         terminal_write("[Process] fork: kmalloc PCB failed.\n");
+         return NULL;
+     }
+     memset(child, 0, sizeof(pcb_t));
+     child->pid = atomic_fetch_add_u32(&next_pid, 1);
+     child->parent_pid = parent->pid;
+     child->entry_point = parent->entry_point;
+     child->user_stack_top = parent->user_stack_top;
+     process_init_fds(child);
+
+     // Page directory: kernel half shared as for any process, user half filled by copy_mm
+     uintptr_t pd_phys = frame_alloc();
+     if (!pd_phys) goto fail_fork;
+     child->page_directory_phys = (uint32_t*)pd_phys;
+     uint32_t *pd_virt = paging_temp_map(pd_phys, PTE_KERNEL_DATA_FLAGS);
+     if (!pd_virt) goto fail_fork;
+     memset(pd_virt, 0, PAGE_SIZE);
+     copy_kernel_pde_entries(pd_virt);
+     pd_virt[RECURSIVE_PDE_INDEX] = (pd_phys & PAGING_ADDR_MASK) | PAGE_PRESENT | PAGE_RW |
+                                    (g_nx_supported ? PAGE_NX_BIT : 0);
+     paging_temp_unmap(pd_virt);
+
+     if (!allocate_kernel_stack(child)) goto fail_fork;
+
+     child->mm = copy_mm(parent->mm, child->page_directory_phys);
+     if (!child->mm) goto fail_fork;
+
+     // Share every open file; each table slot holds its own reference
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&parent->fd_table_lock);
+     for (int fd = 0; fd < MAX_FD; fd++) {
+         if (parent->fd_table[fd]) {
+             sys_file_get(parent->fd_table[fd]);
+             child->fd_table[fd] = parent->fd_table[fd];
+         }
+     }
+     spinlock_release_irqrestore(&parent->fd_table_lock, irq_flags);
+
+     prepare_fork_kernel_stack(child, parent_regs);
+     PROC_DEBUG_PRINTF("PID %lu forked child PID %lu.\n",
+                     (unsigned long)parent->pid, (unsigned long)child->pid);
+     return child;
+
+ fail_fork:
+     terminal_printf("[Process] fork of PID %lu failed.\n", (unsigned long)parent->pid);
+     destroy_process(child); // Handles whatever subset was set up
+     return NULL;
+ }
+
  // ------------------------------------------------------------------------
  // destroy_process - Frees all process resources
  // ------------------------------------------------------------------------
@@ -901,22 +987,18 @@
        if (!pcb) return;
  
        uint32_t pid = pcb->pid; // Store PID for logging before freeing PCB
-       // Using serial write assuming terminal might rely on functioning process/memory
-       serial_write("[destroy_process] Enter for PID ");
-       // TODO: Add a simple uint32_t to serial print function if needed
-       serial_write("\n");
  
        PROC_DEBUG_PRINTF("[Process DEBUG %s:%d] Enter PID=%lu\n", __func__, __LINE__, (unsigned long)pid);
-       terminal_printf("[Process] Destroying process PID %lu.\n", (unsigned long)pid);
+       PROC_DEBUG_PRINTF("Destroying process PID %lu.\n", (unsigned long)pid);
  
        // 1. Close All Open File Descriptors
-       serial_write("[destroy_process] Step 1: Closing FDs...\n");
+       PROC_DEBUG_PRINTF("Step 1: Closing FDs...\n");
        // Assuming process_close_fds(pcb) function exists and works
        process_close_fds(pcb);
-       serial_write("[destroy_process] Step 1: FDs closed.\n");
+       PROC_DEBUG_PRINTF("Step 1: FDs closed.\n");
  
        // 2. Destroy Memory Management structure (handles user space VMAs, page tables, frames)
-       serial_write("[destroy_process] Step 2: Destroying MM (user space memory)...\n");
+       PROC_DEBUG_PRINTF("Step 2: Destroying MM (user space memory)...\n");
        if (pcb->mm) {
            PROC_DEBUG_PRINTF("[Process DEBUG %s:%d]   Destroying mm_struct %p...\n", __func__, __LINE__, pcb->mm);
            // Assuming destroy_mm frees user pages, user page tables, VMA structs, and the mm_struct itself.
@@ -926,10 +1008,10 @@
        } else {
            PROC_DEBUG_PRINTF("[Process DEBUG %s:%d]   No mm_struct found to destroy.\n", __func__, __LINE__);
        }
-       serial_write("[destroy_process] Step 2: MM destroyed.\n");
+       PROC_DEBUG_PRINTF("Step 2: MM destroyed.\n");
  
        // 3. Free Kernel Stack (Including Guard Page)
-       serial_write("[destroy_process] Step 3: Freeing Kernel Stack (incl. guard)...\n");
+       PROC_DEBUG_PRINTF("Step 3: Freeing Kernel Stack (incl. guard)...\n");
        if (pcb->kernel_stack_vaddr_top != NULL) {
            // kernel_stack_vaddr_top points to the end of the *usable* stack (e.g., 0xe0004000)
            uintptr_t stack_top_usable = (uintptr_t)pcb->kernel_stack_vaddr_top;
@@ -939,11 +1021,11 @@
            size_t num_pages_with_guard = total_stack_size / PAGE_SIZE;
            uintptr_t stack_base = stack_top_usable - usable_stack_size; // Base of usable stack (e.g., 0xe0000000)
  
-           terminal_printf("  Freeing kernel stack (incl. guard): V=[%p-%p)\n",
+           PROC_DEBUG_PRINTF("Freeing kernel stack (incl. guard): V=[%p-%p)\n",
                            (void*)stack_base, (void*)(stack_base + total_stack_size));
  
            // Free physical frames (Iterate over usable + guard page)
-           serial_write("  Freeing kernel stack frames (incl. guard)...\n");
+           PROC_DEBUG_PRINTF("Freeing kernel stack frames (incl. guard)...\n");
            for (size_t i = 0; i < num_pages_with_guard; ++i) { // *** GUARD PAGE FIX: Loop limit ***
                uintptr_t v_addr = stack_base + (i * PAGE_SIZE);
                uintptr_t phys_addr = 0;
@@ -960,50 +1042,47 @@
                     terminal_printf("[destroy_process] Warning: Failed to get physical addr for kernel stack V=%p during cleanup.\n", (void*)v_addr);
                }
            }
-           serial_write("  Kernel stack frames (incl. guard) freed.\n");
+           PROC_DEBUG_PRINTF("Kernel stack frames (incl. guard) freed.\n");
  
            // Unmap virtual range from KERNEL page directory
-           serial_write("  Unmapping kernel stack range (incl. guard)...\n");
+           PROC_DEBUG_PRINTF("Unmapping kernel stack range (incl. guard)...\n");
            if (g_kernel_page_directory_phys) {
               // *** GUARD PAGE FIX: Use total size for unmap ***
               paging_unmap_range((uint32_t*)g_kernel_page_directory_phys, stack_base, total_stack_size);
            } else {
               terminal_printf("[destroy_process] Warning: Cannot unmap kernel stack, kernel PD phys not set.\n");
            }
-           serial_write("  Kernel stack range (incl. guard) unmapped.\n");
+           PROC_DEBUG_PRINTF("Kernel stack range (incl. guard) unmapped.\n");
  
            pcb->kernel_stack_vaddr_top = NULL;
            pcb->kernel_stack_phys_base = 0;
        } else {
             PROC_DEBUG_PRINTF("[Process DEBUG %s:%d]   No kernel stack allocated or already freed.\n", __func__, __LINE__);
        }
-        serial_write("[destroy_process] Step 3: Kernel Stack freed.\n");
+        PROC_DEBUG_PRINTF("Step 3: Kernel Stack freed.\n");
  
        // 4. Free the process's Page Directory frame
        //    (Assumes destroy_mm does NOT free the PD frame itself)
-       serial_write("[destroy_process] Step 4: Freeing Page Directory Frame...\n");
-       if (pcb->page_directory_phys) {
+       PROC_DEBUG_PRINTF("Step 4: Freeing Page Directory Frame...\n");
+       if (pcb->page_directory_phys && !pcb->is_kernel_thread) { // Kernel threads share the kernel PD
            // Sanity check: mm should be NULL now if destroy_mm was called.
            if (pcb->mm) {
                 terminal_printf("[destroy_process] Warning: mm_struct is not NULL before freeing PD? Check destroy_mm.\n");
            }
-           terminal_printf("  Freeing process PD frame: P=%p\n", (void*)pcb->page_directory_phys);
+           PROC_DEBUG_PRINTF("Freeing process PD frame: P=%p\n", (void*)pcb->page_directory_phys);
            put_frame((uintptr_t)pcb->page_directory_phys);
            pcb->page_directory_phys = NULL;
        } else {
            PROC_DEBUG_PRINTF("[Process DEBUG %s:%d]   No Page Directory allocated or already freed.\n", __func__, __LINE__);
        }
-       serial_write("[destroy_process] Step 4: Page Directory Frame freed.\n");
+       PROC_DEBUG_PRINTF("Step 4: Page Directory Frame freed.\n");
  
        // 5. Free the PCB structure itself
-       serial_write("[destroy_process] Step 5: Freeing PCB structure...\n");
+       PROC_DEBUG_PRINTF("Step 5: Freeing PCB structure...\n");
        kfree(pcb); // Free the memory allocated for the pcb_t struct
-       serial_write("[destroy_process] Step 5: PCB structure freed.\n");
+       PROC_DEBUG_PRINTF("Step 5: PCB structure freed.\n");
  
-       terminal_printf("[Process] PCB PID %lu resources freed.\n", (unsigned long)pid);
-       serial_write("[destroy_process] Exit for PID ");
-       // TODO: Add uint32_t to serial print function if needed
-       serial_write("\n");
+       PROC_DEBUG_PRINTF("PCB PID %lu resources freed.\n", (unsigned long)pid);
        PROC_DEBUG_PRINTF("[Process DEBUG %s:%d] Exit PID=%lu\n", __func__, __LINE__, (unsigned long)pid);
   }
  
@@ -1075,14 +1154,13 @@
             spinlock_release_irqrestore(&proc->fd_table_lock, irq_flags);
 
             // --- Perform cleanup outside the FD table lock ---
-            // Call VFS close (safe to call now that FD entry is clear)
-            int vfs_ret = vfs_close(sf->vfs_file); // vfs_close handles freeing sf->vfs_file->data and the vnode
+            // Drop this table's reference; the VFS close (and kfree of sf) happens
+            // only when no forked relative still has the file open.
+            int vfs_ret = sys_file_put(sf);
             if (vfs_ret < 0) {
                 terminal_printf("   [Proc %lu] Warning: vfs_close for fd %d returned error %d.\n",
                                (unsigned long)proc->pid, fd, vfs_ret);
             }
-            // Free the sys_file structure itself
-            kfree(sf);
             // --- End cleanup outside lock ---
 
             // Re-acquire the lock to continue the loop safely
@@ -2,12 +2,37 @@
  * @file scheduler.c
  * @brief UiAOS Priority-Based Preemptive Kernel Scheduler (Refactored & Fixed)
  * @author Tor Martin Kohle & Gemini Refactoring
- * @version 5.2
+ * @version 6.0
  *
  * @details Implements a priority-based preemptive scheduler.
- * Features multiple run queues, configurable time slices, sleep queue,
+ * Features multiple run queues, configurable time slices, timer-based sleep,
  * zombie task cleanup, TCB flag for run queue status, and a reschedule hint flag.
  * Assumes a timer interrupt calls scheduler_tick(). Fixes build errors from v5.1.
+ * With PIT_TICKLESS, the periodic tick stops whenever no task is waiting for
+ * the CPU (see scheduler_update_tick); pit.c credits the elapsed ticks.
+ *
+ * Selection is O(1): a bitmap has one bit per non-empty run queue and the
+ * lowest set bit names the highest-priority level. Priorities follow a
+ * multilevel feedback queue: tasks start at the top, drop a level each time
+ * they use up a whole time slice, climb a level when they wake from blocking
+ * or sleeping, and climb a level when they have been ready too long without
+ * running (aging), so CPU-bound tasks cannot starve each other forever.
+ *
+ * Sleeping tasks are not kept in a list: sleep_ms arms the task's
+ * sleep_timer on the timer wheel (timer.h), whose callback makes it ready.
+ *
+ * SMP: every CPU has its own run queues, lock and idle task (cpu_rq_t). New
+ * tasks go to the least loaded CPU and woken tasks back to the CPU they ran
+ * on, unless it is busy and another one idles. A CPU that runs out of work
+ * steals the best task of the busiest queue before it idles, and every
+ * SCHED_BALANCE_INTERVAL_MS a CPU either wakes an idle CPU to steal its
+ * surplus or pulls a task from a queue two or more tasks longer than its own.
+ *
+ * A task's saved ESP doubles as its ownership token: it is taken (set to
+ * NULL) when a CPU picks the task and written back by context_switch as the
+ * very last access to the task's stack. Only tasks with a saved ESP may be
+ * moved to another CPU or reaped; a task that is enqueued while still
+ * switching out (woken right after it blocked) stays on its own CPU.
  */
 
 //============================================================================
@@ -21,12 +46,16 @@
 #include "idt.h"
 #include "gdt.h"
 #include "assert.h"
+#include "timer.h"
 #include "paging.h"
 #include "tss.h"
 #include "serial.h"
 #include "pit.h"
 #include "port_io.h"
 #include "keyboard_hw.h" // Included in previous fix
+#include "frame.h"       // Idle-time pre-zeroing of free frames
+#include "smp.h"
+#include "apic.h"
 #include <libc/stdint.h>
 #include <libc/stddef.h>
 #include <libc/stdbool.h>
@@ -35,21 +64,39 @@
 //============================================================================
 // Scheduler Configuration & Constants
 //============================================================================
-#define SCHED_PRIORITY_LEVELS   4
-#define SCHED_DEFAULT_PRIORITY  1
+#define SCHED_PRIORITY_LEVELS   8
+#define SCHED_TOP_PRIORITY      0
+#define SCHED_DEFAULT_PRIORITY  SCHED_TOP_PRIORITY   // New tasks start at the top
 #define SCHED_IDLE_PRIORITY     (SCHED_PRIORITY_LEVELS - 1)
+#define SCHED_LOWEST_TASK_PRIORITY (SCHED_IDLE_PRIORITY - 1) // Demotion floor; the idle level is the idle tasks' alone
 #define SCHED_KERNEL_PRIORITY   0
 
+// Aging: every SCHED_AGING_INTERVAL_MS, a task that has been ready for
+// SCHED_AGING_THRESHOLD_MS without running moves up one level
+#define SCHED_AGING_INTERVAL_MS   100
+#define SCHED_AGING_THRESHOLD_MS  400
+
+// Load balancing: how often each CPU compares its queue with the others',
+// and the difference in load (ready + running tasks) that makes it pull
+#define SCHED_BALANCE_INTERVAL_MS 20
+#define SCHED_BALANCE_IMBALANCE   2
+
 #ifndef SCHED_TICKS_PER_SECOND
 #define SCHED_TICKS_PER_SECOND  1000
 #endif
 
 #define MS_TO_TICKS(ms) (((ms) * SCHED_TICKS_PER_SECOND) / 1000)
 
+// Short slices at the top, where interactive tasks live; long ones further
+// down, where CPU-bound tasks sink and switching less pays off
 static const uint32_t g_priority_time_slices_ms[SCHED_PRIORITY_LEVELS] = {
-    200, /* P0 */ 100, /* P1 */ 50, /* P2 */ 25  /* P3 (Idle) */
+    10, /* P0 */ 20, /* P1 */ 40, /* P2 */ 60, /* P3 */ 80, /* P4 */ 120, /* P5 */ 200, /* P6 */
+    25  /* P7 (Idle) */
 };
 
+_Static_assert(SCHED_PRIORITY_LEVELS <= 32, "ready_bitmap has one bit per priority level");
+_Static_assert(MAX_CPUS <= 256, "tcb_t.cpu is a uint8_t");
+
 // Error Codes
 #define SCHED_OK          0
 #define SCHED_ERR_NOMEM  (-1)
@@ -82,82 +129,128 @@ static const uint32_t g_priority_time_slices_ms[SCHED_PRIORITY_LEVELS] = {
 
 
 //============================================================================
-// Data Structures (Same as refactored v5.0)
+// Data Structures
 //============================================================================
 typedef struct {
     tcb_t      *head;
     tcb_t      *tail;
     uint32_t    count;
-    spinlock_t  lock;
 } run_queue_t;
 
+/** @brief One CPU's run queues. The idle task is never queued. */
 typedef struct {
-    tcb_t      *head;
-    uint32_t    count;
-    spinlock_t  lock;
-} sleep_queue_t;
+    spinlock_t   lock;              // Guards queues, ready_bitmap and nr_ready
+    run_queue_t  queues[SCHED_PRIORITY_LEVELS];
+    uint32_t     ready_bitmap;      // Bit p set while queues[p] is non-empty
+    volatile uint32_t nr_ready;     // Tasks in queues; read unlocked as a load hint
+    uint32_t     last_aging_tick;   // Touched by the owning CPU only
+    uint32_t     last_balance_tick;
+    sched_cpu_stats_t stats;
+} cpu_rq_t;
+
 
 //============================================================================
-// Module Static Data (Same as refactored v5.0)
+// Module Static Data
 //============================================================================
-static run_queue_t   g_run_queues[SCHED_PRIORITY_LEVELS];
-static sleep_queue_t g_sleep_queue;
-static volatile tcb_t *g_current_task = NULL;
+static cpu_rq_t      g_rqs[MAX_CPUS];
 static tcb_t        *g_all_tasks_head = NULL;
 static spinlock_t    g_all_tasks_lock;
 static volatile uint32_t g_tick_count = 0;
-static tcb_t         g_idle_task_tcb;
-static pcb_t         g_idle_task_pcb;
+// Idle tasks are static (below 0xC0000000), so context_switch never saves
+// their ESP: each time one is resumed it restarts from its initial frame
+static tcb_t         g_idle_tcbs[MAX_CPUS];
+static pcb_t         g_idle_pcbs[MAX_CPUS];
+static uint8_t       g_idle_stacks[MAX_CPUS][PROCESS_KSTACK_SIZE] __attribute__((aligned(16)));
 volatile bool g_scheduler_ready = false;
-volatile bool g_need_reschedule = false;
 
 //============================================================================
-// Forward Declarations (Assembly / Private Helpers) - Same as refactored v5.0
+// Forward Declarations (Assembly / Private Helpers)
 //============================================================================
 extern void context_switch(uint32_t **old_esp_ptr, uint32_t *new_esp, uint32_t *new_pagedir);
-extern void jump_to_user_mode(uint32_t *user_esp, uint32_t *pagedir);
+extern void jump_to_user_mode(uint32_t **old_esp_ptr, uint32_t *user_esp, uint32_t *pagedir);
 
 static void init_run_queue(run_queue_t *queue);
-static void init_sleep_queue(void);
-static bool enqueue_task_locked(tcb_t *task);
-static bool dequeue_task_locked(tcb_t *task);
-static void add_to_sleep_queue_locked(tcb_t *task);
-static void remove_from_sleep_queue_locked(tcb_t *task);
-static void check_sleeping_tasks(void);
-static tcb_t* scheduler_select_next_task(void);
-static void perform_context_switch(tcb_t *old_task, tcb_t *new_task);
+static void run_queue_append_locked(cpu_rq_t *rq, tcb_t *task);
+static bool enqueue_task_locked(cpu_rq_t *rq, tcb_t *task);
+static bool dequeue_task_locked(cpu_rq_t *rq, tcb_t *task);
+static void enqueue_task(tcb_t *task);
+static void wake_task(tcb_t *task);
+static void boost_task(tcb_t *task);
+static void age_ready_tasks(cpu_rq_t *rq);
+static void sleep_timer_expired(ktimer_t *timer, void *arg);
+static tcb_t* scheduler_select_next_task(cpu_t *cpu);
+static void perform_context_switch(tcb_t *old_task, tcb_t *new_task, uint32_t *new_esp);
 static void kernel_idle_task_loop(void) __attribute__((noreturn));
-static void scheduler_init_idle_task(void);
+static void scheduler_init_idle_task(uint32_t cpu);
 void scheduler_cleanup_zombies(void);
 
+static inline bool task_is_idle(const tcb_t *task) {
+    return task->pid == IDLE_TASK_PID;
+}
+
+/** @brief The task's saved ESP, or NULL while some CPU is running it. */
+static inline uint32_t *task_saved_esp(tcb_t *task) {
+    return __atomic_load_n(&task->esp, __ATOMIC_ACQUIRE);
+}
+
+/** @brief Ready plus running (non-idle) tasks of a CPU. Unlocked, a hint only. */
+static uint32_t cpu_load(uint32_t cpu) {
+    tcb_t *current = g_cpus[cpu].current;
+    return g_rqs[cpu].nr_ready + ((current && !task_is_idle(current)) ? 1 : 0);
+}
+
+/** @brief True if the CPU is online and sleeping in its idle task with nothing queued. */
+static bool cpu_is_idle(uint32_t cpu) {
+    tcb_t *current = g_cpus[cpu].current;
+    return g_cpus[cpu].online && current && task_is_idle(current) &&
+           g_rqs[cpu].nr_ready == 0 && !g_cpus[cpu].need_resched;
+}
+
+/** @brief An idle CPU other than @p except, preferring the executing one; -1 if none. */
+static int find_idle_cpu(uint32_t except) {
+    uint32_t self = this_cpu()->index;
+    if (self != except && cpu_is_idle(self)) return (int)self;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (c != except && cpu_is_idle(c)) return (int)c;
+    }
+    return -1;
+}
+
+/**
+ * @brief Tells CPU @p cpu that a task of priority @p prio was queued for it.
+ * The executing CPU just sets its flag; another CPU gets an IPI if it idles or
+ * the task outranks (or ties with) what it runs. Interrupts must be off.
+ */
+static void kick_cpu(uint32_t cpu, uint8_t prio) {
+    cpu_t *self = this_cpu();
+    if (cpu == self->index) {
+        self->need_resched = true;
+        return;
+    }
+    cpu_t *target = &g_cpus[cpu];
+    tcb_t *current = target->current;
+    if (!current || task_is_idle(current) || prio <= current->priority) {
+        target->need_resched = true;
+        if (apic_is_enabled()) {
+            atomic_fetch_add_u32(&g_rqs[cpu].stats.ipis, 1);
+            smp_send_resched(cpu);
+        }
+    }
+}
+
 //============================================================================
-// Queue Management (Refined v5.0 implementations)
+// Queue Management
 //============================================================================
 static void init_run_queue(run_queue_t *queue) {
     KERNEL_ASSERT(queue != NULL, "NULL run queue pointer");
     queue->head = NULL;
     queue->tail = NULL;
     queue->count = 0;
-    spinlock_init(&queue->lock);
 }
 
-static void init_sleep_queue(void) {
-    g_sleep_queue.head = NULL;
-    g_sleep_queue.count = 0;
-    spinlock_init(&g_sleep_queue.lock);
-}
-
-static bool enqueue_task_locked(tcb_t *task) {
-    KERNEL_ASSERT(task != NULL, "Cannot enqueue NULL task");
-    KERNEL_ASSERT(task->state == TASK_READY, "Enqueueing task that is not READY");
-    KERNEL_ASSERT(task->priority < SCHED_PRIORITY_LEVELS, "Invalid task priority for enqueue");
-
-    if (task->in_run_queue) {
-        SCHED_WARN("Task PID %lu already marked as in_run_queue during enqueue attempt.", task->pid);
-        return false;
-    }
-
-    run_queue_t *queue = &g_run_queues[task->priority];
+/** @brief Links a task at the tail of its priority's queue. Caller holds rq->lock. */
+static void run_queue_append_locked(cpu_rq_t *rq, tcb_t *task) {
+    run_queue_t *queue = &rq->queues[task->priority];
     task->next = NULL;
 
     if (queue->tail) {
@@ -169,15 +262,45 @@ static bool enqueue_task_locked(tcb_t *task) {
         queue->tail = task;
     }
     queue->count++;
+    rq->nr_ready++;
+    rq->ready_bitmap |= 1u << task->priority;
     task->in_run_queue = true;
+}
+
+/** @brief Makes a READY task runnable and starts its wait clock. Caller holds rq->lock. */
+static bool enqueue_task_locked(cpu_rq_t *rq, tcb_t *task) {
+    KERNEL_ASSERT(task != NULL, "Cannot enqueue NULL task");
+    KERNEL_ASSERT(!task_is_idle(task), "The idle tasks are never queued");
+    KERNEL_ASSERT(task->state == TASK_READY, "Enqueueing task that is not READY");
+    KERNEL_ASSERT(task->priority < SCHED_PRIORITY_LEVELS, "Invalid task priority for enqueue");
+
+    if (task->in_run_queue) {
+        SCHED_WARN("Task PID %lu already marked as in_run_queue during enqueue attempt.", task->pid);
+        return false;
+    }
+
+    // Another task now wants the CPU: time slicing needs the periodic tick
+    pit_tick_restart();
+    task->ready_since = g_tick_count;
+    run_queue_append_locked(rq, task);
     return true;
 }
 
-static bool dequeue_task_locked(tcb_t *task) {
+/** @brief Queues a READY task on the CPU named by task->cpu. */
+static void enqueue_task(tcb_t *task) {
+    cpu_rq_t *rq = &g_rqs[task->cpu];
+    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&rq->lock);
+    if (!enqueue_task_locked(rq, task)) {
+        SCHED_ERROR("Failed to enqueue task PID %lu", task->pid);
+    }
+    spinlock_release_irqrestore(&rq->lock, queue_irq_flags);
+}
+
+static bool dequeue_task_locked(cpu_rq_t *rq, tcb_t *task) {
     KERNEL_ASSERT(task != NULL, "Cannot dequeue NULL task");
     KERNEL_ASSERT(task->priority < SCHED_PRIORITY_LEVELS, "Invalid task priority for dequeue");
 
-    run_queue_t *queue = &g_run_queues[task->priority];
+    run_queue_t *queue = &rq->queues[task->priority];
     if (!queue->head) {
         SCHED_WARN("Attempted dequeue from empty queue Prio %u for task PID %lu", task->priority, task->pid);
         task->in_run_queue = false;
@@ -189,6 +312,8 @@ static bool dequeue_task_locked(tcb_t *task) {
         if (queue->tail == task) { queue->tail = NULL; KERNEL_ASSERT(queue->head == NULL, "Head non-NULL when tail dequeued");}
         KERNEL_ASSERT(queue->count > 0, "Queue count underflow (head dequeue)");
         queue->count--;
+        rq->nr_ready--;
+        if (!queue->head) rq->ready_bitmap &= ~(1u << task->priority);
         task->next = NULL;
         task->in_run_queue = false;
         return true;
@@ -204,6 +329,7 @@ static bool dequeue_task_locked(tcb_t *task) {
         if (queue->tail == task) { queue->tail = prev; }
         KERNEL_ASSERT(queue->count > 0, "Queue count underflow (mid/tail dequeue)");
         queue->count--;
+        rq->nr_ready--;
         task->next = NULL;
         task->in_run_queue = false;
         return true;
@@ -214,93 +340,248 @@ static bool dequeue_task_locked(tcb_t *task) {
     return false;
 }
 
-static void add_to_sleep_queue_locked(tcb_t *task) {
-    KERNEL_ASSERT(task != NULL && task->state == TASK_SLEEPING, "Invalid task/state for sleep queue add");
-    KERNEL_ASSERT(!task->in_run_queue, "Sleeping task should not be marked as in_run_queue");
-
-    task->wait_next = NULL;
-    task->wait_prev = NULL;
-
-    if (!g_sleep_queue.head || task->wakeup_time <= g_sleep_queue.head->wakeup_time) {
-        task->wait_next = g_sleep_queue.head;
-        if (g_sleep_queue.head) g_sleep_queue.head->wait_prev = task;
-        g_sleep_queue.head = task;
-    } else {
-        tcb_t *current = g_sleep_queue.head;
-        while (current->wait_next && current->wait_next->wakeup_time <= task->wakeup_time) {
-            current = current->wait_next;
+/**
+ * @brief Removes the highest-priority task of CPU @p victim's queues that is
+ * off-CPU (has a saved ESP) and hands it to CPU @p thief. NULL if none.
+ */
+static tcb_t *take_task_from(uint32_t victim, uint32_t thief) {
+    cpu_rq_t *rq = &g_rqs[victim];
+    tcb_t *task = NULL;
+    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&rq->lock);
+    uint32_t bitmap = rq->ready_bitmap;
+    while (bitmap && !task) {
+        int prio = __builtin_ctz(bitmap);
+        bitmap &= bitmap - 1;
+        for (tcb_t *t = rq->queues[prio].head; t; t = t->next) {
+            if (task_saved_esp(t)) { task = t; break; }
         }
-        task->wait_next = current->wait_next;
-        task->wait_prev = current;
-        if (current->wait_next) current->wait_next->wait_prev = task;
-        current->wait_next = task;
     }
-    g_sleep_queue.count++;
+    if (task) {
+        dequeue_task_locked(rq, task);
+        task->cpu = (uint8_t)thief;
+    }
+    spinlock_release_irqrestore(&rq->lock, queue_irq_flags);
+    return task;
 }
 
-static void remove_from_sleep_queue_locked(tcb_t *task) {
-    KERNEL_ASSERT(task != NULL, "Cannot remove NULL from sleep queue");
-    KERNEL_ASSERT(g_sleep_queue.count > 0, "Sleep queue count underflow");
+/** @brief The online CPU other than @p self with the highest load; -1 if all are empty. */
+static int find_busiest_cpu(uint32_t self, uint32_t *out_load) {
+    int busiest = -1;
+    uint32_t busiest_load = 0;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (c == self || !g_cpus[c].online || g_rqs[c].nr_ready == 0) continue;
+        uint32_t load = cpu_load(c);
+        if (load > busiest_load) { busiest = (int)c; busiest_load = load; }
+    }
+    *out_load = busiest_load;
+    return busiest;
+}
 
-    if (task->wait_prev) task->wait_prev->wait_next = task->wait_next;
-    else g_sleep_queue.head = task->wait_next;
+/** @brief Idle-time work stealing: takes a task from the busiest CPU's queue. */
+static tcb_t *steal_task(uint32_t thief) {
+    uint32_t load;
+    int victim = find_busiest_cpu(thief, &load);
+    if (victim < 0) return NULL;
+    tcb_t *task = take_task_from((uint32_t)victim, thief);
+    if (task) {
+        g_rqs[thief].stats.steals++;
+        SCHED_DEBUG("CPU %lu stole PID %lu from CPU %d", (unsigned long)thief, task->pid, victim);
+    }
+    return task;
+}
 
-    if (task->wait_next) task->wait_next->wait_prev = task->wait_prev;
+/**
+ * @brief Periodic balance of CPU @p cpu: with tasks waiting here, wake an idle
+ * CPU to steal one; with an empty queue, pull a task from a CPU whose load is
+ * SCHED_BALANCE_IMBALANCE or more above ours.
+ */
+static void balance_cpu(cpu_t *cpu) {
+    cpu_rq_t *rq = &g_rqs[cpu->index];
+    if (rq->nr_ready > 0) {
+        int idle = find_idle_cpu(cpu->index);
+        if (idle >= 0) kick_cpu((uint32_t)idle, SCHED_IDLE_PRIORITY);
+        return;
+    }
+    uint32_t busiest_load;
+    int busiest = find_busiest_cpu(cpu->index, &busiest_load);
+    if (busiest < 0 || busiest_load < cpu_load(cpu->index) + SCHED_BALANCE_IMBALANCE) return;
+
+    tcb_t *task = take_task_from((uint32_t)busiest, cpu->index);
+    if (!task) return;
+    rq->stats.pulls++;
+    SCHED_DEBUG("CPU %lu pulled PID %lu from CPU %d", (unsigned long)cpu->index, task->pid, busiest);
+    enqueue_task(task);
+    if (task_is_idle(cpu->current) || task->priority <= cpu->current->priority) cpu->need_resched = true;
+}
 
-    task->wait_next = NULL;
-    task->wait_prev = NULL;
-    g_sleep_queue.count--;
+/**
+ * @brief Picks the CPU a task that becomes ready should run on: the one it
+ * last ran on, unless that one is busy and another idles. A task still
+ * switching out (no saved ESP) must stay where it is.
+ */
+static uint32_t select_wake_cpu(tcb_t *task) {
+    uint32_t cpu = task->cpu;
+    if (!task_saved_esp(task) || cpu_load(cpu) == 0) return cpu;
+    int idle = find_idle_cpu(cpu);
+    return idle >= 0 ? (uint32_t)idle : cpu;
 }
 
-static void check_sleeping_tasks(void) {
-    uintptr_t sleep_irq_flags = spinlock_acquire_irqsave(&g_sleep_queue.lock);
-    if (!g_sleep_queue.head) { spinlock_release_irqrestore(&g_sleep_queue.lock, sleep_irq_flags); return; }
+/** @brief Queues a task that just became READY and lets its CPU know. */
+static void wake_task(tcb_t *task) {
+    uintptr_t irq_flags = local_irq_save();
+    task->cpu = (uint8_t)select_wake_cpu(task);
+    enqueue_task(task);
+    kick_cpu(task->cpu, task->priority);
+    local_irq_restore(irq_flags);
+}
 
-    uint32_t current_ticks = g_tick_count;
-    tcb_t *task = g_sleep_queue.head;
-    bool task_woken = false;
+/** @brief Wakes a task whose sleep_ms deadline has passed. Runs from the timer tick. */
+static void sleep_timer_expired(ktimer_t *timer, void *arg) {
+    (void)timer;
+    tcb_t *task = (tcb_t *)arg;
+    KERNEL_ASSERT(task->state == TASK_SLEEPING, "Sleep timer fired for a task that is not sleeping");
+    task->state = TASK_READY;
+    boost_task(task);
+    SCHED_DEBUG("Waking up task PID %lu (Prio %u)", task->pid, task->priority);
+    wake_task(task);
+}
 
-    while (task && task->wakeup_time <= current_ticks) {
-        tcb_t *task_to_wake = task;
-        task = task->wait_next;
-        remove_from_sleep_queue_locked(task_to_wake);
-        task_to_wake->state = TASK_READY;
-        spinlock_release_irqrestore(&g_sleep_queue.lock, sleep_irq_flags); // Release sleep lock
+//============================================================================
+// Multilevel Feedback
+//============================================================================
+/**
+ * @brief Moves a task that is about to become ready after blocking or
+ * sleeping up one level, with a fresh time slice. The task must not be in a
+ * run queue.
+ */
+static void boost_task(tcb_t *task) {
+    KERNEL_ASSERT(!task->in_run_queue, "boost_task: task is queued");
+    if (task_is_idle(task)) return;
+    if (task->priority > SCHED_TOP_PRIORITY) task->priority--;
+    task->ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[task->priority]);
+}
 
-        SCHED_DEBUG("Waking up task PID %lu (Prio %u)", task_to_wake->pid, task_to_wake->priority);
-        run_queue_t *queue = &g_run_queues[task_to_wake->priority];
-        uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&queue->lock);
-        if (!enqueue_task_locked(task_to_wake)) {
-             SCHED_ERROR("Failed to enqueue woken task PID %lu", task_to_wake->pid);
+/**
+ * @brief Moves every task that has waited SCHED_AGING_THRESHOLD_MS in one
+ * CPU's run queues up one level. Levels are visited top-down, so a task moves
+ * at most once per pass; its wait clock keeps running.
+ */
+static void age_ready_tasks(cpu_rq_t *rq) {
+    uint32_t threshold = MS_TO_TICKS(SCHED_AGING_THRESHOLD_MS);
+    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&rq->lock);
+    uint32_t now = g_tick_count;
+    for (int prio = SCHED_TOP_PRIORITY + 1; prio <= SCHED_LOWEST_TASK_PRIORITY; prio++) {
+        if (!(rq->ready_bitmap & (1u << prio))) continue;
+        tcb_t *task = rq->queues[prio].head;
+        while (task) {
+            tcb_t *next = task->next;
+            if (now - task->ready_since >= threshold && now - task->last_aged >= threshold) {
+                dequeue_task_locked(rq, task);
+                task->priority--;
+                task->ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[task->priority]);
+                task->last_aged = now;
+                run_queue_append_locked(rq, task);
+                SCHED_TRACE("Aged PID %lu to Prio %u", task->pid, task->priority);
+            }
+            task = next;
         }
-        task_woken = true;
-        spinlock_release_irqrestore(&queue->lock, queue_irq_flags); // Release queue lock
-
-        sleep_irq_flags = spinlock_acquire_irqsave(&g_sleep_queue.lock); // Re-acquire sleep lock
     }
-    spinlock_release_irqrestore(&g_sleep_queue.lock, sleep_irq_flags); // Release final sleep lock
-    if (task_woken) { g_need_reschedule = true; }
+    spinlock_release_irqrestore(&rq->lock, queue_irq_flags);
 }
 
 //============================================================================
-// Tick Handler (Same as refactored v5.0)
+// Tick Handler
 //============================================================================
 uint32_t scheduler_get_ticks(void) {
+    if (pit_tick_stopped()) {
+        // The count lags while the tick is stopped; catch it up from the PIT
+        uint32_t eflags;
+        asm volatile("pushf; pop %0; cli" : "=r"(eflags));
+        pit_tick_sync();
+        if (eflags & 0x200) asm volatile("sti");
+    }
     return g_tick_count;
 }
 
+/**
+ * @brief Credits ticks that passed with the PIT stopped. Only the BSP keeps
+ * time on the PIT, so only its running task is charged for them; the APs
+ * charge their tasks from their own timers.
+ */
+void scheduler_account_ticks(uint32_t ticks) {
+    atomic_fetch_add_u32(&g_tick_count, ticks);
+    cpu_t *cpu = this_cpu();
+    tcb_t *curr_task = cpu->current;
+    if (cpu->index != 0 || !g_scheduler_ready || !curr_task || task_is_idle(curr_task)) return;
+    curr_task->runtime_ticks += ticks;
+    curr_task->ticks_remaining -= (ticks < curr_task->ticks_remaining) ? ticks : curr_task->ticks_remaining;
+    if (curr_task->ticks_remaining == 0) cpu->need_resched = true;
+}
+
+/** @brief True if some online CPU has a task waiting in its queues. */
+static bool any_task_waiting(void) {
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (g_cpus[c].online && (g_rqs[c].nr_ready || g_cpus[c].need_resched)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Chooses the tick mode. On the BSP: while no task is waiting in any
+ * run queue, nobody can be preempted, so the periodic tick is stopped until
+ * the next timer is due; otherwise it must run. An AP's local timer runs
+ * while the AP has a task running or waiting. Called with interrupts disabled.
+ */
+void scheduler_update_tick(void) {
+    if (!g_scheduler_ready) return;
+    cpu_t *cpu = this_cpu();
+    cpu_rq_t *rq = &g_rqs[cpu->index];
+    if (cpu->index != 0) {
+        if (!task_is_idle(cpu->current) || rq->nr_ready || cpu->need_resched) apic_timer_start();
+        else apic_timer_stop();
+        return;
+    }
+    if (!PIT_TICKLESS) return;
+    // Hold our queue lock so a task queued here meanwhile finds the tick
+    // stopped and restarts it
+    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&rq->lock);
+    if (any_task_waiting()) {
+        spinlock_release_irqrestore(&rq->lock, queue_irq_flags);
+        pit_tick_restart();
+        return;
+    }
+    pit_tick_sync();
+    pit_tick_stop(timer_ticks_until_due(g_tick_count, PIT_ONESHOT_MAX_TICKS));
+    spinlock_release_irqrestore(&rq->lock, queue_irq_flags);
+}
+
 void scheduler_tick(void) {
-    g_tick_count++;
+    uint32_t now = atomic_fetch_add_u32(&g_tick_count, 1) + 1;
+    timer_run(now);
+    scheduler_local_tick();
+}
+
+void scheduler_local_tick(void) {
     if (!g_scheduler_ready) return;
+    cpu_t *cpu = this_cpu();
+    cpu_rq_t *rq = &g_rqs[cpu->index];
+    uint32_t now = g_tick_count;
 
-    check_sleeping_tasks();
+    if (now - rq->last_aging_tick >= MS_TO_TICKS(SCHED_AGING_INTERVAL_MS)) {
+        rq->last_aging_tick = now;
+        age_ready_tasks(rq);
+    }
+    if (smp_cpu_count() > 1 && now - rq->last_balance_tick >= MS_TO_TICKS(SCHED_BALANCE_INTERVAL_MS)) {
+        rq->last_balance_tick = now;
+        balance_cpu(cpu);
+    }
 
-    volatile tcb_t *curr_task_v = g_current_task;
-    if (!curr_task_v) return;
-    tcb_t *curr_task = (tcb_t *)curr_task_v;
+    tcb_t *curr_task = cpu->current;
+    if (!curr_task) return;
 
-    if (curr_task->pid == IDLE_TASK_PID) {
-        if (g_need_reschedule) { g_need_reschedule = false; schedule(); }
+    if (task_is_idle(curr_task)) {
+        if (cpu->need_resched) { cpu->need_resched = false; schedule(); }
+        else scheduler_update_tick();
         return;
     }
 
@@ -311,19 +592,36 @@ void scheduler_tick(void) {
 
     if (curr_task->ticks_remaining == 0) {
         SCHED_DEBUG("Timeslice expired for PID %lu", curr_task->pid);
-        g_need_reschedule = true;
+        cpu->need_resched = true;
     }
 
-    if (g_need_reschedule) {
-        g_need_reschedule = false;
-        schedule();
+    if (cpu->need_resched) {
+        cpu->need_resched = false;
+        schedule(); // Picks the tick mode itself
+        return;
     }
+    scheduler_update_tick();
 }
 
 //============================================================================
 // Idle Task & Zombie Cleanup (Corrected KBC constant)
 //============================================================================
+// Frames the idle task clears per refill call; between calls the timer can
+// preempt it, so a burst never delays a newly runnable task by much.
+#define IDLE_ZERO_CHUNK_FRAMES 16
+
 static __attribute__((noreturn)) void kernel_idle_task_loop(void) {
+    // Idle tasks never change CPU
+    if (this_cpu()->index != 0) {
+        // An AP's idle task only looks for work (its own queue, else
+        // stealing) and sleeps until a reschedule IPI says there is some
+        while (1) {
+            asm volatile ("cli");
+            schedule();
+            asm volatile ("sti; hlt");
+        }
+    }
+
     SCHED_INFO("Idle task started (PID %lu). Entering HLT loop.", (unsigned long)IDLE_TASK_PID);
     serial_write("[Idle Loop] Diagnostic checks will run before each HLT.\n");
 
@@ -331,6 +629,13 @@ static __attribute__((noreturn)) void kernel_idle_task_loop(void) {
         // Perform cleanup of terminated (zombie) processes
         scheduler_cleanup_zombies();
 
+        // Use idle time to top up the pre-zeroed frame pool for fault handlers.
+        // Interrupts stay enabled so any task that becomes ready preempts us.
+        asm volatile ("sti");
+        while (frame_zero_pool_refill(IDLE_ZERO_CHUNK_FRAMES) > 0) {
+            // Keep going until the pool is full
+        }
+
         // --- BEGIN Enhanced DIAGNOSTICS ---
         // This section prints diagnostic information to help debug system state.
         // It's useful to check hardware status (like KBC) and interrupt masks.
@@ -364,25 +669,54 @@ static __attribute__((noreturn)) void kernel_idle_task_loop(void) {
         */ // --- End Removed Warning ---
 
         // 2. Check PIC1 Interrupt Mask Register (IMR) Status (Port 0x21)
-        // This helps verify if expected hardware interrupts (like keyboard IRQ1) are enabled.
-        uint8_t master_imr_before = inb(PIC1_DATA_PORT); // Read Master PIC IMR
-        terminal_printf("[Idle Diagnostics] PIC1 IMR (Port 0x%x) before: 0x%x. ", PIC1_DATA_PORT, master_imr_before);
-
-        // Check if Keyboard IRQ (IRQ1, corresponds to bit 1) is masked (1 = masked, 0 = unmasked)
-        if (master_imr_before & 0x02) {
-             terminal_write("IRQ1 MASKED! Forcing unmask... ");
-             // Force unmask IRQ1 (clear bit 1) - this is often a debug measure
-             outb(PIC1_DATA_PORT, master_imr_before & ~0x02);
-             uint8_t master_imr_after = inb(PIC1_DATA_PORT); // Read back to confirm
-             terminal_printf("PIC1 IMR after: 0x%x\n", master_imr_after);
-        } else {
-            terminal_write("IRQ1 Unmasked (OK).\n");
+        // With the APICs in charge the PICs are masked on purpose (apic.c).
+        if (!apic_is_enabled()) {
+            uint8_t master_imr_before = inb(PIC1_DATA_PORT); // Read Master PIC IMR
+            terminal_printf("[Idle Diagnostics] PIC1 IMR (Port 0x%x) before: 0x%x. ", PIC1_DATA_PORT, master_imr_before);
+
+            // Check if Keyboard IRQ (IRQ1, corresponds to bit 1) is masked (1 = masked, 0 = unmasked)
+            if (master_imr_before & 0x02) {
+                 terminal_write("IRQ1 MASKED! Forcing unmask... ");
+                 // Force unmask IRQ1 (clear bit 1) - this is often a debug measure
+                 outb(PIC1_DATA_PORT, master_imr_before & ~0x02);
+                 uint8_t master_imr_after = inb(PIC1_DATA_PORT); // Read back to confirm
+                 terminal_printf("PIC1 IMR after: 0x%x\n", master_imr_after);
+            } else {
+                terminal_write("IRQ1 Unmasked (OK).\n");
+            }
         }
         if (inb(KBC_STATUS_PORT) & KBC_SR_OBF) {
             uint8_t sc = inb(KBC_DATA_PORT);
             serial_write("[IdlePoll KBC] Scancode: 0x"); serial_print_hex(sc); serial_write("\n");
         }
 
+        frame_zero_pool_stats_t zstats;
+        frame_zero_pool_get_stats(&zstats);
+        terminal_printf("[Idle Diagnostics] Zero pool: %lu/%lu frames, hits=%lu misses=%lu idle_zeroed=%lu\n",
+                        (unsigned long)zstats.pool_count, (unsigned long)zstats.capacity,
+                        (unsigned long)zstats.hits, (unsigned long)zstats.misses,
+                        (unsigned long)zstats.idle_zeroed);
+
+        pit_stats_t pstats;
+        timer_stats_t tstats;
+        pit_get_stats(&pstats);
+        timer_get_stats(&tstats);
+        terminal_printf("[Idle Diagnostics] Tick: %lu ticks, %lu IRQs, %lu one-shots (%lu expired, %lu cut short), %lu ticks while stopped\n",
+                        (unsigned long)scheduler_get_ticks(), (unsigned long)pstats.irqs,
+                        (unsigned long)pstats.oneshots, (unsigned long)pstats.oneshot_expiries,
+                        (unsigned long)pstats.early_restarts, (unsigned long)pstats.stopped_ticks);
+        terminal_printf("[Idle Diagnostics] Timers: %lu pending, %lu expired, late max=%lu total=%llu ticks\n",
+                        (unsigned long)tstats.pending, (unsigned long)tstats.expired,
+                        (unsigned long)tstats.max_late_ticks, (unsigned long long)tstats.total_late_ticks);
+        for (uint32_t c = 0; c < MAX_CPUS; c++) {
+            if (!g_cpus[c].online) continue;
+            sched_cpu_stats_t cstats;
+            scheduler_get_cpu_stats(c, &cstats);
+            terminal_printf("[Idle Diagnostics] CPU %lu: %lu ready, %lu dispatches, %lu steals, %lu pulls, %lu IPIs\n",
+                            (unsigned long)c, (unsigned long)g_rqs[c].nr_ready, (unsigned long)cstats.dispatches,
+                            (unsigned long)cstats.steals, (unsigned long)cstats.pulls, (unsigned long)cstats.ipis);
+        }
+
         terminal_printf("[Idle Diagnostics] Executing sti; hlt...\n");
         // --- END Idle Diagnostics ---
 
@@ -398,6 +732,11 @@ static __attribute__((noreturn)) void kernel_idle_task_loop(void) {
             serial_print_hex(sc);
             serial_write("\n");
         }
+        // Look for work (our queue, else steal); with none, schedule()
+        // stops the periodic tick until the next timer. Interrupts stay off
+        // from the decision until hlt
+        asm volatile ("cli");
+        schedule();
         asm volatile ("sti; hlt");
 
         // Execution resumes here after an interrupt handler returns.
@@ -408,63 +747,74 @@ static __attribute__((noreturn)) void kernel_idle_task_loop(void) {
 } // End kernel_idle_task_loop
 
 
-static void scheduler_init_idle_task(void) {
-    SCHED_DEBUG("Initializing idle task...");
-    memset(&g_idle_task_pcb, 0, sizeof(pcb_t));
-    g_idle_task_pcb.pid = IDLE_TASK_PID;
-    g_idle_task_pcb.page_directory_phys = (uint32_t*)g_kernel_page_directory_phys;
-    KERNEL_ASSERT(g_idle_task_pcb.page_directory_phys != NULL, "Kernel PD phys NULL during idle init");
-    g_idle_task_pcb.entry_point = (uintptr_t)kernel_idle_task_loop;
+static void scheduler_init_idle_task(uint32_t cpu) {
+    SCHED_DEBUG("Initializing idle task of CPU %lu...", (unsigned long)cpu);
+    pcb_t *idle_pcb = &g_idle_pcbs[cpu];
+    tcb_t *idle_tcb = &g_idle_tcbs[cpu];
+    memset(idle_pcb, 0, sizeof(pcb_t));
+    idle_pcb->pid = IDLE_TASK_PID;
+    idle_pcb->page_directory_phys = (uint32_t*)g_kernel_page_directory_phys;
+    KERNEL_ASSERT(idle_pcb->page_directory_phys != NULL, "Kernel PD phys NULL during idle init");
+    idle_pcb->entry_point = (uintptr_t)kernel_idle_task_loop;
+    idle_pcb->is_kernel_thread = true;
 
     // --- Corrected Stack Setup ---
-    static uint8_t idle_stack_buffer[PROCESS_KSTACK_SIZE] __attribute__((aligned(16)));
-
-    // Step 1: Assume &idle_stack_buffer provides the physical (or link-time) base address.
+    // Step 1: Assume &g_idle_stacks provides the physical (or link-time) base address.
     // This assumption might be fragile depending on linking and loading specifics.
-    uintptr_t stack_buffer_phys_base = (uintptr_t)&idle_stack_buffer;
+    uintptr_t stack_buffer_phys_base = (uintptr_t)&g_idle_stacks[cpu][0];
 
     // Step 2: Calculate the physical address just PAST the end of the buffer.
-    uintptr_t stack_buffer_phys_top = stack_buffer_phys_base + sizeof(idle_stack_buffer);
+    uintptr_t stack_buffer_phys_top = stack_buffer_phys_base + PROCESS_KSTACK_SIZE;
 
     // Step 3: Convert this physical top address to the corresponding KERNEL VIRTUAL top address.
     uintptr_t stack_top_virt_addr = PHYS_TO_VIRT(stack_buffer_phys_top);
-    g_idle_task_pcb.kernel_stack_vaddr_top = (uint32_t*)stack_top_virt_addr; // Store HIGH VIRT addr TOP
+    idle_pcb->kernel_stack_vaddr_top = (uint32_t*)stack_top_virt_addr; // Store HIGH VIRT addr TOP
 
     SCHED_DEBUG("Idle task stack: PhysBase=0x%lx, PhysTop=0x%lx -> VirtTop=0x%lx",
                   stack_buffer_phys_base, stack_buffer_phys_top, stack_top_virt_addr);
 
 
-    // --- Initialize TCB (same as before) ---
-    memset(&g_idle_task_tcb, 0, sizeof(tcb_t));
-    g_idle_task_tcb.process = &g_idle_task_pcb;
-    g_idle_task_tcb.pid     = IDLE_TASK_PID;
-    g_idle_task_tcb.state   = TASK_READY;
-    g_idle_task_tcb.in_run_queue = false;
-    g_idle_task_tcb.has_run = false;
-    g_idle_task_tcb.priority = SCHED_IDLE_PRIORITY;
-    KERNEL_ASSERT(g_idle_task_tcb.priority < SCHED_PRIORITY_LEVELS, "Idle priority out of bounds");
-    g_idle_task_tcb.time_slice_ticks = MS_TO_TICKS(g_priority_time_slices_ms[g_idle_task_tcb.priority]);
-    g_idle_task_tcb.ticks_remaining = g_idle_task_tcb.time_slice_ticks;
+    // --- Initialize TCB ---
+    memset(idle_tcb, 0, sizeof(tcb_t));
+    idle_tcb->process = idle_pcb;
+    idle_tcb->pid     = IDLE_TASK_PID;
+    idle_tcb->state   = TASK_RUNNING;
+    idle_tcb->in_run_queue = false;
+    idle_tcb->has_run = false;
+    idle_tcb->priority = SCHED_IDLE_PRIORITY;
+    idle_tcb->cpu = (uint8_t)cpu;
+    KERNEL_ASSERT(idle_tcb->priority < SCHED_PRIORITY_LEVELS, "Idle priority out of bounds");
+    idle_tcb->time_slice_ticks = MS_TO_TICKS(g_priority_time_slices_ms[idle_tcb->priority]);
+    idle_tcb->ticks_remaining = idle_tcb->time_slice_ticks;
 
     // --- Prepare initial kernel stack frame using the HIGH VIRTUAL top address ---
     uint32_t *kstack_ptr = (uint32_t*)stack_top_virt_addr; // Start at high virtual top
     // Push registers/context in reverse order for context_switch
-    *(--kstack_ptr) = (uint32_t)g_idle_task_pcb.entry_point; // RetAddr for context_switch's 'ret'
+    *(--kstack_ptr) = (uint32_t)idle_pcb->entry_point; // RetAddr for context_switch's 'ret'
     *(--kstack_ptr) = 0; // Dummy EBP for context_switch's 'pop ebp'
-    *(--kstack_ptr) = KERNEL_DATA_SELECTOR; // GS
+    *(--kstack_ptr) = GDT_PERCPU_SELECTOR; // GS
     *(--kstack_ptr) = KERNEL_DATA_SELECTOR; // FS
     *(--kstack_ptr) = KERNEL_DATA_SELECTOR; // ES
     *(--kstack_ptr) = KERNEL_DATA_SELECTOR; // DS
     *(--kstack_ptr) = 0x00000202; // EFLAGS (IF=1)
     for (int i = 0; i < 8; i++) *(--kstack_ptr) = 0; // PUSHAD dummy regs
-    g_idle_task_tcb.esp = kstack_ptr; // Store the resulting HIGH VIRTUAL ESP
-    SCHED_DEBUG("Idle task initial TCB ESP calculated: %p", g_idle_task_tcb.esp); // Should now be high addr
+    idle_tcb->esp = kstack_ptr; // Store the resulting HIGH VIRTUAL ESP
+    SCHED_DEBUG("Idle task initial TCB ESP calculated: %p", idle_tcb->esp); // Should now be high addr
 
-    // Add idle task to the global list (same as before)
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&g_all_tasks_lock);
-    g_idle_task_tcb.all_tasks_next = g_all_tasks_head;
-    g_all_tasks_head = &g_idle_task_tcb;
-    spinlock_release_irqrestore(&g_all_tasks_lock, irq_flags);
+    g_cpus[cpu].idle = idle_tcb;
+    g_cpus[cpu].current = idle_tcb;
+}
+
+/**
+ * @brief True if the task was forked by a process that is still running and
+ * may collect it with waitpid. Caller holds g_all_tasks_lock.
+ */
+static bool task_has_waiting_parent_locked(const tcb_t *task) {
+    if (!task->process || task->process->parent_pid == IDLE_TASK_PID) return false;
+    for (tcb_t *t = g_all_tasks_head; t; t = t->all_tasks_next) {
+        if (t->pid == task->process->parent_pid) return t->state != TASK_ZOMBIE;
+    }
+    return false;
 }
 
 void scheduler_cleanup_zombies(void) { // (Implementation same as refactored v5.0)
@@ -475,7 +825,10 @@ void scheduler_cleanup_zombies(void) { // (Implementation same as refactored v5.
     uintptr_t all_tasks_irq_flags = spinlock_acquire_irqsave(&g_all_tasks_lock);
     tcb_t *current_all = g_all_tasks_head;
     while (current_all) {
-        if (current_all->pid != IDLE_TASK_PID && current_all->state == TASK_ZOMBIE) {
+        // Children of a live parent stay ZOMBIE until scheduler_reap_child
+        // collects them; a zombie without a saved ESP is still leaving its CPU
+        if (current_all->state == TASK_ZOMBIE && task_saved_esp(current_all) &&
+            !task_has_waiting_parent_locked(current_all)) {
             zombie_to_reap = current_all;
             if (prev_all) prev_all->all_tasks_next = current_all->all_tasks_next;
             else g_all_tasks_head = current_all->all_tasks_next;
@@ -499,85 +852,138 @@ void scheduler_cleanup_zombies(void) { // (Implementation same as refactored v5.
 //============================================================================
 // Task Selection & Context Switching (Corrected format specifiers)
 //============================================================================
-static tcb_t* scheduler_select_next_task(void) {
-    for (int prio = 0; prio < SCHED_PRIORITY_LEVELS; ++prio) {
-        run_queue_t *queue = &g_run_queues[prio];
-        if (!queue->head) continue;
-        uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&queue->lock);
-        tcb_t *task = queue->head;
-        if (task) {
-            bool dequeued = dequeue_task_locked(task);
-            spinlock_release_irqrestore(&queue->lock, queue_irq_flags);
-            if (!dequeued) { SCHED_ERROR("Selected task PID %lu Prio %d but failed to dequeue!", task->pid, prio); continue; }
-            task->ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[task->priority]);
-            // Use %lu for PID, %d for prio (int), %lu for ticks (uint32_t)
-            SCHED_DEBUG("Selected task PID %lu (Prio %d), Slice=%lu", task->pid, prio, task->ticks_remaining);
-            return task;
-        }
-        spinlock_release_irqrestore(&queue->lock, queue_irq_flags);
+/**
+ * @brief Takes the first task of this CPU's highest-priority non-empty run
+ * queue (find-first-set on its ready bitmap), else steals one from the
+ * busiest CPU, and charges its wait to its accounting. A task keeps what is
+ * left of its time slice across yields and preemptions; only a used-up slice
+ * is refilled. Falls back to this CPU's idle task.
+ */
+static tcb_t* scheduler_select_next_task(cpu_t *cpu) {
+    cpu_rq_t *rq = &g_rqs[cpu->index];
+    tcb_t *task = NULL;
+    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&rq->lock);
+    if (rq->ready_bitmap) {
+        int prio = __builtin_ctz(rq->ready_bitmap);
+        task = rq->queues[prio].head;
+        KERNEL_ASSERT(task != NULL, "Ready bitmap names an empty run queue");
+        dequeue_task_locked(rq, task);
+    }
+    spinlock_release_irqrestore(&rq->lock, queue_irq_flags);
+
+    if (!task && smp_cpu_count() > 1) task = steal_task(cpu->index);
+
+    if (!task) {
+        cpu->idle->ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[cpu->idle->priority]);
+        return cpu->idle;
+    }
+
+    uint32_t waited = g_tick_count - task->ready_since;
+    task->wait_ticks += waited;
+    if (waited > task->max_wait_ticks) task->max_wait_ticks = waited;
+    task->dispatch_count++;
+    rq->stats.dispatches++;
+    if (task->ticks_remaining == 0) {
+        task->ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[task->priority]);
+    }
+    // Use %lu for PID, %u for prio, %lu for ticks (uint32_t)
+    SCHED_DEBUG("CPU %lu selected task PID %lu (Prio %u), Slice=%lu",
+                (unsigned long)cpu->index, task->pid, task->priority, task->ticks_remaining);
+    return task;
+}
+
+/**
+ * @brief Puts the outgoing running task back in its CPU's run queue, one
+ * level lower (with a fresh slice) if it used up its whole time slice. The
+ * idle task is only marked READY.
+ */
+static void requeue_running_task(tcb_t *task) {
+    task->state = TASK_READY;
+    if (task_is_idle(task)) return;
+    if (task->ticks_remaining == 0) {
+        if (task->priority < SCHED_LOWEST_TASK_PRIORITY) task->priority++;
+        task->ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[task->priority]);
     }
-    g_idle_task_tcb.ticks_remaining = MS_TO_TICKS(g_priority_time_slices_ms[g_idle_task_tcb.priority]);
-    return &g_idle_task_tcb;
+    enqueue_task(task);
 }
 
-static void perform_context_switch(tcb_t *old_task, tcb_t *new_task) {
-    KERNEL_ASSERT(new_task && new_task->process && new_task->esp && new_task->process->page_directory_phys, "Invalid new task");
-    uintptr_t new_kernel_stack_top_vaddr = (new_task->pid == IDLE_TASK_PID)
-        ? (uintptr_t)g_idle_task_pcb.kernel_stack_vaddr_top
-        : (uintptr_t)new_task->process->kernel_stack_vaddr_top;
-    tss_set_kernel_stack((uint32_t)new_kernel_stack_top_vaddr);
+static void perform_context_switch(tcb_t *old_task, tcb_t *new_task, uint32_t *new_esp) {
+    KERNEL_ASSERT(new_task && new_task->process && new_esp && new_task->process->page_directory_phys, "Invalid new task");
+    tss_set_kernel_stack((uint32_t)(uintptr_t)new_task->process->kernel_stack_vaddr_top);
     bool pd_needs_switch = (!old_task || !old_task->process || old_task->process->page_directory_phys != new_task->process->page_directory_phys);
 
-    if (!new_task->has_run && new_task->pid != IDLE_TASK_PID) {
+    if (!new_task->has_run && !task_is_idle(new_task) && !new_task->process->is_kernel_thread) {
         new_task->has_run = true;
         // Use %lu for uint32_t PID, %p for pointers
         SCHED_DEBUG("First run for PID %lu. Jumping to user mode (ESP=%p, PD=%p)",
-                      new_task->pid, new_task->esp, new_task->process->page_directory_phys);
-        jump_to_user_mode(new_task->esp, new_task->process->page_directory_phys);
-        KERNEL_PANIC_HALT("jump_to_user_mode returned!");
+                      new_task->pid, new_esp, new_task->process->page_directory_phys);
+        // The outgoing task's context is saved like context_switch does, so it
+        // resumes here (returning from jump_to_user_mode) when next scheduled.
+        jump_to_user_mode(old_task ? &(old_task->esp) : NULL, new_esp,
+                          new_task->process->page_directory_phys);
     } else {
-        if (!new_task->has_run && new_task->pid == IDLE_TASK_PID) new_task->has_run = true;
+        // The idle task and kernel threads start from a context_switch frame
+        if (!new_task->has_run) new_task->has_run = true;
         // Use %lu for uint32_t PIDs, %p for ESP pointers
-        SCHED_DEBUG("Context switch: PID %lu (ESP=%p) -> PID %lu (ESP=%p) (PD Switch: %s)",
-                      old_task ? old_task->pid : (uint32_t)-1, old_task ? old_task->esp : NULL,
-                      new_task->pid, new_task->esp,
+        SCHED_DEBUG("Context switch: PID %lu -> PID %lu (ESP=%p) (PD Switch: %s)",
+                      old_task ? old_task->pid : (uint32_t)-1,
+                      new_task->pid, new_esp,
                       pd_needs_switch ? "YES" : "NO");
-        context_switch(old_task ? &(old_task->esp) : NULL, new_task->esp,
+        context_switch(old_task ? &(old_task->esp) : NULL, new_esp,
                        pd_needs_switch ? new_task->process->page_directory_phys : NULL);
     }
 }
 
-void schedule(void) {
+/**
+ * @brief Picks the next task and switches to it.
+ * @param yielding If set, a still-running current task goes back in its run
+ * queue only after the choice is made, so any other ready task wins over it,
+ * whatever its priority. Otherwise it competes normally: it keeps the CPU
+ * unless a task of equal or higher priority is ready.
+ */
+static void schedule_common(bool yielding) {
     if (!g_scheduler_ready) return;
     uint32_t eflags;
     asm volatile("pushf; pop %0; cli" : "=r"(eflags));
 
-    tcb_t *old_task = (tcb_t *)g_current_task;
-    tcb_t *new_task = scheduler_select_next_task();
+    cpu_t *cpu = this_cpu();
+    tcb_t *old_task = cpu->current;
+    bool old_running = old_task && old_task->state == TASK_RUNNING;
+    if (old_running && !yielding) {
+        requeue_running_task(old_task);
+    }
+
+    tcb_t *new_task = scheduler_select_next_task(cpu);
     KERNEL_ASSERT(new_task != NULL, "scheduler_select_next_task returned NULL!");
 
     if (new_task == old_task) {
-        if (old_task && old_task->state == TASK_READY) old_task->state = TASK_RUNNING;
+        if (old_task->state == TASK_READY) old_task->state = TASK_RUNNING;
+        scheduler_update_tick();
         if (eflags & 0x200) asm volatile("sti"); // Restore IF if needed and no switch
         return;
     }
 
-    if (old_task) {
-        if (old_task->state == TASK_RUNNING) {
-            old_task->state = TASK_READY;
-            run_queue_t *queue = &g_run_queues[old_task->priority];
-            uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&queue->lock);
-            if (!enqueue_task_locked(old_task)) {
-                SCHED_ERROR("Failed to re-enqueue old task PID %lu", old_task->pid);
-            }
-            spinlock_release_irqrestore(&queue->lock, queue_irq_flags);
-        }
+    if (old_running && yielding) {
+        requeue_running_task(old_task);
     }
 
-    g_current_task = new_task;
+    // Take the ownership token; the idle tasks' initial frame is reused
+    uint32_t *new_esp = new_task->esp;
+    if (!task_is_idle(new_task)) {
+        KERNEL_ASSERT(new_esp != NULL, "Picked a task that is still running on another CPU");
+        new_task->esp = NULL;
+    }
+
+    cpu->current = new_task;
     new_task->state = TASK_RUNNING;
-    perform_context_switch(old_task, new_task);
-    // IF flag restored by context_switch's iret/ret
+    scheduler_update_tick();
+    perform_context_switch(old_task, new_task, new_esp);
+    // IF flag restored by context_switch's iret/ret. We may be on another
+    // CPU now: nothing here may use 'cpu' any more.
+}
+
+void schedule(void) {
+    schedule_common(false);
 }
 
 
@@ -586,7 +992,7 @@ void schedule(void) {
 //============================================================================
 int scheduler_add_task(pcb_t *pcb) {
     KERNEL_ASSERT(pcb && pcb->pid != IDLE_TASK_PID && pcb->page_directory_phys &&
-                  pcb->kernel_stack_vaddr_top && pcb->user_stack_top &&
+                  pcb->kernel_stack_vaddr_top && (pcb->user_stack_top || pcb->is_kernel_thread) &&
                   pcb->entry_point && pcb->kernel_esp_for_switch, "Invalid PCB for add_task");
 
     tcb_t *new_task = (tcb_t *)kmalloc(sizeof(tcb_t));
@@ -602,31 +1008,39 @@ int scheduler_add_task(pcb_t *pcb) {
     KERNEL_ASSERT(new_task->priority < SCHED_PRIORITY_LEVELS, "Bad default prio");
     new_task->time_slice_ticks = MS_TO_TICKS(g_priority_time_slices_ms[new_task->priority]);
     new_task->ticks_remaining = new_task->time_slice_ticks;
+    timer_setup(&new_task->sleep_timer, sleep_timer_expired, new_task);
 
     uintptr_t all_tasks_irq_flags = spinlock_acquire_irqsave(&g_all_tasks_lock);
     new_task->all_tasks_next = g_all_tasks_head;
     g_all_tasks_head = new_task;
     spinlock_release_irqrestore(&g_all_tasks_lock, all_tasks_irq_flags);
 
-    run_queue_t *queue = &g_run_queues[new_task->priority];
-    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&queue->lock);
-    if (!enqueue_task_locked(new_task)) {
-        SCHED_ERROR("Failed to enqueue newly created task PID %lu!", new_task->pid);
+    // Start on the least loaded CPU, the executing one on a tie
+    uintptr_t irq_flags = local_irq_save();
+    uint32_t self = this_cpu()->index;
+    uint32_t target = self;
+    uint32_t target_load = cpu_load(self);
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (!g_cpus[c].online) continue;
+        uint32_t load = cpu_load(c);
+        if (load < target_load) { target = c; target_load = load; }
     }
-    // g_task_count++; // Where should this live? Maybe track active count differently.
-    spinlock_release_irqrestore(&queue->lock, queue_irq_flags);
+    new_task->cpu = (uint8_t)target;
+    enqueue_task(new_task);
+    if (target != self && cpu_is_idle(target)) kick_cpu(target, new_task->priority);
+    local_irq_restore(irq_flags);
 
     // Use %lu for PID, %u for priority (uint8_t), %lu for ticks (uint32_t)
-    SCHED_INFO("Added task PID %lu (Prio %u, Slice %lu ticks)",
-                 new_task->pid, new_task->priority, new_task->time_slice_ticks);
+    SCHED_INFO("Added task PID %lu (Prio %u, Slice %lu ticks) on CPU %lu",
+                 new_task->pid, new_task->priority, new_task->time_slice_ticks, (unsigned long)target);
     return SCHED_OK;
 }
 
 void yield(void) {
     uint32_t eflags;
     asm volatile("pushf; pop %0; cli" : "=r"(eflags));
-    SCHED_TRACE("yield() called by PID %lu", g_current_task ? g_current_task->pid : (uint32_t)-1);
-    schedule();
+    SCHED_TRACE("yield() called by PID %lu", get_current_task() ? get_current_task()->pid : (uint32_t)-1);
+    schedule_common(true);
     if (eflags & 0x200) asm volatile("sti");
 }
 
@@ -635,13 +1049,14 @@ void sleep_ms(uint32_t ms) {
     uint32_t ticks_to_wait = MS_TO_TICKS(ms);
     if (ticks_to_wait == 0 && ms > 0) ticks_to_wait = 1;
     uint32_t current_ticks = scheduler_get_ticks();
-    uint32_t wakeup_target;
-    if (ticks_to_wait > (UINT32_MAX - current_ticks)) { wakeup_target = UINT32_MAX; SCHED_WARN("Sleep duration %lu ms results in tick overflow.", ms); }
-    else { wakeup_target = current_ticks + ticks_to_wait; }
+    // Timer expiries are compared modulo 2^32, so a deadline must be less than half the range away
+    if (ticks_to_wait > (uint32_t)INT32_MAX) { ticks_to_wait = (uint32_t)INT32_MAX; SCHED_WARN("Sleep duration %lu ms clamped to %lu ticks.", ms, ticks_to_wait); }
+    uint32_t wakeup_target = current_ticks + ticks_to_wait;
 
     asm volatile("cli"); // Disable interrupts
-    tcb_t *current = (tcb_t*)g_current_task;
-    KERNEL_ASSERT(current && current->pid != IDLE_TASK_PID && (current->state == TASK_RUNNING || current->state == TASK_READY), "Invalid task state for sleep_ms");
+    cpu_t *cpu = this_cpu();
+    tcb_t *current = cpu->current;
+    KERNEL_ASSERT(current && !task_is_idle(current) && (current->state == TASK_RUNNING || current->state == TASK_READY), "Invalid task state for sleep_ms");
 
     current->wakeup_time = wakeup_target;
     current->state = TASK_SLEEPING;
@@ -649,63 +1064,156 @@ void sleep_ms(uint32_t ms) {
     // Use %lu for PIDs/times/durations
     SCHED_DEBUG("Task PID %lu sleeping for %lu ms until tick %lu", current->pid, ms, current->wakeup_time);
 
-    uintptr_t sleep_irq_flags = spinlock_acquire_irqsave(&g_sleep_queue.lock);
-    add_to_sleep_queue_locked(current);
-    spinlock_release_irqrestore(&g_sleep_queue.lock, sleep_irq_flags);
+    // Interrupts stay off until we switch away, so the timer cannot fire first
+    timer_add(&current->sleep_timer, wakeup_target);
+    // The BSP re-arms a stopped PIT for the new deadline in schedule(); from
+    // an AP, run the tick so the one-shot cannot overshoot it
+    if (cpu->index != 0) pit_tick_restart();
     schedule(); // Switch away
 }
 
 void remove_current_task_with_code(uint32_t code) {
     asm volatile("cli");
-    tcb_t *task_to_terminate = (tcb_t *)g_current_task;
-    KERNEL_ASSERT(task_to_terminate && task_to_terminate->pid != IDLE_TASK_PID, "Cannot terminate idle/null task");
+    tcb_t *task_to_terminate = this_cpu()->current;
+    KERNEL_ASSERT(task_to_terminate && !task_is_idle(task_to_terminate), "Cannot terminate idle/null task");
 
     // Use %lu for PID and code
     SCHED_INFO("Task PID %lu exiting with code %lu. Marking as ZOMBIE.", task_to_terminate->pid, code);
-    task_to_terminate->state = TASK_ZOMBIE;
+    SCHED_INFO("  PID %lu: runtime=%lu ticks, waited=%lu ticks over %lu dispatches (max %lu), final Prio %u",
+               task_to_terminate->pid, task_to_terminate->runtime_ticks, task_to_terminate->wait_ticks,
+               task_to_terminate->dispatch_count, task_to_terminate->max_wait_ticks, task_to_terminate->priority);
     task_to_terminate->exit_code = code;
     task_to_terminate->in_run_queue = false;
+
+    // Becoming a ZOMBIE and finding a parent blocked in scheduler_reap_child
+    // happen under the list lock, so the parent cannot block after the check
+    tcb_t *waiting_parent = NULL;
+    uintptr_t all_tasks_irq_flags = spinlock_acquire_irqsave(&g_all_tasks_lock);
+    task_to_terminate->state = TASK_ZOMBIE;
+    if (task_to_terminate->process) {
+        for (tcb_t *t = g_all_tasks_head; t; t = t->all_tasks_next) {
+            if (t->pid == task_to_terminate->process->parent_pid) {
+                if (t->state == TASK_BLOCKED && t->wait_reason == task_to_terminate) {
+                    t->wait_reason = NULL;
+                    waiting_parent = t;
+                }
+                break;
+            }
+        }
+    }
+    spinlock_release_irqrestore(&g_all_tasks_lock, all_tasks_irq_flags);
+    // The parent may run before this CPU has saved our ESP; it waits out the
+    // rest of the switch in scheduler_reap_child
+    if (waiting_parent) scheduler_unblock_task(waiting_parent);
     schedule();
     KERNEL_PANIC_HALT("Returned from schedule() after terminating task!");
 }
 
-volatile tcb_t* get_current_task_volatile(void) { return g_current_task; }
-tcb_t* get_current_task(void) { return (tcb_t *)g_current_task; }
+int scheduler_reap_child(uint32_t parent_pid, uint32_t child_pid, uint32_t *exit_code_out) {
+    tcb_t *self = get_current_task();
+    for (;;) {
+        tcb_t *child = NULL;
+        tcb_t *prev_all = NULL;
+        bool found = false;
+        bool block = false;
+        bool switching_out = false;
+
+        uint32_t eflags;
+        asm volatile("pushf; pop %0; cli" : "=r"(eflags));
+        uintptr_t all_tasks_irq_flags = spinlock_acquire_irqsave(&g_all_tasks_lock);
+        for (tcb_t *t = g_all_tasks_head; t; prev_all = t, t = t->all_tasks_next) {
+            if (t->pid != child_pid) continue;
+            if (t->process && t->process->parent_pid == parent_pid) {
+                found = true;
+                if (t->state != TASK_ZOMBIE) {
+                    // Woken by remove_current_task_with_code
+                    self->wait_reason = t;
+                    self->state = TASK_BLOCKED;
+                    block = true;
+                } else if (!task_saved_esp(t)) {
+                    // Exited, but its CPU is still switching away from its stack
+                    switching_out = true;
+                } else {
+                    child = t;
+                    if (prev_all) prev_all->all_tasks_next = t->all_tasks_next;
+                    else g_all_tasks_head = t->all_tasks_next;
+                    t->all_tasks_next = NULL;
+                }
+            }
+            break;
+        }
+        spinlock_release_irqrestore(&g_all_tasks_lock, all_tasks_irq_flags); // Interrupts stay off
+        if (block) schedule();
+        if (eflags & 0x200) asm volatile("sti");
+
+        if (!found) return SCHED_ERR_INVALID;
+
+        if (child) {
+            if (exit_code_out) *exit_code_out = child->exit_code;
+            SCHED_DEBUG("PID %lu reaped child PID %lu (Exit Code: %lu).", parent_pid, child_pid, child->exit_code);
+            destroy_process(child->process);
+            kfree(child);
+            return SCHED_OK;
+        }
+
+        // The exiting CPU has interrupts off until its context_switch saves
+        // the ESP, so this wait is only a few instructions long
+        if (switching_out) asm volatile("pause");
+    }
+}
+
+volatile tcb_t* get_current_task_volatile(void) { return this_cpu_current(); }
+tcb_t* get_current_task(void) { return this_cpu_current(); }
 
 void scheduler_start(void) {
     SCHED_INFO("Scheduler marked as ready.");
     g_scheduler_ready = true;
-    g_need_reschedule = true;
+    this_cpu()->need_resched = true;
+}
+
+bool scheduler_can_block(void) {
+    if (!g_scheduler_ready || spinlock_held_count() != 0) return false;
+    tcb_t *current = get_current_task();
+    return current && !task_is_idle(current);
+}
+
+void scheduler_init_cpu(uint32_t cpu) {
+    KERNEL_ASSERT(cpu < MAX_CPUS, "scheduler_init_cpu: CPU index out of range");
+    cpu_rq_t *rq = &g_rqs[cpu];
+    memset(rq, 0, sizeof(*rq));
+    spinlock_init(&rq->lock);
+    for (int i = 0; i < SCHED_PRIORITY_LEVELS; i++) init_run_queue(&rq->queues[i]);
+    rq->last_aging_tick = g_tick_count;
+    rq->last_balance_tick = g_tick_count;
+    scheduler_init_idle_task(cpu);
+}
+
+void scheduler_start_cpu(void) {
+    asm volatile("cli");
+    cpu_t *cpu = this_cpu();
+    KERNEL_ASSERT(cpu->index != 0 && cpu->idle, "scheduler_start_cpu: not an initialized AP");
+    cpu->current = cpu->idle;
+    tss_set_kernel_stack((uint32_t)(uintptr_t)cpu->idle->process->kernel_stack_vaddr_top);
+    // The boot stack is abandoned; the idle task's frame turns interrupts on
+    context_switch(NULL, cpu->idle->esp, NULL);
+    KERNEL_PANIC_HALT("scheduler_start_cpu: returned from context_switch");
 }
 
 void scheduler_init(void) {
-    SCHED_INFO("Initializing scheduler (v5.2 - Final Format Fixes)...");
-    // ... (memset queues, init locks, etc) ...
-    memset(g_run_queues, 0, sizeof(g_run_queues));
-    g_current_task = NULL;
+    SCHED_INFO("Initializing scheduler (v6.0 - per-CPU run queues)...");
     g_tick_count = 0;
     g_scheduler_ready = false;
-    g_need_reschedule = false;
     g_all_tasks_head = NULL;
     spinlock_init(&g_all_tasks_lock);
-    for (int i = 0; i < SCHED_PRIORITY_LEVELS; i++) init_run_queue(&g_run_queues[i]);
-    init_sleep_queue();
-    // ...
-
-    scheduler_init_idle_task(); // Initializes idle PCB/TCB, calculates HIGH VIRT stack top/esp
+    timer_init(g_tick_count);
 
-    // Enqueue idle task
-    run_queue_t *idle_queue = &g_run_queues[g_idle_task_tcb.priority];
-    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&idle_queue->lock);
-    if (!enqueue_task_locked(&g_idle_task_tcb)) {
-        KERNEL_PANIC_HALT("Failed to enqueue idle task");
-    }
-    spinlock_release_irqrestore(&idle_queue->lock, queue_irq_flags);
-
-    g_current_task = &g_idle_task_tcb; // Start with idle task
+    // The BSP starts out "running" its idle task; its ESP is never saved, so
+    // the boot code we are on now is left behind at the first switch
+    scheduler_init_cpu(0);
+    g_cpus[0].need_resched = false;
 
     // --- Setup TSS SP0 using the corrected high virtual address ---
-    uintptr_t idle_stack_top_virt = (uintptr_t)g_idle_task_pcb.kernel_stack_vaddr_top;
+    uintptr_t idle_stack_top_virt = (uintptr_t)g_idle_pcbs[0].kernel_stack_vaddr_top;
     SCHED_DEBUG("Setting initial TSS ESP0 to calculated high virtual top: %p", (void*)idle_stack_top_virt);
     tss_set_kernel_stack((uint32_t)idle_stack_top_virt);
 
@@ -717,24 +1225,24 @@ void scheduler_unblock_task(tcb_t *task) {
     if (!task) { SCHED_WARN("Called with NULL task."); return; }
 
     KERNEL_ASSERT(task->priority < SCHED_PRIORITY_LEVELS, "Invalid task priority for unblock");
-    run_queue_t *queue = &g_run_queues[task->priority];
-    uintptr_t queue_irq_flags = spinlock_acquire_irqsave(&queue->lock);
 
-    if (task->state == TASK_BLOCKED) {
-        task->state = TASK_READY;
+    // Wakers on two CPUs may race; only the one that moves the task out of
+    // BLOCKED queues it
+    _Static_assert(sizeof(task_state_e) == sizeof(uint32_t), "task state is swapped as a 32-bit word");
+    if (atomic_cmpxchg_u32((volatile uint32_t *)&task->state, TASK_BLOCKED, TASK_READY)) {
+        if (!task->in_run_queue) boost_task(task);
         // Use %lu for PID
         SCHED_DEBUG("Task PID %lu unblocked, new state: READY.", task->pid);
-        if (!enqueue_task_locked(task)) {
-             SCHED_ERROR("Failed to enqueue unblocked task PID %lu (already enqueued?)", task->pid);
-        } else {
-             g_need_reschedule = true; // Set hint *after* successfully enqueuing
-             // Use %lu for PID, %u for priority
-             SCHED_DEBUG("Task PID %lu enqueued into run queue Prio %u.", task->pid, task->priority);
-        }
+        wake_task(task);
+        // Use %lu for PID, %u for priority
+        SCHED_DEBUG("Task PID %lu enqueued into run queue Prio %u on CPU %u.", task->pid, task->priority, task->cpu);
     } else {
         // Use %lu for PID, %d for state enum
         SCHED_WARN("Called on task PID %lu which was not BLOCKED (state=%d).", task->pid, task->state);
     }
+}
 
-    spinlock_release_irqrestore(&queue->lock, queue_irq_flags);
-}
\ No newline at end of file
+void scheduler_get_cpu_stats(uint32_t cpu, sched_cpu_stats_t *stats) {
+    if (!stats || cpu >= MAX_CPUS) return;
+    *stats = g_rqs[cpu].stats;
+}
@@ -1,6 +1,14 @@
 /**
  * slab.c - Slab Allocator Implementation
- * Features: SMP Safety (Spinlocks), Slab Coloring, Footer Canaries, Reclaim Option.
+ * Features: SMP Safety (Spinlocks), Slab Coloring, Footer Canaries, Reclaim Option,
+ *           Per-CPU Magazine Layer with a Shared Depot (Bonwick).
+ *
+ * Magazine layer: each cache has a loaded/previous magazine pair per CPU.
+ * slab_alloc/slab_free pop/push those with only local interrupts disabled.
+ * The cache lock is taken only when both magazines are exhausted (alloc) or
+ * full (free), to swap magazines with the depot or to move objects between
+ * magazines and slab pages.
+ * Lock order: cache->lock may be held while calling into the buddy allocator.
  */
 
  #include "slab.h"
@@ -10,6 +18,7 @@
  #include "spinlock.h"
  #include <string.h>
  #include "paging.h"     // For memset
+ #include "get_cpu_id.h" // For magazine slot selection
 
  #ifndef PAGE_SIZE
  #error "PAGE_SIZE is not defined!"
@@ -29,6 +38,10 @@
  // Helper macro for alignment calculation
  #define ALIGN_UP(addr, align) (((uintptr_t)(addr) + (align) - 1) & ~((uintptr_t)(align) - 1))
 
+ // Slab pages are raw, page-aligned buddy blocks so the slab header sits at the page base
+ #define SLAB_PAGE_ORDER 12
+ _Static_assert((1u << SLAB_PAGE_ORDER) == PAGE_SIZE, "SLAB_PAGE_ORDER must match PAGE_SIZE");
+
  // --- Feature Flags ---
  #define ENABLE_SLAB_RECLAIM 1 // Return empty slabs to buddy system
  // #define SLAB_POISON_ALLOC 0xCC // Poison allocated objects
@@ -56,6 +69,8 @@
 
  /* Forward Declarations */
  static slab_t *slab_grow_cache(slab_cache_t *cache);
+ static void *slab_alloc_from_slabs_locked(slab_cache_t *cache);
+ static void slab_free_to_slabs_locked(slab_cache_t *cache, void *obj);
  static void slab_list_add(slab_t **list_head, slab_t *slab);
  static bool slab_list_remove(slab_t **list_head, slab_t *slab_to_remove);
 
@@ -135,6 +150,12 @@
      if (cache->color_range > PAGE_SIZE / 2) cache->color_range = 0; // Avoid excessive waste
      cache->alloc_count      = 0;
      cache->free_count       = 0;
+     memset(cache->cpu_caches, 0, sizeof(cache->cpu_caches));
+     cache->depot_full       = NULL;
+     cache->depot_empty      = NULL;
+     cache->depot_full_count = 0;
+     cache->bypass_alloc_count = 0;
+     cache->bypass_free_count  = 0;
      cache->constructor      = constructor;
      cache->destructor       = destructor;
      spinlock_init(&cache->lock);
@@ -162,7 +183,7 @@
      uintptr_t irq_flags = local_irq_save();
      spinlock_release_irqrestore(&cache->lock, irq_flags);
 
-     void *page = buddy_alloc(PAGE_SIZE); // Buddy must be thread-safe
+     void *page = buddy_alloc_raw(SLAB_PAGE_ORDER); // Buddy must be thread-safe
 
      // *** Re-acquire lock AFTER buddy_alloc ***
      irq_flags = spinlock_acquire_irqsave(&cache->lock);
@@ -192,7 +213,7 @@
      if (slab->objs_this_slab == 0) {
          terminal_printf("[Slab] Cache '%s': Error - Zero objects fit slab after coloring (offset %d, slot size %d).\n",
                         cache->name, slab->color_offset, (int)cache->internal_slot_size);
-         buddy_free(page); // Free the page
+         buddy_free_raw(page, SLAB_PAGE_ORDER); // Free the page
          return NULL; // Indicate failure
      }
      slab->free_count = slab->objs_this_slab;
@@ -221,17 +242,14 @@
      return slab;
  }
 
- /* slab_alloc */
- void *slab_alloc(slab_cache_t *cache) {
-     if (!cache) { /* ... */ return NULL; }
-
-     uintptr_t irq_flags = spinlock_acquire_irqsave(&cache->lock); // *** Acquire Lock ***
-
+ /* slab_alloc_from_slabs_locked: takes one object from the slab pages and constructs it */
+ static void *slab_alloc_from_slabs_locked(slab_cache_t *cache) {
+     // --- Lock MUST be held ---
      slab_t *slab = cache->slab_partial;
      void *obj = NULL;
 
      // Try promoting from empty list
-     if (!slab && cache->slab_empty) { /* ... promotion logic as before ... */
+     if (!slab && cache->slab_empty) {
          slab = cache->slab_empty;
          if (slab_list_remove(&cache->slab_empty, slab)) { slab_list_add(&cache->slab_partial, slab); }
          else { slab = NULL; /* Log error */ }
@@ -239,12 +257,11 @@
      // Grow cache if needed
      if (!slab) {
          slab = slab_grow_cache(cache); // Handles lock release/re-acquire for buddy
-         if (!slab) { spinlock_release_irqrestore(&cache->lock, irq_flags); return NULL; }
+         if (!slab) { return NULL; }
          slab_list_add(&cache->slab_partial, slab);
      }
 
-     // --- Perform Allocation (lock is held) ---
-     if (!is_valid_slab(slab) || !slab->free_list) { /* ... handle error ... */ spinlock_release_irqrestore(&cache->lock, irq_flags); return NULL; }
+     if (!is_valid_slab(slab) || !slab->free_list) { /* ... handle error ... */ return NULL; }
 
      obj = slab->free_list; // Get raw object slot pointer
      slab->free_list = *(void **)obj; // Advance free list
@@ -252,121 +269,277 @@
      cache->alloc_count++;
 
      // Update lists if slab became full
-     if (slab->free_count == 0) { /* ... move slab partial -> full ... */
+     if (slab->free_count == 0) {
           if (slab_list_remove(&cache->slab_partial, slab)) { slab_list_add(&cache->slab_full, slab); }
           else { /* Log error */ }
      }
 
-     // --- Write Footer Canary (inside lock) ---
+     // --- Write Footer Canary ---
      *(uint32_t*)((uintptr_t)obj + cache->internal_slot_size - SLAB_FOOTER_SIZE) = SLAB_FOOTER_MAGIC;
 
-     // Call constructor (inside lock)
+     // Objects are constructed once when they leave the slab layer; magazines cache constructed objects
      if (cache->constructor) {
-         cache->constructor(obj); // Pass pointer to start of user area
+         cache->constructor(obj);
      }
-
-     spinlock_release_irqrestore(&cache->lock, irq_flags); // *** Release Lock ***
-
-     #ifdef SLAB_POISON_ALLOC
-     memset(obj, SLAB_POISON_ALLOC, cache->user_obj_size); // Poison user area only
-     #endif
-
-     return obj; // Return pointer to start of user area
+     return obj;
  }
 
-
- /* slab_free */
- void slab_free(slab_cache_t *provided_cache, void *obj) {
-     if (!obj) { return; }
-
-     // --- Initial Validation (before lock) ---
-     uintptr_t obj_addr = (uintptr_t)obj; // This is the start of the user area / internal slot
-     uintptr_t slab_base = obj_addr & ~(PAGE_SIZE - 1);
+ /* slab_free_to_slabs_locked: destructs an object and puts it back on its slab page */
+ static void slab_free_to_slabs_locked(slab_cache_t *cache, void *obj) {
+     // --- Lock MUST be held; obj already validated by slab_validate_object ---
+     uintptr_t slab_base = (uintptr_t)obj & ~(PAGE_SIZE - 1);
      slab_t *slab = (slab_t *)slab_base;
-     if (!is_valid_slab(slab)) { /* ... handle error ... */ return; }
-     slab_cache_t *cache = slab->cache;
-     if (!cache) { /* ... handle error ... */ return; }
-     if (provided_cache && provided_cache != cache) { /* ... log warning ... */ }
-
-     // --- Acquire Lock ---
-     uintptr_t irq_flags = spinlock_acquire_irqsave(&cache->lock);
-
-     // --- Validations (inside lock) ---
-     if (!is_valid_slab(slab) || slab->cache != cache) { /* ... handle error ... */ spinlock_release_irqrestore(&cache->lock, irq_flags); return; }
-
-     // Validate address range and alignment using color offset
-     uintptr_t data_start = slab_base + SLAB_HEADER_SIZE + slab->color_offset;
-     // Note: objs_this_slab might be smaller than cache->objs_per_slab_max due to coloring
-     uintptr_t data_end = data_start + (slab->objs_this_slab * cache->internal_slot_size);
-     if (obj_addr < data_start || obj_addr >= data_end || ((obj_addr - data_start) % cache->internal_slot_size) != 0) {
-        // <<<<< CORRECTED: Removed erroneous printf, added reasonable one >>>>>
-        terminal_printf("[Slab] Cache '%s': Invalid free address 0x%lx (Out of bounds or misaligned).\n", cache->name, obj_addr);
-        spinlock_release_irqrestore(&cache->lock, irq_flags); return;
-     }
 
-     // --- Check Footer Canary (inside lock) ---
-     uint32_t *footer_ptr = (uint32_t*)(obj_addr + cache->internal_slot_size - SLAB_FOOTER_SIZE);
-     if (*footer_ptr != SLAB_FOOTER_MAGIC) {
-          // <<<<< CORRECTED: Changed %x to %lx >>>>>
-         terminal_printf("[Slab] Cache '%s': CORRUPTION DETECTED freeing obj 0x%lx! Footer magic invalid (Expected: 0x%lx, Found: 0x%lx).\n",
-                         cache->name, obj_addr, (unsigned long)SLAB_FOOTER_MAGIC, (unsigned long)*footer_ptr);
-         // Optionally: Mark slab as corrupt? Abort? For now, just report and abort free.
-         spinlock_release_irqrestore(&cache->lock, irq_flags);
-         // Consider a panic or special handling for corrupted memory
-         return;
-     }
-
-     // Call destructor (inside lock)
      if (cache->destructor) {
          cache->destructor(obj);
      }
 
      #ifdef SLAB_POISON_FREE
      memset(obj, SLAB_POISON_FREE, cache->user_obj_size); // Poison user area
-     // Re-write footer magic after poisoning if needed, or poison around it
-     *footer_ptr = SLAB_FOOTER_MAGIC;
+     // Re-write footer magic after poisoning
+     *(uint32_t*)((uintptr_t)obj + cache->internal_slot_size - SLAB_FOOTER_SIZE) = SLAB_FOOTER_MAGIC;
      #endif
 
-     // --- Perform Free (inside lock) ---
      *(void **)obj = slab->free_list; // Prepend to free list
      slab->free_list = obj;
      slab->free_count++;
      cache->free_count++;
 
-     // --- Update Slab Lists (inside lock) ---
+     // --- Update Slab Lists ---
      bool was_full = (slab->free_count == 1);
      bool is_empty = (slab->free_count == slab->objs_this_slab); // Check against *this slab's* capacity
      bool list_changed = false;
 
-     if (is_empty) { /* ... Move from partial/full to empty/reclaim (as before, use objs_this_slab) ... */
+     if (is_empty) {
          // Remove from partial or full list
          if (was_full) { list_changed = slab_list_remove(&cache->slab_full, slab); }
          else { list_changed = slab_list_remove(&cache->slab_partial, slab); }
 
-         if (!list_changed && slab->free_count != 1) { // Only error if it wasn't found and wasn't just moved from full
-              // <<<<< CORRECTED: Changed %x to %lx >>>>>
+         if (!list_changed && slab->free_count != 1) {
               terminal_printf("[Slab] Cache '%s': ERROR! Empty slab 0x%lx not found on partial/full list.\n", cache->name, (uintptr_t)slab);
          }
 
          #ifdef ENABLE_SLAB_RECLAIM
          if (list_changed) {
-             spinlock_release_irqrestore(&cache->lock, irq_flags); // Release before buddy_free
-             buddy_free((void*)slab_base);
-             return; // Slab memory is gone
+             slab->magic = 0; // Stale objects from this page must no longer validate
+             buddy_free_raw((void*)slab_base, SLAB_PAGE_ORDER);
          }
          #else
          if (list_changed) { slab_list_add(&cache->slab_empty, slab); }
          #endif
 
-     } else if (was_full) { /* ... Move full -> partial (as before) ... */
+     } else if (was_full) {
           if (slab_list_remove(&cache->slab_full, slab)) { slab_list_add(&cache->slab_partial, slab); }
           else { /* Log error */ }
      }
+ }
+
+ /* slab_validate_object: lock-free checks of an object being freed. Returns its cache or NULL. */
+ static slab_cache_t *slab_validate_object(slab_cache_t *provided_cache, void *obj) {
+     uintptr_t obj_addr = (uintptr_t)obj; // This is the start of the user area / internal slot
+     uintptr_t slab_base = obj_addr & ~(PAGE_SIZE - 1);
+     slab_t *slab = (slab_t *)slab_base;
+     if (!is_valid_slab(slab)) { /* ... handle error ... */ return NULL; }
+     slab_cache_t *cache = slab->cache;
+     if (!cache) { /* ... handle error ... */ return NULL; }
+     if (provided_cache && provided_cache != cache) { /* ... log warning ... */ }
+
+     // Validate address range and alignment using color offset (immutable once the slab exists)
+     uintptr_t data_start = slab_base + SLAB_HEADER_SIZE + slab->color_offset;
+     // Note: objs_this_slab might be smaller than cache->objs_per_slab_max due to coloring
+     uintptr_t data_end = data_start + (slab->objs_this_slab * cache->internal_slot_size);
+     if (obj_addr < data_start || obj_addr >= data_end || ((obj_addr - data_start) % cache->internal_slot_size) != 0) {
+        terminal_printf("[Slab] Cache '%s': Invalid free address 0x%lx (Out of bounds or misaligned).\n", cache->name, obj_addr);
+        return NULL;
+     }
+
+     // --- Check Footer Canary ---
+     uint32_t *footer_ptr = (uint32_t*)(obj_addr + cache->internal_slot_size - SLAB_FOOTER_SIZE);
+     if (*footer_ptr != SLAB_FOOTER_MAGIC) {
+         terminal_printf("[Slab] Cache '%s': CORRUPTION DETECTED freeing obj 0x%lx! Footer magic invalid (Expected: 0x%lx, Found: 0x%lx).\n",
+                         cache->name, obj_addr, (unsigned long)SLAB_FOOTER_MAGIC, (unsigned long)*footer_ptr);
+         // Consider a panic or special handling for corrupted memory
+         return NULL;
+     }
+     return cache;
+ }
+
+ /* Helper: push/pop magazine depot lists (lock held) */
+ static inline void slab_mag_push(slab_magazine_t **list_head, slab_magazine_t *mag) {
+     mag->next = *list_head;
+     *list_head = mag;
+ }
+
+ static inline slab_magazine_t *slab_mag_pop(slab_magazine_t **list_head) {
+     slab_magazine_t *mag = *list_head;
+     if (mag) { *list_head = mag->next; mag->next = NULL; }
+     return mag;
+ }
+
+ /* slab_mag_create: allocates an empty magazine (may be called with the cache lock held) */
+ static slab_magazine_t *slab_mag_create(void) {
+     slab_magazine_t *mag = (slab_magazine_t *)buddy_alloc(sizeof(slab_magazine_t));
+     if (mag) { mag->next = NULL; mag->rounds = 0; }
+     return mag;
+ }
+
+ /* slab_alloc_slow: both CPU magazines are empty. IRQs are disabled by the caller. */
+ static void *slab_alloc_slow(slab_cache_t *cache, slab_cpu_cache_t *cc) {
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&cache->lock);
+     void *obj = NULL;
+
+     slab_magazine_t *full = slab_mag_pop(&cache->depot_full);
+     if (full) {
+         // Exchange: previous (empty) goes to the depot, loaded becomes previous
+         cache->depot_full_count--;
+         if (cc->previous) { slab_mag_push(&cache->depot_empty, cc->previous); }
+         cc->previous = cc->loaded;
+         cc->loaded = full;
+     } else {
+         // Depot has no full magazines: refill one from the slabs
+         slab_magazine_t *mag = cc->loaded;
+         if (!mag) { mag = slab_mag_pop(&cache->depot_empty); }
+         if (!mag) { mag = slab_mag_create(); }
+         if (!mag) {
+             obj = slab_alloc_from_slabs_locked(cache); // No magazine memory; serve directly
+             spinlock_release_irqrestore(&cache->lock, irq_flags);
+             return obj;
+         }
+         cc->loaded = mag;
+         // Fill from existing slabs, growing by at most one slab page per refill
+         while (mag->rounds < SLAB_MAGAZINE_SIZE) {
+             if (mag->rounds > 0 && !cache->slab_partial && !cache->slab_empty) { break; }
+             void *fresh = slab_alloc_from_slabs_locked(cache);
+             if (!fresh) { break; }
+             mag->objs[mag->rounds++] = fresh;
+         }
+     }
+
+     if (cc->loaded && cc->loaded->rounds > 0) {
+         obj = cc->loaded->objs[--cc->loaded->rounds];
+     }
+     spinlock_release_irqrestore(&cache->lock, irq_flags);
+     return obj;
+ }
+
+ /* slab_alloc */
+ void *slab_alloc(slab_cache_t *cache) {
+     if (!cache) { /* ... */ return NULL; }
+
+     void *obj = NULL;
+     uintptr_t irq_flags = local_irq_save(); // Pins us to this CPU's magazines
+     int cpu = get_cpu_id();
+
+     if (cpu < 0 || cpu >= MAX_CPUS) {
+         // No magazine slot for this CPU: go straight to the slabs
+         uintptr_t lock_flags = spinlock_acquire_irqsave(&cache->lock);
+         obj = slab_alloc_from_slabs_locked(cache);
+         if (obj) { cache->bypass_alloc_count++; }
+         spinlock_release_irqrestore(&cache->lock, lock_flags);
+     } else {
+         slab_cpu_cache_t *cc = &cache->cpu_caches[cpu];
+         if (cc->loaded && cc->loaded->rounds > 0) {
+             obj = cc->loaded->objs[--cc->loaded->rounds];
+             cc->mag_hits++;
+         } else if (cc->previous && cc->previous->rounds > 0) {
+             slab_magazine_t *tmp = cc->loaded;
+             cc->loaded = cc->previous;
+             cc->previous = tmp;
+             obj = cc->loaded->objs[--cc->loaded->rounds];
+             cc->mag_hits++;
+         } else {
+             cc->mag_misses++;
+             obj = slab_alloc_slow(cache, cc);
+         }
+         if (obj) { cc->alloc_count++; }
+     }
+     local_irq_restore(irq_flags);
+
+     #ifdef SLAB_POISON_ALLOC
+     if (obj) { memset(obj, SLAB_POISON_ALLOC, cache->user_obj_size); } // Poison user area only
+     #endif
 
-     // --- Release Lock (if not already released by reclaim) ---
+     return obj; // Return pointer to start of user area
+ }
+
+ /* slab_free_slow: both CPU magazines are full. IRQs are disabled by the caller. */
+ static void slab_free_slow(slab_cache_t *cache, slab_cpu_cache_t *cc, void *obj) {
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&cache->lock);
+
+     slab_magazine_t *empty = slab_mag_pop(&cache->depot_empty);
+     if (!empty) { empty = slab_mag_create(); }
+     if (!empty) {
+         slab_free_to_slabs_locked(cache, obj); // No magazine memory; free directly
+         spinlock_release_irqrestore(&cache->lock, irq_flags);
+         return;
+     }
+
+     // Exchange: previous (full) goes to the depot, loaded becomes previous
+     if (cc->previous) {
+         slab_mag_push(&cache->depot_full, cc->previous);
+         cache->depot_full_count++;
+     }
+     cc->previous = cc->loaded;
+     cc->loaded = empty;
+     empty->objs[empty->rounds++] = obj;
+
+     // Bound the memory parked in the depot: flush surplus full magazines to the slabs
+     while (cache->depot_full_count > SLAB_DEPOT_MAX_FULL) {
+         slab_magazine_t *surplus = slab_mag_pop(&cache->depot_full);
+         cache->depot_full_count--;
+         while (surplus->rounds > 0) {
+             slab_free_to_slabs_locked(cache, surplus->objs[--surplus->rounds]);
+         }
+         buddy_free(surplus);
+     }
      spinlock_release_irqrestore(&cache->lock, irq_flags);
  }
 
+ /* slab_free */
+ void slab_free(slab_cache_t *provided_cache, void *obj) {
+     if (!obj) { return; }
+
+     // --- Validation (lock-free: only immutable slab metadata is read) ---
+     slab_cache_t *cache = slab_validate_object(provided_cache, obj);
+     if (!cache) { return; }
+
+     uintptr_t irq_flags = local_irq_save(); // Pins us to this CPU's magazines
+     int cpu = get_cpu_id();
+
+     if (cpu < 0 || cpu >= MAX_CPUS) {
+         uintptr_t lock_flags = spinlock_acquire_irqsave(&cache->lock);
+         slab_free_to_slabs_locked(cache, obj);
+         cache->bypass_free_count++;
+         spinlock_release_irqrestore(&cache->lock, lock_flags);
+     } else {
+         slab_cpu_cache_t *cc = &cache->cpu_caches[cpu];
+         if (cc->loaded && cc->loaded->rounds < SLAB_MAGAZINE_SIZE) {
+             cc->loaded->objs[cc->loaded->rounds++] = obj;
+             cc->mag_hits++;
+         } else if (cc->previous && cc->previous->rounds < SLAB_MAGAZINE_SIZE) {
+             slab_magazine_t *tmp = cc->loaded;
+             cc->loaded = cc->previous;
+             cc->previous = tmp;
+             cc->loaded->objs[cc->loaded->rounds++] = obj;
+             cc->mag_hits++;
+         } else {
+             cc->mag_misses++;
+             slab_free_slow(cache, cc, obj);
+         }
+         cc->free_count++;
+     }
+     local_irq_restore(irq_flags);
+ }
+
+
+ /* slab_drop_magazine: destructs cached rounds and frees the magazine (used by slab_destroy) */
+ static void slab_drop_magazine(slab_cache_t *cache, slab_magazine_t *mag) {
+     if (!mag) return;
+     if (cache->destructor) {
+         while (mag->rounds > 0) { cache->destructor(mag->objs[--mag->rounds]); }
+     }
+     buddy_free(mag);
+ }
 
  /* slab_destroy */
  void slab_destroy(slab_cache_t *cache) {
@@ -377,6 +550,19 @@
 
      uintptr_t irq_flags = spinlock_acquire_irqsave(&cache->lock);
      terminal_printf("[Slab] Destroying cache '%s'...\n", cache_name_copy);
+
+     // Drop all magazines first; their objects live in the slab pages freed below
+     for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+         slab_drop_magazine(cache, cache->cpu_caches[cpu].loaded);
+         slab_drop_magazine(cache, cache->cpu_caches[cpu].previous);
+         cache->cpu_caches[cpu].loaded = NULL;
+         cache->cpu_caches[cpu].previous = NULL;
+     }
+     slab_magazine_t *mag;
+     while ((mag = slab_mag_pop(&cache->depot_full)) != NULL) { slab_drop_magazine(cache, mag); }
+     while ((mag = slab_mag_pop(&cache->depot_empty)) != NULL) { slab_drop_magazine(cache, mag); }
+     cache->depot_full_count = 0;
+
      slab_t *curr, *next;
      int freed_count = 0;
      slab_t **lists[] = {&cache->slab_partial, &cache->slab_full, &cache->slab_empty};
@@ -389,7 +575,7 @@
          while (curr) {
              next = curr->next;
              if (!is_valid_slab(curr)) { /* Log warning */ }
-             else { buddy_free((void *)curr); freed_count++; }
+             else { buddy_free_raw((void *)curr, SLAB_PAGE_ORDER); freed_count++; }
              curr = next;
          }
          if (i < 2) { irq_flags = spinlock_acquire_irqsave(&cache->lock); } // Re-acquire for next list/final free
@@ -404,11 +590,24 @@
  }
 
  /* slab_cache_stats */
- void slab_cache_stats(slab_cache_t *cache, unsigned long *out_alloc, unsigned long *out_free) {
-     // ... (Implementation remains the same - acquire lock, read stats, release lock) ...
+ void slab_cache_stats(slab_cache_t *cache, unsigned long *out_alloc, unsigned long *out_free,
+                       unsigned long *out_hits, unsigned long *out_misses) {
      if (!cache) return;
      uintptr_t irq_flags = spinlock_acquire_irqsave(&cache->lock);
-     if (out_alloc) *out_alloc = cache->alloc_count;
-     if (out_free) *out_free = cache->free_count;
+     unsigned long allocs = cache->bypass_alloc_count;
+     unsigned long frees = cache->bypass_free_count;
+     unsigned long hits = 0;
+     unsigned long misses = cache->bypass_alloc_count + cache->bypass_free_count;
+     for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+         const slab_cpu_cache_t *cc = &cache->cpu_caches[cpu];
+         allocs += cc->alloc_count;
+         frees  += cc->free_count;
+         hits   += cc->mag_hits;
+         misses += cc->mag_misses;
+     }
      spinlock_release_irqrestore(&cache->lock, irq_flags);
- }
\ No newline at end of file
+     if (out_alloc) *out_alloc = allocs;
+     if (out_free) *out_free = frees;
+     if (out_hits) *out_hits = hits;
+     if (out_misses) *out_misses = misses;
+ }
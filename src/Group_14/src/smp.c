@@ -0,0 +1,171 @@
+/**
+ * @file smp.c
+ * @brief Per-CPU data and application processor bring-up (see smp.h).
+ *
+ * The BSP finds the CPUs (acpi.c), moves interrupt delivery to the APICs
+ * (apic.c) and starts the APs one at a time with INIT-SIPI-SIPI. Each AP runs
+ * ap_trampoline.asm, then ap_main: its own GDT (with its TSS and per-CPU
+ * segment), the shared IDT, its local APIC, and finally its idle task, from
+ * where the scheduler hands it work (scheduler.c).
+ *
+ * Interrupts stay disabled on the BSP throughout, so the only clock is the
+ * PIT's channel 2 (pit_busy_wait_us).
+ */
+
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "msr.h"
+#include "paging.h"
+#include "pit.h"
+#include "scheduler.h"
+#include "syscall.h"
+#include "terminal.h"
+#include "string.h"
+
+#define SMP_AP_BOOT_STACK_SIZE 8192     // Only used until the AP enters its idle task
+#define SMP_INIT_DELAY_US      10000    // INIT de-assert to first SIPI
+#define SMP_SIPI_DELAY_US      200      // Between the two SIPIs
+#define SMP_AP_TIMEOUT_US      100000   // For the AP to report online
+#define SMP_POLL_US            100
+
+// Laid out as the PARAM_* offsets in ap_trampoline.asm
+typedef struct {
+    uint32_t cr4;
+    uint32_t cr3;
+    uint32_t cr0;
+    uint32_t stack_top;
+    uint32_t cpu_index;
+    uint32_t entry;
+} __attribute__((packed)) ap_trampoline_params_t;
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_trampoline_params[];
+extern uint32_t g_multiboot_info_phys_addr_global;
+
+cpu_t g_cpus[MAX_CPUS];
+
+static uint32_t s_cpu_count = 1;
+static smp_stats_t s_stats;
+static uint8_t s_ap_boot_stacks[MAX_CPUS][SMP_AP_BOOT_STACK_SIZE] __attribute__((aligned(16)));
+
+// Real-mode pages the trampoline may be copied to; all inside the low 1 MB
+// that the frame allocator never hands out
+static const uint32_t s_trampoline_pages[] = { 0x8000, 0x9000, 0x7000, 0x70000 };
+
+static inline uint32_t read_cr0(void) { uint32_t v; asm volatile("mov %%cr0, %0" : "=r"(v)); return v; }
+static inline uint32_t read_cr3(void) { uint32_t v; asm volatile("mov %%cr3, %0" : "=r"(v)); return v; }
+static inline uint32_t read_cr4(void) { uint32_t v; asm volatile("mov %%cr4, %0" : "=r"(v)); return v; }
+
+/** @brief Picks a trampoline page that does not hold the Multiboot information. */
+static uint32_t trampoline_page(void) {
+    uint32_t mbi_start = g_multiboot_info_phys_addr_global;
+    uint32_t mbi_end = mbi_start + *(volatile uint32_t *)(uintptr_t)mbi_start; // total_size
+    for (size_t i = 0; i < sizeof(s_trampoline_pages) / sizeof(s_trampoline_pages[0]); i++) {
+        uint32_t page = s_trampoline_pages[i];
+        if (page + PAGE_SIZE <= mbi_start || page >= mbi_end) return page;
+    }
+    return 0;
+}
+
+/** @brief Runs INIT-SIPI-SIPI for one AP and waits for it to come online. */
+static bool start_ap(uint32_t index, uint32_t page) {
+    cpu_t *cpu = &g_cpus[index];
+    ap_trampoline_params_t *params =
+        (ap_trampoline_params_t *)(uintptr_t)(page + (uint32_t)(ap_trampoline_params - ap_trampoline_start));
+    params->stack_top = (uint32_t)(uintptr_t)&s_ap_boot_stacks[index][SMP_AP_BOOT_STACK_SIZE];
+    params->cpu_index = index;
+
+    lapic_send_init(cpu->apic_id);
+    pit_busy_wait_us(SMP_INIT_DELAY_US);
+    for (int sipi = 0; sipi < 2 && !cpu->online; sipi++) {
+        lapic_send_startup(cpu->apic_id, (uint8_t)(page >> 12));
+        pit_busy_wait_us(SMP_SIPI_DELAY_US);
+    }
+    for (uint32_t waited = 0; !__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE) && waited < SMP_AP_TIMEOUT_US;
+         waited += SMP_POLL_US) {
+        pit_busy_wait_us(SMP_POLL_US);
+    }
+    if (cpu->online) return true;
+
+    // Park it again so it cannot wake up later on a reused stack
+    lapic_send_init(cpu->apic_id);
+    return false;
+}
+
+void smp_init(const void *rsdp) {
+    g_cpus[0].online = true;
+    s_stats.cpus_found = 1;
+    s_stats.cpus_online = 1;
+
+    acpi_topology_t topology;
+    if (!acpi_discover_topology(rsdp, &topology) || !apic_init(&topology)) {
+        terminal_write("[SMP] Running on the bootstrap processor only.\n");
+        return;
+    }
+    g_cpus[0].apic_id = lapic_id();
+    s_stats.cpus_found = topology.cpu_count + topology.cpus_skipped;
+
+    uint32_t page = trampoline_page();
+    if (!page) {
+        terminal_write("[SMP] No free real-mode page for the AP trampoline.\n");
+        return;
+    }
+    memcpy((void *)(uintptr_t)page, ap_trampoline_start, (size_t)(ap_trampoline_end - ap_trampoline_start));
+    ap_trampoline_params_t *params =
+        (ap_trampoline_params_t *)(uintptr_t)(page + (uint32_t)(ap_trampoline_params - ap_trampoline_start));
+    params->cr4 = read_cr4();
+    params->cr3 = read_cr3();
+    params->cr0 = read_cr0();
+    params->entry = (uint32_t)(uintptr_t)ap_main;
+
+    for (uint32_t i = 0; i < topology.cpu_count; i++) {
+        uint8_t apic_id = topology.cpu_apic_ids[i];
+        if (apic_id == g_cpus[0].apic_id) continue;
+        uint32_t index = s_cpu_count;
+        if (index >= MAX_CPUS) break; // Only if the table did not list the BSP
+
+        g_cpus[index].apic_id = apic_id;
+        scheduler_init_cpu(index);
+        if (start_ap(index, page)) {
+            s_cpu_count++;
+            s_stats.cpus_online++;
+            terminal_printf("[SMP] CPU %lu (APIC ID %u) online.\n", (unsigned long)index, apic_id);
+        } else {
+            s_stats.cpus_failed++;
+            terminal_printf("[SMP] CPU with APIC ID %u did not start.\n", apic_id);
+        }
+    }
+
+    terminal_printf("[SMP] %lu of %lu CPU(s) online (%s).\n", (unsigned long)s_stats.cpus_online,
+                    (unsigned long)s_stats.cpus_found, topology.source);
+}
+
+void ap_main(uint32_t cpu_index) {
+    gdt_init_cpu(cpu_index);
+    idt_load();
+    if (g_nx_supported) wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+    apic_init_ap();
+    syscall_init_cpu();
+
+    __atomic_store_n(&g_cpus[cpu_index].online, true, __ATOMIC_RELEASE);
+    scheduler_start_cpu();
+}
+
+uint32_t smp_cpu_count(void) {
+    return __atomic_load_n(&s_cpu_count, __ATOMIC_ACQUIRE);
+}
+
+void smp_get_stats(smp_stats_t *stats) {
+    if (!stats) return;
+    *stats = s_stats;
+    stats->ipis_sent = __atomic_load_n(&s_stats.ipis_sent, __ATOMIC_RELAXED);
+}
+
+void smp_send_resched(uint32_t cpu_index) {
+    atomic_fetch_add_u32(&s_stats.ipis_sent, 1);
+    lapic_send_ipi(g_cpus[cpu_index].apic_id, APIC_RESCHED_VECTOR);
+}
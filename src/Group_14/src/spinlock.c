@@ -1,5 +1,6 @@
 #include "spinlock.h"
 #include "terminal.h" // For potential debug output
+#include "smp.h"      // this_cpu: the held count is per CPU (cpu_t.spinlocks_held)
 
 /**
  * @brief Initializes a spinlock to the unlocked state.
@@ -29,7 +30,8 @@ uintptr_t spinlock_acquire_irqsave(spinlock_t *lock) {
         // Spin (yield or pause instruction recommended for SMP)
         asm volatile ("pause" ::: "memory"); // Hint to CPU we are spinning
     }
-    // Lock acquired
+    // Lock acquired; interrupts are off, so this_cpu() is stable
+    this_cpu()->spinlocks_held++;
 
     return flags; // Return previous interrupt state
 }
@@ -48,6 +50,19 @@ void spinlock_release_irqrestore(spinlock_t *lock, uintptr_t flags) {
     // Atomically clear the lock flag.
     // __ATOMIC_RELEASE ensures memory operations before are not reordered after.
     __atomic_clear(&lock->locked, __ATOMIC_RELEASE);
+    this_cpu()->spinlocks_held--;
 
     local_irq_restore(flags); // Restore previous interrupt state
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Returns how many spinlocks the running code holds.
+ * Interrupts are off whenever this is non-zero, so the value belongs to the
+ * current task until it releases them.
+ */
+uint32_t spinlock_held_count(void) {
+    uintptr_t flags = local_irq_save();
+    uint32_t held = this_cpu()->spinlocks_held;
+    local_irq_restore(flags);
+    return held;
+}
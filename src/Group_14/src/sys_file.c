@@ -23,6 +23,7 @@
  #include "assert.h"         // KERNEL_ASSERT
  #include "serial.h"         // Low-level serial port for debugging
  #include "spinlock.h"
+ #include "mm.h"             // do_mmap, MAP_* flags
  #include <libc/limits.h>    // INT32_MIN
  #include <libc/stdbool.h>   // bool
  
@@ -104,6 +105,7 @@
      }
      sf->vfs_file = vfs_file;
      sf->flags = flags;
+     sf->refcount = 1;
  
      uintptr_t irq_flags = spinlock_acquire_irqsave(&current_proc->fd_table_lock);
      int fd_or_err = assign_fd_locked(current_proc, sf);
@@ -207,8 +209,8 @@
  
      KERNEL_ASSERT(sf_to_close != NULL, "sf_to_close became NULL post-lock");
  
-     int vfs_ret = vfs_close(sf_to_close->vfs_file); // vfs_close handles its own internal locking.
-     kfree(sf_to_close);
+     // A forked child may still hold this open file; only the last close reaches the VFS.
+     int vfs_ret = sys_file_put(sf_to_close);
  
      SF_LOG("sys_close: fd %d, vfs_close returned %d", fd, vfs_ret);
      // POSIX close typically returns 0 on success or -EBADF.
@@ -216,6 +218,31 @@
      return vfs_ret; // Propagate VFS error or success.
  }
  
+ // Guards sys_file_t.refcount; fd tables of different processes share entries after fork
+ static spinlock_t g_sys_file_ref_lock;
+
+ void sys_file_get(sys_file_t *sf) {
+     KERNEL_ASSERT(sf != NULL, "sys_file_get: NULL sys_file");
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&g_sys_file_ref_lock);
+     KERNEL_ASSERT(sf->refcount > 0, "sys_file_get: dead sys_file");
+     sf->refcount++;
+     spinlock_release_irqrestore(&g_sys_file_ref_lock, irq_flags);
+ }
+
+ int sys_file_put(sys_file_t *sf) {
+     KERNEL_ASSERT(sf != NULL, "sys_file_put: NULL sys_file");
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&g_sys_file_ref_lock);
+     KERNEL_ASSERT(sf->refcount > 0, "sys_file_put: dead sys_file");
+     uint32_t remaining = --sf->refcount;
+     spinlock_release_irqrestore(&g_sys_file_ref_lock, irq_flags);
+     if (remaining != 0) {
+         return 0;
+     }
+     int vfs_ret = vfs_close(sf->vfs_file); // vfs_close handles its own internal locking.
+     kfree(sf);
+     return vfs_ret;
+ }
+
  /**
   * @brief Implements the sys_lseek_impl logic.
   * Repositions the read/write file offset.
@@ -242,4 +269,94 @@
      off_t new_pos = vfs_lseek(sf->vfs_file, offset, whence);
      SF_LOG("sys_lseek: fd %d, vfs_lseek returned %ld", fd, (long)new_pos);
      return new_pos; // vfs_lseek returns new offset (>=0) or negative FS_ERR_*
- }
\ No newline at end of file
+ }
+
+ /**
+  * @brief Implements the sys_fsync_impl logic.
+  * Makes the file's data and metadata durable.
+  * @return 0 on success, or a negative error code.
+  */
+ int sys_fsync(int fd) {
+     SF_LOG("sys_fsync: fd=%d", fd);
+
+     pcb_t *current_proc = get_current_process();
+     if (!current_proc) return -EFAULT;
+
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&current_proc->fd_table_lock);
+     sys_file_t *sf = get_sys_file_locked(current_proc, fd);
+     if (sf) sys_file_get(sf); // Keep it open while we wait for the disk
+     spinlock_release_irqrestore(&current_proc->fd_table_lock, irq_flags);
+
+     if (!sf) return -EBADF;
+
+     int result = vfs_fsync(sf->vfs_file);
+     sys_file_put(sf);
+     return result;
+ }
+
+ /**
+  * @brief Implements the sys_sync_impl logic.
+  * Makes everything written to any mounted filesystem durable.
+  */
+ int sys_sync(void) {
+     SF_LOG("sys_sync");
+     return vfs_sync();
+ }
+
+ // Maps do_mmap's FS_ERR_* codes to the errno values mmap(2) uses
+ static int mmap_errno(int fs_err) {
+     switch (fs_err) {
+         case FS_ERR_OUT_OF_MEMORY:  return -ENOMEM;
+         case FS_ERR_BAD_F:          return -EBADF;
+         case FS_ERR_NOT_SUPPORTED:  // Driver cannot map, or shared writable mapping
+         case FS_ERR_IS_A_DIRECTORY: return -ENODEV;
+         default:                    return -EINVAL;
+     }
+ }
+
+ /**
+  * @brief Implements the sys_mmap_impl logic.
+  * Maps part of an open file, or anonymous memory, into the current process.
+  * @return Start address of the mapping, or a negative POSIX errno on failure.
+  */
+ int32_t sys_mmap(uintptr_t addr, size_t length, uint32_t prot, uint32_t flags, int fd, size_t offset) {
+     SF_LOG("sys_mmap: addr=%#lx, len=%lu, prot=%#lx, flags=%#lx, fd=%d", (unsigned long)addr, (unsigned long)length,
+            (unsigned long)prot, (unsigned long)flags, fd);
+
+     pcb_t *current_proc = get_current_process();
+     if (!current_proc || !current_proc->mm) return -EFAULT;
+
+     sys_file_t *sf = NULL;
+     if (!(flags & MAP_ANONYMOUS)) {
+         uintptr_t irq_flags = spinlock_acquire_irqsave(&current_proc->fd_table_lock);
+         sf = get_sys_file_locked(current_proc, fd);
+         if (sf) sys_file_get(sf); // Keep it open while the mapping is set up
+         spinlock_release_irqrestore(&current_proc->fd_table_lock, irq_flags);
+
+         if (!sf) return -EBADF;
+         if ((sf->flags & O_ACCMODE) == O_WRONLY) {
+             sys_file_put(sf);
+             return -EACCES;
+         }
+     }
+
+     uintptr_t start = 0;
+     int result = do_mmap(current_proc->mm, addr, length, prot, flags, sf ? sf->vfs_file : NULL, offset, &start);
+     if (sf) sys_file_put(sf); // The mapping holds its own reference to the file
+     if (result != FS_SUCCESS) return mmap_errno(result);
+     return (int32_t)start;
+ }
+
+ /**
+  * @brief Implements the sys_munmap_impl logic.
+  * @return 0 on success, or a negative POSIX errno on failure.
+  */
+ int sys_munmap(uintptr_t addr, size_t length) {
+     SF_LOG("sys_munmap: addr=%#lx, len=%lu", (unsigned long)addr, (unsigned long)length);
+
+     pcb_t *current_proc = get_current_process();
+     if (!current_proc || !current_proc->mm) return -EFAULT;
+
+     int result = do_munmap(current_proc->mm, addr, length);
+     return (result == FS_SUCCESS) ? 0 : -EINVAL;
+ }
@@ -41,12 +41,14 @@
 ; -----------------------------------------------------------------------------
 
 %define KERNEL_DATA_SELECTOR 0x10
-; USER_DATA_SELECTOR is not directly used here, but defined for completeness if needed.
-; %define USER_DATA_SELECTOR   0x23
+%define PERCPU_DATA_SELECTOR 0x30   ; GDT_PERCPU_SELECTOR (this CPU's cpu_t)
+%define CPU_NEED_RESCHED     4      ; offsetof(cpu_t, need_resched), see smp.h
+%define USER_CODE_SELECTOR   0x1B   ; SYSEXIT loads SYSENTER_CS + 16 | 3
+%define USER_DATA_SELECTOR   0x23   ; ... and SYSENTER_CS + 24 | 3
+%define EFLAGS_IF            0x200
 
     extern syscall_dispatcher     ; C-level syscall handler
     extern schedule             ; <<< ADDED: External C scheduler function
-    extern g_need_reschedule    ; <<< ADDED: External C reschedule flag variable (volatile bool -> byte)
     ; extern serial_putc_asm        ; Optional: for ultra-low-level debug
     ; extern serial_print_hex_asm   ; Optional: for ultra-low-level debug
 
@@ -74,6 +76,7 @@ syscall_handler_asm:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, PERCPU_DATA_SELECTOR
     mov gs, ax
 
     ; --- 5. Call C-level Dispatcher ---
@@ -89,13 +92,13 @@ syscall_handler_asm:
 
     ; --- *** 7. CHECK RESCHEDULE FLAG (Interrupts are still OFF from int 0x80) *** ---
 check_reschedule:
-    ; Access the global C variable (byte for bool)
-    mov al, byte [g_need_reschedule]
+    ; This CPU's cpu_t.need_resched (byte for bool)
+    mov al, byte [gs:CPU_NEED_RESCHED]
     test al, al                      ; Check if the flag is non-zero
     jz .no_reschedule_needed         ; If zero, skip the schedule call
 
     ; Reschedule is needed:
-    mov byte [g_need_reschedule], 0  ; Clear the flag (no lock needed, IF=0)
+    mov byte [gs:CPU_NEED_RESCHED], 0 ; Clear the flag (no lock needed, IF=0)
     call schedule                    ; Call the C scheduler function. It handles context switch.
 
 .no_reschedule_needed:
@@ -112,3 +115,96 @@ check_reschedule:
     ; --- 10. Return to User Mode ---
     iret                    ; Pops EIP_user, CS_user, EFLAGS_user, [ESP_user], [SS_user]
                             ; Returns control to the user process with EAX holding the result.
+
+
+; -----------------------------------------------------------------------------
+; sysenter_entry -- SYSENTER fast path (MSRs set by syscall_init_cpu).
+; User convention (see the stubs in hello.c, shell.c and syscallbench.c):
+;   EAX = syscall number, EBX/ESI/EDI = arguments 1-3,
+;   ECX = user ESP, EDX = user return address (both clobbered).
+; SYSENTER only loads CS/EIP and SS/ESP and clears IF. The stub builds the
+; same isr_frame_t that INT 0x80 produces, with ESI/EDI copied into the
+; ECX/EDX argument slots, so syscall_dispatcher, fork (whose child returns
+; through fork_child_return with IRET) and schedule() cannot tell the two
+; paths apart. It leaves with SYSEXIT instead of IRET.
+; -----------------------------------------------------------------------------
+    global sysenter_entry
+
+sysenter_entry:
+    mov esp, [esp]          ; The MSR's stack word holds this CPU's esp0
+
+    ; --- 1. IRET frame as INT 0x80 would have pushed it ---
+    push dword USER_DATA_SELECTOR   ; SS_user
+    push ecx                ; ESP_user
+    pushfd
+    or dword [esp], EFLAGS_IF ; EFLAGS_user: IF was set in user mode
+    push dword USER_CODE_SELECTOR   ; CS_user
+    push edx                ; EIP_user
+    push dword 0            ; Dummy Error Code
+    push dword 0x80         ; Interrupt Number
+
+    ; --- 2./3. Segments and registers, arguments 2 and 3 in ECX/EDX ---
+    push ds
+    push es
+    push fs
+    push gs
+    mov ecx, esi
+    mov edx, edi
+    pusha
+
+    ; --- 4. Kernel segments ---
+    mov ax, KERNEL_DATA_SELECTOR
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, PERCPU_DATA_SELECTOR
+    mov gs, ax
+
+    ; --- 5./6. Dispatch and store the return value ---
+    mov eax, esp
+    push eax
+    call syscall_dispatcher
+    add  esp, 4
+    mov [esp + 28], eax
+
+    ; --- 7. Reschedule check (IF is still off) ---
+    cmp byte [gs:CPU_NEED_RESCHED], 0
+    je .no_reschedule_needed
+    mov byte [gs:CPU_NEED_RESCHED], 0
+    call schedule
+
+.no_reschedule_needed:
+    ; --- 8./9. Restore registers and segments ---
+    popa
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    add esp, 8              ; int_no, err_code
+
+    ; --- 10. SYSEXIT to EIP_user/ESP_user from the frame ---
+    mov edx, [esp]          ; EIP_user
+    mov ecx, [esp + 12]     ; ESP_user
+    push dword [esp + 8]    ; EFLAGS_user, with IF left for the STI below
+    and dword [esp], ~EFLAGS_IF
+    popfd
+    sti                     ; Takes effect after SYSEXIT: no interrupt on the way out
+    sysexit
+
+
+; -----------------------------------------------------------------------------
+; fork_child_return -- first instructions run by a child created by SYS_FORK.
+; process_fork leaves ESP pointing at a copy of the parent's isr_frame_t (with
+; EAX = 0) and reaches here through a kernel-mode IRET from jump_to_user_mode.
+; Unwinds the frame exactly like steps 8-10 above.
+; -----------------------------------------------------------------------------
+    global fork_child_return
+
+fork_child_return:
+    popa
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    add esp, 8              ; int_no, err_code
+    iret
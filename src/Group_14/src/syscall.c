@@ -25,6 +25,11 @@
 #include "assert.h"
 #include "serial.h"         // Low-level serial output for critical debug
 #include "paging.h"         // KERNEL_SPACE_VIRT_START
+#include "cpuid.h"          // SEP feature bit for the SYSENTER path
+#include "msr.h"
+#include "gdt.h"            // KERNEL_CODE_SELECTOR
+#include "tss.h"            // tss_sysenter_stack
+#include "smp.h"            // this_cpu
 #include <libc/limits.h>
 #include <libc/stdbool.h>
 #include <libc/stddef.h>
@@ -43,9 +48,14 @@
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+#define CPUID_FEAT_EDX_SEP (1u << 11)
+
 // --- Static Data ---
 static syscall_fn_t syscall_table[MAX_SYSCALLS];
 
+// --- Assembly Entry Points ---
+extern void sysenter_entry(void); // syscall.asm
+
 // --- Forward Declarations of Syscall Implementations ---
 static int32_t sys_exit_impl(uint32_t code, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
 static int32_t sys_read_impl(uint32_t fd, uint32_t user_buf_ptr, uint32_t count, isr_frame_t *regs);
@@ -55,6 +65,13 @@ static int32_t sys_close_impl(uint32_t fd, uint32_t arg2, uint32_t arg3, isr_fra
 static int32_t sys_lseek_impl(uint32_t fd, uint32_t offset, uint32_t whence, isr_frame_t *regs);
 static int32_t sys_getpid_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
 static int32_t sys_puts_impl(uint32_t user_str_ptr, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
+static int32_t sys_fork_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
+static int32_t sys_waitpid_impl(uint32_t pid, uint32_t user_status_ptr, uint32_t options, isr_frame_t *regs);
+static int32_t sys_fsync_impl(uint32_t fd, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
+static int32_t sys_sync_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
+static int32_t sys_mmap_impl(uint32_t user_args_ptr, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
+static int32_t sys_munmap_impl(uint32_t addr, uint32_t length, uint32_t arg3, isr_frame_t *regs);
+static int32_t sys_nanosleep_impl(uint32_t user_req_ptr, uint32_t user_rem_ptr, uint32_t arg3, isr_frame_t *regs);
 static int32_t sys_not_implemented(uint32_t arg1, uint32_t arg2, uint32_t arg3, isr_frame_t *regs);
 static int strncpy_from_user_safe(const char *u_src, char *k_dst, size_t maxlen);
 static int32_t sys_read_terminal_line_impl(uint32_t user_buf_ptr, uint32_t count, uint32_t arg3, isr_frame_t *regs);
@@ -78,9 +95,39 @@ void syscall_init(void) {
     syscall_table[SYS_GETPID] = sys_getpid_impl;
     syscall_table[SYS_PUTS]   = sys_puts_impl;
     syscall_table[SYS_READ_TERMINAL_LINE] = sys_read_terminal_line_impl;
+    syscall_table[SYS_FORK]    = sys_fork_impl;
+    syscall_table[SYS_WAITPID] = sys_waitpid_impl;
+    syscall_table[SYS_FSYNC]   = sys_fsync_impl;
+    syscall_table[SYS_SYNC]    = sys_sync_impl;
+    syscall_table[SYS_MMAP]    = sys_mmap_impl;
+    syscall_table[SYS_MUNMAP]  = sys_munmap_impl;
+    syscall_table[SYS_NANOSLEEP] = sys_nanosleep_impl;
 
     KERNEL_ASSERT(syscall_table[SYS_EXIT] == sys_exit_impl, "SYS_EXIT assignment sanity check failed!");
     serial_write("[Syscall] Table initialized.\n");
+    syscall_init_cpu();
+}
+
+bool syscall_sysenter_supported(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_SEP)) return false;
+    // The first Pentium Pro steppings set SEP without implementing SYSENTER
+    uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+void syscall_init_cpu(void) {
+    if (!syscall_sysenter_supported()) {
+        if (this_cpu()->index == 0) serial_write("[Syscall] No SYSENTER (SEP); INT 0x80 only.\n");
+        return;
+    }
+    // SS, user CS and user SS are implied: the kernel data, user code and
+    // user data descriptors follow KERNEL_CODE_SELECTOR in the GDT
+    wrmsr(MSR_IA32_SYSENTER_CS, KERNEL_CODE_SELECTOR);
+    wrmsr(MSR_IA32_SYSENTER_ESP, tss_sysenter_stack(this_cpu()->index));
+    wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t)(uintptr_t)sysenter_entry);
+    if (this_cpu()->index == 0) serial_write("[Syscall] SYSENTER fast path enabled.\n");
 }
 
 //-----------------------------------------------------------------------------
@@ -360,6 +407,76 @@ static int32_t sys_puts_impl(uint32_t user_str_ptr_arg, uint32_t arg2, uint32_t
     return 0; // Simple success indicator
 }
 
+static int32_t sys_fork_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3, isr_frame_t *regs) {
+    (void)arg1; (void)arg2; (void)arg3;
+    pcb_t *parent = get_current_process();
+    KERNEL_ASSERT(parent != NULL, "get_current_process returned NULL in sys_fork");
+
+    pcb_t *child = process_fork(parent, regs);
+    if (!child) return -ENOMEM;
+
+    uint32_t child_pid = child->pid;
+    if (scheduler_add_task(child) != 0) {
+        destroy_process(child);
+        return -ENOMEM;
+    }
+    return (int32_t)child_pid; // The child sees 0 (set in its copied frame)
+}
+
+static int32_t sys_waitpid_impl(uint32_t pid_arg, uint32_t user_status_ptr, uint32_t options, isr_frame_t *regs) {
+    (void)regs;
+    int32_t pid = (int32_t)pid_arg;
+    if (pid <= 0 || options != 0) return -EINVAL; // Only "wait for this child" is supported
+
+    pcb_t *current_proc = get_current_process();
+    KERNEL_ASSERT(current_proc != NULL, "get_current_process returned NULL in sys_waitpid");
+
+    uint32_t exit_code = 0;
+    if (scheduler_reap_child(current_proc->pid, (uint32_t)pid, &exit_code) != 0) return -ECHILD;
+
+    if (user_status_ptr) {
+        int status = (int)((exit_code & 0xFF) << 8); // WEXITSTATUS layout
+        if (copy_to_user((void *)user_status_ptr, &status, sizeof(status)) != 0) return -EFAULT;
+    }
+    return pid;
+}
+
+static int32_t sys_nanosleep_impl(uint32_t user_req_ptr, uint32_t user_rem_ptr, uint32_t arg3, isr_frame_t *regs) {
+    (void)user_rem_ptr; (void)arg3; (void)regs; // Sleeps are never interrupted, so *rem is never written
+    struct { int32_t tv_sec; int32_t tv_nsec; } req;
+    if (!user_req_ptr) return -EFAULT;
+    if (copy_from_user(&req, (const void *)user_req_ptr, sizeof(req)) != 0) return -EFAULT;
+    if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) return -EINVAL;
+
+    uint64_t ms = (uint64_t)req.tv_sec * 1000 + ((uint32_t)req.tv_nsec + 999999u) / 1000000u;
+    sleep_ms(ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms);
+    return 0;
+}
+
+static int32_t sys_fsync_impl(uint32_t fd_arg, uint32_t arg2, uint32_t arg3, isr_frame_t *regs) {
+    (void)arg2; (void)arg3; (void)regs;
+    return sys_fsync((int)fd_arg);
+}
+
+static int32_t sys_sync_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3, isr_frame_t *regs) {
+    (void)arg1; (void)arg2; (void)arg3; (void)regs;
+    return sys_sync();
+}
+
+static int32_t sys_mmap_impl(uint32_t user_args_ptr, uint32_t arg2, uint32_t arg3, isr_frame_t *regs) {
+    (void)arg2; (void)arg3; (void)regs;
+    // Six arguments do not fit in EBX/ECX/EDX, so user space passes a pointer
+    // to { addr, length, prot, flags, fd, offset }, as in Linux's old_mmap
+    uint32_t args[6];
+    if (copy_from_user(args, (const void *)user_args_ptr, sizeof(args)) != 0) return -EFAULT;
+    return sys_mmap((uintptr_t)args[0], (size_t)args[1], args[2], args[3], (int)args[4], (size_t)args[5]);
+}
+
+static int32_t sys_munmap_impl(uint32_t addr, uint32_t length, uint32_t arg3, isr_frame_t *regs) {
+    (void)arg3; (void)regs;
+    return sys_munmap((uintptr_t)addr, (size_t)length);
+}
+
 //-----------------------------------------------------------------------------
 // Main Syscall Dispatcher
 //-----------------------------------------------------------------------------
@@ -0,0 +1,220 @@
+/**
+ * @file timer.c
+ * @brief Hierarchical timing wheel (see timer.h).
+ *
+ * Five levels: the first has 256 one-tick slots, each of the other four has
+ * 64 slots that each span the whole of the level below. A timer is filed by
+ * how far away it is, in the slot of the finest level that can hold it.
+ * Whenever the first level wraps, the next slot of level two is emptied back
+ * into the wheel (and so on upwards when that level wraps too), so a timer
+ * reaches the first level before it is due.
+ *
+ * Slots are singly linked lists with a back-pointer to the link that points
+ * at each timer, so a timer can be unlinked without knowing its slot.
+ * One spinlock covers the wheel; callbacks run with it released.
+ */
+
+#include "timer.h"
+#include "spinlock.h"
+#include "terminal.h"
+#include "string.h"
+#include "assert.h"
+
+#define TVR_BITS    8
+#define TVN_BITS    6
+#define TVR_SIZE    (1u << TVR_BITS)
+#define TVN_SIZE    (1u << TVN_BITS)
+#define TVR_MASK    (TVR_SIZE - 1)
+#define TVN_MASK    (TVN_SIZE - 1)
+#define TVN_LEVELS  4
+
+_Static_assert(TVR_BITS + TVN_LEVELS * TVN_BITS == 32, "timer wheel must cover the whole tick range");
+
+static ktimer_t *s_tv1[TVR_SIZE];
+static ktimer_t *s_tvn[TVN_LEVELS][TVN_SIZE];
+static uint32_t s_clk;               // Next tick the wheel has not run yet
+static spinlock_t s_timer_lock;
+static timer_stats_t s_stats;
+
+/** @brief Slot index of level n (0 = the first 64-slot level) for a tick. */
+static inline uint32_t tvn_index(uint32_t tick, int n)
+{
+    return (tick >> (TVR_BITS + n * TVN_BITS)) & TVN_MASK;
+}
+
+static void slot_insert(ktimer_t **slot, ktimer_t *timer)
+{
+    timer->next = *slot;
+    if (*slot) (*slot)->pprev = &timer->next;
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+static void slot_unlink(ktimer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/** @brief Files a timer in the slot matching its distance from s_clk. Caller holds s_timer_lock. */
+static void wheel_insert_locked(ktimer_t *timer)
+{
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - s_clk;
+    ktimer_t **slot;
+
+    if ((int32_t)delta < 0) {
+        // Already due: run on the next tick the wheel processes
+        slot = &s_tv1[s_clk & TVR_MASK];
+    } else if (delta < TVR_SIZE) {
+        slot = &s_tv1[expires & TVR_MASK];
+    } else if (delta < (1u << (TVR_BITS + TVN_BITS))) {
+        slot = &s_tvn[0][tvn_index(expires, 0)];
+    } else if (delta < (1u << (TVR_BITS + 2 * TVN_BITS))) {
+        slot = &s_tvn[1][tvn_index(expires, 1)];
+    } else if (delta < (1u << (TVR_BITS + 3 * TVN_BITS))) {
+        slot = &s_tvn[2][tvn_index(expires, 2)];
+    } else {
+        slot = &s_tvn[3][tvn_index(expires, 3)];
+    }
+    slot_insert(slot, timer);
+}
+
+/**
+ * @brief Re-files every timer of one coarse slot. Caller holds s_timer_lock.
+ * @return The slot index, so a caller can tell when this level wrapped too.
+ */
+static uint32_t cascade_locked(int level, uint32_t index)
+{
+    ktimer_t *timer = s_tvn[level][index];
+    s_tvn[level][index] = NULL;
+    while (timer) {
+        ktimer_t *next = timer->next;
+        wheel_insert_locked(timer);
+        s_stats.cascaded++;
+        timer = next;
+    }
+    return index;
+}
+
+void timer_init(uint32_t now)
+{
+    spinlock_init(&s_timer_lock);
+    memset(s_tv1, 0, sizeof(s_tv1));
+    memset(s_tvn, 0, sizeof(s_tvn));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_clk = now;
+    terminal_printf("[Timer] Initialized (%u + %u x %u slot wheel).\n",
+                    (unsigned)TVR_SIZE, (unsigned)TVN_LEVELS, (unsigned)TVN_SIZE);
+}
+
+void timer_setup(ktimer_t *timer, ktimer_fn_t fn, void *arg)
+{
+    KERNEL_ASSERT(timer != NULL && fn != NULL, "timer_setup: NULL timer or callback");
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+void timer_add(ktimer_t *timer, uint32_t expires)
+{
+    KERNEL_ASSERT(timer != NULL && timer->fn != NULL, "timer_add: timer not set up");
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_timer_lock);
+    if (timer->pprev) {
+        slot_unlink(timer);
+    } else {
+        s_stats.pending++;
+    }
+    timer->expires = expires;
+    wheel_insert_locked(timer);
+    s_stats.added++;
+    spinlock_release_irqrestore(&s_timer_lock, irq_flags);
+}
+
+bool timer_cancel(ktimer_t *timer)
+{
+    if (!timer) return false;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_timer_lock);
+    bool was_pending = timer->pprev != NULL;
+    if (was_pending) {
+        slot_unlink(timer);
+        s_stats.pending--;
+        s_stats.cancelled++;
+    }
+    spinlock_release_irqrestore(&s_timer_lock, irq_flags);
+    return was_pending;
+}
+
+bool timer_pending(const ktimer_t *timer)
+{
+    return timer && timer->pprev != NULL;
+}
+
+void timer_run(uint32_t now)
+{
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_timer_lock);
+    while ((int32_t)(now - s_clk) >= 0) {
+        uint32_t index = s_clk & TVR_MASK;
+        if (index == 0 &&
+            cascade_locked(0, tvn_index(s_clk, 0)) == 0 &&
+            cascade_locked(1, tvn_index(s_clk, 1)) == 0 &&
+            cascade_locked(2, tvn_index(s_clk, 2)) == 0) {
+            cascade_locked(3, tvn_index(s_clk, 3));
+        }
+        s_clk++;
+
+        // Detach the slot first: callbacks may re-add timers, and anything
+        // they add for this tick lands in the slot of the next one
+        ktimer_t *due = s_tv1[index];
+        s_tv1[index] = NULL;
+        if (due) due->pprev = &due;
+        while (due) {
+            ktimer_t *timer = due;
+            slot_unlink(timer);
+            s_stats.pending--;
+            s_stats.expired++;
+            uint32_t late = now - timer->expires;
+            if ((int32_t)late > 0) {
+                s_stats.total_late_ticks += late;
+                if (late > s_stats.max_late_ticks) s_stats.max_late_ticks = late;
+            }
+            ktimer_fn_t fn = timer->fn;
+            void *arg = timer->arg;
+
+            // The timer is no longer pending, so the callback may free or re-arm it;
+            // 'due' stays valid because timer_cancel of a later entry unlinks through it
+            spinlock_release_irqrestore(&s_timer_lock, irq_flags);
+            fn(timer, arg);
+            irq_flags = spinlock_acquire_irqsave(&s_timer_lock);
+        }
+    }
+    spinlock_release_irqrestore(&s_timer_lock, irq_flags);
+}
+
+uint32_t timer_ticks_until_due(uint32_t now, uint32_t max_ticks)
+{
+    uint32_t result = max_ticks ? max_ticks : 1;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_timer_lock);
+    // Coarse levels only hold timers past the next first-level wrap, when
+    // they are cascaded, so the wrap itself bounds the scan
+    for (uint32_t tick = s_clk; (int32_t)(tick - now) <= (int32_t)max_ticks; tick++) {
+        if (s_tv1[tick & TVR_MASK] || (tick & TVR_MASK) == 0) {
+            result = ((int32_t)(tick - now) > 0) ? tick - now : 1;
+            break;
+        }
+    }
+    spinlock_release_irqrestore(&s_timer_lock, irq_flags);
+    return result;
+}
+
+void timer_get_stats(timer_stats_t *stats)
+{
+    if (!stats) return;
+    uintptr_t irq_flags = spinlock_acquire_irqsave(&s_timer_lock);
+    *stats = s_stats;
+    spinlock_release_irqrestore(&s_timer_lock, irq_flags);
+}
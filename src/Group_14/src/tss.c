@@ -2,9 +2,30 @@
 #include "terminal.h"
 #include "types.h"
 #include "string.h"  // for memset
+#include "smp.h"     // this_cpu, MAX_CPUS
 
-// We define the actual TSS structure here.
-tss_entry_t tss;
+// One TSS per CPU: each holds the ring 0 stack of the task running there.
+static tss_entry_t s_tss[MAX_CPUS];
+
+// SYSENTER takes ESP from an MSR that is written once per CPU, so the MSR
+// points at the top word of a small per-CPU stack that mirrors esp0; the
+// entry stub loads the real kernel stack from there. The words below it
+// absorb an NMI that hits before the stub has switched.
+#define SYSENTER_STACK_WORDS 16
+static uint32_t s_sysenter_stacks[MAX_CPUS][SYSENTER_STACK_WORDS] __attribute__((aligned(64)));
+
+/** Returns the executing CPU's TSS. */
+static tss_entry_t *tss_this_cpu(void) {
+    return &s_tss[this_cpu()->index];
+}
+
+tss_entry_t *tss_for_cpu(uint32_t cpu) {
+    return &s_tss[cpu];
+}
+
+uint32_t tss_sysenter_stack(uint32_t cpu) {
+    return (uint32_t)(uintptr_t)&s_sysenter_stacks[cpu][SYSENTER_STACK_WORDS - 1];
+}
 
 /**
  * tss_init - Zeroes out the TSS and sets up essential fields.
@@ -12,20 +33,24 @@ tss_entry_t tss;
  * This function does not load the TSS into TR; that is done
  * by calling tss_flush() AFTER the GDT is loaded.
  */
-void tss_init(void) {
+void tss_init(uint32_t cpu) {
+    tss_entry_t *tss = &s_tss[cpu];
+
     // Clear all fields
-    memset(&tss, 0, sizeof(tss_entry_t));
+    memset(tss, 0, sizeof(tss_entry_t));
 
     // The kernel data segment selector (index=2 => 0x10).
     // This is used when we enter ring 0 from ring 3 or an interrupt.
-    tss.ss0 = 0x10; // KERNEL_DATA_SELECTOR
+    tss->ss0 = 0x10; // KERNEL_DATA_SELECTOR
 
     // Initial ESP0 is 0 (will be updated before use)
-    tss.esp0 = 0;
-    terminal_printf("[TSS] Initial ESP0 set to 0 (will be updated before use)\n");
+    tss->esp0 = 0;
 
     // No I/O bitmap => set base after TSS, so no extra bits.
-    tss.iomap_base = sizeof(tss_entry_t);
+    tss->iomap_base = sizeof(tss_entry_t);
+
+    if (cpu != 0) return; // APs: the BSP already logged the layout
+    terminal_printf("[TSS] Initial ESP0 set to 0 (will be updated before use)\n");
 
     // We do NOT call tss_flush here (the GDT might not be loaded yet).
     terminal_write("TSS initialized.\n");
@@ -50,7 +75,9 @@ void tss_set_kernel_stack(uint32_t stack) {
         terminal_printf("[TSS WARNING] Setting ESP0 to non-kernel space address: %p\n",
                       (void*)(uintptr_t)stack);
     }
-    tss.esp0 = stack;
+    uint32_t cpu = this_cpu()->index;
+    s_tss[cpu].esp0 = stack;
+    s_sysenter_stacks[cpu][SYSENTER_STACK_WORDS - 1] = stack;
     // terminal_printf("[TSS] ESP0 updated to %p\n", (void*)(uintptr_t)stack); // Reduce verbosity maybe
 }
 
@@ -60,21 +87,22 @@ void tss_set_kernel_stack(uint32_t stack) {
  * Returns true if ESP0 is non-zero and appears to be in kernel space
  */
 bool tss_debug_check_esp0(void) {
+    tss_entry_t *tss = tss_this_cpu();
     // Check that ESP0 is non-zero
-    if (tss.esp0 == 0) {
+    if (tss->esp0 == 0) {
         terminal_printf("[TSS Debug] ERROR: ESP0 is ZERO!\n");
         return false;
     }
 
     // Check that ESP0 is in kernel space (higher half)
     // Check if it's within a reasonable range (e.g., not just barely above C0000000)
-    if (tss.esp0 < 0xC0100000) { // Adjusted lower bound check
+    if (tss->esp0 < 0xC0100000) { // Adjusted lower bound check
         terminal_printf("[TSS Debug] ERROR: ESP0 (%p) is suspiciously low in kernel space!\n",
-                      (void*)(uintptr_t)tss.esp0);
+                      (void*)(uintptr_t)tss->esp0);
         return false;
     }
 
-    terminal_printf("[TSS Debug] ESP0 looks valid: %p\n", (void*)(uintptr_t)tss.esp0);
+    terminal_printf("[TSS Debug] ESP0 looks valid: %p\n", (void*)(uintptr_t)tss->esp0);
     return true;
 }
 
@@ -82,5 +110,5 @@ bool tss_debug_check_esp0(void) {
  * tss_get_esp0 - Returns the current esp0 value from the TSS <<< ADDED
  */
 uint32_t tss_get_esp0(void) {
-    return tss.esp0;
+    return tss_this_cpu()->esp0;
 }
\ No newline at end of file
@@ -196,6 +196,42 @@ bool access_ok(int type, const void *uaddr_void, size_t size) {
     return true;
 }
 
+/**
+ * @brief Makes every page of [uaddr, uaddr + n) present (and, for a write,
+ * writable) before the kernel touches it.
+ * @details A supervisor access to a missing page is not demand-faulted: the
+ * raw copy routines take the exception-table fixup instead. Program
+ * segments, heap, stack and mappings all come in lazily, so each missing
+ * page is run through handle_vma_fault as a user fault would be. CR0.WP is clear, so a supervisor
+ * write also ignores a read-only PTE and would land in a copy-on-write frame
+ * still shared with a forked process; for writes, read-only pages take the
+ * same route. A missing private page comes in read-only and needs a second
+ * (present) pass to be copied or made writable.
+ * @return true if all pages are now accessible.
+ */
+static bool prepare_user_pages(const void *uaddr, size_t n, bool write) {
+    pcb_t *proc = get_current_process();
+    if (!proc || !proc->mm) return false;
+    mm_struct_t *mm = proc->mm;
+
+    uintptr_t end = (uintptr_t)uaddr + n; // access_ok has ruled out overflow
+    for (uintptr_t page = PAGE_ALIGN_DOWN((uintptr_t)uaddr); page < end; page += PAGE_SIZE) {
+        for (int pass = 0; pass < 2; pass++) {
+            uintptr_t phys = 0;
+            uint32_t flags = 0;
+            bool present = paging_get_physical_address_and_flags(mm->pgd_phys, page, &phys, &flags) == 0 &&
+                           (flags & PAGE_PRESENT);
+            if (present && (!write || (flags & PAGE_RW))) break;
+
+            vma_struct_t *vma = find_vma(mm, page);
+            if (!vma) return false;
+            uint32_t error_code = (write ? PAGE_FAULT_WRITE : 0) | PAGE_FAULT_USER | (present ? PAGE_FAULT_PRESENT : 0);
+            if (handle_vma_fault(mm, vma, page, error_code) != 0) return false;
+        }
+    }
+    return true;
+}
+
 // --- copy_from_user and copy_to_user remain unchanged ---
 // (They already call the enhanced access_ok)
 
@@ -214,6 +250,11 @@ size_t copy_from_user(void *k_dst, const void *u_src, size_t n) {
         return n; // Indicate all 'n' bytes failed (permission denied)
     }
 
+    // Fault in pages not yet loaded (see prepare_user_pages)
+    if (!prepare_user_pages(u_src, n, false)) {
+        return n;
+    }
+
     // Perform Raw Copy (Assembly handles faults)
     size_t not_copied = _raw_copy_from_user(k_dst, u_src, n);
 
@@ -246,6 +287,11 @@ size_t copy_to_user(void *u_dst, const void *k_src, size_t n) {
         return n; // Indicate all 'n' bytes failed (permission denied)
     }
 
+    // Fault in missing pages and break copy-on-write sharing first (see prepare_user_pages)
+    if (!prepare_user_pages(u_dst, n, true)) {
+        return n;
+    }
+
     // Perform Raw Copy (Assembly handles faults)
     size_t not_copied = _raw_copy_to_user(u_dst, k_src, n);
 
@@ -37,6 +37,8 @@
  #include <libc/stdarg.h>   // varargs for printf (Assumed available)
  #include "assert.h"        // KERNEL_ASSERT
  #include "serial.h"        // Serial logging for critical paths
+ #include "dcache.h"        // Directory-entry cache
+ #include "pagecache.h"     // Page cache (pagecache_init)
 
  /* Define SEEK macros if not already defined (should be in sys_file.h ideally) */
  #ifndef SEEK_SET
@@ -107,6 +109,8 @@
      spinlock_init(&vfs_driver_lock);
      driver_list = NULL;
      mount_table_init(); // Initialize the separate mount table manager
+     dcache_init();
+     pagecache_init();
      VFS_LOG("Virtual File System initialized");
  }
 
@@ -619,7 +623,9 @@
      file->vnode = node;
      file->flags = flags;
      file->offset = 0;
+     file->refcount = 1;
      spinlock_init(&file->lock); // <<< INITIALIZE LOCK >>>
+     mutex_init(&file->io_lock);
 
      serial_write("[vfs_open] Success. file="); serial_print_hex((uintptr_t)file); /* ... */ serial_write("\n");
      return file;
@@ -630,6 +636,13 @@
      if (!file->vnode) { VFS_ERROR("vfs_close: File handle %p has NULL vnode!", file); kfree(file); return -FS_ERR_BAD_F; }
      if (!file->vnode->fs_driver) { VFS_ERROR("vfs_close: Vnode %p has NULL fs_driver!", file->vnode); kfree(file->vnode); kfree(file); return -FS_ERR_BAD_F; }
 
+     // Mappings (vfs_file_dup) may still use the file; the last reference closes it
+     uintptr_t ref_flags = spinlock_acquire_irqsave(&file->lock);
+     KERNEL_ASSERT(file->refcount > 0, "vfs_close: file refcount underflow");
+     bool last_ref = (--file->refcount == 0);
+     spinlock_release_irqrestore(&file->lock, ref_flags);
+     if (!last_ref) return FS_SUCCESS;
+
      vfs_driver_t* driver = file->vnode->fs_driver;
      VFS_DEBUG_LOG("vfs_close: Closing file handle %p (vnode: %p, driver: %s)", file, file->vnode, driver->fs_name ? driver->fs_name : "[N/A]");
 
@@ -662,7 +675,7 @@
     if (!file->vnode->fs_driver->read) return -FS_ERR_NOT_SUPPORTED;
 
     // === Acquire Lock ===
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&file->lock);
+    mutex_lock(&file->io_lock);
 
     VFS_DEBUG_LOG("vfs_read: START file=%p, offset=%ld, len=%lu", file, (long)file->offset, (unsigned long)len);
     int bytes_read = file->vnode->fs_driver->read(file, buf, len); // Driver uses current file->offset
@@ -683,7 +696,7 @@
     }
 
     // === Release Lock ===
-    spinlock_release_irqrestore(&file->lock, irq_flags);
+    mutex_unlock(&file->io_lock);
     return bytes_read;
  }
 
@@ -700,7 +713,7 @@
     if (!file->vnode->fs_driver->write) return -FS_ERR_NOT_SUPPORTED;
 
     // === Acquire Lock ===
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&file->lock);
+    mutex_lock(&file->io_lock);
 
     VFS_DEBUG_LOG("vfs_write: START file=%p, offset=%ld, len=%lu", file, (long)file->offset, (unsigned long)len);
     int bytes_written = file->vnode->fs_driver->write(file, buf, len); // Driver uses current file->offset
@@ -721,7 +734,7 @@
     }
 
     // === Release Lock ===
-    spinlock_release_irqrestore(&file->lock, irq_flags);
+    mutex_unlock(&file->io_lock);
     return bytes_written;
  }
 
@@ -732,7 +745,7 @@
     if (!file->vnode->fs_driver->lseek) { return (off_t)-FS_ERR_NOT_SUPPORTED; }
 
     // === Acquire Lock ===
-    uintptr_t irq_flags = spinlock_acquire_irqsave(&file->lock);
+    mutex_lock(&file->io_lock);
 
     VFS_DEBUG_LOG("vfs_lseek: START file=%p, current=%ld, req offset=%ld, whence=%d",
                   file, (long)file->offset, (long)offset, whence);
@@ -748,10 +761,90 @@
     }
 
     // === Release Lock ===
-    spinlock_release_irqrestore(&file->lock, irq_flags);
+    mutex_unlock(&file->io_lock);
     return new_offset; // Return result from driver
  }
 
+ /**
+  * @brief Reads at an explicit offset; the file offset is left unchanged.
+  * @return Number of bytes read (0 at EOF) or a negative FS_ERR_* code.
+  */
+ int vfs_pread(file_t *file, void *buf, size_t len, off_t offset) {
+    // Errors are returned as-is (negative), so they cannot pass for a byte count
+    if (!file || !file->vnode || !file->vnode->fs_driver) return FS_ERR_BAD_F;
+    if ((!buf && len > 0) || offset < 0) return FS_ERR_INVALID_PARAM;
+    if (len == 0) return 0;
+    if (!file->vnode->fs_driver->read) return FS_ERR_NOT_SUPPORTED;
+
+    // Drivers read at file->offset, so borrow it under the lock
+    mutex_lock(&file->io_lock);
+    off_t saved_offset = file->offset;
+    file->offset = offset;
+    int bytes_read = file->vnode->fs_driver->read(file, buf, len);
+    file->offset = saved_offset;
+    mutex_unlock(&file->io_lock);
+
+    if (bytes_read < 0) { VFS_ERROR("vfs_pread: FAIL file=%p, driver error %d", file, bytes_read); }
+    return bytes_read;
+ }
+
+ /**
+  * @brief Takes another reference to an open file; vfs_close drops it.
+  * @return @p file.
+  */
+ file_t *vfs_file_dup(file_t *file) {
+     if (!file) return NULL;
+     uintptr_t irq_flags = spinlock_acquire_irqsave(&file->lock);
+     KERNEL_ASSERT(file->refcount > 0, "vfs_file_dup: file already closed");
+     file->refcount++;
+     spinlock_release_irqrestore(&file->lock, irq_flags);
+     return file;
+ }
+
+ /**
+  * @brief Gets the identity shared by all opens of the file (see vfs_file_id_t).
+  * @return FS_SUCCESS, or FS_ERR_NOT_SUPPORTED if the driver cannot tell.
+  */
+ int vfs_identify(file_t *file, vfs_file_id_t *id_out) {
+     if (!file || !file->vnode || !file->vnode->fs_driver) return FS_ERR_BAD_F;
+     if (!id_out) return FS_ERR_INVALID_PARAM;
+     if (!file->vnode->fs_driver->identify) return FS_ERR_NOT_SUPPORTED;
+     return file->vnode->fs_driver->identify(file, id_out);
+ }
+
+ /**
+  * @brief Makes an open file's data and metadata durable.
+  * @return FS_SUCCESS or negative error code.
+  */
+ int vfs_fsync(file_t *file) {
+     if (!file || !file->vnode || !file->vnode->fs_driver) return -FS_ERR_BAD_F;
+     if (!file->vnode->fs_driver->fsync) return -FS_ERR_NOT_SUPPORTED;
+
+     // Not under file->io_lock: the driver may write back a lot, and it has
+     // its own locking; a racing write is simply covered by the next fsync
+     int result = file->vnode->fs_driver->fsync(file);
+     if (result != FS_SUCCESS) { VFS_ERROR("vfs_fsync: Driver fsync failed for file %p (err %d)", file, result); }
+     return result;
+ }
+
+ /**
+  * @brief Makes every mounted filesystem durable.
+  * @return FS_SUCCESS, or the first error a driver reported.
+  */
+ int vfs_sync(void) {
+     int first_error = FS_SUCCESS;
+     for (mount_t *mnt = mount_table_get_head(); mnt; mnt = mnt->next) {
+         vfs_driver_t *driver = vfs_get_driver(mnt->fs_name);
+         if (!driver || !driver->sync) continue;
+         int result = driver->sync(mnt->fs_context);
+         if (result != FS_SUCCESS) {
+             VFS_ERROR("vfs_sync: Driver '%s' sync failed for '%s' (err %d)", driver->fs_name, mnt->mount_point, result);
+             if (first_error == FS_SUCCESS) first_error = result;
+         }
+     }
+     return first_error;
+ }
+
  /**
   * @brief Reads a directory entry via the appropriate driver.
   * @param dir_file Open file handle representing the directory.
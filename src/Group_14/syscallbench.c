@@ -0,0 +1,102 @@
+/*
+ * syscallbench.c – UiAOS User-Space System Call Entry Benchmark
+ *
+ * Purpose: Compares the two ways into the kernel with a null system call,
+ * SYS_GETPID, which does no work beyond the entry, the dispatcher table and
+ * the exit. Each sample times a batch of SCB_BATCH calls and is divided by
+ * the batch size, so the rows are cycles per round trip:
+ *
+ *   BENCH,proc,getpid,<op>,count,avg,p50,p99,max     (TSC cycles)
+ *
+ *   int80     INT 0x80 through the interrupt gate, returning with IRET
+ *   sysenter  SYSENTER/SYSEXIT (only if CPUID reports SEP)
+ *
+ * Both stubs use the same registers otherwise, and both paths end in the
+ * same syscall_dispatcher. The kernel launches this program only in
+ * KERNEL_BENCH builds.
+ */
+
+#include "benchlib.h"
+
+/* ==== Benchmark Parameters ============================================== */
+ #define SCB_SAMPLES   200   /* Samples per row */
+ #define SCB_BATCH     64    /* Calls per sample */
+ #define SCB_WARMUP    1000  /* Untimed calls per path first */
+
+ static uint32_t g_samples[SCB_SAMPLES];
+
+/* ==== Syscall Stubs ===================================================== */
+ /* int 0x80: EAX = number, EBX/ECX/EDX = arguments. */
+ static inline int32_t syscall_int80(int32_t num, int32_t a1, int32_t a2, int32_t a3) {
+     int32_t ret;
+     __asm__ volatile (
+         "int $0x80"
+         : "=a" (ret)
+         : "0" (num), "b" (a1), "c" (a2), "d" (a3)
+         : "cc", "memory"
+     );
+     return ret;
+ }
+
+ /*
+  * SYSENTER: EAX = number, EBX/ESI/EDI = arguments, ECX = our ESP and
+  * EDX = the return address for SYSEXIT; ECX and EDX come back clobbered.
+  */
+ static inline int32_t syscall_sysenter(int32_t num, int32_t a1, int32_t a2, int32_t a3) {
+     int32_t ret;
+     __asm__ volatile (
+         "movl %%esp, %%ecx    \n\t"
+         "movl $1f, %%edx      \n\t"
+         "sysenter             \n\t"
+         "1:                   \n\t"
+         : "=a" (ret)
+         : "0" (num), "b" (a1), "S" (a2), "D" (a3)
+         : "ecx", "edx", "cc", "memory"
+     );
+     return ret;
+ }
+
+ /* CPUID SEP; the first Pentium Pro steppings report it without SYSENTER. */
+ static int32_t have_sysenter(void) {
+     uint32_t a, b, c, d;
+     __asm__ volatile ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1));
+     uint32_t family = (a >> 8) & 0xF, model = (a >> 4) & 0xF, stepping = a & 0xF;
+     return (d & (1u << 11)) && !(family == 6 && model < 3 && stepping < 3);
+ }
+
+/* ==== Workloads ========================================================= */
+ /* Fills g_samples with per-call cycles for one entry path. */
+ static void run_getpid(int32_t fast) {
+     int32_t pid = syscall_int80(SYS_GETPID, 0, 0, 0);
+     for (uint32_t i = 0; i < SCB_WARMUP; i++) {
+         if (fast) syscall_sysenter(SYS_GETPID, 0, 0, 0);
+         else syscall_int80(SYS_GETPID, 0, 0, 0);
+     }
+     for (uint32_t s = 0; s < SCB_SAMPLES; s++) {
+         int32_t bad = 0;
+         uint64_t t0 = rdtsc();
+         for (uint32_t i = 0; i < SCB_BATCH; i++) {
+             int32_t r = fast ? syscall_sysenter(SYS_GETPID, 0, 0, 0)
+                              : syscall_int80(SYS_GETPID, 0, 0, 0);
+             bad |= (r != pid);
+         }
+         g_samples[s] = cycles_since(t0) / SCB_BATCH;
+         if (bad) sys_puts("[syscallbench] getpid returned a wrong PID\n");
+     }
+ }
+
+/* ==== Main ============================================================== */
+ int main(void) {
+     run_getpid(0);
+     report("getpid", "int80", g_samples, SCB_SAMPLES);
+
+     if (have_sysenter()) {
+         run_getpid(1);
+         report("getpid", "sysenter", g_samples, SCB_SAMPLES);
+     } else {
+         sys_puts("[syscallbench] No SYSENTER (SEP) on this CPU; sysenter row skipped\n");
+     }
+
+     sys_puts("BENCH-USER-END\n");
+     return 0;
+ }